@@ -0,0 +1,213 @@
+/**
+   @file bench.c
+   @brief Microbenchmarks of every construct PGOMP interposes.
+
+    Each benchmark runs a construct ITERS times per thread in a team of
+    the given size and reports the best wall time per iteration (in
+    nanoseconds) over REPS repetitions. Run it once without PGOMP and once
+    per PGOMP mode; the difference is the wrapper overhead (see bench.sh).
+
+       pgomp-bench [threads ...]
+
+    Without arguments it runs at 1, 2, 4 ... up to omp_get_max_threads()
+    threads.
+    Output (CSV on stdout): construct,threads,ns
+    Environment: BENCH_ITERS (default 20000), BENCH_REPS (default 5).
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+static long iters = 20000;
+static omp_lock_t lock;
+static omp_nest_lock_t nestLock;
+static volatile long sink;
+
+static void emptyBarrier(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp barrier
+      }
+   }
+}
+
+static void uncontendedCritical(int threads)
+{
+   // only the master enters, the rest of the team waits at the end
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      #pragma omp master
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp critical
+         sink++;
+      }
+   }
+}
+
+static void contendedCritical(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp critical
+         sink++;
+      }
+   }
+}
+
+static void namedCritical(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp critical(benchName)
+         sink++;
+      }
+   }
+}
+
+static void lockUnlock(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         omp_set_lock(&lock);
+         sink++;
+         omp_unset_lock(&lock);
+      }
+   }
+}
+
+static void nestedLock(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         omp_set_nest_lock(&nestLock);
+         omp_set_nest_lock(&nestLock);
+         sink++;
+         omp_unset_nest_lock(&nestLock);
+         omp_unset_nest_lock(&nestLock);
+      }
+   }
+}
+
+static void testLock(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         if (omp_test_lock(&lock))
+         {
+            sink++;
+            omp_unset_lock(&lock);
+         }
+      }
+   }
+}
+
+static void single(int threads)
+{
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp single nowait
+         sink++;
+      }
+   }
+}
+
+static void parallelStartEnd(int threads)
+{
+   long i;
+   for (i = 0; i < iters / 10; i++)
+   {
+      #pragma omp parallel num_threads(threads)
+      sink++;
+   }
+}
+
+/**
+   Benchmark table: name and function, and how many constructs one
+   iteration of the function counts for
+**/
+static struct
+{
+   const char *name;
+   void (*fn)(int threads);
+   double perIter;
+} benchmarks[] =
+{
+   { "barrier", emptyBarrier, 1.0 },
+   { "critical_uncontended", uncontendedCritical, 1.0 },
+   { "critical_contended", contendedCritical, 1.0 },
+   { "critical_named", namedCritical, 1.0 },
+   { "lock_unlock", lockUnlock, 1.0 },
+   { "nest_lock", nestedLock, 1.0 },
+   { "test_lock", testLock, 1.0 },
+   { "single", single, 1.0 },
+   { "parallel", parallelStartEnd, 0.1 },
+};
+
+int main(int argc, char **argv)
+{
+   int reps = 5, numThreads = 0, a, b, r;
+   int threadList[64];
+   if (getenv("BENCH_ITERS"))
+      iters = atol(getenv("BENCH_ITERS"));
+   if (getenv("BENCH_REPS"))
+      reps = atoi(getenv("BENCH_REPS"));
+   // thread counts from the command line, or 1, 2, 4 ... up to the maximum
+   for (a = 1; a < argc && numThreads < 64; a++)
+      threadList[numThreads++] = atoi(argv[a]);
+   if (numThreads == 0)
+   {
+      for (a = 1; a < omp_get_max_threads(); a *= 2)
+         threadList[numThreads++] = a;
+      threadList[numThreads++] = omp_get_max_threads();
+   }
+   omp_init_lock(&lock);
+   omp_init_nest_lock(&nestLock);
+   printf("construct,threads,ns\n");
+   for (b = 0; b < (int) (sizeof(benchmarks) / sizeof(benchmarks[0])); b++)
+   {
+      for (a = 0; a < numThreads; a++)
+      {
+         double best = 1e30;
+         benchmarks[b].fn(threadList[a]); // warm up the thread pool
+         for (r = 0; r < reps; r++)
+         {
+            double t = omp_get_wtime();
+            benchmarks[b].fn(threadList[a]);
+            t = omp_get_wtime() - t;
+            if (t < best)
+               best = t;
+         }
+         printf("%s,%d,%.1f\n", benchmarks[b].name, threadList[a],
+                best * 1e9 / (iters * benchmarks[b].perIter));
+         fflush(stdout);
+      }
+   }
+   omp_destroy_lock(&lock);
+   omp_destroy_nest_lock(&nestLock);
+   return 0;
+}
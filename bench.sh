@@ -0,0 +1,74 @@
+#!/bin/sh
+#
+# Wrapper overhead benchmark (make bench)
+#
+# Runs pgomp-bench without PGOMP and then with PGOMP preloaded in every
+# mode, and writes the cost PGOMP adds to each construct to
+# bench-results.csv:
+#
+#    mode,construct,threads,base_ns,ns,overhead_ns
+#
+# Exits with status 1 if an overhead is over BENCH_MAX_NS, or, when a
+# previous result file is given in BENCH_BASELINE, if an overhead grew by
+# more than BENCH_TOLERANCE percent plus BENCH_SLACK_NS over it.
+#
+# Environment:
+#   BENCH_THREADS   thread counts to run (default 1, 2, 4 ... all cores)
+#   BENCH_MODES     PGOMP modes: trace, aggregate, papi (default trace aggregate)
+#   BENCH_MAX_NS    largest acceptable overhead per call (default 20000)
+#   BENCH_BASELINE  bench-results.csv of an earlier run to compare with
+#   BENCH_TOLERANCE allowed growth over the baseline in percent (default 50)
+#   BENCH_SLACK_NS  allowed growth over the baseline in ns (default 200)
+#   BENCH_ITERS, BENCH_REPS are passed on to pgomp-bench
+#
+
+BENCH_MODES=${BENCH_MODES:-"trace aggregate"}
+BENCH_MAX_NS=${BENCH_MAX_NS:-20000}
+BENCH_TOLERANCE=${BENCH_TOLERANCE:-50}
+BENCH_SLACK_NS=${BENCH_SLACK_NS:-200}
+RESULTS=bench-results.csv
+
+top=$(pwd)
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+
+# PGOMP writes its output into the current directory, keep it out of here
+run() {
+   (cd "$work" && env "$@" "$top/pgomp-bench" $BENCH_THREADS) > "$work/run.csv" \
+      || { echo "bench: pgomp-bench failed ($*)" >&2; exit 1; }
+}
+
+echo "bench: no PGOMP" >&2
+run PGOMP_BENCH=base
+mv "$work/run.csv" "$work/base.csv"
+
+echo "mode,construct,threads,base_ns,ns,overhead_ns" > $RESULTS
+for mode in $BENCH_MODES; do
+   echo "bench: $mode" >&2
+   case $mode in
+      trace) run LD_PRELOAD="$top/libpgomp.so.0.1" PGOMP_MODE=trace ;;
+      aggregate) run LD_PRELOAD="$top/libpgomp.so.0.1" PGOMP_MODE=aggregate ;;
+      papi) run LD_PRELOAD="$top/libpgomp.so.0.1" PGOMP_MODE=aggregate PGOMP_PAPI=true ;;
+      *) echo "bench: unknown mode $mode" >&2; exit 1 ;;
+   esac
+   awk -F, -v mode=$mode 'NR == FNR { base[$1 "," $2] = $3; next }
+        FNR > 1 { printf "%s,%s,%s,%s,%s,%.1f\n", mode, $1, $2,
+                  base[$1 "," $2], $3, $3 - base[$1 "," $2] }' \
+       "$work/base.csv" "$work/run.csv" >> $RESULTS
+done
+
+# Table for people, the CSV is for scripts
+column -t -s, $RESULTS 2> /dev/null || cat $RESULTS
+
+awk -F, -v max=$BENCH_MAX_NS -v tol=$BENCH_TOLERANCE -v slack=$BENCH_SLACK_NS \
+    'FNR == 1 { next }
+     FILENAME != ARGV[ARGC-1] { old[$1 "," $2 "," $3] = $6; next }
+     $6 > max { printf "bench: FAIL %s %s %s threads: %s ns over the %s ns limit\n",
+                $1, $2, $3, $6, max; bad = 1 }
+     ($1 "," $2 "," $3) in old && $6 > old[$1 "," $2 "," $3] * (1 + tol / 100) + slack {
+                printf "bench: FAIL %s %s %s threads: %s ns, was %s ns\n",
+                $1, $2, $3, $6, old[$1 "," $2 "," $3]; bad = 1 }
+     END { exit bad }' $BENCH_BASELINE $RESULTS
+status=$?
+[ $status -eq 0 ] && echo "bench: overhead within limits, results in $RESULTS" >&2
+exit $status
@@ -0,0 +1,118 @@
+#!/bin/sh
+#
+# Correctness check (make check)
+#
+# Runs pgomp-stress under PGOMP in aggregate and in trace mode and checks
+# that PGOMP recorded exactly the number of barriers, critical sections and
+# lock operations the program did, and every critical call site. Trace mode
+# is checked with the text writer, the LZ compressed trace and the
+# memory-mapped trace, the binary ones read back with pgomp-decode. With
+# libomp, pgomp-stress-omp (the same program on LLVM's libomp) is checked
+# the same way, through the OMPT backend. Last, pgomp-report, pgomp-sim,
+# pgomp-diff and pgomp-advise are run once on the results and must not
+# fail.
+#
+# Environment:
+#   CHECK_THREADS   threads of the flat team (default 8)
+#   CHECK_ITERS     iterations per thread (default 1000)
+#   CHECK_RUNTIMES  OpenMP runtimes: libgomp, libomp (default libgomp)
+#
+
+CHECK_THREADS=${CHECK_THREADS:-8}
+CHECK_ITERS=${CHECK_ITERS:-1000}
+CHECK_RUNTIMES=${CHECK_RUNTIMES:-libgomp}
+
+top=$(pwd)
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+status=0
+
+# PGOMP writes its output into the current directory, keep it out of here
+run() {
+   (cd "$work" && rm -f pgomp-out.* \
+    && env LD_PRELOAD="$top/libpgomp.so.0.1" "$@" \
+       "$top/$program" $CHECK_THREADS $CHECK_ITERS) > "$work/expect.txt" \
+      || { echo "check: $program failed ($*)" >&2; status=1; }
+   # libomp reports named critical sections like the others, a successful
+   # omp_test_lock() like omp_set_lock(), and only the first
+   # omp_set_nest_lock() of a nesting
+   [ $program = pgomp-stress-omp ] && \
+      awk '{ if ($2 == "GOMP_critical_name_start") $2 = "GOMP_critical_start"
+             else if ($2 == "omp_test_lock") $2 = "omp_set_lock"
+             else if ($2 == "omp_set_nest_lock") $3 /= 2
+             n[$1 " " $2] += $3 }
+           END { for (k in n) print k, n[k] }' "$work/expect.txt" > "$work/omp.txt" \
+      && mv "$work/omp.txt" "$work/expect.txt"
+}
+
+# compare <mode> <awk program that prints "<function> <count>" and
+#                 "sites <function> <count>" lines from pgomp-out.txt>
+compare() {
+   awk "$2" "$work/pgomp-out.txt" > "$work/got.txt"
+   awk -v mode="$1" 'NR == FNR { got[$1 == "sites" ? "sites " $2 : $1] = $NF; next }
+        { key = ($1 == "sites" ? "sites " : "") $2
+          if (got[key] + 0 != $3) {
+             printf "check: FAIL %s: %s %s recorded %d times, expected %d\n",
+                    mode, $1 == "sites" ? "distinct sites of" : "", $2,
+                    got[key], $3
+             bad = 1 } }
+        END { exit bad }' "$work/got.txt" "$work/expect.txt" || status=1
+}
+
+# decode <trace file>: pgomp-out.txt from a binary trace
+decode() {
+   "$top/pgomp-decode" "$work/$1" > "$work/pgomp-out.txt" \
+      || { echo "check: pgomp-decode $1 failed" >&2; status=1; }
+}
+
+# smoke <tool> <arguments>: the tool must succeed and print something
+smoke() {
+   tool=$1
+   shift
+   (cd "$work" && "$top/$tool" "$@") > "$work/smoke.txt" 2> "$work/smoke.err" \
+      && [ -s "$work/smoke.txt" ] \
+      || { echo "check: FAIL $tool $*" >&2; cat "$work/smoke.err" >&2; status=1; }
+}
+
+trace='{ count[$1]++; if (!(($1 " " $2) in site)) { site[$1 " " $2]; sites[$1]++ } }
+       END { for (f in count) print f, count[f]
+             for (f in sites) print "sites", f, sites[f] }'
+
+for runtime in $CHECK_RUNTIMES; do
+   case $runtime in
+      libgomp) program=pgomp-stress ;;
+      libomp) program=pgomp-stress-omp ;;
+      *) echo "check: unknown runtime $runtime" >&2; exit 1 ;;
+   esac
+   echo "check: $runtime aggregate mode" >&2
+   run PGOMP_MODE=aggregate
+   compare "$runtime aggregate" '{ count[$1] += $7; if (!(($1 " " $2) in site)) { site[$1 " " $2]; sites[$1]++ } }
+                      END { for (f in count) print f, count[f]
+                            for (f in sites) print "sites", f, sites[f] }'
+   mv "$work/pgomp-out.txt" "$work/aggregate.txt"
+
+   echo "check: $runtime trace mode" >&2
+   run PGOMP_MODE=trace
+   compare "$runtime trace" "$trace"
+   mv "$work/pgomp-out.txt" "$work/trace.txt"
+
+   echo "check: $runtime trace mode, compressed" >&2
+   run PGOMP_MODE=trace PGOMP_COMPRESS=lz
+   decode pgomp-out.pgz
+   compare "$runtime trace compressed" "$trace"
+
+   echo "check: $runtime trace mode, memory-mapped" >&2
+   run PGOMP_MODE=trace PGOMP_TRACE_IO=mmap
+   decode pgomp-out.pgm
+   compare "$runtime trace memory-mapped" "$trace"
+done
+
+# The results of the last runtime through the analysis tools
+echo "check: analysis tools" >&2
+smoke pgomp-report trace.txt
+smoke pgomp-sim trace.txt
+smoke pgomp-diff aggregate.txt aggregate.txt
+smoke pgomp-advise aggregate.txt
+
+[ $status -eq 0 ] && echo "check: all counts correct" >&2
+exit $status
@@ -6,8 +6,116 @@
 // Output file name
 #define OUTPUT_FILENAME "pgomp-out.txt"
 
-// Maximum number of threads that libPGOMP can handle
-#define MAX_THREADS 100 /**< Maximum number of threads can be used */
+// Output file name for compressed traces (PGOMP_COMPRESS); read it back
+// with pgomp-decode
+#define COMPRESSED_FILENAME "pgomp-out.pgz"
+
+// Trace records are written per thread into chunks of this many bytes.
+// When a chunk fills, the thread swaps in a spare and hands the full one
+// to the writer thread through a queue of WRITER_QUEUE_LEN entries; the
+// writer compresses it (PGOMP_COMPRESS) and writes up to WRITER_BATCH
+// chunks per system call. If the queue is full the chunk is dropped (and
+// counted) rather than making the application thread wait on the disk.
+#define TRACE_CHUNK_SIZE (1024*1024)
+#define WRITER_QUEUE_LEN 64
+#define WRITER_BATCH 16
+#define WRITER_IDLE_NS 200000 // writer poll interval when idle
+#define COMPRESS_LEVEL 1 // zstd level, low values are fastest
+
+// Memory-mapped traces (PGOMP_TRACE_IO=mmap). Threads write their records
+// straight into the file, in extents handed out from the end of the file,
+// so the file grows with the trace. A thread maps one extent at a time and
+// chains a new one when it is full: its first extent has
+// MMAP_FIRST_EXTENT bytes, each next one twice as many, up to
+// MMAP_EXTENT_SIZE (both multiples of the page size). The disk
+// space of an extent is allocated with fallocate() when it is handed out.
+// Records that find the disk full, or all MMAP_MAX_EXTENTS extents taken,
+// are dropped (and counted).
+#define MMAP_FILENAME "pgomp-out.pgm"
+#define MMAP_FIRST_EXTENT (64UL*1024)
+#define MMAP_EXTENT_SIZE (4UL*1024*1024)
+#define MMAP_MAX_EXTENTS 65536
+
+// Longest trace record, in bytes
+#define MAX_RECORD_LEN 512
+
+// Aggregate mode keeps one entry per thread and call site in a hash table
+// of HTABLE_SIZE entries (a power of two). Events that find the table full
+// are not counted; their number is reported at exit.
+#define HTABLE_SIZE (1 << 18)
+
+// Aggregate mode also reports the utilization of the team of every
+// parallel region call site, for at most REGION_SITES sites (a power of two)
+#define REGION_SITES 4096
+
+// Aggregate mode also reports the chunks of every dynamic, guided and
+// runtime scheduled loop call site, for at most LOOP_SITES sites (a power
+// of two), with the time spent on its iterations in LOOP_BINS bins by
+// position in the loop (see pgomp-advise)
+#define LOOP_SITES 1024
+#define LOOP_BINS 64
+
+// With PGOMP_CPU=true every event also notes the CPU the thread runs on
+// (sched_getcpu()). The core, socket and NUMA node of at most MAX_CPUS
+// CPUs are read from sysfs at start. Lock and critical section handoffs
+// are classified by where the releasing and the acquiring thread ran, for
+// at most HANDOFF_SITES distinct locks and critical section names (a
+// power of two).
+#define MAX_CPUS 4096
+#define HANDOFF_SITES 4096
+
+// Aggregate mode also reports every critical section name (the unnamed
+// critical section and atomics libgomp serializes count as one name each),
+// for at most CRITICAL_NAMES names (a power of two). Wait and hold times
+// go to CRITICAL_HIST power-of-two buckets: below 1 us, 1-2 us, 2-4 us ...
+// with the last bucket open ended.
+#define CRITICAL_NAMES 1024
+#define CRITICAL_HIST 16
+
+// Aggregate mode keeps the call site and times of every lock, critical
+// section and ordered region a thread is in until it leaves it, for the
+// innermost HELD_CONSTRUCTS of them. One nested deeper is recorded with
+// the times of the last construct of its kind the thread entered.
+#define HELD_CONSTRUCTS 16
+
+// With PGOMP_CONVOY=true aggregate mode keeps the holder and the number of
+// waiters of every lock and critical section (at most CONVOY_LOCKS, a power
+// of two), and a sampler thread reads this wait-for graph every
+// CONVOY_INTERVAL_NS nanoseconds. The samples go to CONVOY_SLOTS slots;
+// when they are full, neighbouring slots merge and a slot covers twice as
+// many samples. A lock acquired while the thread holds others (the
+// innermost CONVOY_HELD) adds a lock-order pair, for at most CONVOY_ORDERS
+// pairs (a power of two).
+#define CONVOY_LOCKS 4096
+#define CONVOY_INTERVAL_NS 1000000
+#define CONVOY_SLOTS 256
+#define CONVOY_HELD 8
+#define CONVOY_ORDERS 1024
+
+// With PGOMP_TRACE_BUDGET=<percent> trace mode watches its own cost. Every
+// GOVERNOR_WINDOW seconds each thread estimates the share of its time it
+// spent formatting records. If that is over the budget, or the writer
+// queue (with PGOMP_TRACE_IO=mmap, the thread's segment) is more than 3/4
+// full, the thread's busiest site drops one level: from every event traced
+// to one in GOVERNOR_SAMPLE, then to none. At most GOVERNOR_SITES sites in
+// all and GOVERNOR_SLOTS per thread are governed (powers of two); others
+// are always traced.
+#define GOVERNOR_WINDOW 0.01
+#define GOVERNOR_SAMPLE 16
+#define GOVERNOR_SITES 4096
+#define GOVERNOR_SLOTS 256
+
+// PGOMP_MODE=tail traces only outliers. Each thread keeps a moving average
+// and variance of the record time of every site in its aggregate table
+// buckets, with weight 1/TAIL_EWMA for the newest event, and remembers its
+// last TAIL_HISTORY events. An event more than PGOMP_TAIL_SIGMA (default
+// 4) standard deviations and at least TAIL_MIN_EXCESS seconds above the
+// average of its site, once the site has seen TAIL_WARMUP events, is
+// written together with the thread's events before it.
+#define TAIL_EWMA 64
+#define TAIL_HISTORY 32
+#define TAIL_WARMUP 64
+#define TAIL_MIN_EXCESS 5e-6
 
 // By default, times are output as real value seconds since Jan 1, 1970.
 // If you want times relative to the beginning of the program, uncomment
@@ -15,6 +123,16 @@
 // time a timestamp is needed.
 //#define RELATIVE_TIME
 
+// With PGOMP_SPIN=true, waits (barriers, locks, critical sections) are also
+// measured in thread CPU time so the wait can be split into spin time (the
+// thread was running, e.g. libgomp spinning before it goes to sleep) and
+// blocked time (the thread was asleep on a futex). Reading
+// CLOCK_THREAD_CPUTIME_ID is a system call, several times the cost of the
+// wall clock, so the split is off by default. Comment out the following
+// #define to leave the clock reads out of the build; the spin time is then
+// always reported as zero.
+#define SPIN_TIME
+
 //
 // All Gnu platforms should implement these built-in functions that provide
 // the return address (i.e., the location from which we are called). If this
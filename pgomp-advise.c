@@ -0,0 +1,456 @@
+/**
+   @file pgomp-advise.c
+   @brief Recommends a schedule and chunk size for the loops of a program
+          from its aggregate results.
+
+    Reads a PGOMP aggregate output (text or CSV format) and, for every
+    loop with a dynamic, guided or runtime schedule, simulates the loop
+    under other schedules and chunk sizes:
+
+       pgomp-advise [-t threads] [-n lines] [-a] file
+
+    - t team size to predict for (default: the measured one).
+    - n number of loops printed (default 20, 0 for all).
+    - a print every chunk size tried, not only the best of each schedule.
+
+    libpgomp records, for every loop site, the time its chunks ran spread
+    over LOOP_BINS bins by the position of their iterations in the loop
+    ("# loop-profile" lines), and the time of a call that hands out a
+    chunk ("# loop" lines). An iteration costs the time of its bin over the
+    iterations in it, a chunk the sum of its iterations and, if it is
+    handed out at run time, one call. The simulation gives the chunks out
+    as the runtime does:
+
+    - static: one block of iterations per thread, the first ones one
+      iteration longer if they do not divide evenly.
+    - static,k: chunks of k round robin, without calls.
+    - dynamic,k: chunks of k to the thread that is free first.
+    - guided,k: like dynamic, of the remaining iterations over the team
+      size, but at least k.
+
+    and predicts the time of the loop as that of its last thread. k is
+    tried in powers of two up to the iterations per thread. Loops of the
+    measured schedule are predicted the same way, so a gain is relative to
+    the model; the measured span (time from the start call to the end of
+    the loop, averaged over the team) shows how close the model is.
+
+    Exits with 2 on errors.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include "config.h"
+
+#define NAME_LEN 256 /**< Longest object or function name */
+#define MAX_CHUNKS 10000000 /**< Most chunks simulated for one schedule */
+
+/** Schedules simulated, in print order */
+enum { SCHED_STATIC, SCHED_STATIC_CHUNK, SCHED_DYNAMIC, SCHED_GUIDED, NUM_SCHEDS };
+
+static const char *schedNames[NUM_SCHEDS] = { "static", "static", "dynamic", "guided" };
+
+/**
+   A loop site, from its "# loop" and "# loop-profile" lines
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t addr; /**< Call site of the start function */
+   char schedule[16]; /**< Measured schedule */
+   long chunkSize; /**< Its chunk size, 0 for static without one */
+   long count; /**< Loops run */
+   long threads; /**< Team members, over all loops */
+   double iterations; /**< Over all loops */
+   long calls; /**< Calls that handed out chunks */
+   double dispatch; /**< Time in them */
+   double busy; /**< Time running chunks */
+   double span; /**< Start call to the end of the loop, over all members */
+   double profile[LOOP_BINS]; /**< Time by position in the loop */
+   int hasProfile;
+   char object[NAME_LEN]; /**< From the "# location" line, "" if none */
+   char function[NAME_LEN];
+   uint64_t offset;
+/*@}*/
+} Loop;
+
+/**
+   A loop instance to simulate: the average one of a site
+**/
+typedef struct
+{
+/*@{*/
+   long n; /**< Iterations */
+   int team; /**< Threads */
+   double cum[LOOP_BINS + 1]; /**< Time of the iterations before each bin */
+   double call; /**< Time of a call that hands out a chunk */
+/*@}*/
+} Model;
+
+static Loop *loops = NULL;
+static long numLoops = 0, maxLoops = 0;
+static double *freeAt = NULL; /**< Time each thread is free, a min-heap */
+
+/**
+   @brief Exits after running out of memory.
+**/
+static void outOfMemory()
+{
+   fprintf(stderr,"pgomp-advise: out of memory\n");
+   exit(2);
+}
+
+/**
+   @brief The loop of a site, added if it is new.
+**/
+static Loop* findLoop(uint64_t addr)
+{
+   long i;
+   for (i = 0; i < numLoops; i++)
+      if (loops[i].addr == addr)
+         return &loops[i];
+   if (numLoops == maxLoops)
+   {
+      maxLoops = maxLoops ? 2 * maxLoops : 64;
+      loops = realloc(loops, maxLoops * sizeof(Loop));
+      if (loops == NULL)
+         outOfMemory();
+   }
+   memset(&loops[numLoops], 0, sizeof(Loop));
+   loops[numLoops].addr = addr;
+   return &loops[numLoops++];
+}
+
+/**
+   @brief Reads the loop sites and their locations from an aggregate output.
+   @return 0, -1 on errors.
+**/
+static int readLoops(const char *fileName)
+{
+   FILE *f;
+   char *line = NULL;
+   size_t lineSize = 0;
+   long lineNo = 0, i, k;
+   f = fopen(fileName, "r");
+   if (f == NULL)
+   {
+      perror(fileName);
+      return -1;
+   }
+   while (getline(&line, &lineSize, f) > 0)
+   {
+      Loop l, *loop;
+      char object[NAME_LEN], function[NAME_LEN];
+      uint64_t addr, offset;
+      int n, b;
+      if (lineNo++ == 0 && line[0] == '{')
+      {
+         fprintf(stderr,"%s: JSON output is not supported, use PGOMP_FORMAT=text or csv\n",
+                 fileName);
+         goto fail;
+      }
+      if (sscanf(line, "# loop %lx %15s %ld %ld %ld %lf %*d %ld %lf %lf %lf",
+                 &l.addr, l.schedule, &l.chunkSize, &l.count, &l.threads,
+                 &l.iterations, &l.calls, &l.dispatch, &l.busy, &l.span) == 10)
+      {
+         loop = findLoop(l.addr);
+         memcpy(loop->schedule, l.schedule, sizeof(l.schedule));
+         loop->chunkSize = l.chunkSize;
+         loop->count = l.count;
+         loop->threads = l.threads;
+         loop->iterations = l.iterations;
+         loop->calls = l.calls;
+         loop->dispatch = l.dispatch;
+         loop->busy = l.busy;
+         loop->span = l.span;
+         continue;
+      }
+      if (sscanf(line, "# loop-profile %lx%n", &addr, &n) == 1)
+      {
+         const char *p = line + n;
+         loop = findLoop(addr);
+         for (b = 0; b < LOOP_BINS; b++)
+         {
+            char *next;
+            loop->profile[b] = strtod(p, &next);
+            if (next == p)
+               break;
+            p = next;
+         }
+         if (b < LOOP_BINS)
+         {
+            fprintf(stderr,"%s:%ld: loop profile of %d bins, expected %d "
+                           "(LOOP_BINS of libpgomp)\n", fileName, lineNo, b, LOOP_BINS);
+            goto fail;
+         }
+         loop->hasProfile = 1;
+         continue;
+      }
+      if (sscanf(line, "# location %lx %255s %255s %lx", &addr, object, function,
+                 &offset) == 4)
+      {
+         // the locations are printed before the loops, so every site gets
+         // an entry here, and the ones that are not loops are dropped below
+         loop = findLoop(addr);
+         strcpy(loop->object, object);
+         strcpy(loop->function, function);
+         loop->offset = offset;
+      }
+   }
+   free(line);
+   fclose(f);
+   // drop the sites that are only locations
+   for (i = 0, k = 0; i < numLoops; i++)
+      if (loops[i].count > 0 || loops[i].hasProfile)
+         loops[k++] = loops[i];
+   numLoops = k;
+   for (i = 0; i < numLoops; i++)
+      if (loops[i].count == 0 || !loops[i].hasProfile)
+      {
+         fprintf(stderr,"%s: loop 0x%lx without its \"# loop\" or \"# loop-profile\" line\n",
+                 fileName, (unsigned long) loops[i].addr);
+         return -1;
+      }
+   return 0;
+fail:
+   free(line);
+   fclose(f);
+   return -1;
+}
+
+/**
+   @brief Time of the iterations from first up to last.
+**/
+static double chunkTime(const Model *m, long first, long last)
+{
+   double x = (double) first / m->n * LOOP_BINS, y = (double) last / m->n * LOOP_BINS;
+   int bx = x < LOOP_BINS ? (int) x : LOOP_BINS - 1;
+   int by = y < LOOP_BINS ? (int) y : LOOP_BINS - 1;
+   return m->cum[by] + (y - by) * (m->cum[by+1] - m->cum[by])
+          - m->cum[bx] - (x - bx) * (m->cum[bx+1] - m->cum[bx]);
+}
+
+/**
+   @brief Restores the heap order of freeAt[] after its first element grew.
+**/
+static void siftDown(int team)
+{
+   int i = 0, c;
+   double t = freeAt[0];
+   while ((c = 2 * i + 1) < team)
+   {
+      if (c + 1 < team && freeAt[c+1] < freeAt[c])
+         c++;
+      if (freeAt[c] >= t)
+         break;
+      freeAt[i] = freeAt[c];
+      i = c;
+   }
+   freeAt[i] = t;
+}
+
+/**
+   @brief Predicts the time of a loop under a schedule.
+   @param k - Chunk size, ignored for SCHED_STATIC.
+   @return The time, negative if the schedule would need more than
+           MAX_CHUNKS chunks.
+**/
+static double simulate(const Model *m, int sched, long k)
+{
+   double longest = 0.0, t;
+   long first, q;
+   int i;
+   if (sched != SCHED_STATIC && (m->n + k - 1) / k > MAX_CHUNKS)
+      return -1.0;
+   switch (sched)
+   {
+   case SCHED_STATIC:
+      // libgomp gives the first n % team threads one iteration more
+      q = m->n / m->team;
+      for (i = 0, first = 0; i < m->team && first < m->n; i++)
+      {
+         long size = q + (i < m->n % m->team);
+         t = chunkTime(m, first, first + size);
+         if (t > longest)
+            longest = t;
+         first += size;
+      }
+      return longest;
+   case SCHED_STATIC_CHUNK:
+      for (i = 0; i < m->team; i++)
+      {
+         for (first = i * k, t = 0.0; first < m->n; first += m->team * k)
+            t += chunkTime(m, first, first + k < m->n ? first + k : m->n);
+         if (t > longest)
+            longest = t;
+      }
+      return longest;
+   default:
+      for (i = 0; i < m->team; i++)
+         freeAt[i] = 0.0;
+      for (first = 0; first < m->n; first += q)
+      {
+         q = k;
+         if (sched == SCHED_GUIDED && (m->n - first + m->team - 1) / m->team > k)
+            q = (m->n - first + m->team - 1) / m->team;
+         if (q > m->n - first)
+            q = m->n - first;
+         freeAt[0] += m->call + chunkTime(m, first, first + q);
+         siftDown(m->team);
+      }
+      // every thread makes a last call that finds no chunk
+      for (i = 0; i < m->team; i++)
+         if (freeAt[i] + m->call > longest)
+            longest = freeAt[i] + m->call;
+      return longest;
+   }
+}
+
+/**
+   @brief Prints a schedule and its predicted time.
+**/
+static void printSchedule(int sched, long k, double t, double current)
+{
+   char name[64];
+   if (sched == SCHED_STATIC)
+      snprintf(name, sizeof(name), "%s", schedNames[sched]);
+   else
+      snprintf(name, sizeof(name), "%s,%ld", schedNames[sched], k);
+   printf("    %-20s %12.6f s %+8.1f%%\n", name, t,
+          current > 0.0 ? (t - current) / current * 100.0 : 0.0);
+}
+
+/**
+   @brief qsort() comparison of loops, longest span first.
+**/
+static int compareLoops(const void *a, const void *b)
+{
+   const Loop *x = a, *y = b;
+   return (x->span < y->span) - (x->span > y->span);
+}
+
+int main(int argc, char **argv)
+{
+   int opt, lines = 20, team = 0, all = 0, sched, b;
+   long i;
+   while ((opt = getopt(argc, argv, "t:n:a")) != -1)
+   {
+      switch (opt)
+      {
+      case 't':
+         team = atoi(optarg);
+         if (team <= 0)
+            goto usage;
+         break;
+      case 'n':
+         lines = atoi(optarg);
+         break;
+      case 'a':
+         all = 1;
+         break;
+      default:
+         goto usage;
+      }
+   }
+   if (argc - optind != 1)
+      goto usage;
+   if (readLoops(argv[optind]) != 0)
+      return 2;
+   if (numLoops == 0)
+   {
+      printf("no loops with a dynamic, guided or runtime schedule\n");
+      return 0;
+   }
+   qsort(loops, numLoops, sizeof(Loop), compareLoops);
+   for (i = 0; i < numLoops && (lines == 0 || i < lines); i++)
+   {
+      const Loop *l = &loops[i];
+      Model m;
+      double current, best = -1.0, t, bestOf;
+      long k, bestK = 0, kBest, perThread;
+      int bestSched = SCHED_STATIC;
+      m.team = team ? team : (int) ((l->threads + l->count / 2) / l->count);
+      m.n = (long) (l->iterations / l->count + 0.5);
+      m.call = l->calls > 0 ? l->dispatch / l->calls : 0.0;
+      if (m.team < 1)
+         m.team = 1;
+      m.cum[0] = 0.0;
+      for (b = 0; b < LOOP_BINS; b++)
+         m.cum[b+1] = m.cum[b] + l->profile[b] / l->count;
+      freeAt = realloc(freeAt, m.team * sizeof(double));
+      if (freeAt == NULL)
+         outOfMemory();
+      printf("loop 0x%lx", (unsigned long) l->addr);
+      if (l->object[0] != '\0')
+         printf(" (%s %s+0x%lx)", l->object, l->function, (unsigned long) l->offset);
+      printf(": %ld loops of %ld iterations, %d threads\n", l->count, m.n, m.team);
+      printf("    measured %s,%ld: span %.6f s, busy %.6f s per thread, "
+             "%.3f us per call\n", l->schedule, l->chunkSize,
+             l->span / l->threads, l->busy / l->threads, m.call * 1e6);
+      if (m.n <= 0)
+      {
+         printf("    no iterations\n\n");
+         continue;
+      }
+      // the measured schedule, in the model
+      sched = strcmp(l->schedule, "guided") == 0 ? SCHED_GUIDED
+              : strcmp(l->schedule, "dynamic") == 0 ? SCHED_DYNAMIC
+              : l->chunkSize > 0 ? SCHED_STATIC_CHUNK : SCHED_STATIC;
+      current = simulate(&m, sched, l->chunkSize > 0 ? l->chunkSize : 1);
+      printf("    predicted %s", schedNames[sched]);
+      if (sched != SCHED_STATIC)
+         printf(",%ld", l->chunkSize > 0 ? l->chunkSize : 1);
+      printf(": %.6f s\n", current);
+      perThread = (m.n + m.team - 1) / m.team;
+      for (sched = 0; sched < NUM_SCHEDS; sched++)
+      {
+         bestOf = -1.0;
+         kBest = 0;
+         for (k = 1; ; k *= 2)
+         {
+            t = simulate(&m, sched, k);
+            if (t >= 0.0 && all)
+               printSchedule(sched, k, t, current);
+            if (t >= 0.0 && (bestOf < 0.0 || t < bestOf))
+            {
+               bestOf = t;
+               kBest = k;
+            }
+            if (sched == SCHED_STATIC || k >= perThread)
+               break;
+         }
+         if (bestOf < 0.0)
+            continue;
+         if (!all)
+            printSchedule(sched, kBest, bestOf, current);
+         if (best < 0.0 || bestOf < best)
+         {
+            best = bestOf;
+            bestSched = sched;
+            bestK = kBest;
+         }
+      }
+      if (best >= 0.0 && best < current)
+      {
+         printf("    advice: schedule(%s", schedNames[bestSched]);
+         if (bestSched != SCHED_STATIC)
+            printf(",%ld", bestK);
+         printf("), %.1f%% faster\n\n", (current - best) / current * 100.0);
+      }
+      else
+         printf("    advice: keep the schedule\n\n");
+   }
+   if (lines > 0 && numLoops > lines)
+      printf("(%ld more, -n 0 prints all)\n", numLoops - lines);
+   free(loops);
+   free(freeAt);
+   return 0;
+usage:
+   fprintf(stderr,"usage: pgomp-advise [-t threads] [-n lines] [-a] file\n");
+   return 2;
+}
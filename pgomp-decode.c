@@ -0,0 +1,245 @@
+/**
+   @file pgomp-decode.c
+   @brief Decoder for binary PGOMP traces: compressed (PGOMP_COMPRESS) and
+          memory-mapped (PGOMP_TRACE_IO=mmap).
+
+    Prints the trace text of a binary trace file, either whole or for a
+    single thread stream, or lists its chunks or extents.
+
+       pgomp-decode [-i] [-s stream] [file]
+
+    - i lists the chunks (extents) instead of printing the trace.
+    - s prints only the records of one stream (thread).
+    The file defaults to COMPRESSED_FILENAME from config.h. The streams
+    of a memory-mapped trace (each a chain of extents) are merged by
+    record start time.
+**/
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "config.h"
+#include "pgomp-read.h"
+
+/**
+   Read position in one stream of a memory-mapped trace
+**/
+typedef struct
+{
+/*@{*/
+   const char *line; /**< Next record */
+   const char *end; /**< End of the extent's records */
+   uint32_t extent; /**< Extent being read */
+   double time; /**< Start time of the next record */
+/*@}*/
+} StreamCursor;
+
+/**
+   @brief Gets the start time (fourth column) of a trace record.
+**/
+static double recordTime(const char *line, const char *end)
+{
+   int field = 0;
+   while (line < end && *line != '\n')
+   {
+      while (line < end && *line == ' ')
+         line++;
+      if (++field == 4)
+         return strtod(line, NULL);
+      while (line < end && *line != ' ' && *line != '\n')
+         line++;
+   }
+   return 0.0;
+}
+
+/**
+   @brief Moves a cursor to the first record of an extent of its chain,
+          that one or the first after it with records.
+   @return 0 if there was one, -1 at the end of the chain.
+**/
+static int startExtent(const TraceFile *tf, StreamCursor *c, uint32_t extent)
+{
+   const ExtentEntry *e;
+   for (; extent != MMAP_NO_EXTENT; extent = e->next)
+   {
+      e = &tf->header->extents[extent];
+      if (e->used == 0)
+         continue;
+      c->extent = extent;
+      c->line = tf->map + e->offset;
+      c->end = c->line + e->used;
+      c->time = recordTime(c->line, c->end);
+      return 0;
+   }
+   return -1;
+}
+
+/**
+   @brief Moves a cursor to its next record.
+   @return 0 if there was one, -1 at the end of the stream.
+**/
+static int nextRecord(const TraceFile *tf, StreamCursor *c)
+{
+   const char *nl = memchr(c->line, '\n', c->end - c->line);
+   c->line = nl ? nl + 1 : c->end;
+   if (c->line >= c->end)
+      return startExtent(tf, c, tf->header->extents[c->extent].next);
+   c->time = recordTime(c->line, c->end);
+   return 0;
+}
+
+/**
+   @brief Restores the heap order of cursors below position i.
+**/
+static void siftDown(StreamCursor *heap, int n, int i)
+{
+   for (;;)
+   {
+      int min = i, l = 2 * i + 1, r = l + 1;
+      StreamCursor t;
+      if (l < n && heap[l].time < heap[min].time)
+         min = l;
+      if (r < n && heap[r].time < heap[min].time)
+         min = r;
+      if (min == i)
+         return;
+      t = heap[i];
+      heap[i] = heap[min];
+      heap[min] = t;
+      i = min;
+   }
+}
+
+/**
+   @brief Prints a memory-mapped trace: every thread's chain of extents,
+          merged into one timeline by record start time.
+   @param tf - Open trace (traceOpen() checked the chains).
+   @param listIndex - List the extents instead.
+   @param stream - Only print this stream, or -1 for all.
+   @return Exit status.
+**/
+static int decodeExtents(const TraceFile *tf, int listIndex, long stream)
+{
+   const MmapHeader *header = tf->header;
+   StreamCursor *heap;
+   unsigned char *chained;
+   unsigned long i;
+   int n = 0;
+   if (listIndex)
+   {
+      printf("# extent offset size stream used next\n");
+      for (i = 0; i < header->numExtents; i++)
+      {
+         const ExtentEntry *e = &header->extents[i];
+         printf("%lu %llu %u %u %u %ld\n", i, (unsigned long long) e->offset,
+                e->size, e->stream, e->used,
+                e->next == MMAP_NO_EXTENT ? -1L : (long) e->next);
+      }
+      printf("# %u extents, %lu records dropped\n", header->numExtents,
+             tf->dropped);
+      return 0;
+   }
+   heap = malloc((header->numExtents + 1) * sizeof(StreamCursor));
+   chained = calloc(header->numExtents + 1, 1);
+   if (heap == NULL || chained == NULL)
+   {
+      fprintf(stderr,"pgomp-decode: out of memory\n");
+      return 1;
+   }
+   for (i = 0; i < header->numExtents; i++)
+      if (header->extents[i].next != MMAP_NO_EXTENT)
+         chained[header->extents[i].next] = 1;
+   for (i = 0; i < header->numExtents; i++)
+   {
+      if (chained[i] || (stream >= 0 && header->extents[i].stream != stream))
+         continue;
+      if (startExtent(tf, &heap[n], i) == 0)
+         n++;
+   }
+   for (i = n / 2 + 1; i-- > 0; )
+      siftDown(heap, n, i);
+   while (n > 0)
+   {
+      const char *nl = memchr(heap[0].line, '\n', heap[0].end - heap[0].line);
+      fwrite(heap[0].line, 1, (nl ? nl + 1 : heap[0].end) - heap[0].line, stdout);
+      if (nextRecord(tf, &heap[0]) != 0)
+         heap[0] = heap[--n];
+      siftDown(heap, n, 0);
+   }
+   if (tf->dropped > 0)
+      fprintf(stderr,"pgomp-decode: warning: %lu records were dropped while "
+                     "tracing, the trace is incomplete\n", tf->dropped);
+   free(chained);
+   free(heap);
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   const char *fileName = COMPRESSED_FILENAME;
+   TraceFile tf;
+   unsigned long i;
+   const char *text;
+   char *buffer;
+   int opt, listIndex = 0;
+   long stream = -1;
+   while ((opt = getopt(argc, argv, "is:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'i':
+         listIndex = 1;
+         break;
+      case 's':
+         stream = atol(optarg);
+         break;
+      default:
+         fprintf(stderr,"usage: pgomp-decode [-i] [-s stream] [file]\n");
+         return 1;
+      }
+   }
+   if (optind < argc)
+      fileName = argv[optind];
+   if (traceOpen(&tf, fileName) != 0)
+      return 1;
+   if (tf.format == TRACE_MMAP)
+      return decodeExtents(&tf, listIndex, stream);
+   if (tf.format != TRACE_COMPRESSED)
+   {
+      fprintf(stderr,"pgomp-decode: %s is not a binary PGOMP trace\n",
+              fileName);
+      return 1;
+   }
+   if (listIndex)
+   {
+      printf("# chunk offset stream codec rawLen compLen\n");
+      for (i = 0; i < tf.numChunks; i++)
+         printf("%lu %llu %u %u %u %u\n", i, (unsigned long long) tf.index[i].offset,
+                tf.index[i].stream, tf.index[i].codec, tf.index[i].rawLen,
+                tf.index[i].compLen);
+      printf("# %lu chunks, %lu dropped\n", tf.numChunks, tf.dropped);
+      return 0;
+   }
+   buffer = malloc(TRACE_CHUNK_SIZE);
+   for (i = 0; i < tf.numPieces; i++)
+   {
+      if (stream >= 0 && tf.pieces[i].stream != stream)
+         continue;
+      if ((text = tracePieceText(&tf, &tf.pieces[i], buffer)) == NULL)
+      {
+         fprintf(stderr,"pgomp-decode: chunk %lu is corrupt\n", i);
+         return 1;
+      }
+      fwrite(text, 1, tf.pieces[i].len, stdout);
+   }
+   if (tf.dropped > 0)
+      fprintf(stderr,"pgomp-decode: warning: %lu chunks were dropped while "
+                     "tracing, the trace is incomplete\n", tf.dropped);
+   free(buffer);
+   traceClose(&tf);
+   return 0;
+}
@@ -0,0 +1,776 @@
+/**
+   @file pgomp-diff.c
+   @brief Compares the aggregate results of two builds or runs of a program,
+          for nightly regression tracking.
+
+    Reads PGOMP aggregate outputs (text or CSV format), one or more
+    repetitions of the old and of the new run, matches their sites and
+    prints the sites whose waiting time, execution time or call count
+    changed by more than a threshold:
+
+       pgomp-diff [-w pct] [-x pct] [-c pct] [-a seconds] [-p alpha] [-n lines]
+                  old [old...] -- new [new...]
+
+    With one file on each side the "--" may be left out.
+
+    - w threshold for the waiting time, percent (default 10).
+    - x threshold for the execution time, percent (default 10).
+    - c threshold for the call count, percent (default: off).
+      A negative percentage turns a check off.
+    - a smallest change of a time, seconds, that counts (default 0.001).
+    - p significance level of the statistical tests (default 0.05).
+    - n number of changes printed (default 20, 0 for all).
+
+    Site addresses change from run to run (address space randomization) and
+    from build to build, so sites are matched by the location libpgomp
+    writes for them at exit: the object (file name), the function, and the
+    position of the site among the sites of the same construct in that
+    function. Code added to a function moves its sites but keeps their
+    order. Sites of objects without symbols are matched by their offset in
+    the object, outputs without locations by address. Critical section
+    names are matched by name.
+
+    With two or more repetitions on both sides a change must also pass
+    Welch's t-test on the per-run totals; with fewer, the waits of critical
+    section names are compared with a chi-square test on their histograms.
+    A change that fails the test is printed as noise.
+
+    Exits with 1 if any site regressed: a time or count grew beyond its
+    threshold (and significantly, where there is a test) or a new site
+    waits at least the smallest counted change. Exits with 2 on errors.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include "config.h"
+
+#define NAME_LEN 256 /**< Longest construct, function or object name */
+#define MAX_RUNS 256 /**< Repetitions per side */
+
+/** Compared quantities */
+enum { M_WAIT, M_EXEC, M_COUNT, NUM_METRICS };
+
+/** Outcome of a comparison, in print order */
+enum { ST_REGRESSED, ST_NEW, ST_IMPROVED, ST_GONE, ST_NOISE, NUM_STATUS };
+
+static const char *metricNames[NUM_METRICS] = { "wait", "exec", "count" };
+static const char *statusNames[NUM_STATUS] = { "regressed", "new", "improved",
+                                               "gone", "noise" };
+
+/**
+   The location of a site, from a "# location" line
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t addr; /**< Site address in that run */
+   char object[NAME_LEN]; /**< File name of the object */
+   char function[NAME_LEN]; /**< Function, "?" if the object has no symbols */
+   uint64_t offset; /**< From the function, or from the object if unknown */
+/*@}*/
+} Location;
+
+/**
+   One site of one run: a row of the aggregate output, summed over threads
+**/
+typedef struct
+{
+/*@{*/
+   char name[NAME_LEN]; /**< Construct (wrapped function) */
+   uint64_t addr; /**< Site address */
+   double v[NUM_METRICS]; /**< Totals */
+   const Location *loc; /**< Location, NULL if the output has none */
+   long ordinal; /**< Among the sites of the construct in the function */
+/*@}*/
+} RunSite;
+
+/**
+   A site or critical section name of one run, under its matching key
+**/
+typedef struct
+{
+/*@{*/
+   char *key; /**< Same in all runs */
+   char *construct; /**< Printed construct */
+   char *where; /**< Printed location */
+   int side; /**< 0 old, 1 new */
+   int run; /**< Repetition within the side */
+   double v[NUM_METRICS]; /**< Totals */
+   long hist[CRITICAL_HIST]; /**< Wait histogram of a critical section name */
+   int hasHist; /**< hist was read */
+/*@}*/
+} Entry;
+
+/**
+   A change worth printing
+**/
+typedef struct
+{
+/*@{*/
+   const Entry *entry; /**< Any entry of the key, for the names */
+   int metric; /**< M_WAIT, M_EXEC or M_COUNT */
+   int status; /**< ST_* */
+   double old, new; /**< Means over the repetitions */
+   double p; /**< Test result, -1 if no test was possible */
+/*@}*/
+} Change;
+
+static Entry *entries = NULL;
+static long numEntries = 0, maxEntries = 0;
+static int numRuns[2] = { 0, 0 };
+
+/**
+   @brief Exits after running out of memory.
+**/
+static void outOfMemory()
+{
+   fprintf(stderr,"pgomp-diff: out of memory\n");
+   exit(2);
+}
+
+/**
+   @brief Appends an entry for the current run of a side.
+**/
+static Entry* addEntry(int side, const char *key, const char *construct,
+                       const char *where)
+{
+   Entry *e;
+   if (numEntries == maxEntries)
+   {
+      maxEntries = maxEntries ? 2 * maxEntries : 1024;
+      entries = realloc(entries, maxEntries * sizeof(Entry));
+      if (entries == NULL)
+         outOfMemory();
+   }
+   e = &entries[numEntries++];
+   memset(e, 0, sizeof(*e));
+   e->key = strdup(key);
+   e->construct = strdup(construct);
+   e->where = strdup(where);
+   if (e->key == NULL || e->construct == NULL || e->where == NULL)
+      outOfMemory();
+   e->side = side;
+   e->run = numRuns[side];
+   return e;
+}
+
+/**
+   @brief Finds the critical section name entry of the current run.
+**/
+static Entry* criticalEntry(int side, const char *name)
+{
+   char key[NAME_LEN + 16];
+   long i;
+   snprintf(key, sizeof(key), "critical %s", name);
+   for (i = numEntries - 1; i >= 0 && entries[i].side == side
+                            && entries[i].run == numRuns[side]; i--)
+      if (strcmp(entries[i].key, key) == 0)
+         return &entries[i];
+   return addEntry(side, key, "critical", name);
+}
+
+/**
+   @brief Compares sites by construct and address, for qsort().
+**/
+static int compareRunSites(const void *a, const void *b)
+{
+   const RunSite *x = a, *y = b;
+   int c = strcmp(x->name, y->name);
+   if (c != 0)
+      return c;
+   return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/**
+   @brief Compares sites by construct, object, function and offset: the
+          sites of a construct in a function end up in code order.
+**/
+static int compareLocatedSites(const void *a, const void *b)
+{
+   const RunSite *x = *(RunSite* const *) a, *y = *(RunSite* const *) b;
+   int c = strcmp(x->name, y->name);
+   if (c == 0)
+      c = strcmp(x->loc->object, y->loc->object);
+   if (c == 0)
+      c = strcmp(x->loc->function, y->loc->function);
+   if (c != 0)
+      return c;
+   return x->loc->offset < y->loc->offset ? -1 : x->loc->offset > y->loc->offset;
+}
+
+/**
+   @brief Compares locations by address, for qsort() and bsearch().
+**/
+static int compareLocations(const void *a, const void *b)
+{
+   const Location *x = a, *y = b;
+   return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+/**
+   @brief Splits a CSV line at the commas, keeping empty fields.
+   @return Number of fields.
+**/
+static int splitCsv(char *line, char **fields, int max)
+{
+   int n = 0;
+   while (n < max)
+   {
+      char *comma = strchr(line, ',');
+      fields[n++] = line;
+      if (comma == NULL)
+         break;
+      *comma = '\0';
+      line = comma + 1;
+   }
+   return n;
+}
+
+/**
+   @brief Reads one aggregate output into entries of a side.
+   @return 0 on success, -1 after printing an error.
+**/
+static int readRun(const char *fileName, int side)
+{
+   FILE *f;
+   char *line = NULL, *fields[12];
+   size_t lineSize = 0;
+   RunSite *sites = NULL, **located;
+   Location *locs = NULL;
+   long numSites = 0, maxSites = 0, numLocs = 0, maxLocs = 0, numCritical = 0, i, k;
+   if (numRuns[side] == MAX_RUNS)
+   {
+      fprintf(stderr,"pgomp-diff: more than %d runs on a side\n", MAX_RUNS);
+      return -1;
+   }
+   f = fopen(fileName, "r");
+   if (f == NULL)
+   {
+      perror(fileName);
+      return -1;
+   }
+   while (getline(&line, &lineSize, f) > 0)
+   {
+      RunSite s;
+      Location l;
+      char name[NAME_LEN], end[NAME_LEN], what[8];
+      long hist[CRITICAL_HIST], count, contended;
+      double wait, waitMax, hold;
+      int thId, n, b;
+      if (numSites == 0 && numLocs == 0 && line[0] == '{')
+      {
+         fprintf(stderr,"%s: JSON output is not supported, use PGOMP_FORMAT=text or csv\n",
+                 fileName);
+         goto fail;
+      }
+      memset(&s, 0, sizeof(s));
+      if (sscanf(line, "# location %lx %255s %255s %lx", &l.addr, l.object,
+                 l.function, &l.offset) == 4)
+      {
+         if (numLocs == maxLocs)
+         {
+            maxLocs = maxLocs ? 2 * maxLocs : 256;
+            locs = realloc(locs, maxLocs * sizeof(Location));
+            if (locs == NULL)
+               outOfMemory();
+         }
+         locs[numLocs++] = l;
+         continue;
+      }
+      if (sscanf(line, "# critical %255s %ld %ld %lf %lf %lf", name, &count,
+                 &contended, &wait, &waitMax, &hold) == 6)
+      {
+         Entry *e = criticalEntry(side, name);
+         e->v[M_WAIT] = wait;
+         e->v[M_EXEC] = hold;
+         e->v[M_COUNT] = count;
+         numCritical++;
+         continue;
+      }
+      if (sscanf(line, "# critical-hist %255s %7s%n", name, what, &n) == 2
+          && strcmp(what, "wait") == 0)
+      {
+         const char *p = line + n;
+         for (b = 0; b < CRITICAL_HIST; b++)
+         {
+            int used;
+            if (sscanf(p, " %ld%n", &hist[b], &used) != 1)
+               break;
+            p += used;
+         }
+         if (b == CRITICAL_HIST)
+         {
+            Entry *e = criticalEntry(side, name);
+            memcpy(e->hist, hist, sizeof(hist));
+            e->hasHist = 1;
+         }
+         continue;
+      }
+      if (strncmp(line, "site,", 5) == 0)
+      {
+         // kind,function,begin,end,thread,threads,count,wait,exec,...
+         if (splitCsv(line, fields, 12) < 9)
+            continue;
+         snprintf(s.name, sizeof(s.name), "%s", fields[1]);
+         s.addr = strtoull(fields[2], NULL, 16);
+         s.v[M_COUNT] = atol(fields[6]);
+         s.v[M_WAIT] = atof(fields[7]);
+         s.v[M_EXEC] = atof(fields[8]);
+      }
+      // a text row: name begin end thId wTime exTime count spin blocked
+      // (trace records have fewer fields and no end address)
+      else if (line[0] != ' '
+               || sscanf(line, " %255s %lx %255s %d %lf %lf %ld %lf %lf", s.name, &s.addr,
+                         end, &thId, &s.v[M_WAIT], &s.v[M_EXEC], &count, &wait, &hold) != 9
+               || (strncmp(end, "0x", 2) != 0 && strcmp(end, "(nil)") != 0))
+         continue;
+      else
+         s.v[M_COUNT] = count;
+      if (numSites == maxSites)
+      {
+         maxSites = maxSites ? 2 * maxSites : 256;
+         sites = realloc(sites, maxSites * sizeof(RunSite));
+         if (sites == NULL)
+            outOfMemory();
+      }
+      sites[numSites++] = s;
+   }
+   if (numSites == 0 && numCritical == 0)
+   {
+      fprintf(stderr,"%s: no aggregate results (PGOMP_MODE=aggregate output?)\n",
+              fileName);
+      goto fail;
+   }
+   fclose(f);
+   free(line);
+
+   // the text format has a row per thread, sum them up per site
+   qsort(sites, numSites, sizeof(RunSite), compareRunSites);
+   for (i = 0, k = 0; i < numSites; i++)
+   {
+      if (k > 0 && compareRunSites(&sites[i], &sites[k-1]) == 0)
+      {
+         int m;
+         for (m = 0; m < NUM_METRICS; m++)
+            sites[k-1].v[m] += sites[i].v[m];
+      }
+      else
+         sites[k++] = sites[i];
+   }
+   numSites = k;
+
+   // number the sites of each construct within their function
+   qsort(locs, numLocs, sizeof(Location), compareLocations);
+   located = malloc((numSites + 1) * sizeof(RunSite*));
+   if (located == NULL)
+      outOfMemory();
+   for (i = 0, k = 0; i < numSites; i++)
+   {
+      Location key;
+      key.addr = sites[i].addr;
+      sites[i].loc = numLocs ? bsearch(&key, locs, numLocs, sizeof(Location),
+                                       compareLocations) : NULL;
+      if (sites[i].loc != NULL && strcmp(sites[i].loc->function, "?") != 0)
+         located[k++] = &sites[i];
+   }
+   qsort(located, k, sizeof(RunSite*), compareLocatedSites);
+   for (i = 0; i < k; i++)
+   {
+      RunSite *prev = i > 0 ? located[i-1] : NULL;
+      if (prev != NULL && strcmp(prev->name, located[i]->name) == 0
+          && strcmp(prev->loc->object, located[i]->loc->object) == 0
+          && strcmp(prev->loc->function, located[i]->loc->function) == 0)
+         located[i]->ordinal = prev->ordinal + 1;
+   }
+   free(located);
+
+   for (i = 0; i < numSites; i++)
+   {
+      const RunSite *s = &sites[i];
+      char key[3 * NAME_LEN + 32], where[2 * NAME_LEN + 32];
+      Entry *e;
+      int m;
+      if (s->loc == NULL)
+      {
+         snprintf(key, sizeof(key), "%s 0x%lx", s->name, (unsigned long) s->addr);
+         snprintf(where, sizeof(where), "0x%lx", (unsigned long) s->addr);
+      }
+      else if (strcmp(s->loc->function, "?") == 0)
+      {
+         snprintf(key, sizeof(key), "%s %s+0x%lx", s->name, s->loc->object,
+                  (unsigned long) s->loc->offset);
+         snprintf(where, sizeof(where), "%s+0x%lx", s->loc->object,
+                  (unsigned long) s->loc->offset);
+      }
+      else
+      {
+         snprintf(key, sizeof(key), "%s %s %s #%ld", s->name, s->loc->object,
+                  s->loc->function, s->ordinal);
+         snprintf(where, sizeof(where), "%s+0x%lx (%s)", s->loc->function,
+                  (unsigned long) s->loc->offset, s->loc->object);
+      }
+      e = addEntry(side, key, s->name, where);
+      for (m = 0; m < NUM_METRICS; m++)
+         e->v[m] = s->v[m];
+   }
+   free(sites);
+   free(locs);
+   numRuns[side]++;
+   return 0;
+fail:
+   fclose(f);
+   free(line);
+   free(sites);
+   free(locs);
+   return -1;
+}
+
+/**
+   @brief Continued fraction of the incomplete beta function (modified
+          Lentz's method).
+**/
+static double betaFraction(double a, double b, double x)
+{
+   const double tiny = 1e-300;
+   double c = 1.0, d = 1.0 - (a + b) * x / (a + 1.0), h, aa, delta;
+   int m;
+   if (fabs(d) < tiny)
+      d = tiny;
+   d = 1.0 / d;
+   h = d;
+   for (m = 1; m <= 300; m++)
+   {
+      aa = m * (b - m) * x / ((a - 1.0 + 2 * m) * (a + 2 * m));
+      d = 1.0 + aa * d;
+      c = 1.0 + aa / c;
+      d = 1.0 / (fabs(d) < tiny ? tiny : d);
+      c = fabs(c) < tiny ? tiny : c;
+      h *= d * c;
+      aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 1.0 + 2 * m));
+      d = 1.0 + aa * d;
+      c = 1.0 + aa / c;
+      d = 1.0 / (fabs(d) < tiny ? tiny : d);
+      c = fabs(c) < tiny ? tiny : c;
+      delta = d * c;
+      h *= delta;
+      if (fabs(delta - 1.0) < 1e-12)
+         break;
+   }
+   return h;
+}
+
+/**
+   @brief Regularized incomplete beta function I_x(a, b).
+**/
+static double incompleteBeta(double a, double b, double x)
+{
+   double front;
+   if (x <= 0.0)
+      return 0.0;
+   if (x >= 1.0)
+      return 1.0;
+   front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1.0 - x));
+   if (x < (a + 1.0) / (a + b + 2.0))
+      return front * betaFraction(a, b, x) / a;
+   return 1.0 - front * betaFraction(b, a, 1.0 - x) / b;
+}
+
+/**
+   @brief Regularized upper incomplete gamma function Q(a, x): a series
+          below a + 1, a continued fraction above.
+**/
+static double upperGamma(double a, double x)
+{
+   const double tiny = 1e-300;
+   double front, sum, term, b, c, d, h, delta;
+   int i;
+   if (x <= 0.0)
+      return 1.0;
+   front = exp(-x + a * log(x) - lgamma(a));
+   if (x < a + 1.0)
+   {
+      sum = term = 1.0 / a;
+      for (i = 1; i <= 1000 && fabs(term) > fabs(sum) * 1e-15; i++)
+      {
+         term *= x / (a + i);
+         sum += term;
+      }
+      return 1.0 - front * sum;
+   }
+   b = x + 1.0 - a;
+   c = 1.0 / tiny;
+   d = 1.0 / b;
+   h = d;
+   for (i = 1; i <= 1000; i++)
+   {
+      double an = -i * (i - a);
+      b += 2.0;
+      d = an * d + b;
+      c = b + an / c;
+      d = 1.0 / (fabs(d) < tiny ? tiny : d);
+      c = fabs(c) < tiny ? tiny : c;
+      delta = d * c;
+      h *= delta;
+      if (fabs(delta - 1.0) < 1e-15)
+         break;
+   }
+   return front * h;
+}
+
+/**
+   @brief Welch's t-test: do two samples have the same mean?
+   @return The two-sided p-value.
+**/
+static double welchTest(const double *x, int nx, const double *y, int ny)
+{
+   double mx = 0.0, my = 0.0, vx = 0.0, vy = 0.0, se, t, df;
+   int i;
+   for (i = 0; i < nx; i++)
+      mx += x[i] / nx;
+   for (i = 0; i < ny; i++)
+      my += y[i] / ny;
+   for (i = 0; i < nx; i++)
+      vx += (x[i] - mx) * (x[i] - mx) / (nx - 1);
+   for (i = 0; i < ny; i++)
+      vy += (y[i] - my) * (y[i] - my) / (ny - 1);
+   vx /= nx;
+   vy /= ny;
+   se = vx + vy;
+   if (se <= 0.0)
+      return mx == my ? 1.0 : 0.0;
+   t = (my - mx) / sqrt(se);
+   df = se * se / (vx * vx / (nx - 1) + vy * vy / (ny - 1));
+   return incompleteBeta(df / 2, 0.5, df / (df + t * t));
+}
+
+/**
+   @brief Chi-square test of two histograms: are they samples of the same
+          distribution? Empty buckets are left out.
+   @return The p-value, -1 if there is nothing to test.
+**/
+static double histogramTest(const long *x, const long *y, int n)
+{
+   double sx = 0.0, sy = 0.0, chi = 0.0;
+   int i, buckets = 0;
+   for (i = 0; i < n; i++)
+   {
+      sx += x[i];
+      sy += y[i];
+   }
+   if (sx == 0.0 || sy == 0.0)
+      return -1.0;
+   for (i = 0; i < n; i++)
+   {
+      double ex = (x[i] + y[i]) * sx / (sx + sy), ey = (x[i] + y[i]) * sy / (sx + sy);
+      if (x[i] + y[i] == 0)
+         continue;
+      chi += (x[i] - ex) * (x[i] - ex) / ex + (y[i] - ey) * (y[i] - ey) / ey;
+      buckets++;
+   }
+   if (buckets < 2)
+      return -1.0;
+   return upperGamma((buckets - 1) / 2.0, chi / 2);
+}
+
+/**
+   @brief Compares entries by key, side and run, for qsort().
+**/
+static int compareEntries(const void *a, const void *b)
+{
+   const Entry *x = a, *y = b;
+   int c = strcmp(x->key, y->key);
+   if (c != 0)
+      return c;
+   if (x->side != y->side)
+      return x->side - y->side;
+   return x->run - y->run;
+}
+
+/**
+   @brief Compares changes: by status, then metric, then the largest
+          change first.
+**/
+static int compareChanges(const void *a, const void *b)
+{
+   const Change *x = a, *y = b;
+   double dx = fabs(x->new - x->old), dy = fabs(y->new - y->old);
+   if (x->status != y->status)
+      return x->status - y->status;
+   if (x->metric != y->metric)
+      return x->metric - y->metric;
+   return dx < dy ? 1 : dx > dy ? -1 : strcmp(x->entry->key, y->entry->key);
+}
+
+int main(int argc, char **argv)
+{
+   double threshold[NUM_METRICS] = { 10.0, 10.0, -1.0 };
+   double minChange = 0.001, alpha = 0.05;
+   double vals[2][MAX_RUNS];
+   long hist[2][CRITICAL_HIST];
+   Change *changes;
+   long numChanges = 0, matched = 0, added = 0, removed = 0, i, j;
+   int opt, lines = 20, sep = -1, side, m, b, count[NUM_STATUS];
+   while ((opt = getopt(argc, argv, "+w:x:c:a:p:n:")) != -1)
+   {
+      switch (opt)
+      {
+      case 'w':
+         threshold[M_WAIT] = atof(optarg);
+         break;
+      case 'x':
+         threshold[M_EXEC] = atof(optarg);
+         break;
+      case 'c':
+         threshold[M_COUNT] = atof(optarg);
+         break;
+      case 'a':
+         minChange = atof(optarg);
+         break;
+      case 'p':
+         alpha = atof(optarg);
+         break;
+      case 'n':
+         lines = atoi(optarg);
+         break;
+      default:
+         goto usage;
+      }
+   }
+   for (i = optind; i < argc; i++)
+      if (strcmp(argv[i], "--") == 0)
+         sep = i;
+   if (sep < 0 && argc - optind == 2)
+   {
+      if (readRun(argv[optind], 0) != 0 || readRun(argv[optind+1], 1) != 0)
+         return 2;
+   }
+   else if (sep > optind && sep < argc - 1)
+   {
+      for (i = optind; i < argc; i++)
+         if (i != sep && readRun(argv[i], i > sep) != 0)
+            return 2;
+   }
+   else
+      goto usage;
+
+   qsort(entries, numEntries, sizeof(Entry), compareEntries);
+   changes = malloc((NUM_METRICS * numEntries + 1) * sizeof(Change));
+   if (changes == NULL)
+      outOfMemory();
+   for (i = 0; i < numEntries; i = j)
+   {
+      int present[2] = { 0, 0 }, hasHist[2] = { 0, 0 };
+      for (j = i; j < numEntries && strcmp(entries[j].key, entries[i].key) == 0; j++)
+         ;
+      memset(hist, 0, sizeof(hist));
+      for (b = i; b < j; b++)
+      {
+         const Entry *e = &entries[b];
+         present[e->side] = 1;
+         if (e->hasHist)
+         {
+            hasHist[e->side] = 1;
+            for (m = 0; m < CRITICAL_HIST; m++)
+               hist[e->side][m] += e->hist[m];
+         }
+      }
+      if (present[0] && present[1])
+         matched++;
+      else if (present[1])
+         added++;
+      else
+         removed++;
+      for (m = 0; m < NUM_METRICS; m++)
+      {
+         Change c;
+         double change, percent;
+         memset(vals, 0, sizeof(vals));
+         for (b = i; b < j; b++)
+            vals[entries[b].side][entries[b].run] = entries[b].v[m];
+         c.entry = &entries[i];
+         c.metric = m;
+         c.old = c.new = 0.0;
+         for (side = 0; side < 2; side++)
+            for (b = 0; b < numRuns[side]; b++)
+               *(side ? &c.new : &c.old) += vals[side][b] / numRuns[side];
+         c.p = -1.0;
+         change = c.new - c.old;
+         if (!present[0] || !present[1])
+         {
+            // a site of one side is noted once, by its wait or else its
+            // execution time; a new site that waits is a regression
+            if (m == M_COUNT || fabs(change) < minChange)
+               continue;
+            c.status = present[0] ? ST_GONE
+                       : m == M_WAIT && threshold[M_WAIT] >= 0 ? ST_REGRESSED : ST_NEW;
+            changes[numChanges++] = c;
+            m = NUM_METRICS;
+            continue;
+         }
+         percent = c.old > 0 ? 100 * change / c.old : change != 0 ? INFINITY : 0.0;
+         if (threshold[m] < 0 || fabs(percent) <= threshold[m]
+             || (m != M_COUNT && fabs(change) < minChange))
+            continue;
+         if (numRuns[0] >= 2 && numRuns[1] >= 2)
+            c.p = welchTest(vals[0], numRuns[0], vals[1], numRuns[1]);
+         else if (m == M_WAIT && hasHist[0] && hasHist[1])
+            c.p = histogramTest(hist[0], hist[1], CRITICAL_HIST);
+         if (c.p >= alpha)
+            c.status = ST_NOISE;
+         else
+            c.status = change > 0 ? ST_REGRESSED : ST_IMPROVED;
+         changes[numChanges++] = c;
+      }
+   }
+   qsort(changes, numChanges, sizeof(Change), compareChanges);
+
+   memset(count, 0, sizeof(count));
+   for (i = 0; i < numChanges; i++)
+      count[changes[i].status]++;
+   printf("%d old and %d new runs, %ld sites matched, %ld new, %ld gone\n",
+          numRuns[0], numRuns[1], matched, added, removed);
+   printf("thresholds:");
+   for (m = 0; m < NUM_METRICS; m++)
+      if (threshold[m] >= 0)
+         printf(" %s %+.1f%%", metricNames[m], threshold[m]);
+      else
+         printf(" %s off", metricNames[m]);
+   printf(", times changed by %.6f s or more, p < %g\n", minChange, alpha);
+   if (numChanges > 0)
+   {
+      printf("\n%-10s %-6s %-26s %-40s %12s %12s %9s %8s\n", "status", "metric",
+             "construct", "location", "old", "new", "change", "p");
+      for (i = 0; i < numChanges && (lines == 0 || i < lines); i++)
+      {
+         const Change *c = &changes[i];
+         printf("%-10s %-6s %-26s %-40s %12.6f %12.6f ", statusNames[c->status],
+                metricNames[c->metric], c->entry->construct, c->entry->where,
+                c->old, c->new);
+         if (c->old > 0)
+            printf("%+8.1f%%", 100 * (c->new - c->old) / c->old);
+         else
+            printf("%9s", "-");
+         if (c->p >= 0)
+            printf(" %8.4f\n", c->p);
+         else
+            printf(" %8s\n", "-");
+      }
+      if (i < numChanges)
+         printf("(%ld more, -n 0 prints all)\n", numChanges - i);
+   }
+   printf("\n");
+   for (m = 0; m < NUM_STATUS; m++)
+      printf("%s%d %s", m > 0 ? ", " : "", count[m], statusNames[m]);
+   printf("\n");
+   return count[ST_REGRESSED] > 0 ? 1 : 0;
+usage:
+   fprintf(stderr,"usage: pgomp-diff [-w pct] [-x pct] [-c pct] [-a seconds] [-p alpha] "
+                  "[-n lines] old [old...] -- new [new...]\n");
+   return 2;
+}
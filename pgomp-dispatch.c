@@ -0,0 +1,424 @@
+/**
+   @file pgomp-dispatch.c
+   @brief The libpgomp.so that is preloaded: picks the build of PGOMP
+          for PGOMP_MODE and PGOMP_PAPI and forwards every wrapped
+          function to it.
+
+   Each mode is built into its own library (libpgomp-trace.so,
+   libpgomp-agg.so, and with BUILD_PAPI libpgomp-trace-papi.so and
+   libpgomp-agg-papi.so, see the Makefile) that holds only the code of
+   that mode. The dispatcher loads the one asked for from its own
+   directory at start up. A forwarding function only jumps to the wrapper
+   (it is written in assembly, so it does not depend on the compiler
+   making a tail call), so the wrapper still sees the return address of
+   the program's call.
+
+   A process without an OpenMP runtime (a shell started by system(), a
+   helper program that inherited LD_PRELOAD) has nothing to profile: the
+   dispatcher then loads no build, and neither does it when the build can
+   not be loaded. The forwarding functions go to the next definition of
+   the wrapped functions instead, and the program runs without PGOMP.
+
+   The dispatcher also defines malloc(), free(), calloc(), realloc() and
+   posix_memalign(), which only the preloaded library can replace. They
+   call the C library's, and with PGOMP_MALLOC time the call for the
+   build (see pgomp_alloc_begin() in pgomp.c).
+**/
+
+#define _GNU_SOURCE // required for RTLD_NEXT and dladdr()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <omp.h>
+#ifdef BUILD_OMPT
+#include <omp-tools.h>
+#endif
+
+typedef enum { false, true } bool;
+
+#include "pgomp-wrap.h"
+
+static void *variant = NULL; /**< The loaded build */
+
+// Wrappers of the loaded build, only read by the forwarding functions
+#define VARIANT_POINTER(ret, name, params, args) \
+   static ret (*variant_##name) params __attribute__((used));
+PGOMP_WRAPPED_VOID(VARIANT_POINTER)
+PGOMP_WRAPPED_VALUE(VARIANT_POINTER)
+
+//
+// Forwarding functions: an indirect jump through variant_<function>. A
+// forwarder written in C is only a tail call when it is optimized; at -O0
+// it calls the wrapper, which then records a site in this library.
+//
+#if defined(__x86_64__)
+# if defined(__CET__) && (__CET__ & 1)
+#  define FORWARD_ENTRY "endbr64\n\t"
+# else
+#  define FORWARD_ENTRY ""
+# endif
+# define FORWARD_JUMP(name) "jmp *variant_" #name "(%rip)"
+#elif defined(__aarch64__)
+# ifdef __ARM_FEATURE_BTI_DEFAULT
+#  define FORWARD_ENTRY "bti c\n\t"
+# else
+#  define FORWARD_ENTRY ""
+# endif
+# define FORWARD_JUMP(name) "adrp x16, variant_" #name "\n\t" \
+                            "ldr x16, [x16, :lo12:variant_" #name "]\n\t" \
+                            "br x16"
+#else
+# error "pgomp-dispatch.c has no forwarding functions for this architecture"
+#endif
+
+#define FORWARD(ret, name, params, args) \
+__asm__(".text\n\t" \
+        ".globl " #name "\n\t" \
+        ".type " #name ", %function\n" \
+        #name ":\n\t" \
+        FORWARD_ENTRY FORWARD_JUMP(name) "\n\t" \
+        ".size " #name ", .-" #name);
+PGOMP_WRAPPED_VOID(FORWARD)
+PGOMP_WRAPPED_VALUE(FORWARD)
+
+/**
+   @brief Looks up a real libgomp function for the loaded build: a library
+          loaded with dlopen() is not in the preload chain, so its own
+          RTLD_NEXT lookup would not find the function after PGOMP.
+          RTLD_NEXT goes by the caller, so the dlsym() call must not
+          become a tail call from the build, hence the check here.
+   @param name - Function name.
+   @return The function.
+**/
+void* pgomp_real_function(const char *name)
+{
+   void *function = dlsym(RTLD_NEXT, name);
+   if (function == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to resolve real %s: (%s)\n", name,
+              dlerror());
+      exit(0);
+   }
+   return function;
+}
+
+//
+// Allocation functions
+//
+#define BOOTSTRAP_HEAP 16384 /**< Bytes served while the C library's are looked up */
+
+static void* (*realMalloc)(size_t) = NULL;
+static void (*realFree)(void *) = NULL;
+static void* (*realCalloc)(size_t, size_t) = NULL;
+static void* (*realRealloc)(void *, size_t) = NULL;
+static int (*realPosixMemalign)(void **, size_t, size_t) = NULL;
+
+/** The build's hooks, NULL unless it tracks allocations (PGOMP_MALLOC) */
+static double (*allocBegin)(void) = NULL;
+static void (*allocEnd)(int, size_t, double) = NULL;
+
+/** Set while the thread is in a hook: allocations of the hook itself, and
+    of the C library on its behalf (thread-local storage of the build), go
+    straight to the C library. This library is preloaded, so its
+    thread-local storage is allocated with the thread. */
+static __thread int allocBusy __attribute__((tls_model("initial-exec"))) = 0;
+
+/** dlsym() may allocate while it looks up the C library's functions */
+static char bootstrapHeap[BOOTSTRAP_HEAP] __attribute__((aligned(16)));
+static size_t bootstrapUsed = 0;
+static int resolving = 0;
+
+#define IN_BOOTSTRAP(p) ((char *) (p) >= bootstrapHeap \
+                         && (char *) (p) < bootstrapHeap + BOOTSTRAP_HEAP)
+
+/**
+   @brief Serves an allocation from the bootstrap heap, zeroed, with its
+          size in the 16 bytes before it. The memory is never freed.
+**/
+static void* bootstrapAlloc(size_t size)
+{
+   size_t *block;
+   if (size > BOOTSTRAP_HEAP)
+      return NULL;
+   size = (size + 15) & ~(size_t) 15;
+   if (size + 16 > BOOTSTRAP_HEAP - bootstrapUsed)
+      return NULL;
+   block = (size_t *) (bootstrapHeap + bootstrapUsed);
+   bootstrapUsed += size + 16;
+   block[0] = size;
+   return block + 2;
+}
+
+/**
+   @brief Looks up the C library's allocation functions, once, on the
+          first allocation (which comes before any constructor).
+   @return false while they are being looked up: the caller is dlsym().
+**/
+static bool resolveAllocator(void)
+{
+   if (resolving)
+      return false;
+   if (realMalloc != NULL)
+      return true;
+   resolving = 1;
+   realFree = dlsym(RTLD_NEXT, "free");
+   realCalloc = dlsym(RTLD_NEXT, "calloc");
+   realRealloc = dlsym(RTLD_NEXT, "realloc");
+   realPosixMemalign = dlsym(RTLD_NEXT, "posix_memalign");
+   realMalloc = dlsym(RTLD_NEXT, "malloc");
+   resolving = 0;
+   if (realMalloc == NULL || realFree == NULL || realCalloc == NULL
+       || realRealloc == NULL || realPosixMemalign == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to resolve the allocation functions\n");
+      exit(0);
+   }
+   return true;
+}
+
+void* malloc(size_t size)
+{
+   void *p;
+   double start;
+   if (!resolveAllocator())
+      return bootstrapAlloc(size);
+   if (allocBegin == NULL || allocBusy)
+      return realMalloc(size);
+   allocBusy = 1;
+   start = allocBegin();
+   p = realMalloc(size);
+   if (start >= 0.0)
+      allocEnd(ALLOC_MALLOC, size, start);
+   allocBusy = 0;
+   return p;
+}
+
+void free(void *ptr)
+{
+   double start;
+   if (IN_BOOTSTRAP(ptr) || !resolveAllocator())
+      return;
+   if (allocBegin == NULL || allocBusy)
+   {
+      realFree(ptr);
+      return;
+   }
+   allocBusy = 1;
+   start = allocBegin();
+   realFree(ptr);
+   if (start >= 0.0)
+      allocEnd(ALLOC_FREE, 0, start);
+   allocBusy = 0;
+}
+
+void* calloc(size_t count, size_t size)
+{
+   void *p;
+   double start;
+   if (!resolveAllocator())
+      return size == 0 || count <= BOOTSTRAP_HEAP / size
+             ? bootstrapAlloc(count * size) : NULL;
+   if (allocBegin == NULL || allocBusy)
+      return realCalloc(count, size);
+   allocBusy = 1;
+   start = allocBegin();
+   p = realCalloc(count, size);
+   if (start >= 0.0)
+      allocEnd(ALLOC_CALLOC, count * size, start);
+   allocBusy = 0;
+   return p;
+}
+
+void* realloc(void *ptr, size_t size)
+{
+   void *p;
+   double start;
+   if (IN_BOOTSTRAP(ptr))
+   {
+      // move the block to the C library's heap (or a new bootstrap block)
+      size_t old = ((size_t *) ptr)[-2];
+      if ((p = malloc(size)) != NULL)
+         memcpy(p, ptr, old < size ? old : size);
+      return p;
+   }
+   if (!resolveAllocator())
+      return bootstrapAlloc(size);
+   if (allocBegin == NULL || allocBusy)
+      return realRealloc(ptr, size);
+   allocBusy = 1;
+   start = allocBegin();
+   p = realRealloc(ptr, size);
+   if (start >= 0.0)
+      allocEnd(ALLOC_REALLOC, size, start);
+   allocBusy = 0;
+   return p;
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+   int result;
+   double start;
+   if (!resolveAllocator())
+   {
+      if (alignment > 16 || (*ptr = bootstrapAlloc(size)) == NULL)
+         return ENOMEM;
+      return 0;
+   }
+   if (allocBegin == NULL || allocBusy)
+      return realPosixMemalign(ptr, alignment, size);
+   allocBusy = 1;
+   start = allocBegin();
+   result = realPosixMemalign(ptr, alignment, size);
+   if (start >= 0.0)
+      allocEnd(ALLOC_MEMALIGN, size, start);
+   allocBusy = 0;
+   return result;
+}
+
+/**
+   @brief Error checking wrapper around dlsym() for the loaded build.
+   @return The function, NULL if the build does not have it.
+**/
+static void* lookupVariant(const char *name)
+{
+   void *function = dlsym(variant, name);
+   if (function == NULL)
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to resolve %s in the PGOMP build (%s)\n",
+              name, dlerror());
+   return function;
+}
+
+/**
+   @brief Without a build, points the forwarding functions at the next
+          definitions of the wrapped functions, those of the OpenMP runtime.
+          A process without a runtime never calls them.
+**/
+static void forwardToRuntime(void)
+{
+#define NEXT_LOOKUP(ret, name, params, args) \
+   variant_##name = dlsym(RTLD_NEXT, #name);
+   PGOMP_WRAPPED_VOID(NEXT_LOOKUP)
+   PGOMP_WRAPPED_VALUE(NEXT_LOOKUP)
+}
+
+/**
+   @brief Loads the build for PGOMP_MODE and PGOMP_PAPI, once. The
+          constructor of that build reads the rest of the environment and
+          checks the values again. The constructor of this library must not
+          stop the program: without an OpenMP runtime, or when the build can
+          not be loaded, the program runs without PGOMP.
+**/
+static void loadVariant(void)
+{
+   static bool tried = false;
+   char path[PATH_MAX], *mode, *slash;
+   const char *build, *suffix = "";
+   Dl_info self;
+   int (*tracking)(void);
+   bool found = true;
+   if (tried)
+      return;
+   tried = true;
+   if (dlsym(RTLD_DEFAULT, "omp_get_thread_num") == NULL)
+   {
+      forwardToRuntime();
+      return;
+   }
+   mode = getenv("PGOMP_MODE");
+   if (mode == NULL || strcmp(mode, "aggregate") == 0)
+      build = "agg";
+   else if (strcmp(mode, "trace") == 0 || strcmp(mode, "tail") == 0)
+      build = "trace";
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable "
+                     "PGOMP_MODE not 'trace', 'tail' or 'aggregate', "
+                     "running without PGOMP\n");
+      forwardToRuntime();
+      return;
+   }
+#ifdef BUILD_PAPI
+   mode = getenv("PGOMP_PAPI");
+   if (mode != NULL && strcmp(mode, "true") == 0)
+      suffix = "-papi";
+#endif
+   // the builds live next to this library
+   if (!dladdr((void *) loadVariant, &self) || self.dli_fname == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to find the PGOMP library directory, "
+                     "running without PGOMP\n");
+      forwardToRuntime();
+      return;
+   }
+   slash = strrchr(self.dli_fname, '/');
+   snprintf(path, sizeof(path), "%.*slibpgomp-%s%s.so",
+            slash == NULL ? 0 : (int) (slash - self.dli_fname + 1),
+            self.dli_fname, build, suffix);
+   variant = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+   if (variant == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to load %s (%s), running without "
+                     "PGOMP\n", path, dlerror());
+      forwardToRuntime();
+      return;
+   }
+#define VARIANT_LOOKUP(ret, name, params, args) \
+   if ((variant_##name = lookupVariant(#name)) == NULL) \
+      found = false;
+   PGOMP_WRAPPED_VOID(VARIANT_LOOKUP)
+   PGOMP_WRAPPED_VALUE(VARIANT_LOOKUP)
+   tracking = (int (*)(void)) lookupVariant("pgomp_alloc_tracking");
+   if (!found || tracking == NULL)
+   {
+      // a build of another version: do not run half of it
+      fprintf(stderr,"LIBPGOMP ERROR: %s does not match this libpgomp.so, "
+                     "running without PGOMP\n", path);
+      variant = NULL;
+      forwardToRuntime();
+      return;
+   }
+   if (tracking())
+   {
+      allocEnd = (void (*)(int, size_t, double)) lookupVariant("pgomp_alloc_end");
+      allocBegin = (double (*)(void)) lookupVariant("pgomp_alloc_begin");
+   }
+}
+
+__attribute__((constructor)) static void pgomp_dispatch_init(void)
+{
+   loadVariant();
+}
+
+#ifdef BUILD_OMPT
+/**
+   @brief Called by an OMPT runtime (LLVM's libomp) when it starts, which
+          may be before the constructor: hands over to the OMPT backend of
+          the build. The runtime then reports every construct itself, so
+          from now on the wrapped functions go straight to it.
+**/
+ompt_start_tool_result_t* ompt_start_tool(unsigned int ompVersion,
+                                          const char *runtimeVersion)
+{
+   ompt_start_tool_result_t* (*startTool)(unsigned int, const char *);
+   ompt_start_tool_result_t *result;
+   loadVariant();
+   if (variant == NULL)
+      return NULL;
+   startTool = (ompt_start_tool_result_t* (*)(unsigned int, const char *))
+               lookupVariant("ompt_start_tool");
+   if (startTool == NULL)
+      return NULL;
+   result = startTool(ompVersion, runtimeVersion);
+   if (result == NULL)
+      return NULL;
+#define REAL_LOOKUP(ret, name, params, args) \
+   variant_##name = pgomp_real_function(#name);
+   PGOMP_WRAPPED_VOID(REAL_LOOKUP)
+   PGOMP_WRAPPED_VALUE(REAL_LOOKUP)
+   return result;
+}
+#endif
@@ -0,0 +1,165 @@
+/**
+   @file pgomp-lz.c
+   @brief Built-in LZ codec used for compressed trace chunks.
+          See pgomp-lz.h for the stream format.
+**/
+
+#include <stdint.h>
+#include <string.h>
+#include "pgomp-lz.h"
+
+#define HASH_BITS 13 /**< log2 of the match finder table size */
+#define MIN_MATCH 4 /**< Shortest match that is encoded */
+#define MAX_OFFSET 65535 /**< Longest distance a 2 byte offset reaches */
+
+/**
+   @brief Hashes the 4 bytes at p into the match finder table.
+**/
+static unsigned int hashSeq(const unsigned char *p)
+{
+   uint32_t v;
+   memcpy(&v, p, sizeof(v));
+   return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/**
+   @brief Writes the continuation bytes of a length whose nibble was 15.
+**/
+static unsigned char* putLength(unsigned char *op, size_t len)
+{
+   while (len >= 255)
+   {
+      *op++ = 255;
+      len -= 255;
+   }
+   *op++ = (unsigned char) len;
+   return op;
+}
+
+/**
+   @brief Emits one sequence: the literals from anchor, then (if mlen is
+          not zero) a match of mlen bytes at the given offset.
+**/
+static unsigned char* putSequence(unsigned char *op, const unsigned char *anchor,
+                                  size_t litLen, size_t offset, size_t mlen)
+{
+   unsigned char *token = op++;
+   size_t mcode = mlen ? mlen - MIN_MATCH : 0;
+   *token = (unsigned char) (((litLen < 15 ? litLen : 15) << 4)
+                             | (mcode < 15 ? mcode : 15));
+   if (litLen >= 15)
+      op = putLength(op, litLen - 15);
+   memcpy(op, anchor, litLen);
+   op += litLen;
+   if (mlen == 0)
+      return op;
+   *op++ = (unsigned char) (offset & 0xff);
+   *op++ = (unsigned char) (offset >> 8);
+   if (mcode >= 15)
+      op = putLength(op, mcode - 15);
+   return op;
+}
+
+/**
+   @brief Compresses a buffer.
+   @param src - Input.
+   @param srcLen - Input length.
+   @param dst - Output buffer.
+   @param dstCap - Output capacity, at least LZ_BOUND(srcLen).
+   @return Compressed length, or 0 if dst is too small.
+**/
+size_t lzCompress(const char *src, size_t srcLen, char *dst, size_t dstCap)
+{
+   const unsigned char *base = (const unsigned char*) src;
+   const unsigned char *ip = base, *anchor = base, *end = base + srcLen;
+   const unsigned char *matchLimit = srcLen > MIN_MATCH ? end - MIN_MATCH : base;
+   unsigned char *op = (unsigned char*) dst;
+   unsigned int table[1 << HASH_BITS]; // position + 1, 0 is empty
+   if (dstCap < LZ_BOUND(srcLen))
+      return 0;
+   memset(table, 0, sizeof(table));
+   while (ip < matchLimit)
+   {
+      unsigned int h = hashSeq(ip);
+      const unsigned char *ref = table[h] ? base + table[h] - 1 : NULL;
+      size_t mlen;
+      table[h] = (unsigned int) (ip - base) + 1;
+      if (ref == NULL || ip - ref > MAX_OFFSET || memcmp(ref, ip, MIN_MATCH) != 0)
+      {
+         ip++;
+         continue;
+      }
+      mlen = MIN_MATCH;
+      while (ip + mlen < end && ref[mlen] == ip[mlen])
+         mlen++;
+      op = putSequence(op, anchor, ip - anchor, ip - ref, mlen);
+      ip += mlen;
+      anchor = ip;
+   }
+   op = putSequence(op, anchor, end - anchor, 0, 0);
+   return op - (unsigned char*) dst;
+}
+
+/**
+   @brief Reads the continuation bytes of a length whose nibble was 15.
+   @return The updated input pointer, or NULL if the input ran out.
+**/
+static const unsigned char* getLength(const unsigned char *ip,
+                                      const unsigned char *ipEnd, size_t *len)
+{
+   unsigned char b;
+   do
+   {
+      if (ip >= ipEnd)
+         return NULL;
+      b = *ip++;
+      *len += b;
+   } while (b == 255);
+   return ip;
+}
+
+/**
+   @brief Decompresses a buffer produced by lzCompress().
+   @param src - Compressed input.
+   @param srcLen - Compressed length.
+   @param dst - Output buffer.
+   @param dstCap - Output capacity.
+   @return Decompressed length, or -1 if the input is corrupt or dst is
+           too small.
+**/
+long lzDecompress(const char *src, size_t srcLen, char *dst, size_t dstCap)
+{
+   const unsigned char *ip = (const unsigned char*) src, *ipEnd = ip + srcLen;
+   unsigned char *op = (unsigned char*) dst, *opEnd = op + dstCap;
+   while (ip < ipEnd)
+   {
+      unsigned int token = *ip++;
+      size_t len = token >> 4, offset;
+      const unsigned char *ref;
+      if (len == 15 && (ip = getLength(ip, ipEnd, &len)) == NULL)
+         return -1;
+      if ((size_t) (ipEnd - ip) < len || (size_t) (opEnd - op) < len)
+         return -1;
+      memcpy(op, ip, len);
+      op += len;
+      ip += len;
+      if (ip >= ipEnd)
+         break; // last sequence has no match
+      if (ipEnd - ip < 2)
+         return -1;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - (unsigned char*) dst))
+         return -1;
+      len = token & 15;
+      if (len == 15 && (ip = getLength(ip, ipEnd, &len)) == NULL)
+         return -1;
+      len += MIN_MATCH;
+      if ((size_t) (opEnd - op) < len)
+         return -1;
+      ref = op - offset;
+      while (len--)
+         *op++ = *ref++; // byte copy, matches may overlap the output
+   }
+   return op - (unsigned char*) dst;
+}
@@ -0,0 +1,29 @@
+//
+// PGOMP built-in LZ codec
+//
+// A small byte-oriented LZ77 codec in the spirit of LZ4: no entropy
+// coding, a single hash probe per position, and a decoder that is little
+// more than memcpy. It is used to compress trace chunks when PGOMP was not
+// built with zstd (and is always available to the decoder).
+//
+// Compressed stream: a sequence of
+//    token     - high nibble literal count, low nibble match length - 4
+//    [255...]  - literal count continuation when the nibble is 15
+//    literals
+//    offset    - 2 bytes little endian, distance back to the match
+//    [255...]  - match length continuation when the nibble is 15
+// The last sequence has literals only (the stream ends after them).
+//
+
+#ifndef PGOMP_LZ_H
+#define PGOMP_LZ_H
+
+#include <stddef.h>
+
+/** Worst case compressed size of n bytes of input */
+#define LZ_BOUND(n) ((n) + (n)/255 + 16)
+
+size_t lzCompress(const char *src, size_t srcLen, char *dst, size_t dstCap);
+long lzDecompress(const char *src, size_t srcLen, char *dst, size_t dstCap);
+
+#endif
@@ -0,0 +1,313 @@
+/**
+   @file pgomp-read.c
+   @brief Reader for PGOMP traces of every format, shared by the offline
+          tools (pgomp-decode, pgomp-report). See pgomp-read.h.
+**/
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "config.h"
+#include "pgomp-lz.h"
+#include "pgomp-read.h"
+#ifdef BUILD_ZSTD
+#include <zstd.h>
+#endif
+
+/**
+   @brief Appends a piece to the piece list.
+   @return 0 on success, -1 when out of memory.
+**/
+static int addPiece(TraceFile *tf, unsigned long *max, uint64_t offset,
+                    uint64_t len, int64_t stream, long chunk)
+{
+   if (tf->numPieces == *max)
+   {
+      TracePiece *p;
+      *max = *max ? 2 * *max : 1024;
+      p = realloc(tf->pieces, *max * sizeof(TracePiece));
+      if (p == NULL)
+         return -1;
+      tf->pieces = p;
+   }
+   tf->pieces[tf->numPieces].offset = offset;
+   tf->pieces[tf->numPieces].len = len;
+   tf->pieces[tf->numPieces].stream = stream;
+   tf->pieces[tf->numPieces].chunk = chunk;
+   tf->numPieces++;
+   return 0;
+}
+
+/**
+   @brief Cuts len bytes of text at offset into pieces of at most
+          TRACE_PIECE_SIZE bytes that end at line ends.
+   @return 0 on success, -1 when out of memory.
+**/
+static int splitText(TraceFile *tf, unsigned long *max, uint64_t offset,
+                     uint64_t len, int64_t stream)
+{
+   uint64_t end = offset + len;
+   while (offset < end)
+   {
+      uint64_t cut = offset + TRACE_PIECE_SIZE;
+      if (cut >= end)
+         cut = end;
+      else
+      {
+         const char *nl = memchr(tf->map + cut, '\n', end - cut);
+         cut = nl ? (uint64_t) (nl - tf->map) + 1 : end;
+      }
+      if (addPiece(tf, max, offset, cut - offset, stream, -1) != 0)
+         return -1;
+      offset = cut;
+   }
+   return 0;
+}
+
+/**
+   @brief Reads the chunk index of a compressed trace. Uses the index at
+          the end of the file if the trace is complete, otherwise walks
+          the chunk headers from the start (the trace of a program that did
+          not exit normally).
+   @return 0 on success, -1 if the index is corrupt.
+**/
+static int readIndex(TraceFile *tf)
+{
+   TraceFooter footer;
+   ChunkHeader header;
+   unsigned long max = 0, i;
+   uint64_t offset;
+   if (tf->size >= 8 + sizeof(footer))
+   {
+      memcpy(&footer, tf->map + tf->size - sizeof(footer), sizeof(footer));
+      if (memcmp(footer.magic, TRACE_INDEX_MAGIC, 8) == 0)
+      {
+         if (footer.indexOffset > tf->size
+             || footer.numChunks > (tf->size - footer.indexOffset) / sizeof(ChunkIndexEntry))
+            return -1;
+         tf->index = malloc(footer.numChunks * sizeof(ChunkIndexEntry) + 1);
+         if (tf->index == NULL)
+            return -1;
+         memcpy(tf->index, tf->map + footer.indexOffset,
+                footer.numChunks * sizeof(ChunkIndexEntry));
+         tf->numChunks = footer.numChunks;
+         tf->dropped = footer.droppedChunks;
+      }
+   }
+   if (tf->index == NULL)
+   {
+      fprintf(stderr,"%s: no chunk index (trace incomplete?), scanning chunks\n",
+              tf->name);
+      offset = 8;
+      while (offset + sizeof(header) <= tf->size)
+      {
+         memcpy(&header, tf->map + offset, sizeof(header));
+         if (header.magic != CHUNK_MAGIC)
+            break;
+         if (tf->numChunks == max)
+         {
+            ChunkIndexEntry *p;
+            max = max ? 2 * max : 1024;
+            p = realloc(tf->index, max * sizeof(ChunkIndexEntry));
+            if (p == NULL)
+               return -1;
+            tf->index = p;
+         }
+         tf->index[tf->numChunks].offset = offset;
+         tf->index[tf->numChunks].stream = header.stream;
+         tf->index[tf->numChunks].codec = header.codec;
+         tf->index[tf->numChunks].rawLen = header.rawLen;
+         tf->index[tf->numChunks].compLen = header.compLen;
+         tf->numChunks++;
+         offset += sizeof(header) + header.compLen;
+      }
+   }
+   for (i = 0; i < tf->numChunks; i++)
+   {
+      const ChunkIndexEntry *e = &tf->index[i];
+      if (e->offset + sizeof(ChunkHeader) + e->compLen > tf->size
+          || e->rawLen > TRACE_CHUNK_SIZE || e->compLen > LZ_BOUND(TRACE_CHUNK_SIZE))
+      {
+         fprintf(stderr,"%s: chunk %lu is corrupt\n", tf->name, i);
+         tf->numChunks = i;
+         break;
+      }
+   }
+   return 0;
+}
+
+/**
+   @brief Opens a trace file of any format and splits it into pieces.
+   @param tf - Set to the open trace.
+   @param name - File name.
+   @return 0 on success, -1 after printing an error.
+**/
+int traceOpen(TraceFile *tf, const char *name)
+{
+   struct stat st;
+   unsigned long max = 0, i;
+   const MmapHeader *header;
+   unsigned char *chained;
+   uint32_t next;
+   int fd;
+   memset(tf, 0, sizeof(*tf));
+   tf->name = name;
+   fd = open(name, O_RDONLY);
+   if (fd < 0 || fstat(fd, &st) != 0)
+   {
+      perror(name);
+      return -1;
+   }
+   tf->size = st.st_size;
+   if (tf->size > 0)
+      tf->map = mmap(NULL, tf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (tf->map == MAP_FAILED)
+   {
+      perror(name);
+      return -1;
+   }
+   if (tf->size >= 8 && memcmp(tf->map, TRACE_MAGIC, 8) == 0)
+   {
+      tf->format = TRACE_COMPRESSED;
+      if (readIndex(tf) != 0)
+      {
+         fprintf(stderr,"%s: corrupt chunk index\n", name);
+         return -1;
+      }
+      for (i = 0; i < tf->numChunks; i++)
+         if (addPiece(tf, &max, tf->index[i].offset, tf->index[i].rawLen,
+                      tf->index[i].stream, i) != 0)
+            goto noMemory;
+   }
+   else if (tf->size >= sizeof(MmapHeader) && memcmp(tf->map, MMAP_MAGIC, 8) == 0)
+   {
+      tf->format = TRACE_MMAP;
+      tf->header = header = (const MmapHeader*) tf->map;
+      if (header->numExtents > header->maxExtents
+          || header->headerSize > tf->size
+          || sizeof(MmapHeader) + header->maxExtents * sizeof(ExtentEntry)
+             > header->headerSize)
+      {
+         fprintf(stderr,"%s: corrupt extent table\n", name);
+         return -1;
+      }
+      tf->dropped = header->dropped;
+      // a stream's chain starts at the extent no other one leads to; an
+      // extent is always handed out after the one before it in the chain
+      chained = calloc(header->numExtents + 1, 1);
+      if (chained == NULL)
+         goto noMemory;
+      for (i = 0; i < header->numExtents; i++)
+      {
+         next = header->extents[i].next;
+         if (next == MMAP_NO_EXTENT)
+            continue;
+         if (next <= i || next >= header->numExtents || chained[next]
+             || header->extents[next].stream != header->extents[i].stream)
+         {
+            fprintf(stderr,"%s: extent %lu is corrupt\n", name, i);
+            free(chained);
+            return -1;
+         }
+         chained[next] = 1;
+      }
+      for (i = 0; i < header->numExtents; i++)
+      {
+         if (chained[i])
+            continue;
+         for (next = i; next != MMAP_NO_EXTENT; next = header->extents[next].next)
+         {
+            const ExtentEntry *e = &header->extents[next];
+            // an extent that got no disk space is empty, and may lie beyond
+            // the end of the file
+            if (e->used == 0)
+               continue;
+            if (e->offset + e->used > tf->size || e->used > e->size
+                || e->size > header->extentSize)
+            {
+               fprintf(stderr,"%s: extent %lu is corrupt\n", name,
+                       (unsigned long) next);
+               free(chained);
+               return -1;
+            }
+            if (splitText(tf, &max, e->offset, e->used, e->stream) != 0)
+            {
+               free(chained);
+               goto noMemory;
+            }
+         }
+      }
+      free(chained);
+   }
+   else
+   {
+      tf->format = TRACE_TEXT;
+      if (splitText(tf, &max, 0, tf->size, -1) != 0)
+         goto noMemory;
+   }
+   return 0;
+noMemory:
+   fprintf(stderr,"%s: out of memory\n", name);
+   return -1;
+}
+
+/**
+   @brief Gets the text of a piece. Thread safe.
+   @param tf - Open trace.
+   @param piece - One of tf->pieces.
+   @param buffer - TRACE_CHUNK_SIZE bytes to decompress a chunk into.
+   @return The piece->len bytes of text, or NULL if the chunk is corrupt.
+**/
+const char* tracePieceText(const TraceFile *tf, const TracePiece *piece,
+                           char *buffer)
+{
+   const ChunkIndexEntry *entry;
+   const char *comp;
+   long len = -1;
+   if (tf->format != TRACE_COMPRESSED)
+      return tf->map + piece->offset;
+   entry = &tf->index[piece->chunk];
+   comp = tf->map + entry->offset + sizeof(ChunkHeader);
+   switch (entry->codec)
+   {
+   case CODEC_NONE:
+      if (entry->compLen != entry->rawLen)
+         return NULL;
+      return comp;
+   case CODEC_LZ:
+      len = lzDecompress(comp, entry->compLen, buffer, entry->rawLen);
+      break;
+#ifdef BUILD_ZSTD
+   case CODEC_ZSTD:
+      len = ZSTD_decompress(buffer, entry->rawLen, comp, entry->compLen);
+      if (ZSTD_isError(len))
+         len = -1;
+      break;
+#endif
+   default:
+      fprintf(stderr,"%s: chunk codec %u not supported by this build\n",
+              tf->name, entry->codec);
+      return NULL;
+   }
+   return len == (long) entry->rawLen ? buffer : NULL;
+}
+
+/**
+   @brief Unmaps the trace and frees the piece list.
+**/
+void traceClose(TraceFile *tf)
+{
+   if (tf->map != NULL && tf->map != MAP_FAILED)
+      munmap((void*) tf->map, tf->size);
+   free(tf->index);
+   free(tf->pieces);
+   memset(tf, 0, sizeof(*tf));
+}
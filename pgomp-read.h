@@ -0,0 +1,68 @@
+//
+// PGOMP trace reader
+//
+// Opens a trace in any of the formats libpgomp writes - plain text
+// (pgomp-out.txt), compressed (PGOMP_COMPRESS) or memory-mapped
+// (PGOMP_TRACE_IO=mmap) - and splits its text records into pieces that can
+// be read independently, e.g. by different threads. Every piece holds
+// whole lines of the text trace format. The file is memory-mapped, never
+// read into memory as a whole.
+//
+// Pieces come in file order, except in memory-mapped traces, where they
+// follow each stream's chain of extents. In compressed traces a piece is a
+// chunk, in the other formats pieces are at most TRACE_PIECE_SIZE bytes,
+// cut at line ends. Pieces of one stream (thread) are in time order; a
+// memory-mapped trace keeps each stream in extents of its own, so there a
+// piece also never mixes streams.
+//
+
+#ifndef PGOMP_READ_H
+#define PGOMP_READ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pgomp-trace.h"
+
+#define TRACE_PIECE_SIZE (16*1024*1024)
+
+/** Format of a trace file */
+enum { TRACE_TEXT, TRACE_COMPRESSED, TRACE_MMAP };
+
+/**
+   Part of a trace that can be read on its own
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t offset; /**< File offset of the text (of the chunk header if compressed) */
+   uint64_t len; /**< Length of the text */
+   int64_t stream; /**< Stream (thread) of all records, -1 if mixed or unknown */
+   long chunk; /**< Index entry of a compressed chunk, -1 otherwise */
+/*@}*/
+} TracePiece;
+
+/**
+   An open trace file
+**/
+typedef struct
+{
+/*@{*/
+   const char *name; /**< File name */
+   int format; /**< TRACE_TEXT, TRACE_COMPRESSED or TRACE_MMAP */
+   const char *map; /**< Whole file, mapped read only */
+   size_t size; /**< File size */
+   ChunkIndexEntry *index; /**< Chunk index of a compressed trace */
+   unsigned long numChunks; /**< Entries in index */
+   const MmapHeader *header; /**< Extent table of a memory-mapped trace */
+   unsigned long dropped; /**< Chunks (records) lost while tracing */
+   TracePiece *pieces; /**< All pieces, in file order */
+   unsigned long numPieces; /**< Entries in pieces */
+/*@}*/
+} TraceFile;
+
+int traceOpen(TraceFile *tf, const char *name);
+const char* tracePieceText(const TraceFile *tf, const TracePiece *piece,
+                           char *buffer);
+void traceClose(TraceFile *tf);
+
+#endif
@@ -0,0 +1,1460 @@
+/**
+   @file pgomp-report.c
+   @brief Offline report of a PGOMP trace.
+
+    Reads a trace in any format (text, compressed or memory-mapped), pairs
+    the begin and end records of every thread and prints
+
+    - the top sites by waiting time
+    - a per-thread breakdown of where the time went
+    - a summary per lock and critical section (acquire site)
+    - the load imbalance at every barrier, and parallel region times
+    - the wake-up latency, work and join wait of every team member
+    - the CPU migrations of every thread (traces taken with PGOMP_CPU)
+    - the serial and parallel time, and the speedup Amdahl's law predicts
+    - with -c, the critical path and the sites on it
+
+       pgomp-report [-n top] [-j threads] [-c] [file]
+
+    - n number of entries in each top list (default 20).
+    - j number of threads used to read the trace (default: all cores).
+    - c extract the critical path: keeps the records in memory.
+    The file defaults to OUTPUT_FILENAME from config.h.
+
+    The trace is memory-mapped and read in batches of pieces (see
+    pgomp-read.h): the pieces of a batch are parsed in parallel, then the
+    records of every thread are paired in parallel, one thread per task,
+    so memory use does not grow with the trace size and the time it takes
+    goes down with the number of cores. Locks are identified by the site
+    that acquires them, the trace does not record the lock itself.
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "config.h"
+#include "pgomp-read.h"
+
+#define MAX_NAMES 256 /**< Distinct record names */
+#define NAME_LEN 48 /**< Longest record name */
+#define MAX_DEPTH 64 /**< Deepest nesting of open acquisitions per thread */
+#define MAX_THREAD_ID (1 << 20) /**< Larger thread ids are taken as corrupt lines */
+#define CONTENDED 1e-6 /**< Waits longer than this (s) count as contended */
+
+/** What a trace record is */
+enum { REC_BARRIER, REC_ACQUIRE, REC_RELEASE, REC_REGION, REC_WAKE, REC_JOIN,
+       REC_CPU, REC_PGOMP, REC_OTHER };
+
+/** Acquire and release records pair up within a family */
+enum { FAM_CRITICAL, FAM_NAMED, FAM_LOCK, FAM_NEST, FAM_PARALLEL, FAM_ATOMIC,
+       FAM_ORDERED, NUM_FAMILIES, FAM_NONE = -1 };
+
+/** Per-thread time categories */
+enum { CAT_BARRIER, CAT_LOCK, CAT_CRITICAL, CAT_LOCK_HELD, CAT_CRITICAL_HELD,
+       CAT_RUNTIME, CAT_FORK_JOIN, NUM_CATS };
+
+static const struct
+{
+   const char *name;
+   int kind;
+   int family;
+} knownNames[] =
+{
+   { "GOMP_barrier", REC_BARRIER, FAM_NONE },
+   { "GOMP_critical_start", REC_ACQUIRE, FAM_CRITICAL },
+   { "GOMP_critical_end", REC_RELEASE, FAM_CRITICAL },
+   { "GOMP_critical_name_start", REC_ACQUIRE, FAM_NAMED },
+   { "GOMP_critical_name_end", REC_RELEASE, FAM_NAMED },
+   { "GOMP_atomic_start", REC_ACQUIRE, FAM_ATOMIC },
+   { "GOMP_atomic_end", REC_RELEASE, FAM_ATOMIC },
+   { "GOMP_ordered_start", REC_ACQUIRE, FAM_ORDERED },
+   { "GOMP_ordered_end", REC_RELEASE, FAM_ORDERED },
+   { "GOMP_sections_end", REC_BARRIER, FAM_NONE },
+   { "GOMP_loop_end", REC_BARRIER, FAM_NONE },
+   { "implicit_barrier", REC_BARRIER, FAM_NONE },
+   { "taskwait", REC_BARRIER, FAM_NONE },
+   { "taskgroup", REC_BARRIER, FAM_NONE },
+   { "reduction", REC_BARRIER, FAM_NONE },
+   { "omp_set_lock", REC_ACQUIRE, FAM_LOCK },
+   { "omp_test_lock", REC_ACQUIRE, FAM_LOCK },
+   { "omp_unset_lock", REC_RELEASE, FAM_LOCK },
+   { "omp_set_nest_lock", REC_ACQUIRE, FAM_NEST },
+   { "omp_test_nest_lock", REC_ACQUIRE, FAM_NEST },
+   { "omp_unset_nest_lock", REC_RELEASE, FAM_NEST },
+   { "GOMP_parallel_start", REC_ACQUIRE, FAM_PARALLEL },
+   { "GOMP_parallel_end", REC_RELEASE, FAM_PARALLEL },
+   { "GOMP_parallel", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_dynamic", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_guided", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_nonmonotonic_dynamic", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_nonmonotonic_guided", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_runtime", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_nonmonotonic_runtime", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_loop_maybe_nonmonotonic_runtime", REC_REGION, FAM_PARALLEL },
+   { "GOMP_parallel_wake", REC_WAKE, FAM_NONE },
+   { "GOMP_parallel_join", REC_JOIN, FAM_NONE },
+   { "PGOMP_cpu", REC_CPU, FAM_NONE },
+   { "PGOMP_sampled", REC_PGOMP, FAM_NONE },
+   { "PGOMP_untraced", REC_PGOMP, FAM_NONE },
+   { "PGOMP_omitted", REC_PGOMP, FAM_NONE },
+   { "PGOMP_tail", REC_PGOMP, FAM_NONE },
+};
+
+static int pathFlag = 0; /**< -c: extract the critical path */
+
+/** Record names: the known ones first, others as they are found */
+static char names[MAX_NAMES][NAME_LEN];
+static int nameKind[MAX_NAMES], nameFamily[MAX_NAMES];
+static int numNames = 0;
+
+/**
+   One parsed trace record
+**/
+typedef struct
+{
+/*@{*/
+   double t1; /**< First time column (call) */
+   double t2; /**< Second time column (return) */
+   uint64_t addr; /**< Call site */
+   uint32_t thread; /**< Thread id */
+   uint32_t name; /**< Index in names */
+/*@}*/
+} Record;
+
+/**
+   The records of one piece, grouped by thread
+**/
+typedef struct
+{
+/*@{*/
+   Record *recs; /**< Records, by thread, in trace order per thread */
+   long num; /**< Number of records */
+   uint32_t maxThread; /**< Largest thread id in the piece */
+   long *start; /**< Records of thread t are recs[start[t]] to recs[start[t+1]-1] */
+   long skipped; /**< Lines that are not records */
+   int corrupt; /**< The piece could not be read */
+/*@}*/
+} PieceRecords;
+
+/**
+   Statistics of one call site
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t addr; /**< Call site */
+   uint32_t name; /**< Index in names */
+   long count; /**< Records */
+   long contended; /**< Acquisitions that waited longer than CONTENDED */
+   double wait, waitMax; /**< Time in the call (waiting) */
+   long holds; /**< Acquisitions paired with a release */
+   double hold, holdMax; /**< Time between acquire and release */
+   int threads; /**< Threads that reached the site */
+   double *arrivals; /**< Barrier arrival times of one thread, in order */
+   long numArrivals, maxArrivals;
+   const double **threadArrivals; /**< Merged: arrivals of every thread */
+   long *threadNumArrivals;
+/*@}*/
+} SiteStats;
+
+/**
+   Site table: sites in a growing array, found through a hash of indices
+**/
+typedef struct
+{
+/*@{*/
+   SiteStats *sites;
+   long num, max;
+   long *slots; /**< Index + 1 of the site, 0 if free */
+   long numSlots; /**< Power of two */
+/*@}*/
+} SiteTable;
+
+/**
+   An acquisition waiting for its release
+**/
+typedef struct
+{
+/*@{*/
+   long site; /**< Acquire site */
+   double started; /**< Time the acquire call was made */
+   double acquired; /**< Time the acquire call returned */
+/*@}*/
+} OpenAcquire;
+
+/**
+   Pairing state and totals of one thread
+**/
+typedef struct
+{
+/*@{*/
+   double first, last; /**< First and last time seen */
+   long events; /**< Records */
+   long unmatched; /**< Releases without an acquisition */
+   double time[NUM_CATS]; /**< Time per category */
+   OpenAcquire open[NUM_FAMILIES][MAX_DEPTH];
+   int depth[NUM_FAMILIES];
+   SiteTable sites;
+   double *regions; /**< Start and end time of every parallel region */
+   long numRegions, maxRegions;
+   long teamRegions; /**< Regions the thread ran as a team member */
+   double wake, wakeMax; /**< Region start to entering the body */
+   double work; /**< Time in region bodies */
+   double entered; /**< End of the last wake record, 0 after its join */
+   long cpuRecords; /**< PGOMP_cpu records: the first CPU and every migration */
+   uint64_t cpu; /**< CPU of the last PGOMP_cpu record */
+   double join, joinMax; /**< Leaving the body to the end of the region */
+   Record *kept; /**< Records for the critical path (-c) */
+   long numKept, maxKept;
+/*@}*/
+} ThreadState;
+
+/** Critical path time of a site: the code before it, holding it, in it */
+enum { PATH_WORK, PATH_HELD, PATH_SYNC, NUM_PATH };
+
+/**
+   A record on the timeline of a thread, with the dependency of its wait
+**/
+typedef struct
+{
+/*@{*/
+   double t1, t2;
+   int kind; /**< REC_* */
+   long site; /**< Index in the merged sites, of the acquisition for a release */
+   long ctx; /**< Site the code before the record belongs to, -1 if serial */
+   int held; /**< That code holds the lock of ctx, else it is region work */
+   uint64_t group; /**< Barrier, wake, join: region site; acquire: lock */
+   double fork; /**< Barrier, wake, join: region start */
+   long k; /**< Barrier: number in the body; acquire: its release, -1 if none */
+   uint32_t fromThread; /**< Thread of from */
+   long from; /**< The record whose call ended the wait, -1 if none */
+/*@}*/
+} PathRecord;
+
+/**
+   A record of one thread that joins the records of others on the path
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t group;
+   double fork, time, end;
+   long k;
+   uint32_t thread;
+   long index, other; /**< The record, and another (release, join) */
+/*@}*/
+} PathEdge;
+
+/**
+   @brief Finds or adds a record name. Thread safe.
+   @return Index in names.
+**/
+static int lookupName(const char *s, size_t len)
+{
+   int i, n = __atomic_load_n(&numNames, __ATOMIC_ACQUIRE);
+   if (len >= NAME_LEN)
+      len = NAME_LEN - 1;
+   for (i = 0; i < n; i++)
+      if (strncmp(names[i], s, len) == 0 && names[i][len] == '\0')
+         return i;
+   #pragma omp critical(names)
+   {
+      n = numNames;
+      for (i = 0; i < n; i++)
+         if (strncmp(names[i], s, len) == 0 && names[i][len] == '\0')
+            break;
+      if (i == n && n < MAX_NAMES)
+      {
+         memcpy(names[i], s, len);
+         names[i][len] = '\0';
+         nameKind[i] = REC_OTHER;
+         nameFamily[i] = FAM_NONE;
+         __atomic_store_n(&numNames, n + 1, __ATOMIC_RELEASE);
+      }
+      else if (i == n)
+         i = MAX_NAMES - 1; // everything else is lumped into the last name
+   }
+   return i;
+}
+
+/**
+   @brief Parses one line of the text trace format:
+          name address thread time1 time2 [more columns]
+   @return 0 on success, -1 if it is not a record.
+**/
+static int parseLine(const char *line, const char *end, Record *r)
+{
+   const char *name;
+   char *next;
+   long thread;
+   while (line < end && *line == ' ')
+      line++;
+   name = line;
+   while (line < end && *line != ' ')
+      line++;
+   if (line == name || line >= end)
+      return -1;
+   r->name = lookupName(name, line - name);
+   r->addr = strtoull(line, &next, 16);
+   if (next == line) // "(nil)"
+   {
+      while (line < end && *line == ' ')
+         line++;
+      while (line < end && *line != ' ')
+         line++;
+      next = (char*) line;
+   }
+   line = next;
+   thread = strtol(line, &next, 10);
+   if (next == line || thread < 0 || thread >= MAX_THREAD_ID)
+      return -1;
+   r->thread = thread;
+   line = next;
+   r->t1 = strtod(line, &next);
+   if (next == line)
+      return -1;
+   line = next;
+   r->t2 = strtod(line, &next);
+   if (next == line || next > end)
+      return -1;
+   return 0;
+}
+
+/**
+   @brief Parses the records of one piece and groups them by thread.
+**/
+static void parsePiece(const TraceFile *tf, const TracePiece *piece,
+                       char *buffer, PieceRecords *pr)
+{
+   const char *text = tracePieceText(tf, piece, buffer), *line, *end, *nl;
+   Record *recs, *sorted;
+   long max = piece->len / 40 + 16, t, i;
+   memset(pr, 0, sizeof(*pr));
+   if (text == NULL)
+   {
+      pr->corrupt = 1;
+      return;
+   }
+   recs = malloc(max * sizeof(Record));
+   for (line = text, end = text + piece->len; line < end; line = nl + 1)
+   {
+      nl = memchr(line, '\n', end - line);
+      if (nl == NULL)
+         nl = end;
+      if (pr->num == max)
+      {
+         max *= 2;
+         recs = realloc(recs, max * sizeof(Record));
+      }
+      if (parseLine(line, nl, &recs[pr->num]) != 0)
+      {
+         if (nl > line)
+            pr->skipped++;
+         continue;
+      }
+      if (recs[pr->num].thread > pr->maxThread)
+         pr->maxThread = recs[pr->num].thread;
+      pr->num++;
+   }
+   // counting sort by thread keeps the trace order of each thread
+   pr->start = calloc(pr->maxThread + 2, sizeof(long));
+   for (i = 0; i < pr->num; i++)
+      pr->start[recs[i].thread + 1]++;
+   for (t = 0; t <= pr->maxThread; t++)
+      pr->start[t + 1] += pr->start[t];
+   sorted = malloc((pr->num + 1) * sizeof(Record));
+   for (i = 0; i < pr->num; i++)
+      sorted[pr->start[recs[i].thread]++] = recs[i];
+   for (t = pr->maxThread + 1; t > 0; t--)
+      pr->start[t] = pr->start[t - 1];
+   pr->start[0] = 0;
+   free(recs);
+   pr->recs = sorted;
+}
+
+/**
+   @brief Finds or adds the site of a name and address.
+   @return Index of the site in table->sites.
+**/
+static long findSite(SiteTable *table, uint32_t name, uint64_t addr)
+{
+   uint64_t h;
+   long i, s;
+   if (2 * (table->num + 1) > table->numSlots)
+   {
+      // grow the slots, the sites themselves do not move
+      long n = table->numSlots ? 2 * table->numSlots : 256;
+      free(table->slots);
+      table->slots = calloc(n, sizeof(long));
+      table->numSlots = n;
+      for (s = 0; s < table->num; s++)
+      {
+         h = (table->sites[s].addr ^ ((uint64_t) table->sites[s].name << 56))
+             * 0x9e3779b97f4a7c15ULL;
+         for (i = (h >> 32) & (n - 1); table->slots[i] != 0; i = (i + 1) & (n - 1))
+            ;
+         table->slots[i] = s + 1;
+      }
+   }
+   h = (addr ^ ((uint64_t) name << 56)) * 0x9e3779b97f4a7c15ULL;
+   for (i = (h >> 32) & (table->numSlots - 1); table->slots[i] != 0;
+        i = (i + 1) & (table->numSlots - 1))
+   {
+      SiteStats *site = &table->sites[table->slots[i] - 1];
+      if (site->addr == addr && site->name == name)
+         return table->slots[i] - 1;
+   }
+   if (table->num == table->max)
+   {
+      table->max = table->max ? 2 * table->max : 64;
+      table->sites = realloc(table->sites, table->max * sizeof(SiteStats));
+   }
+   memset(&table->sites[table->num], 0, sizeof(SiteStats));
+   table->sites[table->num].addr = addr;
+   table->sites[table->num].name = name;
+   table->slots[i] = table->num + 1;
+   return table->num++;
+}
+
+/**
+   @brief Records the time of a parallel region started by the thread.
+**/
+static void addRegion(ThreadState *ts, double start, double end)
+{
+   if (ts->numRegions == ts->maxRegions)
+   {
+      ts->maxRegions = ts->maxRegions ? 2 * ts->maxRegions : 64;
+      ts->regions = realloc(ts->regions, 2 * ts->maxRegions * sizeof(double));
+   }
+   ts->regions[2 * ts->numRegions] = start;
+   ts->regions[2 * ts->numRegions++ + 1] = end;
+}
+
+/**
+   @brief Adds one record to the state of its thread: pairs releases with
+          the acquisitions they end and accumulates the site statistics.
+**/
+static void processRecord(ThreadState *ts, const Record *r)
+{
+   double t = r->t2 - r->t1;
+   int family = nameFamily[r->name], held = family == FAM_LOCK || family == FAM_NEST;
+   SiteStats *site;
+   long s;
+   if (t < 0)
+      t = 0;
+   if (nameKind[r->name] == REC_PGOMP)
+   {
+      // PGOMP_omitted has the event count and time in its time columns,
+      // PGOMP_tail the site's average and threshold, the level changes the
+      // time of the change in both
+      s = findSite(&ts->sites, r->name, r->addr);
+      site = &ts->sites.sites[s];
+      site->count += strcmp(names[r->name], "PGOMP_omitted") == 0 ? (long) r->t1 : 1;
+      site->wait += strcmp(names[r->name], "PGOMP_omitted") == 0 ? r->t2 : r->t1;
+      site->hold += r->t2;
+      return;
+   }
+   if (ts->events++ == 0 || r->t1 < ts->first)
+      ts->first = r->t1;
+   if (r->t2 > ts->last)
+      ts->last = r->t2;
+   if (nameKind[r->name] == REC_CPU)
+   {
+      ts->cpuRecords++;
+      ts->cpu = r->addr;
+      return;
+   }
+   // the region records cover the master's body and join, which its
+   // wake and join records have
+   if (pathFlag && family != FAM_PARALLEL)
+   {
+      if (ts->numKept == ts->maxKept)
+      {
+         ts->maxKept = ts->maxKept ? 2 * ts->maxKept : 1024;
+         ts->kept = realloc(ts->kept, ts->maxKept * sizeof(Record));
+      }
+      ts->kept[ts->numKept++] = *r;
+   }
+   if (nameKind[r->name] == REC_RELEASE)
+   {
+      OpenAcquire *open;
+      if (family != FAM_PARALLEL) // the master's join wait covers it
+         ts->time[CAT_RUNTIME] += t;
+      if (ts->depth[family] == 0)
+      {
+         ts->unmatched++;
+         return;
+      }
+      open = &ts->open[family][--ts->depth[family]];
+      site = &ts->sites.sites[open->site];
+      t = r->t1 - open->acquired;
+      if (t < 0)
+         t = 0;
+      site->holds++;
+      site->hold += t;
+      if (t > site->holdMax)
+         site->holdMax = t;
+      if (family != FAM_PARALLEL)
+         ts->time[held ? CAT_LOCK_HELD : CAT_CRITICAL_HELD] += t;
+      else
+         addRegion(ts, open->started, r->t2);
+      return;
+   }
+   s = findSite(&ts->sites, r->name, r->addr);
+   site = &ts->sites.sites[s];
+   site->count++;
+   if (nameKind[r->name] == REC_REGION)
+   {
+      // the whole region in one record, the master's work included
+      site->holds++;
+      site->hold += t;
+      if (t > site->holdMax)
+         site->holdMax = t;
+      addRegion(ts, r->t1, r->t2);
+      return;
+   }
+   site->wait += t;
+   if (t > site->waitMax)
+      site->waitMax = t;
+   switch (nameKind[r->name])
+   {
+   case REC_BARRIER:
+      ts->time[CAT_BARRIER] += t;
+      if (site->numArrivals == site->maxArrivals)
+      {
+         site->maxArrivals = site->maxArrivals ? 2 * site->maxArrivals : 64;
+         site->arrivals = realloc(site->arrivals, site->maxArrivals * sizeof(double));
+      }
+      site->arrivals[site->numArrivals++] = r->t1;
+      break;
+   case REC_ACQUIRE:
+      if (t > CONTENDED)
+         site->contended++;
+      if (family != FAM_PARALLEL)
+         ts->time[held ? CAT_LOCK : CAT_CRITICAL] += t;
+      if (ts->depth[family] < MAX_DEPTH)
+      {
+         ts->open[family][ts->depth[family]].site = s;
+         ts->open[family][ts->depth[family]].started = r->t1;
+         ts->open[family][ts->depth[family]++].acquired = r->t2;
+      }
+      break;
+   case REC_WAKE:
+      ts->time[CAT_FORK_JOIN] += t;
+      ts->teamRegions++;
+      ts->wake += t;
+      if (t > ts->wakeMax)
+         ts->wakeMax = t;
+      ts->entered = r->t2;
+      break;
+   case REC_JOIN:
+      // the body ran from the end of the wake record to the join record
+      if (ts->entered > 0 && r->t1 >= ts->entered)
+         ts->work += r->t1 - ts->entered;
+      ts->entered = 0;
+      ts->time[CAT_FORK_JOIN] += t;
+      ts->join += t;
+      if (t > ts->joinMax)
+         ts->joinMax = t;
+      break;
+   default:
+      ts->time[CAT_RUNTIME] += t;
+   }
+}
+
+/**
+   @brief Adds the sites of every thread into one table.
+**/
+static void mergeSites(ThreadState *threads, long numThreads, SiteTable *all)
+{
+   long t, i, s;
+   for (t = 0; t < numThreads; t++)
+   {
+      for (i = 0; i < threads[t].sites.num; i++)
+      {
+         const SiteStats *from = &threads[t].sites.sites[i];
+         SiteStats *to;
+         s = findSite(all, from->name, from->addr);
+         to = &all->sites[s];
+         to->count += from->count;
+         to->contended += from->contended;
+         to->wait += from->wait;
+         to->holds += from->holds;
+         to->hold += from->hold;
+         if (from->waitMax > to->waitMax)
+            to->waitMax = from->waitMax;
+         if (from->holdMax > to->holdMax)
+            to->holdMax = from->holdMax;
+         if (from->numArrivals > 0)
+         {
+            to->threadArrivals = realloc(to->threadArrivals,
+                                         (to->threads + 1) * sizeof(double*));
+            to->threadNumArrivals = realloc(to->threadNumArrivals,
+                                            (to->threads + 1) * sizeof(long));
+            to->threadArrivals[to->threads] = from->arrivals;
+            to->threadNumArrivals[to->threads] = from->numArrivals;
+         }
+         to->threads++;
+      }
+   }
+}
+
+static int compareWait(const void *a, const void *b)
+{
+   const SiteStats *x = *(SiteStats* const*) a, *y = *(SiteStats* const*) b;
+   return x->wait < y->wait ? 1 : (x->wait > y->wait ? -1 : 0);
+}
+
+static int compareWaitHold(const void *a, const void *b)
+{
+   const SiteStats *x = *(SiteStats* const*) a, *y = *(SiteStats* const*) b;
+   double cx = x->wait + x->hold, cy = y->wait + y->hold;
+   return cx < cy ? 1 : (cx > cy ? -1 : 0);
+}
+
+/**
+   Load imbalance at one barrier site
+**/
+typedef struct
+{
+/*@{*/
+   const SiteStats *site;
+   long episodes; /**< Times the team met at the barrier */
+   double total, max; /**< Last minus first arrival, summed and largest */
+/*@}*/
+} Imbalance;
+
+static int compareImbalance(const void *a, const void *b)
+{
+   const Imbalance *x = a, *y = b;
+   return x->total < y->total ? 1 : (x->total > y->total ? -1 : 0);
+}
+
+/**
+   @brief Measures the imbalance at a barrier: the k-th arrival of every
+          thread at the site is one episode, its imbalance is the time
+          between the first and the last thread arriving.
+**/
+static void barrierImbalance(const SiteStats *site, Imbalance *im)
+{
+   long k, maxEpisodes = 0;
+   int t;
+   im->site = site;
+   im->episodes = 0;
+   im->total = im->max = 0.0;
+   for (t = 0; t < site->threads; t++)
+      if (site->threadNumArrivals[t] > maxEpisodes)
+         maxEpisodes = site->threadNumArrivals[t];
+   for (k = 0; k < maxEpisodes; k++)
+   {
+      double first = 0.0, last = 0.0, d;
+      int n = 0;
+      for (t = 0; t < site->threads; t++)
+      {
+         double a;
+         if (k >= site->threadNumArrivals[t])
+            continue;
+         a = site->threadArrivals[t][k];
+         if (n++ == 0 || a < first)
+            first = a;
+         if (n == 1 || a > last)
+            last = a;
+      }
+      if (n < 2)
+         continue;
+      d = last - first;
+      im->episodes++;
+      im->total += d;
+      if (d > im->max)
+         im->max = d;
+   }
+}
+
+static int compareStart(const void *a, const void *b)
+{
+   const double *x = a, *y = b;
+   return x[0] < y[0] ? -1 : (x[0] > y[0] ? 1 : 0);
+}
+
+/**
+   @brief Prints the time spent outside and inside parallel regions and
+          what Amdahl's law predicts for other thread counts, assuming the
+          parallel time scales perfectly with the threads. Regions nested
+          in others (overlapping in time) count once.
+**/
+static void printSerial(ThreadState *threads, long numThreads)
+{
+   double *all, first = 0.0, last = 0.0, parallel = 0.0, end = 0.0;
+   double serial, work, fraction, t;
+   long i, n = 0, outer = 0, team = 0;
+   int m, maxThreads = 8;
+   for (i = 0; i < numThreads; i++)
+   {
+      if (threads[i].events == 0)
+         continue;
+      if (team++ == 0 || threads[i].first < first)
+         first = threads[i].first;
+      if (threads[i].last > last)
+         last = threads[i].last;
+      n += threads[i].numRegions;
+   }
+   if (n == 0)
+      return;
+   all = malloc(2 * n * sizeof(double));
+   for (i = n = 0; i < numThreads; i++)
+   {
+      memcpy(all + 2 * n, threads[i].regions, 2 * threads[i].numRegions * sizeof(double));
+      n += threads[i].numRegions;
+   }
+   qsort(all, n, 2 * sizeof(double), compareStart);
+   for (i = 0; i < n; i++)
+   {
+      if (outer == 0 || all[2 * i] > end)
+      {
+         outer++;
+         parallel += all[2 * i + 1] - all[2 * i];
+         end = all[2 * i + 1];
+      }
+      else if (all[2 * i + 1] > end)
+      {
+         parallel += all[2 * i + 1] - end;
+         end = all[2 * i + 1];
+      }
+   }
+   free(all);
+   serial = last - first - parallel;
+   if (serial < 0)
+      serial = 0;
+   work = serial + team * parallel;
+   fraction = work > 0 ? serial / work : 1.0;
+   while (maxThreads < 4 * team)
+      maxThreads *= 2;
+   printf("\nSerial and parallel time (trace span %.6f s)\n\n", last - first);
+   printf("serial %.6f s, parallel %.6f s in %ld regions with %ld threads\n",
+          serial, parallel, outer, team);
+   if (fraction > 0)
+      printf("serial fraction %.6f, speedup ceiling %.3f\n\n", fraction, 1 / fraction);
+   else
+      printf("serial fraction 0, no speedup ceiling\n\n");
+   printf("%8s %12s %10s\n", "threads", "time(s)", "speedup");
+   for (m = 1; m <= maxThreads; m *= 2)
+   {
+      t = serial + team * parallel / m;
+      printf("%8d %12.6f %10.3f\n", m, t, t > 0 ? work / t : 0.0);
+   }
+}
+
+/**
+   @brief Prints how every thread spent the parallel regions it ran in:
+          waking up after the region started, working in the body and
+          waiting for the rest of the team to finish.
+**/
+static void printTeam(ThreadState *threads, long numThreads)
+{
+   long i;
+   for (i = 0; i < numThreads; i++)
+      if (threads[i].teamRegions > 0)
+         break;
+   if (i == numThreads)
+      return;
+   printf("\nParallel region team members (wake-up latency, work, join wait)\n\n");
+   printf("%6s %9s %12s %10s %10s %12s %12s %10s %10s\n", "thread", "regions",
+          "wake(s)", "mean(us)", "max(us)", "work(s)", "join(s)", "mean(us)",
+          "max(us)");
+   for (i = 0; i < numThreads; i++)
+   {
+      const ThreadState *ts = &threads[i];
+      long n = ts->teamRegions;
+      if (n == 0)
+         continue;
+      printf("%6ld %9ld %12.6f %10.3f %10.3f %12.6f %12.6f %10.3f %10.3f\n", i, n,
+             ts->wake, ts->wake / n * 1e6, ts->wakeMax * 1e6, ts->work,
+             ts->join, ts->join / n * 1e6, ts->joinMax * 1e6);
+   }
+}
+
+/**
+   @brief Prints the CPU every thread ran on last and how often it moved
+          to another CPU, from the PGOMP_cpu records (PGOMP_CPU=true).
+**/
+static void printCpus(ThreadState *threads, long numThreads)
+{
+   long i;
+   for (i = 0; i < numThreads; i++)
+      if (threads[i].cpuRecords > 0)
+         break;
+   if (i == numThreads)
+      return;
+   printf("\nCPU migrations\n\n");
+   printf("%6s %8s %11s\n", "thread", "last cpu", "migrations");
+   for (i = 0; i < numThreads; i++)
+      if (threads[i].cpuRecords > 0)
+         printf("%6ld %8lu %11ld\n", i, (unsigned long) threads[i].cpu,
+                threads[i].cpuRecords - 1);
+}
+
+/**
+   @brief Prints the sites the trace governor (PGOMP_TRACE_BUDGET) sampled
+          or stopped tracing, when, and how many of their events are not in
+          the trace. The statistics of these sites above only cover the
+          events that were traced.
+**/
+static void printGovernor(SiteTable *all)
+{
+   long i, j, n = 0;
+   for (i = 0; i < all->num; i++)
+   {
+      const SiteStats *site = &all->sites[i];
+      double sampled = 0, untraced = 0, omittedTime = 0;
+      long omitted = 0;
+      if (strcmp(names[site->name], "PGOMP_sampled") != 0)
+         continue;
+      for (j = 0; j < all->num; j++)
+      {
+         if (all->sites[j].addr != site->addr)
+            continue;
+         if (strcmp(names[all->sites[j].name], "PGOMP_untraced") == 0)
+            untraced = all->sites[j].wait;
+         else if (strcmp(names[all->sites[j].name], "PGOMP_omitted") == 0)
+         {
+            omitted = all->sites[j].count;
+            omittedTime = all->sites[j].wait;
+         }
+      }
+      sampled = site->wait;
+      if (n++ == 0)
+      {
+         printf("\nSites the trace governor thinned (statistics above cover "
+                "traced events only)\n\n");
+         printf("%-18s %18s %18s %10s %12s\n", "site", "sampled at",
+                "untraced at", "omitted", "omitted(s)");
+      }
+      printf("0x%-16lx %18.6f ", (unsigned long) site->addr, sampled);
+      if (untraced > 0)
+         printf("%18.6f", untraced);
+      else
+         printf("%18s", "-");
+      printf(" %10ld %12.6f\n", omitted, omittedTime);
+   }
+}
+
+/**
+   @brief Prints the sites with outliers in a tail mode trace
+          (PGOMP_MODE=tail): how many, and the average and threshold of the
+          site when they happened. The statistics above only cover the
+          outliers and the events before them.
+**/
+static void printTail(SiteTable *all)
+{
+   long i, n = 0;
+   for (i = 0; i < all->num; i++)
+   {
+      const SiteStats *site = &all->sites[i];
+      if (strcmp(names[site->name], "PGOMP_tail") != 0)
+         continue;
+      if (n++ == 0)
+      {
+         printf("\nTail outliers (statistics above cover outliers and their "
+                "context only)\n\n");
+         printf("%-18s %10s %12s %14s\n", "site", "outliers", "mean(us)",
+                "threshold(us)");
+      }
+      printf("0x%-16lx %10ld %12.3f %14.3f\n", (unsigned long) site->addr,
+             site->count, site->wait / site->count * 1e6,
+             site->hold / site->count * 1e6);
+   }
+}
+
+static int compareKept(const void *a, const void *b)
+{
+   const Record *x = a, *y = b;
+   if (x->t1 != y->t1)
+      return x->t1 < y->t1 ? -1 : 1;
+   return (x->t2 > y->t2) - (x->t2 < y->t2);
+}
+
+/**
+   @brief Puts the records of a thread on its timeline, in time order: the
+          site of the code before every record (the innermost lock held, or
+          the region body), acquisitions paired with their releases, and
+          barriers numbered within the body of their region.
+**/
+static PathRecord* buildTimeline(ThreadState *ts, SiteTable *all)
+{
+   struct { int family; long site, index, barriers; uint64_t addr; double fork; }
+      open[MAX_DEPTH];
+   PathRecord *tl = malloc((ts->numKept + 1) * sizeof(PathRecord));
+   int depth = 0, d;
+   long i;
+   qsort(ts->kept, ts->numKept, sizeof(Record), compareKept);
+   for (i = 0; i < ts->numKept; i++)
+   {
+      const Record *r = &ts->kept[i];
+      PathRecord *p = &tl[i];
+      int kind = nameKind[r->name], family = nameFamily[r->name];
+      p->t1 = r->t1;
+      p->t2 = r->t2 > r->t1 ? r->t2 : r->t1;
+      p->kind = kind;
+      p->site = kind == REC_RELEASE ? -1 : findSite(all, r->name, r->addr);
+      p->ctx = depth > 0 ? open[depth-1].site : -1;
+      p->held = depth > 0 && open[depth-1].family != FAM_NONE;
+      p->group = r->addr;
+      p->fork = 0.0;
+      p->k = -1;
+      p->from = -1;
+      p->fromThread = 0;
+      switch (kind)
+      {
+      case REC_ACQUIRE:
+         // unnamed critical sections are one lock, and atomics
+         p->group = (family == FAM_CRITICAL || family == FAM_ATOMIC ? 0 : r->addr) << 3
+                    | family;
+         if (depth < MAX_DEPTH)
+         {
+            open[depth].family = family;
+            open[depth].site = p->site;
+            open[depth++].index = i;
+         }
+         break;
+      case REC_RELEASE:
+         for (d = depth - 1; d >= 0 && open[d].family != family; d--)
+            ;
+         if (d < 0)
+            break;
+         p->site = open[d].site;
+         tl[open[d].index].k = i;
+         memmove(&open[d], &open[d+1], (--depth - d) * sizeof(open[0]));
+         break;
+      case REC_BARRIER:
+         for (d = depth - 1; d >= 0 && open[d].family != FAM_NONE; d--)
+            ;
+         if (d < 0)
+            break;
+         p->group = open[d].addr;
+         p->fork = open[d].fork;
+         p->k = open[d].barriers++;
+         break;
+      case REC_WAKE:
+         if (depth < MAX_DEPTH)
+         {
+            open[depth].family = FAM_NONE;
+            open[depth].site = p->site;
+            open[depth].index = i;
+            open[depth].barriers = 0;
+            open[depth].addr = r->addr;
+            open[depth++].fork = r->t1;
+         }
+         p->fork = r->t1;
+         break;
+      case REC_JOIN:
+         for (d = depth - 1; d >= 0 && (open[d].family != FAM_NONE
+                                        || open[d].addr != r->addr); d--)
+            ;
+         if (d < 0)
+            break;
+         p->fork = open[d].fork;
+         p->k = open[d].index;
+         memmove(&open[d], &open[d+1], (--depth - d) * sizeof(open[0]));
+         break;
+      }
+   }
+   return tl;
+}
+
+static int compareEdges(const void *a, const void *b)
+{
+   const PathEdge *x = a, *y = b;
+   if (x->fork != y->fork)
+      return x->fork < y->fork ? -1 : 1;
+   if (x->group != y->group)
+      return x->group < y->group ? -1 : 1;
+   if (x->k != y->k)
+      return x->k < y->k ? -1 : 1;
+   if (x->time != y->time)
+      return x->time < y->time ? -1 : 1;
+   return (x->thread > y->thread) - (x->thread < y->thread);
+}
+
+/**
+   @brief Adds an edge to a growing array.
+**/
+static PathEdge* addEdge(PathEdge *edges, long *num, long *max, const PathEdge *e)
+{
+   if (*num == *max)
+   {
+      *max = *max ? 2 * *max : 1024;
+      edges = realloc(edges, *max * sizeof(PathEdge));
+   }
+   edges[(*num)++] = *e;
+   return edges;
+}
+
+/**
+   @brief Links the waits on the timelines to the records that ended them:
+          an acquisition called before the previous holder released the lock
+          to that release, a barrier to the last thread arriving, a team
+          member's start to the fork on the master (thread 0 of the team)
+          and the master's join to the last member to finish.
+**/
+static void linkTimelines(PathRecord **tl, ThreadState *threads, long numThreads)
+{
+   PathEdge *locks = NULL, *barriers = NULL, *members = NULL, e;
+   long numLocks = 0, maxLocks = 0, numBarriers = 0, maxBarriers = 0,
+        numMembers = 0, maxMembers = 0, t, i, j, g;
+   for (t = 0; t < numThreads; t++)
+      for (i = 0; i < threads[t].numKept; i++)
+      {
+         const PathRecord *p = &tl[t][i];
+         e.group = p->group;
+         e.fork = p->fork;
+         e.thread = t;
+         e.index = i;
+         if (p->kind == REC_ACQUIRE && p->k >= 0)
+         {
+            // by lock and acquisition time
+            e.fork = 0.0;
+            e.k = 0;
+            e.time = p->t2;
+            e.end = p->t1;
+            e.other = p->k;
+            locks = addEdge(locks, &numLocks, &maxLocks, &e);
+         }
+         else if (p->kind == REC_BARRIER && p->k >= 0)
+         {
+            e.k = p->k;
+            e.time = p->t1;
+            barriers = addEdge(barriers, &numBarriers, &maxBarriers, &e);
+         }
+         else if (p->kind == REC_JOIN && p->k >= 0)
+         {
+            e.k = 0;
+            e.time = t; // by thread number, the master first
+            e.index = p->k;
+            e.other = i;
+            e.end = p->t1;
+            members = addEdge(members, &numMembers, &maxMembers, &e);
+         }
+      }
+
+   // the holders of a lock in turn
+   qsort(locks, numLocks, sizeof(PathEdge), compareEdges);
+   for (i = 1; i < numLocks; i++)
+   {
+      const PathEdge *prev = &locks[i-1], *cur = &locks[i];
+      double release = tl[prev->thread][prev->other].t1; // the call
+      if (prev->group == cur->group && release > cur->end && release <= cur->time)
+      {
+         tl[cur->thread][cur->index].from = prev->other;
+         tl[cur->thread][cur->index].fromThread = prev->thread;
+      }
+   }
+
+   qsort(barriers, numBarriers, sizeof(PathEdge), compareEdges);
+   for (i = 0; i < numBarriers; i = j)
+   {
+      for (j = i; j < numBarriers && barriers[j].fork == barriers[i].fork
+                  && barriers[j].group == barriers[i].group
+                  && barriers[j].k == barriers[i].k; j++)
+         ;
+      for (g = i; g < j - 1; g++)
+         if (barriers[j-1].time > barriers[g].time)
+         {
+            tl[barriers[g].thread][barriers[g].index].from = barriers[j-1].index;
+            tl[barriers[g].thread][barriers[g].index].fromThread = barriers[j-1].thread;
+         }
+   }
+
+   qsort(members, numMembers, sizeof(PathEdge), compareEdges);
+   for (i = 0; i < numMembers; i = j)
+   {
+      long last = i;
+      for (j = i; j < numMembers && members[j].fork == members[i].fork
+                  && members[j].group == members[i].group; j++)
+      {
+         if (members[j].end > members[last].end)
+            last = j;
+         if (j > i)
+         {
+            tl[members[j].thread][members[j].index].from = members[i].index;
+            tl[members[j].thread][members[j].index].fromThread = members[i].thread;
+         }
+      }
+      if (last != i)
+      {
+         tl[members[i].thread][members[i].other].from = members[last].other;
+         tl[members[i].thread][members[i].other].fromThread = members[last].thread;
+      }
+   }
+   free(locks);
+   free(barriers);
+   free(members);
+}
+
+static int comparePath(const void *a, const void *b)
+{
+   const double *x = *(const double* const*) a, *y = *(const double* const*) b;
+   double cx = x[PATH_WORK] + x[PATH_HELD] + x[PATH_SYNC];
+   double cy = y[PATH_WORK] + y[PATH_HELD] + y[PATH_SYNC];
+   return cx < cy ? 1 : (cx > cy ? -1 : 0);
+}
+
+/**
+   @brief Extracts the critical path of the run and prints what is on it.
+
+   Walks back from the end of the trace along the timeline of one thread.
+   Code between records counts for the lock held or the region body it
+   runs in, the time in a call for its site. A wait that another thread
+   ended (see linkTimelines()) counts for its site from the time that
+   thread made the call that ended it, and the walk goes on on that thread
+   from there. Every moment of the run is on the path once: the sites are
+   ranked by how much the run would get shorter if they took no time.
+**/
+static void printPath(ThreadState *threads, long numThreads, SiteTable *all, int top)
+{
+   PathRecord **tl = calloc(numThreads + 1, sizeof(PathRecord*));
+   double (*path)[NUM_PATH] = calloc(all->num + 1, sizeof(*path));
+   double **order = malloc((all->num + 1) * sizeof(double*));
+   double first = 0.0, end = 0.0, serial = 0.0, tau, construct[NUM_CATS + 2] = { 0.0 };
+   long t, x, i, n, steps = 0, maxSteps = 0, jumps = 0;
+   static const char *constructs[NUM_CATS + 2] = { "barrier", "lock", "critical",
+                                                   "lock-held", "crit-held", "runtime",
+                                                   "fork-join", "work", "serial" };
+   int c, found = 0;
+   #pragma omp parallel for schedule(dynamic)
+   for (t = 0; t < numThreads; t++)
+      tl[t] = buildTimeline(&threads[t], all);
+   linkTimelines(tl, threads, numThreads);
+
+   // the walk starts at the thread that ended last
+   for (t = 0, x = -1; t < numThreads; t++)
+   {
+      long num = threads[t].numKept;
+      maxSteps += 2 * num + 1;
+      if (num == 0)
+         continue;
+      if (!found || tl[t][0].t1 < first)
+         first = tl[t][0].t1;
+      for (i = 0; i < num; i++)
+         if (!found || tl[t][i].t2 > end)
+         {
+            end = tl[t][i].t2;
+            x = t;
+            found = 1;
+         }
+   }
+   if (!found)
+   {
+      printf("\nCritical path: no records\n");
+      goto done;
+   }
+   t = x;
+   x = threads[t].numKept;
+   tau = end;
+   while (x > 0 && steps++ < maxSteps)
+   {
+      const PathRecord *r = &tl[t][x-1];
+      long ctx = x < threads[t].numKept ? tl[t][x].ctx : -1;
+      int held = x < threads[t].numKept && tl[t][x].held;
+      if (tau > r->t2)
+      {
+         if (ctx < 0)
+            serial += tau - r->t2;
+         else
+            path[ctx][held ? PATH_HELD : PATH_WORK] += tau - r->t2;
+         tau = r->t2;
+      }
+      if (r->from >= 0)
+      {
+         const PathRecord *d = &tl[r->fromThread][r->from];
+         if (d->t1 >= r->t1 && d->t1 <= tau)
+         {
+            if (r->site >= 0)
+               path[r->site][PATH_SYNC] += tau - d->t1;
+            else
+               serial += tau - d->t1;
+            t = r->fromThread;
+            x = r->from;
+            tau = d->t1;
+            jumps++;
+            continue;
+         }
+      }
+      if (tau > r->t1)
+      {
+         if (r->site >= 0)
+            path[r->site][PATH_SYNC] += tau - r->t1;
+         else
+            serial += tau - r->t1;
+         tau = r->t1;
+      }
+      x--;
+   }
+   if (x > 0)
+      fprintf(stderr,"pgomp-report: warning: the critical path walk did not end, "
+                     "the trace is inconsistent\n");
+   serial += tau - first;
+
+   for (i = n = 0; i < all->num; i++)
+   {
+      const SiteStats *site = &all->sites[i];
+      int kind = nameKind[site->name], family = nameFamily[site->name];
+      int lock = family == FAM_LOCK || family == FAM_NEST;
+      construct[NUM_CATS] += path[i][PATH_WORK];
+      construct[lock ? CAT_LOCK_HELD : CAT_CRITICAL_HELD] += path[i][PATH_HELD];
+      c = kind == REC_BARRIER ? CAT_BARRIER
+          : kind == REC_ACQUIRE ? (lock ? CAT_LOCK : CAT_CRITICAL)
+          : kind == REC_WAKE || kind == REC_JOIN ? CAT_FORK_JOIN : CAT_RUNTIME;
+      construct[c] += path[i][PATH_SYNC];
+      if (path[i][PATH_WORK] + path[i][PATH_HELD] + path[i][PATH_SYNC] > 0)
+         order[n++] = path[i];
+   }
+   construct[NUM_CATS + 1] = serial;
+   printf("\nCritical path (%.6f s, crossing threads %ld times), by construct\n\n",
+          end - first, jumps);
+   printf("%-10s %12s %7s\n", "construct", "time(s)", "path");
+   for (c = 0; c < NUM_CATS + 2; c++)
+      printf("%-10s %12.6f %6.1f%%\n", constructs[c], construct[c],
+             end > first ? 100 * construct[c] / (end - first) : 0.0);
+
+   qsort(order, n, sizeof(double*), comparePath);
+   printf("\nTop %d sites by critical path time (work: code in the region body, "
+          "held: code holding the lock)\n\n", top);
+   printf("%-26s %-18s %12s %7s %12s %12s %12s %12s\n", "function", "site", "path(s)",
+          "path", "work(s)", "held(s)", "in call(s)", "wait(s)");
+   for (i = 0; i < n && i < top; i++)
+   {
+      const SiteStats *site = &all->sites[(double (*)[NUM_PATH]) order[i] - path];
+      double sum = order[i][PATH_WORK] + order[i][PATH_HELD] + order[i][PATH_SYNC];
+      printf("%-26s 0x%-16lx %12.6f %6.1f%% %12.6f %12.6f %12.6f %12.6f\n",
+             names[site->name], (unsigned long) site->addr, sum,
+             end > first ? 100 * sum / (end - first) : 0.0, order[i][PATH_WORK],
+             order[i][PATH_HELD], order[i][PATH_SYNC], site->wait);
+   }
+done:
+   for (t = 0; t < numThreads; t++)
+      free(tl[t]);
+   free(tl);
+   free(path);
+   free(order);
+}
+
+static void printReport(ThreadState *threads, long numThreads, SiteTable *all,
+                        int top)
+{
+   SiteStats **order = malloc((all->num + 1) * sizeof(SiteStats*));
+   Imbalance *imbalance = malloc((all->num + 1) * sizeof(Imbalance));
+   long i, n, numBarriers = 0;
+   static const char *catNames[NUM_CATS] = { "barrier", "lock", "critical",
+                                             "lock-held", "crit-held", "runtime",
+                                             "fork-join" };
+   int c;
+
+   for (i = n = 0; i < all->num; i++)
+      if (nameKind[all->sites[i].name] != REC_PGOMP)
+         order[n++] = &all->sites[i];
+   qsort(order, n, sizeof(SiteStats*), compareWait);
+   printf("Top %d sites by waiting time\n\n", top);
+   printf("%-26s %-18s %10s %7s %12s %12s %12s\n", "function", "site", "count",
+          "threads", "wait(s)", "mean(us)", "max(us)");
+   for (i = 0; i < n && i < top; i++)
+      printf("%-26s 0x%-16lx %10ld %7d %12.6f %12.3f %12.3f\n", names[order[i]->name],
+             (unsigned long) order[i]->addr, order[i]->count, order[i]->threads,
+             order[i]->wait, order[i]->wait / order[i]->count * 1e6,
+             order[i]->waitMax * 1e6);
+
+   printf("\nPer-thread time breakdown (seconds, %% of the thread's span)\n\n");
+   printf("%6s %10s %12s", "thread", "events", "span");
+   for (c = 0; c < NUM_CATS; c++)
+      printf(" %18s", catNames[c]);
+   printf(" %18s\n", "other");
+   for (i = 0; i < numThreads; i++)
+   {
+      double span = threads[i].last - threads[i].first, other = span;
+      if (threads[i].events == 0)
+         continue;
+      printf("%6ld %10ld %12.6f", i, threads[i].events, span);
+      for (c = 0; c < NUM_CATS; c++)
+      {
+         other -= threads[i].time[c];
+         printf(" %11.6f %5.1f%%", threads[i].time[c],
+                span > 0 ? 100 * threads[i].time[c] / span : 0.0);
+      }
+      printf(" %11.6f %5.1f%%\n", other > 0 ? other : 0.0,
+             span > 0 && other > 0 ? 100 * other / span : 0.0);
+   }
+
+   for (i = n = 0; i < all->num; i++)
+   {
+      int family = nameFamily[all->sites[i].name];
+      if (nameKind[all->sites[i].name] == REC_ACQUIRE && family != FAM_PARALLEL)
+         order[n++] = &all->sites[i];
+   }
+   qsort(order, n, sizeof(SiteStats*), compareWaitHold);
+   printf("\nTop %d locks and critical sections, by acquire site\n\n", top);
+   printf("%-26s %-18s %10s %9s %12s %10s %12s %10s\n", "function", "site",
+          "acquired", "contended", "wait(s)", "wmax(us)", "held(s)", "hmax(us)");
+   for (i = 0; i < n && i < top; i++)
+      printf("%-26s 0x%-16lx %10ld %8.1f%% %12.6f %10.3f %12.6f %10.3f\n",
+             names[order[i]->name], (unsigned long) order[i]->addr, order[i]->count,
+             100.0 * order[i]->contended / order[i]->count, order[i]->wait,
+             order[i]->waitMax * 1e6, order[i]->hold, order[i]->holdMax * 1e6);
+
+   for (i = 0; i < all->num; i++)
+      if (nameKind[all->sites[i].name] == REC_BARRIER)
+         order[numBarriers++] = &all->sites[i];
+   #pragma omp parallel for schedule(dynamic)
+   for (i = 0; i < numBarriers; i++)
+      barrierImbalance(order[i], &imbalance[i]);
+   qsort(imbalance, numBarriers, sizeof(Imbalance), compareImbalance);
+   printf("\nTop %d barriers by load imbalance (last minus first thread to arrive)\n\n",
+          top);
+   printf("%-18s %7s %9s %12s %12s %12s %12s\n", "site", "threads", "episodes",
+          "total(s)", "mean(us)", "max(us)", "wait(s)");
+   for (i = 0; i < numBarriers && i < top; i++)
+      printf("0x%-16lx %7d %9ld %12.6f %12.3f %12.3f %12.6f\n",
+             (unsigned long) imbalance[i].site->addr, imbalance[i].site->threads,
+             imbalance[i].episodes, imbalance[i].total,
+             imbalance[i].episodes ? imbalance[i].total / imbalance[i].episodes * 1e6 : 0.0,
+             imbalance[i].max * 1e6, imbalance[i].site->wait);
+
+   for (i = n = 0; i < all->num; i++)
+      if (nameFamily[all->sites[i].name] == FAM_PARALLEL)
+         order[n++] = &all->sites[i];
+   if (n > 0)
+   {
+      printf("\nParallel regions (master thread)\n\n");
+      printf("%-18s %10s %12s %12s %12s %12s\n", "site", "count", "time(s)",
+             "mean(us)", "max(us)", "fork(s)");
+      for (i = 0; i < n; i++)
+         printf("0x%-16lx %10ld %12.6f %12.3f %12.3f %12.6f\n",
+                (unsigned long) order[i]->addr, order[i]->count, order[i]->hold,
+                order[i]->holds ? order[i]->hold / order[i]->holds * 1e6 : 0.0,
+                order[i]->holdMax * 1e6, order[i]->wait);
+   }
+   printGovernor(all);
+   printTail(all);
+   printTeam(threads, numThreads);
+   printCpus(threads, numThreads);
+   printSerial(threads, numThreads);
+   if (pathFlag)
+      printPath(threads, numThreads, all, top);
+   free(order);
+   free(imbalance);
+}
+
+int main(int argc, char **argv)
+{
+   const char *fileName = OUTPUT_FILENAME;
+   TraceFile tf;
+   PieceRecords *batch;
+   ThreadState *threads = NULL;
+   SiteTable all;
+   long numThreads = 0, batchSize, b, i, t, records = 0, skipped = 0, unmatched = 0;
+   int opt, top = 20, corrupt = 0;
+   double start = omp_get_wtime();
+   while ((opt = getopt(argc, argv, "n:j:c")) != -1)
+   {
+      switch (opt)
+      {
+      case 'n':
+         top = atoi(optarg);
+         break;
+      case 'j':
+         omp_set_num_threads(atoi(optarg));
+         break;
+      case 'c':
+         pathFlag = 1;
+         break;
+      default:
+         fprintf(stderr,"usage: pgomp-report [-n top] [-j threads] [-c] [file]\n");
+         return 1;
+      }
+   }
+   if (optind < argc)
+      fileName = argv[optind];
+   if (traceOpen(&tf, fileName) != 0)
+      return 1;
+   for (i = 0; i < (long) (sizeof(knownNames) / sizeof(knownNames[0])); i++)
+   {
+      strcpy(names[i], knownNames[i].name);
+      nameKind[i] = knownNames[i].kind;
+      nameFamily[i] = knownNames[i].family;
+   }
+   numNames = i;
+   batchSize = 4 * omp_get_max_threads();
+   batch = malloc(batchSize * sizeof(PieceRecords));
+   for (b = 0; b < (long) tf.numPieces; b += batchSize)
+   {
+      long n = tf.numPieces - b < (unsigned long) batchSize ? tf.numPieces - b : batchSize;
+      long maxThread = -1;
+      #pragma omp parallel
+      {
+         char *buffer = tf.format == TRACE_COMPRESSED ? malloc(TRACE_CHUNK_SIZE) : NULL;
+         #pragma omp for schedule(dynamic)
+         for (i = 0; i < n; i++)
+            parsePiece(&tf, &tf.pieces[b + i], buffer, &batch[i]);
+         free(buffer);
+      }
+      for (i = 0; i < n; i++)
+      {
+         if (batch[i].corrupt)
+         {
+            fprintf(stderr,"pgomp-report: piece %ld of %s is corrupt\n", b + i,
+                    fileName);
+            corrupt = 1;
+            continue;
+         }
+         if (batch[i].num > 0 && (long) batch[i].maxThread > maxThread)
+            maxThread = batch[i].maxThread;
+         records += batch[i].num;
+         skipped += batch[i].skipped;
+      }
+      if (maxThread >= numThreads)
+      {
+         threads = realloc(threads, (maxThread + 1) * sizeof(ThreadState));
+         memset(&threads[numThreads], 0, (maxThread + 1 - numThreads) * sizeof(ThreadState));
+         numThreads = maxThread + 1;
+      }
+      #pragma omp parallel for schedule(dynamic) private(i)
+      for (t = 0; t < numThreads; t++)
+      {
+         for (i = 0; i < n; i++)
+         {
+            long r;
+            if (batch[i].corrupt || batch[i].num == 0 || t > batch[i].maxThread)
+               continue;
+            for (r = batch[i].start[t]; r < batch[i].start[t + 1]; r++)
+               processRecord(&threads[t], &batch[i].recs[r]);
+         }
+      }
+      for (i = 0; i < n; i++)
+      {
+         free(batch[i].recs);
+         free(batch[i].start);
+      }
+   }
+   memset(&all, 0, sizeof(all));
+   mergeSites(threads, numThreads, &all);
+   for (t = 0; t < numThreads; t++)
+      unmatched += threads[t].unmatched;
+   printf("PGOMP report: %s, %ld records, %ld threads, %lu pieces\n\n", fileName,
+          records, numThreads, tf.numPieces);
+   printReport(threads, numThreads, &all, top);
+   fprintf(stderr,"pgomp-report: read %ld records in %.3f s on %d threads\n",
+           records, omp_get_wtime() - start, omp_get_max_threads());
+   if (skipped > 0)
+      fprintf(stderr,"pgomp-report: warning: %ld lines are not trace records\n",
+              skipped);
+   if (unmatched > 0)
+      fprintf(stderr,"pgomp-report: warning: %ld releases without an acquisition\n",
+              unmatched);
+   if (tf.dropped > 0)
+      fprintf(stderr,"pgomp-report: warning: %lu chunks (records) were dropped "
+                     "while tracing, the trace is incomplete\n", tf.dropped);
+   traceClose(&tf);
+   return corrupt;
+}
@@ -0,0 +1,1132 @@
+/**
+   @file pgomp-sim.c
+   @brief Predicts the runtime of a traced program at other thread counts,
+          and with changes to its locks, by replaying its trace.
+
+    Reads a trace in any format (text, compressed or memory-mapped) and
+    rebuilds, for every member of every parallel region, the work it did
+    between synchronizations: compute, acquisitions of locks and critical
+    sections with the time they were held, and barriers. A discrete-event
+    simulation replays the regions with modeled lock and barrier costs at
+    other team sizes, and again with what-if changes:
+
+       pgomp-sim [-t threads,...] [-s site:factor] [-x site[:ways]] [file]
+
+    - t team sizes to predict (default: powers of two up to twice the
+      traced team, and the traced team).
+    - s multiplies the hold time of the acquisitions at an acquire site,
+      e.g. -s 0x401a2c:0.5 for a critical section shortened by half.
+    - x splits the lock acquired at a site: its acquisitions there go round
+      robin to the lock and ways-1 (default 1) new locks.
+    -s and -x may be given up to MAX_WHATIFS times each. The file defaults
+    to OUTPUT_FILENAME from config.h.
+
+    The work of a region is spread over a team of another size by giving
+    team member q of Q the share [q P/Q, (q+1) P/Q) of the P traced
+    members: the same fraction of each compute interval of a traced member
+    it overlaps, and the acquisitions that fall into its share, so the
+    total compute and hold time stay the same. The barriers of the region
+    stay where they were. Serial time (outside regions) does not change.
+
+    Costs come from the trace: an acquisition of a free lock costs its
+    mean wait, a lock handed to a waiter (called before the release) the
+    mean time from the release to its acquisition, a barrier the
+    mean time from the last arrival to the departures (growing with the
+    logarithm of the team size), starting a member the latency fitted
+    linearly over the member number (never below zero, and never falling
+    for later members), and the join its mean.
+
+    Locks are identified as in pgomp-report: by the site that acquires
+    them, except that all unnamed critical sections are one lock, and all
+    atomics. Nested acquisitions are part of the outermost hold, nested
+    regions are not replayed (their thread numbers overlap the outer team).
+**/
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <math.h>
+#include "config.h"
+#include "pgomp-read.h"
+
+#define MAX_THREAD_ID (1 << 20) /**< Larger thread ids are taken as corrupt lines */
+#define MAX_DEPTH 64 /**< Deepest nesting of acquisitions or regions per thread */
+#define MAX_TEAMS 64 /**< Team sizes predicted */
+#define MAX_WHATIFS 16 /**< -s and -x options */
+
+/** What a trace record is, for the replay */
+enum { REC_BARRIER, REC_ACQUIRE, REC_RELEASE, REC_WAKE, REC_JOIN, REC_PGOMP };
+
+/** Acquire and release records pair up within a family */
+enum { FAM_CRITICAL, FAM_NAMED, FAM_LOCK, FAM_NEST, FAM_ATOMIC, FAM_ORDERED,
+       FAM_NONE = -1 };
+
+static const struct
+{
+   const char *name;
+   int kind;
+   int family;
+} knownNames[] =
+{
+   { "GOMP_barrier", REC_BARRIER, FAM_NONE },
+   { "GOMP_sections_end", REC_BARRIER, FAM_NONE },
+   { "GOMP_loop_end", REC_BARRIER, FAM_NONE },
+   { "implicit_barrier", REC_BARRIER, FAM_NONE },
+   { "taskwait", REC_BARRIER, FAM_NONE },
+   { "taskgroup", REC_BARRIER, FAM_NONE },
+   { "reduction", REC_BARRIER, FAM_NONE },
+   { "GOMP_critical_start", REC_ACQUIRE, FAM_CRITICAL },
+   { "GOMP_critical_end", REC_RELEASE, FAM_CRITICAL },
+   { "GOMP_critical_name_start", REC_ACQUIRE, FAM_NAMED },
+   { "GOMP_critical_name_end", REC_RELEASE, FAM_NAMED },
+   { "GOMP_atomic_start", REC_ACQUIRE, FAM_ATOMIC },
+   { "GOMP_atomic_end", REC_RELEASE, FAM_ATOMIC },
+   { "GOMP_ordered_start", REC_ACQUIRE, FAM_ORDERED },
+   { "GOMP_ordered_end", REC_RELEASE, FAM_ORDERED },
+   { "omp_set_lock", REC_ACQUIRE, FAM_LOCK },
+   { "omp_unset_lock", REC_RELEASE, FAM_LOCK },
+   { "omp_set_nest_lock", REC_ACQUIRE, FAM_NEST },
+   { "omp_unset_nest_lock", REC_RELEASE, FAM_NEST },
+   { "GOMP_parallel_wake", REC_WAKE, FAM_NONE },
+   { "GOMP_parallel_join", REC_JOIN, FAM_NONE },
+   { "PGOMP_sampled", REC_PGOMP, FAM_NONE },
+   { "PGOMP_untraced", REC_PGOMP, FAM_NONE },
+   { "PGOMP_omitted", REC_PGOMP, FAM_NONE },
+   { "PGOMP_tail", REC_PGOMP, FAM_NONE },
+};
+
+#define NUM_KNOWN ((int) (sizeof(knownNames) / sizeof(knownNames[0])))
+
+/**
+   A trace record the replay needs
+**/
+typedef struct
+{
+/*@{*/
+   double t1; /**< First time column (call) */
+   double t2; /**< Second time column (return) */
+   uint64_t addr; /**< Call site */
+   uint32_t thread; /**< Thread id */
+   uint32_t name; /**< Index in knownNames */
+   long seq; /**< Position in the trace, orders records of equal times */
+/*@}*/
+} Record;
+
+/**
+   Work of a team member up to an acquisition, or up to the end of a phase
+**/
+typedef struct
+{
+/*@{*/
+   double compute; /**< Time before the acquisition */
+   float hold; /**< Time the lock was held */
+   int32_t lock; /**< Lock, -1 if the unit ends the phase */
+   int32_t site; /**< Acquire site, index in sites */
+/*@}*/
+} Unit;
+
+/**
+   A phase of a team member: its work up to a barrier or the end of the body
+**/
+typedef struct
+{
+/*@{*/
+   long end; /**< Its units end before units[end] */
+   double arrive, depart; /**< Barrier times, 0 for the last phase */
+/*@}*/
+} Phase;
+
+/**
+   A team member of a parallel region
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t addr; /**< Region site */
+   double fork, start, end, join; /**< Region start, body, region end */
+   uint32_t thread;
+   long firstUnit; /**< Its units start at units[firstUnit] */
+   long firstPhase; /**< Its phases start at phases[firstPhase] */
+   int numPhases;
+/*@}*/
+} Member;
+
+/**
+   A parallel region that ran, with its team
+**/
+typedef struct
+{
+/*@{*/
+   Member *members; /**< By thread number */
+   int team;
+   int phases; /**< Of every member, 0 if the region is not replayed */
+/*@}*/
+} Region;
+
+/**
+   An acquisition, for the handoff cost
+**/
+typedef struct
+{
+/*@{*/
+   int lock;
+   double called, acquired, released;
+/*@}*/
+} Acquisition;
+
+static Record *records = NULL;
+static long numRecords = 0, maxRecords = 0;
+static Unit *units = NULL;
+static long numUnits = 0, maxUnits = 0;
+static Phase *phases = NULL;
+static long numPhases = 0, maxPhases = 0;
+static Acquisition *acquisitions = NULL;
+static long numAcquisitions = 0, maxAcquisitions = 0;
+
+/**
+   Keys in a growing array, found through a hash of indices
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t *keys;
+   long num, max;
+   long *slots; /**< Index + 1 of the key, 0 if free */
+   long numSlots; /**< Power of two */
+/*@}*/
+} KeyTable;
+
+/** Locks: family and site (0 for the one critical and atomic lock) */
+static KeyTable locks;
+/** Acquire sites, and their what-if changes */
+static KeyTable sites;
+static double *holdScale = NULL;
+static int *splitWays = NULL;
+static long *splitBase = NULL; /**< First new lock of a split */
+
+/** Modeled costs, seconds */
+static double acquireCost = 0.0, handoffCost = 0.0, barrierCost = 0.0,
+              joinCost = 0.0, wakeBase = 0.0, wakeSlope = 0.0;
+static int tracedTeam = 1; /**< Largest team traced */
+
+/**
+   @brief Exits after running out of memory.
+**/
+static void outOfMemory()
+{
+   fprintf(stderr,"pgomp-sim: out of memory\n");
+   exit(1);
+}
+
+/**
+   @brief Makes room for one more element in a growing array.
+**/
+static void* grow(void *array, long num, long *max, size_t size)
+{
+   if (num < *max)
+      return array;
+   *max = *max ? 2 * *max : 1024;
+   array = realloc(array, *max * size);
+   if (array == NULL)
+      outOfMemory();
+   return array;
+}
+
+/**
+   @brief Parses one line of the text trace format:
+          name address thread time1 time2 [more columns]
+          and keeps it if it is a record the replay needs.
+   @return 0 if it is a record, -1 if not.
+**/
+static int parseLine(const char *line, const char *end, Record *r)
+{
+   const char *name;
+   char *next;
+   long thread;
+   int i;
+   while (line < end && *line == ' ')
+      line++;
+   name = line;
+   while (line < end && *line != ' ')
+      line++;
+   if (line == name || line >= end)
+      return -1;
+   for (i = 0; i < NUM_KNOWN; i++)
+      if (strncmp(knownNames[i].name, name, line - name) == 0
+          && knownNames[i].name[line - name] == '\0')
+         break;
+   r->name = i;
+   r->addr = strtoull(line, &next, 16);
+   if (next == line) // "(nil)"
+   {
+      while (line < end && *line == ' ')
+         line++;
+      while (line < end && *line != ' ')
+         line++;
+      next = (char*) line;
+   }
+   line = next;
+   thread = strtol(line, &next, 10);
+   if (next == line || thread < 0 || thread >= MAX_THREAD_ID)
+      return -1;
+   r->thread = thread;
+   line = next;
+   r->t1 = strtod(line, &next);
+   if (next == line)
+      return -1;
+   line = next;
+   r->t2 = strtod(line, &next);
+   if (next == line || next > end)
+      return -1;
+   return 0;
+}
+
+/**
+   @brief qsort() comparison of records: by thread, then in time order.
+**/
+static int compareRecords(const void *a, const void *b)
+{
+   const Record *x = a, *y = b;
+   if (x->thread != y->thread)
+      return x->thread < y->thread ? -1 : 1;
+   if (x->t1 != y->t1)
+      return x->t1 < y->t1 ? -1 : 1;
+   return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+   @brief qsort() comparison of members: by region, then thread.
+**/
+static int compareMembers(const void *a, const void *b)
+{
+   const Member *x = a, *y = b;
+   if (x->fork != y->fork)
+      return x->fork < y->fork ? -1 : 1;
+   if (x->addr != y->addr)
+      return x->addr < y->addr ? -1 : 1;
+   return (x->thread > y->thread) - (x->thread < y->thread);
+}
+
+/**
+   @brief qsort() comparison of acquisitions: by lock, then time.
+**/
+static int compareAcquisitions(const void *a, const void *b)
+{
+   const Acquisition *x = a, *y = b;
+   if (x->lock != y->lock)
+      return x->lock < y->lock ? -1 : 1;
+   return (x->acquired > y->acquired) - (x->acquired < y->acquired);
+}
+
+/**
+   @brief Finds or adds a key.
+   @return Its index.
+**/
+static long lookupKey(KeyTable *kt, uint64_t key)
+{
+   long slot, i;
+   if (2 * (kt->num + 1) > kt->numSlots)
+   {
+      free(kt->slots);
+      kt->numSlots = kt->numSlots ? 2 * kt->numSlots : 1024;
+      kt->slots = calloc(kt->numSlots, sizeof(long));
+      if (kt->slots == NULL)
+         outOfMemory();
+      for (i = 0; i < kt->num; i++)
+      {
+         slot = (kt->keys[i] * 0x9e3779b97f4a7c15ULL >> 20) & (kt->numSlots - 1);
+         while (kt->slots[slot] != 0)
+            slot = (slot + 1) & (kt->numSlots - 1);
+         kt->slots[slot] = i + 1;
+      }
+   }
+   slot = (key * 0x9e3779b97f4a7c15ULL >> 20) & (kt->numSlots - 1);
+   while (kt->slots[slot] != 0)
+   {
+      if (kt->keys[kt->slots[slot] - 1] == key)
+         return kt->slots[slot] - 1;
+      slot = (slot + 1) & (kt->numSlots - 1);
+   }
+   kt->keys = grow(kt->keys, kt->num, &kt->max, sizeof(uint64_t));
+   kt->keys[kt->num] = key;
+   kt->slots[slot] = kt->num + 1;
+   return kt->num++;
+}
+
+/**
+   @brief Finds or adds an acquire site, with no what-if changes.
+**/
+static int lookupSite(uint64_t addr)
+{
+   long i = lookupKey(&sites, addr), max = sites.max;
+   if (i == sites.num - 1)
+   {
+      holdScale = realloc(holdScale, max * sizeof(double));
+      splitWays = realloc(splitWays, max * sizeof(int));
+      splitBase = realloc(splitBase, max * sizeof(long));
+      if (holdScale == NULL || splitWays == NULL || splitBase == NULL)
+         outOfMemory();
+      holdScale[i] = 1.0;
+      splitWays[i] = 1;
+      splitBase[i] = 0;
+   }
+   return i;
+}
+
+/**
+   @brief Builds the units and phases of a team member from the records of
+          its thread in the region body.
+   @param recs, num - Records of the thread, in time order.
+**/
+static void buildMember(Member *m, const Record *recs, long num)
+{
+   struct { int family; int lock; int site; double called, acquired; } open[MAX_DEPTH];
+   double prev = m->start, pending = 0.0;
+   int depth = 0;
+   long lo = 0, hi = num, r;
+   // first record of the body
+   while (lo < hi)
+   {
+      long mid = (lo + hi) / 2;
+      if (recs[mid].t1 < m->start)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   m->firstUnit = numUnits;
+   m->firstPhase = numPhases;
+   m->numPhases = 0;
+   for (r = lo; r < num && recs[r].t1 <= m->end; r++)
+   {
+      const Record *rec = &recs[r];
+      int kind = knownNames[rec->name].kind, family = knownNames[rec->name].family;
+      if (rec->t2 > m->end)
+         break;
+      if (kind == REC_ACQUIRE)
+      {
+         if (depth > 0 && depth < MAX_DEPTH)
+         {
+            open[depth++].family = family; // part of the outer hold
+            continue;
+         }
+         if (depth > 0)
+            continue;
+         pending += rec->t1 - prev;
+         open[0].family = family;
+         open[0].lock = lookupKey(&locks, (family == FAM_CRITICAL || family == FAM_ATOMIC
+                                           ? 0 : rec->addr) << 3 | family);
+         open[0].site = lookupSite(rec->addr);
+         open[0].acquired = rec->t2;
+         open[0].called = rec->t1;
+         depth = 1;
+      }
+      else if (kind == REC_RELEASE && depth > 0 && open[depth-1].family == family)
+      {
+         if (--depth > 0)
+            continue;
+         units = grow(units, numUnits, &maxUnits, sizeof(Unit));
+         units[numUnits].compute = pending;
+         units[numUnits].hold = rec->t2 - open[0].acquired;
+         units[numUnits].lock = open[0].lock;
+         units[numUnits++].site = open[0].site;
+         acquisitions = grow(acquisitions, numAcquisitions, &maxAcquisitions,
+                             sizeof(Acquisition));
+         acquisitions[numAcquisitions].lock = open[0].lock;
+         acquisitions[numAcquisitions].called = open[0].called;
+         acquisitions[numAcquisitions].acquired = open[0].acquired;
+         acquisitions[numAcquisitions++].released = rec->t2;
+
+         pending = 0.0;
+         prev = rec->t2;
+      }
+      else if (kind == REC_BARRIER && depth == 0)
+      {
+         units = grow(units, numUnits, &maxUnits, sizeof(Unit));
+         units[numUnits].compute = pending + rec->t1 - prev;
+         units[numUnits].hold = 0.0;
+         units[numUnits].lock = -1;
+         units[numUnits++].site = -1;
+         phases = grow(phases, numPhases, &maxPhases, sizeof(Phase));
+         phases[numPhases].end = numUnits;
+         phases[numPhases].arrive = rec->t1;
+         phases[numPhases++].depart = rec->t2;
+         m->numPhases++;
+         pending = 0.0;
+         prev = rec->t2;
+      }
+   }
+   // an acquisition still open at the end is work
+   units = grow(units, numUnits, &maxUnits, sizeof(Unit));
+   units[numUnits].compute = pending + m->end - prev;
+   units[numUnits].hold = 0.0;
+   units[numUnits].lock = -1;
+   units[numUnits++].site = -1;
+   phases = grow(phases, numPhases, &maxPhases, sizeof(Phase));
+   phases[numPhases].end = numUnits;
+   phases[numPhases].arrive = phases[numPhases].depart = 0.0;
+   numPhases++;
+   m->numPhases++;
+}
+
+/**
+   @brief Estimates the costs of the model from the trace.
+**/
+static void estimateCosts(const Region *regions, long numRegions)
+{
+   double freeWait = 0.0, handoff = 0.0, barrier = 0.0, join = 0.0;
+   double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+   long numFree = 0, numHandoffs = 0, numBarriers = 0, numJoins = 0, n = 0;
+   long i, k;
+   int s;
+   // an acquisition called before the release before it waited for it
+   qsort(acquisitions, numAcquisitions, sizeof(Acquisition), compareAcquisitions);
+   for (i = 0; i < numAcquisitions; i++)
+   {
+      const Acquisition *a = &acquisitions[i], *prev = i > 0 ? a - 1 : a;
+      if (i > 0 && prev->lock == a->lock && a->called < prev->released
+          && a->acquired >= prev->released)
+      {
+         handoff += a->acquired - prev->released;
+         numHandoffs++;
+      }
+      else
+      {
+         freeWait += a->acquired - a->called;
+         numFree++;
+      }
+   }
+   for (i = 0; i < numRegions; i++)
+   {
+      const Region *r = &regions[i];
+      double lastEnd = 0.0;
+      if (r->phases == 0)
+         continue;
+      for (s = 0; s < r->team; s++)
+      {
+         const Member *m = &r->members[s];
+         if (m->end > lastEnd)
+            lastEnd = m->end;
+         sx += s;
+         sy += m->start - m->fork;
+         sxx += (double) s * s;
+         sxy += s * (m->start - m->fork);
+         n++;
+      }
+      join += r->members[0].join - lastEnd;
+      numJoins++;
+      for (k = 0; k + 1 < r->phases; k++)
+      {
+         double last = 0.0, depart = 0.0;
+         for (s = 0; s < r->team; s++)
+         {
+            const Phase *p = &phases[r->members[s].firstPhase + k];
+            if (p->arrive > last)
+               last = p->arrive;
+            depart += p->depart;
+         }
+         if (r->team > 1)
+         {
+            barrier += depart / r->team - last;
+            numBarriers++;
+         }
+      }
+   }
+   acquireCost = numFree ? freeWait / numFree : 0.0;
+   handoffCost = numHandoffs ? handoff / numHandoffs : acquireCost;
+   barrierCost = numBarriers ? barrier / numBarriers : 0.0;
+   joinCost = numJoins ? join / numJoins : 0.0;
+   if (n > 1 && n * sxx - sx * sx > 0.0)
+      wakeSlope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+   // Later threads do not start sooner: a falling fit is noise, so the
+   // start cost is then the mean, and a fit below zero at thread 0 is
+   // made again through the origin.
+   if (wakeSlope < 0.0)
+      wakeSlope = 0.0;
+   wakeBase = n ? (sy - wakeSlope * sx) / n : 0.0;
+   if (wakeBase < 0.0)
+   {
+      wakeBase = 0.0;
+      wakeSlope = sxx > 0.0 && sxy > 0.0 ? sxy / sxx : 0.0;
+   }
+   if (barrierCost < 0.0)
+      barrierCost = 0.0;
+   if (joinCost < 0.0)
+      joinCost = 0.0;
+}
+
+/**
+   Replay state of one member of the simulated team
+**/
+typedef struct
+{
+/*@{*/
+   double time; /**< Time of its next step */
+   int stage; /**< STAGE_* */
+   int phase;
+   double from, to; /**< Its share of the traced members */
+   int source; /**< Traced member whose units it runs */
+   long unit, phaseStart, phaseEnd; /**< Next unit, and the units of the phase */
+   long acquiring; /**< Unit of the acquisition in progress */
+   int lock; /**< Its lock */
+   int next; /**< Next waiter for the same lock, -1 if none */
+/*@}*/
+} SimThread;
+
+enum { STAGE_RUN, STAGE_ACQUIRE, STAGE_RELEASE, STAGE_DONE };
+
+static SimThread *sim = NULL;
+static int *heap = NULL, heapSize = 0; /**< Simulated threads by time */
+static int *holder = NULL, *firstWaiter = NULL, *lastWaiter = NULL; /**< By lock */
+static long simLocks = 0; /**< Locks, with those of the splits */
+
+static int earlier(int a, int b)
+{
+   return sim[a].time < sim[b].time || (sim[a].time == sim[b].time && a < b);
+}
+
+static void heapPush(int t)
+{
+   int i = heapSize++;
+   while (i > 0 && earlier(t, heap[(i - 1) / 2]))
+   {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+   }
+   heap[i] = t;
+}
+
+static int heapPop(void)
+{
+   int top = heap[0], t = heap[--heapSize], i = 0, c;
+   while ((c = 2 * i + 1) < heapSize)
+   {
+      if (c + 1 < heapSize && earlier(heap[c+1], heap[c]))
+         c++;
+      if (!earlier(heap[c], t))
+         break;
+      heap[i] = heap[c];
+      i = c;
+   }
+   if (heapSize > 0)
+      heap[i] = t;
+   return top;
+}
+
+/**
+   @brief Moves a simulated thread to the units of the next traced member
+          it has a share of in its phase.
+   @return 0, -1 if it has none left.
+**/
+static int nextSource(const Region *r, SimThread *st)
+{
+   const Member *m;
+   if (st->source + 1 >= r->team || st->source + 1 >= st->to)
+      return -1;
+   st->source++;
+   m = &r->members[st->source];
+   st->phaseStart = st->phase == 0 ? m->firstUnit
+                    : phases[m->firstPhase + st->phase - 1].end;
+   st->phaseEnd = phases[m->firstPhase + st->phase].end;
+   st->unit = st->phaseStart;
+   return 0;
+}
+
+/**
+   @brief Runs a simulated thread until its next acquisition or the end of
+          its phase.
+   @return STAGE_ACQUIRE or STAGE_DONE.
+**/
+static int runUnits(const Region *r, SimThread *st)
+{
+   for (;;)
+   {
+      const Unit *u;
+      double share, point;
+      long n;
+      if (st->unit == st->phaseEnd && nextSource(r, st) != 0)
+         return STAGE_DONE;
+      if (st->unit == st->phaseEnd)
+         continue;
+      u = &units[st->unit];
+      share = (st->to < st->source + 1 ? st->to : st->source + 1)
+              - (st->from > st->source ? st->from : st->source);
+      st->time += u->compute * share;
+      n = st->phaseEnd - st->phaseStart;
+      point = st->source + (st->unit - st->phaseStart + 0.5) / n;
+      if (u->lock >= 0 && point >= st->from && point < st->to)
+      {
+         int ways = splitWays[u->site], way = st->unit % ways;
+         st->acquiring = st->unit++;
+         st->lock = way == 0 ? u->lock : splitBase[u->site] + way - 1;
+         return STAGE_ACQUIRE;
+      }
+      st->unit++;
+   }
+}
+
+/**
+   @brief Starts a simulated thread on a phase.
+**/
+static void startPhase(const Region *r, SimThread *st, int phase)
+{
+   st->phase = phase;
+   st->source = (int) st->from - 1;
+   st->unit = st->phaseEnd = 0;
+   nextSource(r, st);
+   st->stage = STAGE_RUN;
+}
+
+/**
+   @brief Replays a region with a team of another size.
+   @param team - Simulated team size.
+   @return Time from the start of the region to its end.
+**/
+static double simulateRegion(const Region *r, int team)
+{
+   double last = 0.0, end = 0.0, barrier;
+   int q, arrived = 0, waiter, phase;
+   long l;
+   barrier = tracedTeam > 1 ? barrierCost * log2(team) / log2(tracedTeam)
+                            : barrierCost;
+   for (l = 0; l < simLocks; l++)
+      holder[l] = firstWaiter[l] = -1;
+   heapSize = 0;
+   for (q = 0; q < team; q++)
+   {
+      SimThread *st = &sim[q];
+      st->from = (double) q * r->team / team;
+      st->to = (double) (q + 1) * r->team / team;
+      st->time = wakeBase + wakeSlope * q;
+      if (st->time < 0.0)
+         st->time = 0.0;
+      startPhase(r, st, 0);
+      heapPush(q);
+   }
+   while (heapSize > 0)
+   {
+      q = heapPop();
+      SimThread *st = &sim[q];
+      switch (st->stage)
+      {
+      case STAGE_RUN:
+         st->stage = runUnits(r, st);
+         if (st->stage == STAGE_ACQUIRE)
+         {
+            heapPush(q);
+            break;
+         }
+         // arrived at the barrier that ends the phase, or at the end
+         if (st->time > last)
+            last = st->time;
+         if (++arrived < team)
+            break;
+         arrived = 0;
+         if (st->phase + 1 == r->phases)
+         {
+            end = last;
+            break;
+         }
+         phase = st->phase + 1;
+         for (waiter = 0; waiter < team; waiter++)
+         {
+            sim[waiter].time = last + barrier;
+            startPhase(r, &sim[waiter], phase);
+            heapPush(waiter);
+         }
+         last = 0.0;
+         break;
+      case STAGE_ACQUIRE:
+         if (holder[st->lock] < 0)
+         {
+            holder[st->lock] = q;
+            st->time += acquireCost + units[st->acquiring].hold
+                        * holdScale[units[st->acquiring].site];
+            st->stage = STAGE_RELEASE;
+            heapPush(q);
+         }
+         else
+         {
+            st->next = -1;
+            if (firstWaiter[st->lock] < 0)
+               firstWaiter[st->lock] = q;
+            else
+               sim[lastWaiter[st->lock]].next = q;
+            lastWaiter[st->lock] = q;
+         }
+         break;
+      case STAGE_RELEASE:
+         waiter = firstWaiter[st->lock];
+         if (waiter >= 0)
+         {
+            SimThread *w = &sim[waiter];
+            firstWaiter[st->lock] = w->next;
+            holder[st->lock] = waiter;
+            w->time = st->time + handoffCost + units[w->acquiring].hold
+                      * holdScale[units[w->acquiring].site];
+            w->stage = STAGE_RELEASE;
+            heapPush(waiter);
+         }
+         else
+            holder[st->lock] = -1;
+         st->stage = STAGE_RUN;
+         heapPush(q);
+         break;
+      }
+   }
+   return end + joinCost;
+}
+
+/**
+   @brief Predicts the runtime of the program with a team size.
+   @param regions - Regions to replay (the others are fixed time).
+**/
+static double simulate(const Region *regions, long numRegions, int team)
+{
+   double time = 0.0;
+   long i;
+   for (i = 0; i < numRegions; i++)
+      if (regions[i].phases > 0)
+      {
+         // a region traced with a smaller team asked for it
+         int size = regions[i].team < tracedTeam && regions[i].team < team
+                    ? regions[i].team : team;
+         time += simulateRegion(&regions[i], size);
+      }
+   return time;
+}
+
+/**
+   @brief Parses a site address with an optional ":value".
+   @return 0, -1 if it is not one.
+**/
+static int parseWhatIf(const char *arg, uint64_t *addr, double *value)
+{
+   char *next;
+   *addr = strtoull(arg, &next, 16);
+   if (next == arg)
+      return -1;
+   if (*next == '\0')
+      return 0;
+   if (*next != ':')
+      return -1;
+   arg = next + 1;
+   *value = strtod(arg, &next);
+   return next == arg || *next != '\0' ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+   const char *fileName = OUTPUT_FILENAME;
+   TraceFile tf;
+   Region *regions = NULL;
+   Member *members = NULL;
+   long numRegions = 0, numMembers = 0, maxMembers = 0, replayed = 0, nested = 0,
+        mismatched = 0, skipped = 0, incomplete = 0, tracedSites, i, j, k;
+   uint64_t shortenSite[MAX_WHATIFS], splitSite[MAX_WHATIFS];
+   double shortenFactor[MAX_WHATIFS], splitCount[MAX_WHATIFS];
+   int teams[MAX_TEAMS], numTeams = 0, numShorten = 0, numSplit = 0, opt, maxTeam;
+   double first = -1.0, last = 0.0, regionTime = 0.0, fixedTime = 0.0, serial;
+   double base[MAX_TEAMS], whatIf[MAX_TEAMS], traced, one;
+   char *buffer = NULL, *list, *next;
+   while ((opt = getopt(argc, argv, "t:s:x:")) != -1)
+   {
+      switch (opt)
+      {
+      case 't':
+         for (list = optarg; *list != '\0' && numTeams < MAX_TEAMS; list = next)
+         {
+            teams[numTeams] = strtol(list, &next, 10);
+            if (next == list || teams[numTeams] <= 0 || (*next != ',' && *next != '\0'))
+               goto usage;
+            numTeams++;
+            if (*next == ',')
+               next++;
+         }
+         break;
+      case 's':
+         shortenFactor[numShorten] = -1.0;
+         if (numShorten == MAX_WHATIFS
+             || parseWhatIf(optarg, &shortenSite[numShorten], &shortenFactor[numShorten]) != 0
+             || shortenFactor[numShorten] < 0.0)
+            goto usage;
+         numShorten++;
+         break;
+      case 'x':
+         splitCount[numSplit] = 2.0;
+         if (numSplit == MAX_WHATIFS
+             || parseWhatIf(optarg, &splitSite[numSplit], &splitCount[numSplit]) != 0
+             || splitCount[numSplit] < 1.0)
+            goto usage;
+         numSplit++;
+         break;
+      default:
+         goto usage;
+      }
+   }
+   if (optind < argc)
+      fileName = argv[optind];
+   if (traceOpen(&tf, fileName) != 0)
+      return 1;
+
+   // the records the replay needs, by thread in time order
+   if (tf.format == TRACE_COMPRESSED)
+      buffer = malloc(TRACE_CHUNK_SIZE);
+   for (i = 0; i < (long) tf.numPieces; i++)
+   {
+      const char *text = tracePieceText(&tf, &tf.pieces[i], buffer), *line, *end, *nl;
+      if (text == NULL)
+      {
+         fprintf(stderr,"pgomp-sim: piece %ld of %s is corrupt\n", i, fileName);
+         return 1;
+      }
+      for (line = text, end = text + tf.pieces[i].len; line < end; line = nl + 1)
+      {
+         Record r;
+         nl = memchr(line, '\n', end - line);
+         if (nl == NULL)
+            nl = end;
+         if (parseLine(line, nl, &r) != 0)
+         {
+            if (nl > line)
+               skipped++;
+            continue;
+         }
+         if (first < 0.0 || r.t1 < first)
+            first = r.t1;
+         if (r.t2 > last)
+            last = r.t2;
+         if (r.name == NUM_KNOWN)
+            continue;
+         if (knownNames[r.name].kind == REC_PGOMP)
+         {
+            incomplete++;
+            continue;
+         }
+         r.seq = numRecords;
+         records = grow(records, numRecords, &maxRecords, sizeof(Record));
+         records[numRecords++] = r;
+      }
+   }
+   free(buffer);
+   qsort(records, numRecords, sizeof(Record), compareRecords);
+
+   // team members: a wake record starts one, the join record of the same
+   // region ends it; inside another body they belong to a nested region
+   for (i = 0; i < numRecords; i = j)
+   {
+      Member open[MAX_DEPTH];
+      int depth = 0;
+      for (j = i; j < numRecords && records[j].thread == records[i].thread; j++)
+      {
+         const Record *r = &records[j];
+         if (knownNames[r->name].kind == REC_WAKE && depth < MAX_DEPTH)
+         {
+            open[depth].addr = r->addr;
+            open[depth].fork = r->t1;
+            open[depth].start = r->t2;
+            open[depth++].thread = r->thread;
+         }
+         else if (knownNames[r->name].kind == REC_JOIN && depth > 0
+                  && open[depth-1].addr == r->addr)
+         {
+            Member *m = &open[--depth];
+            if (depth > 0)
+            {
+               nested++;
+               continue;
+            }
+            m->end = r->t1;
+            m->join = r->t2;
+            members = grow(members, numMembers, &maxMembers, sizeof(Member));
+            members[numMembers++] = *m;
+         }
+      }
+   }
+   qsort(members, numMembers, sizeof(Member), compareMembers);
+   regions = malloc((numMembers + 1) * sizeof(Region));
+   if (regions == NULL)
+      outOfMemory();
+   for (i = 0; i < numMembers; i = j)
+   {
+      Region *r = &regions[numRegions];
+      for (j = i; j < numMembers && members[j].fork == members[i].fork
+                  && members[j].addr == members[i].addr; j++)
+         ;
+      // a region that starts inside another is nested (in a team member
+      // the outer team does not have)
+      if (numRegions > 0 && members[i].fork < regions[numRegions-1].members[0].join)
+      {
+         nested++;
+         continue;
+      }
+      r->members = &members[i];
+      r->team = j - i;
+      r->phases = 0;
+      numRegions++;
+      regionTime += members[i].join - members[i].fork;
+   }
+
+   // the units of every member, from the records of its thread
+   for (i = 0; i < numRegions; i++)
+   {
+      Region *r = &regions[i];
+      int s;
+      for (s = 0; s < r->team; s++)
+      {
+         Member *m = &r->members[s];
+         long lo = 0, hi = numRecords, from;
+         // records of the thread
+         while (lo < hi)
+         {
+            long mid = (lo + hi) / 2;
+            if (records[mid].thread < m->thread)
+               lo = mid + 1;
+            else
+               hi = mid;
+         }
+         for (from = lo, hi = lo; hi < numRecords && records[hi].thread == m->thread; hi++)
+            ;
+         buildMember(m, &records[from], hi - from);
+      }
+      r->phases = r->members[0].numPhases;
+      for (s = 1; s < r->team; s++)
+         if (r->members[s].numPhases != r->phases)
+            r->phases = 0;
+      if (r->phases == 0)
+      {
+         mismatched++;
+         fixedTime += r->members[0].join - r->members[0].fork;
+         continue;
+      }
+      if (r->team > tracedTeam)
+         tracedTeam = r->team;
+      replayed++;
+   }
+   free(records);
+
+   // what-if changes
+   tracedSites = sites.num;
+   for (k = 0; k < numShorten; k++)
+   {
+      long site = lookupSite(shortenSite[k]);
+      holdScale[site] = shortenFactor[k];
+   }
+   simLocks = locks.num;
+   for (k = 0; k < numSplit; k++)
+   {
+      long site = lookupSite(splitSite[k]);
+      splitWays[site] = (int) splitCount[k];
+      splitBase[site] = simLocks;
+      simLocks += splitWays[site] - 1;
+   }
+   estimateCosts(regions, numRegions);
+
+   if (numTeams == 0)
+   {
+      for (maxTeam = 1; maxTeam <= 2 * tracedTeam; maxTeam *= 2)
+      {
+         if (maxTeam > tracedTeam && (maxTeam / 2) < tracedTeam)
+            teams[numTeams++] = tracedTeam;
+         teams[numTeams++] = maxTeam;
+      }
+      if (teams[numTeams-1] < tracedTeam)
+         teams[numTeams++] = tracedTeam;
+   }
+   for (k = 0, maxTeam = 1; k < numTeams; k++)
+      if (teams[k] > maxTeam)
+         maxTeam = teams[k];
+   if (maxTeam < tracedTeam)
+      maxTeam = tracedTeam;
+   sim = malloc(maxTeam * sizeof(SimThread));
+   heap = malloc(maxTeam * sizeof(int));
+   holder = malloc((simLocks + 1) * sizeof(int));
+   firstWaiter = malloc((simLocks + 1) * sizeof(int));
+   lastWaiter = malloc((simLocks + 1) * sizeof(int));
+   if (sim == NULL || heap == NULL || holder == NULL || firstWaiter == NULL
+       || lastWaiter == NULL)
+      outOfMemory();
+
+   // the time of the regions not replayed is serial
+   serial = last - first - regionTime + fixedTime;
+   if (numRegions == 0 || first < 0.0)
+      serial = last > first ? last - first : 0.0;
+   // the baseline without the what-ifs, then with them
+   {
+      double *savedScale = malloc(sites.num * sizeof(double) + 1);
+      int *savedWays = malloc(sites.num * sizeof(int) + 1);
+      if (savedScale == NULL || savedWays == NULL)
+         outOfMemory();
+      memcpy(savedScale, holdScale, sites.num * sizeof(double));
+      memcpy(savedWays, splitWays, sites.num * sizeof(int));
+      for (i = 0; i < sites.num; i++)
+      {
+         holdScale[i] = 1.0;
+         splitWays[i] = 1;
+      }
+      one = serial + simulate(regions, numRegions, 1);
+      traced = serial + simulate(regions, numRegions, tracedTeam);
+      for (k = 0; k < numTeams; k++)
+         base[k] = serial + simulate(regions, numRegions, teams[k]);
+      memcpy(holdScale, savedScale, sites.num * sizeof(double));
+      memcpy(splitWays, savedWays, sites.num * sizeof(int));
+      for (k = 0; k < numTeams && numShorten + numSplit > 0; k++)
+         whatIf[k] = serial + simulate(regions, numRegions, teams[k]);
+      free(savedScale);
+      free(savedWays);
+   }
+   printf("PGOMP replay: %s, %ld threads, %ld regions (%ld replayed), %ld locks, "
+          "%ld acquisitions\n", fileName, (long) tracedTeam, numRegions, replayed,
+          locks.num, numAcquisitions);
+   printf("traced %.6f s: serial %.6f s, regions %.6f s\n", last - first,
+          serial, regionTime - fixedTime);
+   printf("costs: acquire %.3f us, handoff %.3f us, barrier %.3f us at %d threads, "
+          "join %.3f us, start %.3f + %.3f us per thread\n", acquireCost * 1e6,
+          handoffCost * 1e6, barrierCost * 1e6, tracedTeam, joinCost * 1e6,
+          wakeBase * 1e6, wakeSlope * 1e6);
+   for (k = 0; k < numShorten; k++)
+      printf("what-if: holds at 0x%lx x%.2f\n", (unsigned long) shortenSite[k],
+             shortenFactor[k]);
+   for (k = 0; k < numSplit; k++)
+      printf("what-if: lock acquired at 0x%lx split in %d\n",
+             (unsigned long) splitSite[k], (int) splitCount[k]);
+   printf("replayed at %d threads: %.6f s (%+.1f%% of traced)\n\n", tracedTeam,
+          traced, last > first ? (traced - (last - first)) / (last - first) * 100.0 : 0.0);
+
+   printf("threads   runtime(s)  speedup  efficiency");
+   if (numShorten + numSplit > 0)
+      printf("   what-if(s)  speedup     gain");
+   printf("\n");
+   for (k = 0; k < numTeams; k++)
+   {
+      printf("%7d %12.6f %8.2f %10.1f%%", teams[k], base[k], one / base[k],
+             one / base[k] / teams[k] * 100.0);
+      if (numShorten + numSplit > 0)
+         printf(" %12.6f %8.2f %7.1f%%", whatIf[k], one / whatIf[k],
+                (base[k] - whatIf[k]) / base[k] * 100.0);
+      printf("\n");
+   }
+   if (sites.num > tracedSites)
+      fprintf(stderr,"pgomp-sim: warning: %ld what-if sites acquire nothing in the "
+                     "trace\n", sites.num - tracedSites);
+   if (nested > 0)
+      fprintf(stderr,"pgomp-sim: warning: %ld nested regions are not replayed, their "
+                     "time counts as the work of the outer team\n", nested);
+   if (mismatched > 0)
+      fprintf(stderr,"pgomp-sim: warning: %ld regions whose members passed different "
+                     "numbers of barriers are not replayed\n", mismatched);
+   if (incomplete > 0 || tf.dropped > 0)
+      fprintf(stderr,"pgomp-sim: warning: the trace is incomplete (sampled, tail or "
+                     "dropped records), the replay is of the traced events only\n");
+   if (skipped > 0)
+      fprintf(stderr,"pgomp-sim: warning: %ld lines are not trace records\n", skipped);
+   traceClose(&tf);
+   return 0;
+usage:
+   fprintf(stderr,"usage: pgomp-sim [-t threads,...] [-s site:factor] [-x site[:ways]] "
+                  "[file]\n");
+   return 1;
+}
@@ -0,0 +1,124 @@
+//
+// PGOMP binary trace file formats
+//
+// Written by libpgomp, read by pgomp-decode. All integers are in the byte
+// order of the machine that wrote the trace.
+//
+// 1. Compressed trace (PGOMP_COMPRESS)
+//
+//    TRACE_MAGIC                      8 bytes
+//    ChunkHeader + payload            repeated, one per trace chunk
+//    ChunkIndexEntry                  repeated, one per chunk
+//    TraceFooter                      fixed size, at the very end
+//
+// Each chunk holds the text records of one thread (stream), so the
+// payload of a chunk decompresses to whole lines of the normal trace
+// format. The index at the end makes the file seekable: a reader can find
+// any chunk (e.g. all chunks of one thread) without decompressing the
+// others. If the program died before the index was written, the chunk
+// headers alone are enough to walk the file from the beginning.
+//
+// 2. Memory-mapped trace (PGOMP_TRACE_IO=mmap)
+//
+//    MmapHeader + ExtentEntry[maxExtents]     padded to headerSize
+//    extent 0                                 its size bytes
+//    extent 1 ...
+//
+// Every thread that traces writes its text records directly into extents
+// of the file through a memory mapping. Extents are handed out from the
+// end of the file as threads fill them, so the extents of one thread are
+// interleaved with those of others. A thread's first extent is small and
+// each next one twice the size, up to extentSize. The header gives the offset of each
+// extent, how much of it holds records (the rest is unused), and the next
+// extent of the same thread: a thread's records are its chain of extents,
+// in time order. A reader merges the chains by the start time column to
+// get one timeline.
+//
+
+#ifndef PGOMP_TRACE_H
+#define PGOMP_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC "PGOMPZ01" /**< First 8 bytes of a compressed trace */
+#define TRACE_INDEX_MAGIC "PGOMPIDX" /**< Last 8 bytes of a complete trace */
+#define CHUNK_MAGIC 0x4b4e4843 /**< "CHNK", start of every chunk header */
+#define MMAP_MAGIC "PGOMPM02" /**< First 8 bytes of a memory-mapped trace */
+#define MMAP_NO_EXTENT 0xffffffffu /**< ExtentEntry.next of a chain's last extent */
+
+/** Codec used for a chunk payload */
+enum { CODEC_NONE = 0, CODEC_LZ = 1, CODEC_ZSTD = 2 };
+
+/**
+   Precedes every chunk payload in the file
+**/
+typedef struct
+{
+/*@{*/
+   uint32_t magic; /**< CHUNK_MAGIC */
+   uint32_t stream; /**< Thread stream the chunk belongs to */
+   uint32_t codec; /**< CODEC_NONE, CODEC_LZ or CODEC_ZSTD */
+   uint32_t rawLen; /**< Length of the decompressed text */
+   uint32_t compLen; /**< Length of the payload that follows */
+/*@}*/
+} ChunkHeader;
+
+/**
+   One entry of the chunk index at the end of the file
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t offset; /**< File offset of the chunk header */
+   uint32_t stream; /**< Thread stream the chunk belongs to */
+   uint32_t codec; /**< Codec of the payload */
+   uint32_t rawLen; /**< Length of the decompressed text */
+   uint32_t compLen; /**< Length of the payload */
+/*@}*/
+} ChunkIndexEntry;
+
+/**
+   Last bytes of a complete compressed trace
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t indexOffset; /**< File offset of the first index entry */
+   uint64_t numChunks; /**< Number of index entries */
+   uint64_t droppedChunks; /**< Chunks dropped because the compressor fell behind */
+   char magic[8]; /**< TRACE_INDEX_MAGIC */
+/*@}*/
+} TraceFooter;
+
+/**
+   Location of one extent of a memory-mapped trace
+**/
+typedef struct
+{
+/*@{*/
+   uint64_t offset; /**< File offset of the extent */
+   uint32_t size; /**< Size of the extent */
+   uint32_t used; /**< Bytes of records written into the extent */
+   uint32_t stream; /**< Thread stream that owns the extent */
+   uint32_t next; /**< Next extent of the stream, MMAP_NO_EXTENT if none */
+/*@}*/
+} ExtentEntry;
+
+/**
+   Start of a memory-mapped trace
+**/
+typedef struct
+{
+/*@{*/
+   char magic[8]; /**< MMAP_MAGIC */
+   uint64_t headerSize; /**< Bytes before the first extent */
+   uint64_t extentSize; /**< Size of the largest extents */
+   uint64_t fileSize; /**< End of the last extent handed out */
+   uint64_t dropped; /**< Records dropped: disk full or all extents taken */
+   uint32_t maxExtents; /**< Number of entries in extents[] */
+   uint32_t numExtents; /**< Extents handed out */
+   ExtentEntry extents[]; /**< One per extent, in the order handed out */
+/*@}*/
+} MmapHeader;
+
+#endif
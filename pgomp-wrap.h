@@ -0,0 +1,118 @@
+//
+// The functions PGOMP wraps
+//
+// PGOMP_WRAPPED_VOID(X) and PGOMP_WRAPPED_VALUE(X) call
+// X(ret, name, params, args) once for every wrapped libgomp function: its
+// return type, name, parameter list, and the argument list that passes
+// the parameters on. The first list has the functions that return
+// nothing. libpgomp builds the pointers to the real functions and their
+// lookups from the lists, the dispatcher (pgomp-dispatch.c) its
+// forwarding functions. A function added here needs a wrapper in pgomp.c.
+//
+// The includer defines bool (GOMP_single_start) and includes omp.h. The
+// loop functions return libgomp's bool, which is _Bool: only its low byte
+// is set, PGOMP's bool is an int.
+//
+
+#ifndef PGOMP_WRAP_H
+#define PGOMP_WRAP_H
+
+#define PGOMP_WRAPPED_VOID(X) \
+   X(void, omp_init_lock, (omp_lock_t *pLock), (pLock)) \
+   X(void, omp_destroy_lock, (omp_lock_t *pLock), (pLock)) \
+   X(void, omp_set_lock, (omp_lock_t *pLock), (pLock)) \
+   X(void, omp_unset_lock, (omp_lock_t *pLock), (pLock)) \
+   X(void, omp_set_nest_lock, (omp_nest_lock_t *pLock), (pLock)) \
+   X(void, omp_unset_nest_lock, (omp_nest_lock_t *pLock), (pLock)) \
+   X(void, GOMP_barrier, (void), ()) \
+   X(void, GOMP_critical_start, (void), ()) \
+   X(void, GOMP_critical_end, (void), ()) \
+   X(void, GOMP_critical_name_start, (void **name), (name)) \
+   X(void, GOMP_critical_name_end, (void **name), (name)) \
+   X(void, GOMP_atomic_start, (void), ()) \
+   X(void, GOMP_atomic_end, (void), ()) \
+   X(void, GOMP_ordered_start, (void), ()) \
+   X(void, GOMP_ordered_end, (void), ()) \
+   X(void, GOMP_parallel_start, (void (*fn) (void *), void *data, unsigned num_threads), \
+     (fn, data, num_threads)) \
+   X(void, GOMP_parallel_end, (void), ()) \
+   X(void, GOMP_parallel, (void (*fn) (void *), void *data, unsigned num_threads, \
+                           unsigned int flags), (fn, data, num_threads, flags)) \
+   X(void, GOMP_sections_end, (void), ()) \
+   X(void, GOMP_sections_end_nowait, (void), ()) \
+   X(void, GOMP_single_copy_end, (void *data), (data)) \
+   X(void, GOMP_loop_end, (void), ()) \
+   X(void, GOMP_loop_end_nowait, (void), ()) \
+   PGOMP_PARALLEL_LOOPS(X, PARALLEL_LOOP) \
+   PGOMP_PARALLEL_LOOP_RUNTIMES(X, PARALLEL_LOOP_RUNTIME)
+
+#define PGOMP_WRAPPED_VALUE(X) \
+   X(int, omp_test_lock, (omp_lock_t *pLock), (pLock)) \
+   X(int, omp_test_nest_lock, (omp_nest_lock_t *pLock), (pLock)) \
+   X(bool, GOMP_single_start, (void), ()) \
+   X(unsigned, GOMP_sections_start, (unsigned count), (count)) \
+   X(unsigned, GOMP_sections_next, (void), ()) \
+   X(void*, GOMP_single_copy_start, (void), ()) \
+   PGOMP_LOOP_STARTS(X, LOOP_START) \
+   PGOMP_LOOP_RUNTIME_STARTS(X, LOOP_RUNTIME_START) \
+   PGOMP_LOOP_NEXTS(X, LOOP_NEXT)
+
+// The loops with dynamic, guided and runtime schedules; static ones do not
+// call libgomp. A list calls X(ret, name, params, args) like the lists
+// above, through the adapter A, and pgomp.c also calls it with its own
+// adapter to add the schedule. A combined parallel loop is started with
+// GOMP_parallel_loop_*() and its team only calls the next functions.
+#define LOOP_START(X, name, schedule) \
+   X(_Bool, name, (long start, long end, long incr, long chunk, long *istart, \
+                   long *iend), (start, end, incr, chunk, istart, iend))
+#define LOOP_RUNTIME_START(X, name, schedule) \
+   X(_Bool, name, (long start, long end, long incr, long *istart, long *iend), \
+     (start, end, incr, istart, iend))
+#define LOOP_NEXT(X, name, schedule) \
+   X(_Bool, name, (long *istart, long *iend), (istart, iend))
+#define PARALLEL_LOOP(X, name, schedule) \
+   X(void, name, (void (*fn) (void *), void *data, unsigned num_threads, long start, \
+                  long end, long incr, long chunk, unsigned flags), \
+     (fn, data, num_threads, start, end, incr, chunk, flags))
+#define PARALLEL_LOOP_RUNTIME(X, name, schedule) \
+   X(void, name, (void (*fn) (void *), void *data, unsigned num_threads, long start, \
+                  long end, long incr, unsigned flags), \
+     (fn, data, num_threads, start, end, incr, flags))
+
+#define PGOMP_LOOP_STARTS(X, A) \
+   A(X, GOMP_loop_dynamic_start, "dynamic") \
+   A(X, GOMP_loop_guided_start, "guided") \
+   A(X, GOMP_loop_nonmonotonic_dynamic_start, "dynamic") \
+   A(X, GOMP_loop_nonmonotonic_guided_start, "guided")
+#define PGOMP_LOOP_RUNTIME_STARTS(X, A) \
+   A(X, GOMP_loop_runtime_start, "runtime") \
+   A(X, GOMP_loop_nonmonotonic_runtime_start, "runtime") \
+   A(X, GOMP_loop_maybe_nonmonotonic_runtime_start, "runtime")
+#define PGOMP_LOOP_NEXTS(X, A) \
+   A(X, GOMP_loop_dynamic_next, "dynamic") \
+   A(X, GOMP_loop_guided_next, "guided") \
+   A(X, GOMP_loop_nonmonotonic_dynamic_next, "dynamic") \
+   A(X, GOMP_loop_nonmonotonic_guided_next, "guided") \
+   A(X, GOMP_loop_runtime_next, "runtime") \
+   A(X, GOMP_loop_nonmonotonic_runtime_next, "runtime") \
+   A(X, GOMP_loop_maybe_nonmonotonic_runtime_next, "runtime")
+#define PGOMP_PARALLEL_LOOPS(X, A) \
+   A(X, GOMP_parallel_loop_dynamic, "dynamic") \
+   A(X, GOMP_parallel_loop_guided, "guided") \
+   A(X, GOMP_parallel_loop_nonmonotonic_dynamic, "dynamic") \
+   A(X, GOMP_parallel_loop_nonmonotonic_guided, "guided")
+#define PGOMP_PARALLEL_LOOP_RUNTIMES(X, A) \
+   A(X, GOMP_parallel_loop_runtime, "runtime") \
+   A(X, GOMP_parallel_loop_nonmonotonic_runtime, "runtime") \
+   A(X, GOMP_parallel_loop_maybe_nonmonotonic_runtime, "runtime")
+
+/** Exported by the dispatcher: looks up a real libgomp function for the
+    build it loaded, which can not use RTLD_NEXT */
+#define PGOMP_REAL_LOOKUP "pgomp_real_function"
+
+/** Allocation functions the dispatcher reports to the build (PGOMP_MALLOC),
+    see pgomp_alloc_begin() in pgomp.c */
+enum { ALLOC_MALLOC, ALLOC_FREE, ALLOC_CALLOC, ALLOC_REALLOC, ALLOC_MEMALIGN,
+       NUM_ALLOCS };
+
+#endif
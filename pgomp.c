@@ -26,19 +26,48 @@
 #define _GNU_SOURCE // required -- PGOMP is Gnu specific, not useful for other compilers
 
 #define BILLION  1000000000.0
-#define HTABLE_SIZE 5000 /**< Hash table size */
 #define MAX_MODE_FLAG 2 /**< Maximum value for mode variable */
+#define REGION_MEMBERS 64 /**< Team members timed without allocating memory */
+#define OMPT_SCOPES 16 /**< Deepest nesting of OMPT scopes per thread */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
+#include <math.h>
 #include <dlfcn.h>
 #include <omp.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sched.h>
+#include <dirent.h>
+#include <link.h>
 #include <time.h>
 #include "config.h"
-#include"papi.h"
+#include "pgomp-lz.h"
+#include "pgomp-trace.h"
+#include "pgomp-wrap.h"
+#ifdef BUILD_PAPI
+#include "papi.h"
+#endif
+#ifdef BUILD_ZSTD
+#include <zstd.h>
+#endif
+#if defined(BUILD_OMPT) && defined(PGOMP_STATIC)
+// OMPT needs the dispatcher to turn the wrappers off, see the OMPT backend
+#undef BUILD_OMPT
+#endif
+#ifdef BUILD_OMPT
+#include <omp-tools.h>
+#endif
 
 
 // 
@@ -70,6 +99,8 @@ typedef struct
    double startTime_2; /**< Time thread reach the end function */
    double startExTime; /**< Start execution time of the function section */
    double endTime; /**< Time thread finsh end function */
+   double startCpu_1; /**< Thread CPU time when the thread reach the start function */
+   double startExCpu; /**< Thread CPU time when the thread stops waiting */
    long long iCount;
 /*@}*/
 } PerThreadInfo;
@@ -86,53 +117,536 @@ typedef struct
    int thId; /**< thread Id */
    double wTime; /**< time thread locking. */
    double exTime; /**< time thread spends executing the critical section */
+   double spinTime; /**< part of wTime the thread spent running on a CPU */
    long count; /**< times of repetition */
    long long iCount; /** instructions count */
+   double mean; /**< Tail mode: moving average of the record time */
+   double var; /**< Tail mode: its moving variance */
+   unsigned int owner; /**< threadKey of the only thread that writes the bucket, 0 if free */
 /*@}*/
 } AggregateInfo;
 
-static PerThreadInfo
-   lock[MAX_THREADS],
-   critical[MAX_THREADS],
-   namedCritical[MAX_THREADS],
-   barrier[MAX_THREADS],
-   nestedLock[MAX_THREADS],
-   parallel[MAX_THREADS],
-   single[MAX_THREADS];
+// Kept per OS thread rather than per OpenMP thread number: in nested teams
+// several threads share a thread number, and there is no limit on threads.
+static __thread PerThreadInfo
+   lock,
+   critical,
+   namedCritical,
+   nestedLock,
+   parallel,
+   single,
+   atomic,
+   ordered,
+   sections,
+   singleCopy;
 
 static AggregateInfo hTable[HTABLE_SIZE];
+static unsigned int usedBuckets[HTABLE_SIZE]; /**< Claimed buckets, in claim order */
+static unsigned int numUsedBuckets = 0;
+static __thread unsigned int threadKey = 0; /**< Unique per OS thread, 0 until assigned */
+static unsigned int numThreadKeys = 0;
+static unsigned long droppedEvents = 0; /**< Events not counted, hash table full */
 
 static FILE * outFile = NULL;
 
-//static double seqTime, seqStartTime, totalSeqTime, totalParaTime, endProgTime;
-//static double ParallelTotalTime=0.0, parallelTime;
+/**
+   A fixed size block of trace text written by one thread, the unit that
+   is handed to the writer thread
+**/
+typedef struct
+{
+/*@{*/
+   unsigned int stream; /**< Stream (thread) the chunk belongs to */
+   size_t len; /**< Bytes of data used */
+   char data[TRACE_CHUNK_SIZE]; /**< Trace records */
+/*@}*/
+} TraceChunk;
+
+/**
+   Per-thread trace output stream
+**/
+typedef struct TraceStream
+{
+/*@{*/
+   TraceChunk *chunk; /**< Chunk the thread is currently filling */
+   TraceChunk *spare; /**< Empty chunk to swap in when chunk fills */
+   char *window; /**< The mapped extent (mmap output) */
+   uint64_t size; /**< Size of the extent */
+   uint64_t pos; /**< Bytes written into the extent */
+   int extent; /**< Extent of the trace file, -1 if none yet */
+   bool noSpace; /**< No extent could be had, the rest is dropped */
+   unsigned int id; /**< Stream number */
+   struct TraceStream *next; /**< Next stream in the list of all streams */
+/*@}*/
+} TraceStream;
+
+/**
+   Bounded lock-free queue of chunks (multiple producers and consumers)
+**/
+typedef struct
+{
+/*@{*/
+   struct
+   {
+      unsigned long seq; /**< Cell sequence number */
+      TraceChunk *chunk; /**< Queued chunk */
+   } cells[WRITER_QUEUE_LEN];
+   unsigned long head; /**< Next cell to pop */
+   unsigned long tail; /**< Next cell to push */
+/*@}*/
+} ChunkQueue;
+
+/** Trace output paths */
+enum { IO_WRITER = 0, IO_MMAP = 1 };
+
+static int compressFlag = CODEC_NONE; /**< Codec, CODEC_NONE writes plain text */
+static __thread TraceStream *myStream = NULL;
+static TraceStream *allStreams = NULL;
+static unsigned int numStreams = 0;
+static ChunkQueue fullChunks, freeChunks;
+static pthread_t writer;
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER; // held while writing
+static int writerDone = 0;
+static unsigned long droppedChunks = 0;
+static ChunkIndexEntry *chunkIndex = NULL; // only touched by the writer
+static unsigned long numChunks = 0, maxChunks = 0;
+static uint64_t fileOffset = 0;
+static pid_t outputPid = 0; // set in a forked child, which gets its own file
+static int ioMode = IO_WRITER; /**< How trace records reach the file */
+
+/** Trace levels of a site under PGOMP_TRACE_BUDGET */
+enum { LEVEL_FULL, LEVEL_SAMPLED, LEVEL_UNTRACED, NUM_LEVELS };
+
+/**
+   Trace level of one site, shared by all threads
+**/
+typedef struct
+{
+/*@{*/
+   void *addr; /**< Call site, NULL if the entry is free */
+   int level; /**< LEVEL_FULL, LEVEL_SAMPLED or LEVEL_UNTRACED */
+/*@}*/
+} GovernorSite;
+
+/**
+   Events of one site in one thread
+**/
+typedef struct
+{
+/*@{*/
+   void *addr; /**< Call site, NULL if the slot is free */
+   GovernorSite *site; /**< Its level, NULL if the site table is full */
+   long events; /**< Events in the current window */
+   long omitted; /**< Events not traced */
+   double omittedTime; /**< Their time (second minus first time column) */
+   unsigned int sample; /**< Events seen while sampled */
+   int thId; /**< Thread number of the last event */
+/*@}*/
+} GovernorSlot;
+
+/**
+   Cost monitor of one thread (PGOMP_TRACE_BUDGET)
+**/
+typedef struct GovernorThread
+{
+/*@{*/
+   double windowStart; /**< Start of the current window */
+   long traced; /**< Records written in the current window */
+   unsigned long dropped; /**< droppedChunks at the start of the window */
+   GovernorSlot slots[GOVERNOR_SLOTS];
+   struct GovernorThread *next; /**< Next in allGovernors */
+/*@}*/
+} GovernorThread;
+
+static double traceBudget = 0.0; /**< PGOMP_TRACE_BUDGET as a fraction, 0 if off */
+static double recordCost = 0.0; /**< Time to format one record, measured at start */
+static GovernorSite governorSites[GOVERNOR_SITES];
+static unsigned long levelChanges[NUM_LEVELS]; /**< Sites moved to each level */
+static __thread GovernorThread *myGovernor = NULL;
+static GovernorThread *allGovernors = NULL;
+
+/**
+   A trace record held back in tail mode
+**/
+typedef struct
+{
+/*@{*/
+   const char *format; /**< Its format */
+   const char *name; /**< Its fields, as in every trace record */
+   void *addr;
+   int thId;
+   double t1, t2;
+   long long iCount; /**< Instruction count, if the format has one */
+/*@}*/
+} TailEvent;
+
+static int tailFlag = 0; /**< PGOMP_MODE=tail: trace mode, outliers only */
+static double tailSigma = 4.0; /**< PGOMP_TAIL_SIGMA */
+static __thread TailEvent tailHistory[TAIL_HISTORY]; /**< The thread's last events */
+static __thread unsigned long tailSeen = 0; /**< Events in tailHistory so far */
+static __thread unsigned long tailWritten = 0; /**< Of those, the ones written */
+static int mmapFd = -1;
+static int mmapNoSpace = 0; /**< Set when an extent could not be had */
+static MmapHeader *mmapHeader = NULL;
+static uint64_t pageSize;
+
+// Serial versus parallel time of the whole program: outermost parallel
+// regions only, added up by the threads that start them
+static double progStartTime, totalParaTime = 0.0, teamParaTime = 0.0;
+static long numRegions = 0;
+static pthread_mutex_t regionLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread double outerStartTime; // GOMP_parallel_start of an outermost region
+
+/** States of a thread's utilization timeline */
+enum { STATE_WORK, STATE_BARRIER, STATE_LOCK, STATE_CRITICAL, STATE_RUNTIME,
+       STATE_IDLE, NUM_STATES };
+static const char *stateNames[NUM_STATES] = { "work", "barrier", "lock",
+                                              "critical", "runtime", "idle" };
+
+/** Where a lock or critical section handoff went (PGOMP_CPU) */
+enum { HANDOFF_CORE, HANDOFF_SOCKET, HANDOFF_REMOTE, NUM_HANDOFFS };
+static const char *handoffNames[NUM_HANDOFFS] = { "same-core", "same-socket",
+                                                  "cross-socket" };
+
+/**
+   Handoffs of one class: a thread acquired a lock or critical section it
+   waited for, released by a thread on another or the same CPU
+**/
+typedef struct
+{
+/*@{*/
+   long count; /**< Handoffs */
+   double time; /**< Release to acquisition, over all handoffs */
+   double max; /**< Longest release to acquisition */
+/*@}*/
+} Handoff;
+
+/**
+   Calls of the allocation functions (PGOMP_MALLOC), see pgomp_alloc_begin()
+**/
+typedef struct
+{
+/*@{*/
+   long calls[NUM_ALLOCS]; /**< Calls of each function */
+   long bytes; /**< Bytes asked for */
+   double time; /**< Time in the functions */
+/*@}*/
+} AllocCount;
+
+static const char *allocNames[NUM_ALLOCS] = { "malloc", "free", "calloc",
+                                              "realloc", "posix_memalign" };
+static int allocFlag = 0; /**< PGOMP_MALLOC: time allocations in regions */
+/** Where the thread's allocations are counted, NULL outside a region body */
+static __thread AllocCount *allocCount = NULL;
+
+/**
+   Where one OS thread's time went (aggregate mode). Every wrapper moves
+   the thread to the state it waits in and back when it returns; a team
+   member is at work in a region body and idle outside of it.
+**/
+typedef struct Timeline
+{
+/*@{*/
+   unsigned int id; /**< Order in which the thread was first seen */
+   int state; /**< Current state */
+   double since; /**< Time the current state was entered */
+   double start; /**< Time the thread was first seen */
+   double time[NUM_STATES]; /**< Time in each state up to since */
+   double moved[NUM_STATES]; /**< Wake and join time moved by the joining thread */
+   int cpu; /**< CPU of the last event (PGOMP_CPU) */
+   long migrations; /**< Events on another CPU than the one before */
+   long nodeMigrations; /**< Of those, to another NUMA node */
+   Handoff handoffs[NUM_HANDOFFS]; /**< Handoffs to this thread */
+   AllocCount alloc; /**< Allocations in region bodies (PGOMP_MALLOC) */
+   struct ConvoyLock *waiting; /**< Lock waited for, NULL if none (PGOMP_CONVOY) */
+   struct ConvoyLock *held[CONVOY_HELD]; /**< Locks held, innermost last */
+   int numHeld; /**< Locks held, may exceed CONVOY_HELD */
+   struct Timeline *next; /**< Next in allTimelines */
+/*@}*/
+} Timeline;
+
+static __thread Timeline *myTimeline = NULL;
+static Timeline *allTimelines = NULL;
+static unsigned int numTimelines = 0;
+
+/**
+   Times of one team member in a parallel region
+**/
+typedef struct
+{
+/*@{*/
+   double startTime; /**< Time the thread entered the region body */
+   double endTime; /**< Time the thread left the region body */
+   double body[NUM_STATES]; /**< Time in each state in the body */
+   Timeline *timeline; /**< The member's timeline, NULL if not kept */
+   int fromState; /**< The member's state before it entered the body */
+   AllocCount alloc; /**< The member's allocations in the body */
+/*@}*/
+} RegionMember;
+
+/**
+   Utilization of the team of the parallel regions started at one site
+**/
+typedef struct
+{
+/*@{*/
+   void *addr; /**< Call site, NULL if the entry is free */
+   long count; /**< Regions */
+   long threads; /**< Team members, over all regions */
+   double elapsed; /**< Wall time, over all regions */
+   double time[NUM_STATES]; /**< Thread time in each state, over all members */
+   AllocCount alloc; /**< Allocations in the bodies, over all members */
+/*@}*/
+} RegionStats;
+
+static RegionStats regionStats[REGION_SITES]; // protected by regionLock
+
+/**
+   The last release of a lock or critical section (PGOMP_CPU). Written by
+   the thread that releases it while still holding it, so the next owner
+   reads it without a race.
+**/
+typedef struct
+{
+/*@{*/
+   void *key; /**< Lock, critical section name or &criticalKey, NULL if free */
+   int cpu; /**< CPU of the releasing thread */
+   double time; /**< Time of the release */
+/*@}*/
+} ReleaseInfo;
+
+static int cpuFlag = 0; /**< PGOMP_CPU: note the CPU of every event */
+static int numCpus = 0; /**< CPUs with a known topology */
+static int cpuCore[MAX_CPUS], cpuSocket[MAX_CPUS], cpuNode[MAX_CPUS];
+static __thread int lastCpu = -1; /**< CPU of the thread's last event */
+static ReleaseInfo releases[HANDOFF_SITES];
+static char criticalKey; // the unnamed critical section
+static char atomicKey; // libgomp's lock for atomics without hardware support
+
+/**
+   The wait-for view of one lock or critical section (PGOMP_CONVOY): who
+   holds it and how many threads wait for it. The acquisition counts are
+   written by the thread that got it, the sample counts by the sampler.
+**/
+typedef struct ConvoyLock
+{
+/*@{*/
+   void *key; /**< Lock, critical section name or &criticalKey, NULL if free */
+   int named; /**< A critical section, named by criticalName() */
+   void *site; /**< Call site of its first acquisition */
+   Timeline *holder; /**< Thread holding it, NULL if free */
+   int waiters; /**< Threads waiting for it */
+   long count; /**< Acquisitions */
+   long contended; /**< Of those, with a wait */
+   long samples; /**< Samples that found threads waiting */
+   long depth; /**< Threads waiting, over those samples */
+   int maxDepth; /**< Most threads waiting in one sample */
+   long chained; /**< Samples that found the holder waiting for another lock */
+/*@}*/
+} ConvoyLock;
+
+/**
+   Samples of the wait-for graph, CONVOY_INTERVAL_NS apart, merged into
+   one slot
+**/
+typedef struct
+{
+/*@{*/
+   double time; /**< Time of the first sample */
+   long samples; /**< Samples */
+   long waiting; /**< Threads waiting for a lock, over all samples */
+   int maxDepth; /**< Most threads waiting for one lock */
+   int maxChain; /**< Longest chain of threads waiting for each other */
+   long cycles; /**< Locks found on a cycle of waits (a deadlock) */
+/*@}*/
+} ConvoySlot;
+
+/**
+   One lock acquired while the thread held another (PGOMP_CONVOY). An
+   entry is only added and counted by the thread holding held, so no two
+   threads update one entry at once.
+**/
+typedef struct
+{
+/*@{*/
+   ConvoyLock *held; /**< The lock held, NULL if the entry is free */
+   ConvoyLock *wanted; /**< The lock acquired */
+   long count; /**< Acquisitions */
+   long contended; /**< Of those, with a wait */
+   double wait; /**< Time waited */
+   bool inversion; /**< On a cycle of pairs, see findInversions() */
+/*@}*/
+} LockOrder;
+
+static int convoyFlag = 0; /**< PGOMP_CONVOY: sample lock convoys and order */
+static ConvoyLock convoyLocks[CONVOY_LOCKS];
+static LockOrder lockOrders[CONVOY_ORDERS];
+static ConvoySlot convoySlots[CONVOY_SLOTS]; // written by the sampler only
+static int numConvoySlots = 0;
+static long convoyPerSlot = 1; /**< Samples merged into one slot */
+static pthread_t sampler;
+static int samplerDone = 0;
+
+/**
+   Contention of one critical section name, over all its sites and threads.
+   Only updated by the thread holding the critical section.
+**/
+typedef struct
+{
+/*@{*/
+   void *key; /**< Name cell, &criticalKey or &atomicKey, NULL if free */
+   long count; /**< Times entered */
+   long contended; /**< Of those, with a wait of 1 us or more */
+   double wait; /**< Time waiting to enter */
+   double waitMax; /**< Longest wait */
+   double hold; /**< Time inside */
+   double holdMax; /**< Longest time inside */
+   long waitHist[CRITICAL_HIST]; /**< Waits by power-of-two bucket */
+   long holdHist[CRITICAL_HIST]; /**< Holds by power-of-two bucket */
+/*@}*/
+} CriticalStats;
+
+static CriticalStats criticalStats[CRITICAL_NAMES];
+
+/**
+   A parallel region in progress. PGOMP hands regionBody() and the frame
+   to libgomp in place of the outlined body and its data, so every team
+   member timestamps its entry and exit.
+**/
+typedef struct RegionFrame
+{
+/*@{*/
+   void (*fn)(void *); /**< Outlined region body */
+   void *data; /**< Its argument */
+   void *addr; /**< Call site of the region */
+   double forkTime; /**< Time the region was started */
+   unsigned team; /**< Threads in the team */
+   unsigned maxMembers; /**< Entries in members */
+   RegionMember *members; /**< Indexed by thread number */
+   struct RegionFrame *outer; /**< Region the thread started before this one */
+   AllocCount *outerAlloc; /**< allocCount of the starting thread before */
+   const char *schedule; /**< Of a combined parallel loop, NULL for a region */
+   long start, end, incr, chunk; /**< Iterations and chunk size of the loop */
+   RegionMember inlineMembers[REGION_MEMBERS];
+/*@}*/
+} RegionFrame;
+
+/**
+   A thread's share of a dynamic, guided or runtime scheduled loop
+   (aggregate mode): the chunk it runs and what it did in the loop so far
+**/
+typedef struct
+{
+/*@{*/
+   void *addr; /**< Call site of the loop's start function, NULL outside a loop */
+   const char *schedule; /**< "dynamic", "guided" or "static" (a runtime schedule) */
+   long chunkSize; /**< Chunk size, 0 for static without one */
+   long start, incr; /**< First iteration and step */
+   double iterations; /**< Iterations of the loop */
+   double loopStart; /**< Time the start function was called */
+   const char *name; /**< Function that handed out the running chunk, NULL if none */
+   void *dispatchAddr; /**< Its call site */
+   double dispatchStart; /**< Time it was called */
+   double handedOut; /**< Time it returned */
+   long long iCount; /**< Instructions counted in it */
+   long first, last; /**< Iterations of the chunk, from first up to last */
+   long chunks; /**< Chunks run */
+   long calls; /**< Calls of the start and next functions */
+   double dispatch; /**< Time in those calls */
+   double busy; /**< Time running chunks */
+   double profile[LOOP_BINS]; /**< Time on the iterations by position in the loop */
+/*@}*/
+} LoopState;
+
+/**
+   The loops run at one call site, over all threads (aggregate mode)
+**/
+typedef struct
+{
+/*@{*/
+   void *addr; /**< Call site of the start function, NULL if the entry is free */
+   const char *schedule; /**< Schedule of the first loop */
+   long chunkSize; /**< Its chunk size */
+   long count; /**< Loops */
+   long threads; /**< Team members, over all loops */
+   double iterations; /**< Over all loops */
+   long chunks; /**< Chunks run */
+   long calls; /**< Calls of the start and next functions */
+   double dispatch; /**< Time in those calls */
+   double busy; /**< Time running chunks */
+   double span; /**< Start call to the end of the loop, over all members */
+   double profile[LOOP_BINS]; /**< Time on the iterations by position in the loop */
+/*@}*/
+} LoopStats;
+
+static LoopStats loopStats[LOOP_SITES]; // protected by loopLock
+static pthread_mutex_t loopLock = PTHREAD_MUTEX_INITIALIZER;
+/** The loop state of the region body the thread runs, see regionBody() */
+static __thread LoopState *myLoop = NULL;
+static __thread LoopState threadLoop; /**< Loop state outside region bodies */
+
+// Regions started with GOMP_parallel_start and not yet ended, innermost first
+static __thread RegionFrame *openRegion = NULL;
 static int modeFlag,  papiFlag=0;
 
 //
-// Function pointers for real GOMP/OMP functions
+// The specialized builds (see the Makefile) fix the mode, and whether
+// PAPI counts instructions, at compile time, so that their wrappers only
+// hold the code of that mode. A build without PGOMP_VARIANT_* decides at
+// run time.
 //
-static int(*real_omp_unset_lock)(omp_lock_t *pLock) = NULL;
-static int (*real_omp_set_nest_lock)(omp_nest_lock_t *pLock) = NULL;
-static int (*real_omp_test_nest_lock)(omp_nest_lock_t *pLock) = NULL;
-static int(*real_omp_unset_nest_lock)(omp_nest_lock_t *pLock) = NULL;
-static void (*real_GOMP_barrier)(void) = NULL;
-static int (*real_omp_test_lock)(omp_lock_t *pLock) = NULL;
-static int (*real_omp_set_lock)(omp_lock_t *pLock) = NULL;
-static int (*real_omp_destroy_lock)(omp_lock_t *pLock) = NULL;
-static int (*real_omp_init_lock)(omp_lock_t *pLock) = NULL;
-static int (*real_GOMP_critical_start)(void) = NULL;
-static int (*real_GOMP_critical_end)(void) = NULL;
-static int (*real_GOMP_critical_name_start)(void ** name) = NULL;
-static int (*real_GOMP_critical_name_end)(void ** name) = NULL;
-static int (*real_GOMP_parallel_start)(void (*fn)(void *),
-            void *data, unsigned num_threads) = NULL;
-static int (*real_GOMP_parallel_end)(void) = NULL;
-static bool (*real_GOMP_single_start)(void) = NULL;
-char errstring[PAPI_MAX_STR_LEN];
+#if defined(PGOMP_VARIANT_TRACE)
+# define TRACING 1
+# define AGGREGATING 0
+#elif defined(PGOMP_VARIANT_AGGREGATE)
+# define TRACING 0
+# define AGGREGATING 1
+#else
+# define TRACING (modeFlag == 1)
+# define AGGREGATING (modeFlag == 2)
+#endif
+#if !defined(BUILD_PAPI)
+# define COUNTING 0
+#elif defined(PGOMP_VARIANT_TRACE) || defined(PGOMP_VARIANT_AGGREGATE)
+# ifdef PGOMP_VARIANT_PAPI
+#  define COUNTING 1
+# else
+#  define COUNTING 0
+# endif
+#else
+# define COUNTING papiFlag
+#endif
+
+/** Aggregate output formats */
+enum { FORMAT_TEXT = 0, FORMAT_CSV = 1, FORMAT_JSON = 2 };
+static int formatFlag = FORMAT_TEXT;
 
+#ifdef PGOMP_STATIC
+//
+// The static archive (libpgomp.a, see the Makefile) is linked into the
+// program with -Wl,--wrap=<function> for every wrapped function: the
+// program's calls go to __wrap_<function>, and __real_<function> is the
+// real one. The wrappers keep their names in C (so __func__ still names
+// the records) but are emitted as __wrap_<function>, and real_<function>
+// is a direct call to __real_<function>, with nothing to look up.
+//
+#define STATIC_NAMES(ret, name, params, args) \
+   ret name params __asm__("__wrap_" #name); \
+   extern ret real_##name params __asm__("__real_" #name);
+PGOMP_WRAPPED_VOID(STATIC_NAMES)
+PGOMP_WRAPPED_VALUE(STATIC_NAMES)
+#else
+//
+// Function pointers for real GOMP/OMP functions
+//
+#define REAL_POINTER(ret, name, params, args) static ret (*real_##name) params = NULL;
+PGOMP_WRAPPED_VOID(REAL_POINTER)
+PGOMP_WRAPPED_VALUE(REAL_POINTER)
+#endif
+static __thread long long instCount; /**< Instructions counted in the last start call */
 #ifdef BUILD_PAPI
-   static long long instCount[MAX_THREADS],noCycle[MAX_THREADS];
-   static int  ioverhead,cOverhead=0;
+char errstring[PAPI_MAX_STR_LEN];
+static int ioverhead; /**< Instructions counted around an empty call */
 #endif
 int numOfThreads;
 
@@ -144,1196 +658,5375 @@ int numOfThreads;
 /**
    @brief Open a new file.
            Stop the program and exit if can not open the file.
+           A forked child writes to its own file, named after its pid.
    @return Void.
 **/
 static void openFile()
 {
-   outFile = fopen (OUTPUT_FILENAME, "w");
+   char name[PATH_MAX];
+   const char *base = compressFlag != CODEC_NONE ? COMPRESSED_FILENAME
+                                                 : OUTPUT_FILENAME;
+   if (outputPid != 0)
+      snprintf(name, sizeof(name), "%s.%d", base, (int) outputPid);
+   else
+      snprintf(name, sizeof(name), "%s", base);
+   outFile = fopen (name, "w");
    if (outFile == NULL)
    {
       fprintf(stderr,"LIBPGOMP ERROR: Thread %d cannot open file\n", omp_get_thread_num());
          exit (0);
    }
+   fileOffset = 0;
 }
 
 /*--------------------------------------------------------------------*
- * getTime function to return the time.                               *
+ * Trace chunk queue functions                                        *
  *--------------------------------------------------------------------*/
-#ifdef RELATIVE_TIME
-static double initialTime=0.0;
-#endif
+
 /**
-   @brief Gets the clock time.
-   @return The number of seconds and nanoseconds since 1/1/1970
+   @brief Prepares an empty chunk queue.
 **/
-static double getTime()
+static void queueInit(ChunkQueue *q)
 {
-   struct timespec tim;
-   if (clock_gettime(CLOCK_REALTIME, &tim) == -1)
-   {
-      perror("clock gettime");
-      exit(EXIT_FAILURE);
-   }
-#ifdef RELATIVE_TIME
-   return tim.tv_sec-initialTime+tim.tv_nsec/BILLION;
-#else
-   return tim.tv_sec+tim.tv_nsec/BILLION;
-#endif
+   unsigned long i;
+   for (i = 0; i < WRITER_QUEUE_LEN; i++)
+      q->cells[i].seq = i;
+   q->head = q->tail = 0;
 }
 
-/*-------------------------------------------------------------------*
- * hash function                                                     *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Calculates hash table index.
-   @param add - Function return address.
-   @param tId - Thread Id.
-   @return Hash table index.
+   @brief Adds a chunk to a queue without ever waiting.
+   @return true if the chunk was queued, false if the queue is full.
 **/
-static unsigned int hash(void* add, int tId)
+static bool queuePush(ChunkQueue *q, TraceChunk *chunk)
 {
-   return (((unsigned long) add) + tId) % HTABLE_SIZE;
+   unsigned long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+   for (;;)
+   {
+      unsigned long seq = __atomic_load_n(&q->cells[pos % WRITER_QUEUE_LEN].seq,
+                                          __ATOMIC_ACQUIRE);
+      long dif = (long) (seq - pos);
+      if (dif == 0)
+      {
+         if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if (dif < 0)
+         return false;
+      else
+         pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+   }
+   q->cells[pos % WRITER_QUEUE_LEN].chunk = chunk;
+   __atomic_store_n(&q->cells[pos % WRITER_QUEUE_LEN].seq, pos + 1, __ATOMIC_RELEASE);
+   return true;
 }
 
-/*-------------------------------------------------------------------*
- * addBucket function                                                *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Adds new bucket to hash table.
-   @param index - hash table index.
-   @param thId - Thread Id.
-   @param name - Function name
-   @param beginAddr - Start function return address.
-   @param endAddr - End function return address.
-   @param wTime - Thread waiting time.
-   @param exTime - execution time.
-   @return Hash void.
+   @brief Removes a chunk from a queue without ever waiting.
+   @return The chunk, or NULL if the queue is empty.
 **/
-static void addBucket(int index, int thId,  const char *name, void* beginAddr,
-                void* endAddr, double wTime, double exTime, long long insCount)
+static TraceChunk* queuePop(ChunkQueue *q)
 {
-   hTable[index].funName = name;
-   hTable[index].beginAddr = beginAddr;
-   hTable[index].endAddr = endAddr;
-   hTable[index].thId = thId;
-   hTable[index].wTime = wTime;
-   hTable[index].exTime = exTime;
-   hTable[index].count = 1;
-   hTable[index].iCount = insCount;
+   TraceChunk *chunk;
+   unsigned long pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+   for (;;)
+   {
+      unsigned long seq = __atomic_load_n(&q->cells[pos % WRITER_QUEUE_LEN].seq,
+                                          __ATOMIC_ACQUIRE);
+      long dif = (long) (seq - (pos + 1));
+      if (dif == 0)
+      {
+         if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if (dif < 0)
+         return NULL;
+      else
+         pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+   }
+   chunk = q->cells[pos % WRITER_QUEUE_LEN].chunk;
+   __atomic_store_n(&q->cells[pos % WRITER_QUEUE_LEN].seq, pos + WRITER_QUEUE_LEN,
+                    __ATOMIC_RELEASE);
+   return chunk;
 }
 
-/*-------------------------------------------------------------------*
- * updateBucket function                                             *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Updates an existing bucket in hash table.
-   @param index - hash table index.
-   @param wTime - thread waiting time.
-   @param exTime - execution time.
-   @return Hash void.
+   @brief Tells whether a queue is empty.
 **/
-static void updateBucket(int index, double wTime, double exTime,long long insCount)
+static bool queueEmpty(ChunkQueue *q)
 {
-   hTable[index].count++;
-   hTable[index].wTime += wTime;
-   hTable[index].exTime += exTime;
-   hTable[index].iCount +=insCount;
+   return __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)
+          == __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
 }
 
-/*-------------------------------------------------------------------*
- * editBucket function                                               *
- *-------------------------------------------------------------------*/
+/*--------------------------------------------------------------------*
+ * Writer thread                                                      *
+ *--------------------------------------------------------------------*/
 
 /**
-   @brief If the bucket does not exist in the hash table adds it as a new
-          bucket to hash table. If the bucket is already existed updates it.
-   @param index - hash table index.
-   @param thId - Thread Id.
-   @param name - Function name
-   @param beginAddr - Start function return address.
-   @param endAddr - End function return address.
-   @param wTime - Thread waiting time.
-   @param exTime - execution time.
-   @return Hash void.
+   @brief Writes a vector of buffers at the current end of the output
+          file, retrying partial writes. Only called by the writer.
+   @param iov - Buffers; modified.
+   @param count - Number of buffers.
 **/
-static void editBucket(int index, int thId, const char *name, void* beginAddr,
-                 void* endAddr,double wTime, double exTime,long long insCount)
+static void writeOut(struct iovec *iov, int count)
 {
-   int count = 0, found = 0;
-   while (hTable[index].funName != NULL && found == 0)
+   static int reported = 0;
+   int fd = fileno(outFile);
+   while (count > 0)
    {
-      if (hTable[index].beginAddr == beginAddr
-          && strcmp(hTable[index].funName , name) == 0
-          && hTable[index].thId == thId)
+      ssize_t n = pwritev(fd, iov, count, fileOffset);
+      if (n < 0)
       {
-         found=1;// Bucket already existed
+         if (!reported)
+            perror("LIBPGOMP ERROR: trace write");
+         reported = 1;
+         return;
       }
-      else
+      fileOffset += n;
+      while (count > 0 && (size_t) n >= iov->iov_len)
       {
-         index = (index + 1) % HTABLE_SIZE;
-         count++;
-         if (count >= HTABLE_SIZE - 1)
-         {
-            fprintf(stderr,"LIBPGOMP ERROR: Hash table is full\n");
-            exit(0);
-         }
+         n -= iov->iov_len;
+         iov++;
+         count--;
+      }
+      if (count > 0)
+      {
+         iov->iov_base = (char*) iov->iov_base + n;
+         iov->iov_len -= n;
       }
    }
-   if (hTable[index].funName != NULL)
+}
+
+/**
+   @brief Compresses one chunk and records it in the chunk index.
+          Only called by the writer.
+   @param chunk - Filled chunk.
+   @param out - Buffer large enough for any compressed chunk.
+   @param header - Set to the chunk header.
+   @param offset - File offset the chunk will be written at.
+   @return The payload to write after the header (out, or the chunk data
+           itself if it did not compress).
+**/
+static char* compressChunk(TraceChunk *chunk, char *out, ChunkHeader *header,
+                           uint64_t offset)
+{
+   size_t len = 0;
+   header->magic = CHUNK_MAGIC;
+   header->stream = chunk->stream;
+   header->rawLen = chunk->len;
+   header->codec = compressFlag;
+#ifdef BUILD_ZSTD
+   if (compressFlag == CODEC_ZSTD)
    {
-      // Bucket already existed.
-      updateBucket(index, wTime, exTime,insCount);
+      len = ZSTD_compress(out, ZSTD_compressBound(TRACE_CHUNK_SIZE), chunk->data,
+                          chunk->len, COMPRESS_LEVEL);
+      if (ZSTD_isError(len))
+         len = 0;
    }
    else
+#endif
+      len = lzCompress(chunk->data, chunk->len, out, LZ_BOUND(TRACE_CHUNK_SIZE));
+   if (len == 0 || len >= chunk->len)
    {
-      // Bucket not found.
-      addBucket(index, thId, name, beginAddr, endAddr, wTime, exTime, insCount);
+      // incompressible, store the text as it is
+      header->codec = CODEC_NONE;
+      len = chunk->len;
+      out = chunk->data;
    }
-}
-
-/*---------------------------------------------------------------*
- *  Initialize the PAPI library                                  *
- *---------------------------------------------------------------*/
-void initPapi()
-{
-   int retval;
-   long long values[NUM_EVENTS];
-   int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-   if((retval = PAPI_library_init(PAPI_VER_CURRENT)) != PAPI_VER_CURRENT )
+   header->compLen = len;
+   if (numChunks == maxChunks)
    {
-      fprintf(stderr, "Error: %d %s\n",retval, errstring);
-      exit(1);
+      maxChunks = maxChunks ? 2 * maxChunks : 1024;
+      chunkIndex = realloc(chunkIndex, maxChunks * sizeof(ChunkIndexEntry));
+      if (chunkIndex == NULL)
+      {
+         fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the chunk index\n");
+         exit(0);
+      }
    }
-   if ( PAPI_thread_init((unsigned long (*)(void))(omp_get_thread_num)) != PAPI_OK)
-      ERROR_RETURN(retval);
-   START_COUNTER;
-   STOP_COUNTER;
+   chunkIndex[numChunks].offset = offset;
+   chunkIndex[numChunks].stream = header->stream;
+   chunkIndex[numChunks].codec = header->codec;
+   chunkIndex[numChunks].rawLen = header->rawLen;
+   chunkIndex[numChunks].compLen = header->compLen;
+   numChunks++;
+   return out;
 }
 
-/*--------------------------------------------------------------------*
- * Instruction counts overhead
- *--------------------------------------------------------------------*/
-int instOverhead()
+/**
+   @brief Body of the writer thread. Takes up to WRITER_BATCH filled
+          chunks off the queue at a time, compresses them if asked to,
+          writes the batch with a single pwritev() and recycles the
+          chunks. Runs until stopWriter() sets writerDone and the queue
+          is empty.
+**/
+static void* writerThread(void *arg)
 {
-   int retval;
-   int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-   long long values[NUM_EVENTS];
-   START_COUNTER;
-   STOP_COUNTER;
-   return values[0];
+   TraceChunk *batch[WRITER_BATCH];
+   ChunkHeader headers[WRITER_BATCH];
+   struct iovec iov[2 * WRITER_BATCH];
+   struct timespec idle = { 0, WRITER_IDLE_NS };
+   size_t outSize = LZ_BOUND(TRACE_CHUNK_SIZE);
+   char *out = NULL;
+   int n, i, count;
+   uint64_t offset;
+#ifdef BUILD_ZSTD
+   if (ZSTD_compressBound(TRACE_CHUNK_SIZE) > outSize)
+      outSize = ZSTD_compressBound(TRACE_CHUNK_SIZE);
+#endif
+   if (compressFlag != CODEC_NONE && (out = malloc(WRITER_BATCH * outSize)) == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the trace writer\n");
+      exit(0);
+   }
+   for (;;)
+   {
+      pthread_mutex_lock(&writerLock);
+      for (n = 0; n < WRITER_BATCH; n++)
+         if ((batch[n] = queuePop(&fullChunks)) == NULL)
+            break;
+      if (n == 0)
+      {
+         pthread_mutex_unlock(&writerLock);
+         if (__atomic_load_n(&writerDone, __ATOMIC_ACQUIRE) && queueEmpty(&fullChunks))
+            break;
+         nanosleep(&idle, NULL);
+         continue;
+      }
+      offset = fileOffset;
+      for (i = count = 0; i < n; i++)
+      {
+         if (compressFlag == CODEC_NONE)
+         {
+            iov[count].iov_base = batch[i]->data;
+            iov[count++].iov_len = batch[i]->len;
+            continue;
+         }
+         iov[count].iov_base = &headers[i];
+         iov[count++].iov_len = sizeof(ChunkHeader);
+         iov[count].iov_base = compressChunk(batch[i], out + i * outSize,
+                                             &headers[i], offset);
+         iov[count++].iov_len = headers[i].compLen;
+         offset += sizeof(ChunkHeader) + headers[i].compLen;
+      }
+      writeOut(iov, count);
+      pthread_mutex_unlock(&writerLock);
+      for (i = 0; i < n; i++)
+      {
+         batch[i]->len = 0;
+         if (!queuePush(&freeChunks, batch[i]))
+            free(batch[i]);
+      }
+   }
+   free(out);
+   return NULL;
 }
 
-/*-------------------------------------------------------------------*
- * printResult function                                               *
- *-------------------------------------------------------------------*/
-
 /**
- @brief Prints hash table data.
-   @param table[] - Hash table.
-   @return Hash void.
+   @brief Starts the writer thread. In compressed mode also writes the
+          file magic.
 **/
-static void printResult(AggregateInfo table[])
+static void startWriter()
 {
-   int index;
-if(papiFlag)
-   for (index = 0; index < HTABLE_SIZE ; index++)
+   struct iovec iov;
+   if (compressFlag != CODEC_NONE)
    {
-      if (table[index].count > 0)
-         fprintf(outFile, " %s %p %p %d %lf %lf %ld %lld\n",
-                    table[index].funName, table[index].beginAddr,
-                    table[index].endAddr, table[index].thId,
-                    table[index].wTime, table[index].exTime,
-                    table[index].count,
-                    table[index].iCount);
-   }
-else
-   for (index = 0; index < HTABLE_SIZE ; index++)
+      iov.iov_base = TRACE_MAGIC;
+      iov.iov_len = 8;
+      writeOut(&iov, 1);
+   }
+   queueInit(&fullChunks);
+   queueInit(&freeChunks);
+   writerDone = 0;
+   if (pthread_create(&writer, NULL, writerThread, NULL) != 0)
    {
-  if (table[index].count > 0)
-         fprintf(outFile, " %s %p %p %d %lf %lf %ld \n",
-                    table[index].funName, table[index].beginAddr,
-                    table[index].endAddr, table[index].thId,
-                    table[index].wTime, table[index].exTime,
-                    table[index].count);
+      fprintf(stderr,"LIBPGOMP ERROR: Cannot start the trace writer thread\n");
+      exit(0);
+   }
 }
+
+/**
+   @brief Waits until the writer has written everything queued so far,
+          then keeps it from starting another write (holding writerLock).
+**/
+static void drainWriter()
+{
+   struct timespec idle = { 0, WRITER_IDLE_NS };
+   while (!queueEmpty(&fullChunks))
+      nanosleep(&idle, NULL);
+   pthread_mutex_lock(&writerLock);
 }
 
 /**
-   @brief Error checking wrapper around library dlsym() symbol lookup.
+   @brief Hands every partially filled chunk to the writer, waits for it
+          to finish, and in compressed mode writes the chunk index and
+          footer. Called once from pgomp_end().
 **/
-static void* lookupFunction(char* name)
+static void stopWriter()
 {
-   char* dlerr;
-   void* functionPtr;
-   dlerror(); // clear dlerror flag
-   functionPtr = dlsym(RTLD_NEXT, name);
-   dlerr = dlerror();
-   if (dlerr || !functionPtr) {
-      fprintf(stderr,"LIBPGOMP ERROR: Unable to resolve real %s: (%s)\n",name,
-              (dlerr? dlerr : "no error message available"));
-      exit(0);
+   TraceStream *ts;
+   TraceFooter footer;
+   struct iovec iov[2];
+   struct timespec idle = { 0, WRITER_IDLE_NS };
+   for (ts = allStreams; ts != NULL; ts = ts->next)
+   {
+      if (ts->chunk == NULL || ts->chunk->len == 0)
+         continue;
+      // at exit we can afford to wait for room in the queue
+      while (!queuePush(&fullChunks, ts->chunk))
+         nanosleep(&idle, NULL);
+      ts->chunk = NULL;
    }
-   return functionPtr;
+   __atomic_store_n(&writerDone, 1, __ATOMIC_RELEASE);
+   pthread_join(writer, NULL);
+   if (compressFlag != CODEC_NONE)
+   {
+      footer.indexOffset = fileOffset;
+      footer.numChunks = numChunks;
+      footer.droppedChunks = droppedChunks;
+      memcpy(footer.magic, TRACE_INDEX_MAGIC, 8);
+      iov[0].iov_base = chunkIndex;
+      iov[0].iov_len = numChunks * sizeof(ChunkIndexEntry);
+      iov[1].iov_base = &footer;
+      iov[1].iov_len = sizeof(footer);
+      writeOut(iov, 2);
+   }
+   if (droppedChunks > 0)
+      fprintf(stderr,"LIBPGOMP WARNING: The trace writer fell behind, %lu trace "
+                     "chunks (%lu bytes each) were dropped\n", droppedChunks,
+                     (unsigned long) TRACE_CHUNK_SIZE);
 }
 
+/*--------------------------------------------------------------------*
+ * Memory-mapped trace output                                         *
+ *--------------------------------------------------------------------*/
+
 /**
-   @brief Lookup function name that an address is inside of.
+   @brief Allocates disk space for part of the memory-mapped trace, so
+          stores into the mapping never fault on a full disk halfway
+          through a run. Falls back to extending the file (sparse) where
+          the file system does not support fallocate().
+   @return 0 on success.
 **/
-//
-// This will not be reliable because dladdr() requires the symbol to be
-// accessible as an exported dynamic symbol. If you compile your program
-// with "-Wl,--export-dynamic" then it might work relatively well. For
-// now we do not have it integrated into the code.
-//
-static const char* lookupFunctionName(void* address)
+static int preallocate(uint64_t offset, uint64_t len)
 {
-   Dl_info info;
-   if (dladdr(address,&info))
+   struct stat st;
+   if (fallocate(mmapFd, 0, offset, len) == 0)
       return 0;
-   return info.dli_sname;
+   if (errno != EOPNOTSUPP || fstat(mmapFd, &st) != 0)
+      return -1;
+   if ((uint64_t) st.st_size >= offset + len)
+      return 0;
+   return ftruncate(mmapFd, offset + len);
 }
 
-/*-------------------------------------------------------------------*
- * Constructor attribute                                             *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief It will execute automatically when the tool runs.
-          It calls open file function and gets and checks Environment variable
-          PGOMP_MODE's value.
+   @brief Creates the memory-mapped trace file and maps its header. The
+          extents are handed out as threads need them, see nextExtent().
 **/
+static void openMmap()
+{
+   char name[PATH_MAX];
+   uint64_t headerSize = sizeof(MmapHeader) + MMAP_MAX_EXTENTS * sizeof(ExtentEntry);
+   pageSize = sysconf(_SC_PAGESIZE);
+   headerSize = (headerSize + pageSize - 1) / pageSize * pageSize;
+   if (outputPid != 0)
+      snprintf(name, sizeof(name), "%s.%d", MMAP_FILENAME, (int) outputPid);
+   else
+      snprintf(name, sizeof(name), "%s", MMAP_FILENAME);
+   mmapFd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (mmapFd < 0 || preallocate(0, headerSize) != 0)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Thread %d cannot create %s\n",
+              omp_get_thread_num(), name);
+      exit(0);
+   }
+   mmapHeader = mmap(NULL, headerSize, PROT_READ | PROT_WRITE, MAP_SHARED, mmapFd, 0);
+   if (mmapHeader == MAP_FAILED)
+   {
+      perror("LIBPGOMP ERROR: mmap");
+      exit(0);
+   }
+   memcpy(mmapHeader->magic, MMAP_MAGIC, 8);
+   mmapHeader->headerSize = headerSize;
+   mmapHeader->extentSize = MMAP_EXTENT_SIZE;
+   mmapHeader->fileSize = headerSize;
+   mmapHeader->dropped = 0;
+   mmapHeader->maxExtents = MMAP_MAX_EXTENTS;
+   mmapHeader->numExtents = 0;
+}
 
-__attribute__((constructor)) void pgomp_init()
+/**
+   @brief Gives the calling thread a new extent at the end of the file,
+          with its disk space, and maps it in place of the full one. The
+          file only grows by the extents threads fill, and a full disk
+          ends the thread's trace instead of the program.
+   @return true on success, false if all extents are taken or the disk has
+           no room for one.
+**/
+static bool nextExtent(TraceStream *ts)
 {
-   char* mode;
-#ifdef RELATIVE_TIME
-   initialTime = getTime();
-#endif
-   openFile();
-   if (getenv("PGOMP_MODE") == NULL)
+   unsigned int ext;
+   uint64_t offset, size;
+   ExtentEntry *entry;
+   char *window;
+   if (ts->noSpace)
+      return false;
+   size = ts->window == NULL ? MMAP_FIRST_EXTENT
+          : ts->size * 2 < MMAP_EXTENT_SIZE ? ts->size * 2 : MMAP_EXTENT_SIZE;
+   ext = __atomic_fetch_add(&mmapHeader->numExtents, 1, __ATOMIC_RELAXED);
+   if (ext >= MMAP_MAX_EXTENTS)
    {
-      mode = "aggregate";
+      __atomic_store_n(&mmapHeader->numExtents, MMAP_MAX_EXTENTS, __ATOMIC_RELAXED);
+      if (!__atomic_exchange_n(&mmapNoSpace, 1, __ATOMIC_RELAXED))
+         fprintf(stderr,"LIBPGOMP WARNING: All %d trace extents are taken, records "
+                        "from here on are dropped (raise MMAP_MAX_EXTENTS)\n",
+                 MMAP_MAX_EXTENTS);
+      ts->noSpace = true;
+      return false;
    }
-   else
+   // an extent that gets no disk space stays empty (used 0) and unchained
+   entry = &mmapHeader->extents[ext];
+   offset = __atomic_fetch_add(&mmapHeader->fileSize, size, __ATOMIC_RELAXED);
+   entry->offset = offset;
+   entry->size = size;
+   entry->used = 0;
+   entry->stream = ts->id;
+   entry->next = MMAP_NO_EXTENT;
+   if (preallocate(offset, size) != 0)
    {
-      mode = getenv("PGOMP_MODE"); // Get Environment variable PGOMP_MODE's value.
+      if (!__atomic_exchange_n(&mmapNoSpace, 1, __ATOMIC_RELAXED))
+         fprintf(stderr,"LIBPGOMP WARNING: No disk space for the trace (%s), "
+                        "records from here on are dropped\n", strerror(errno));
+      ts->noSpace = true;
+      return false;
    }
-   if (strcmp(mode , "trace") == 0)// Trace mode
-      modeFlag = 1;
-   else if (strcmp(mode , "aggregate") == 0)// Aggregate mode
-      modeFlag = 2;
-   if (modeFlag < 1 || modeFlag> MAX_MODE_FLAG)
+   window = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mmapFd, offset);
+   if (window == MAP_FAILED)
    {
-      fprintf(stderr,"LIBPGOMP ERROR: Environment variable "
-                     "PGOMP_MODE not 'trace' or 'aggregate'\n");
+      perror("LIBPGOMP ERROR: mmap");
       exit(0);
    }
-#ifdef BUILD_PAPI
-   char* papiMode;
-   if (getenv("PGOMP_PAPI") == NULL)
+   if (ts->extent >= 0)
    {
-      papiMode = "false";
-      papiFlag = 0;
+      mmapHeader->extents[ts->extent].used = ts->pos;
+      mmapHeader->extents[ts->extent].next = ext;
+      munmap(ts->window, ts->size);
    }
-   else
+   ts->extent = ext;
+   ts->window = window;
+   ts->size = size;
+   ts->pos = 0;
+   return true;
+}
+
+/**
+   @brief Writes one trace record straight into the calling thread's
+          mapped extent. No copy and no system call, except when the
+          extent is full.
+   @param ts - Trace stream of the calling thread.
+   @param format - printf style format of the record.
+   @param args - Record values.
+**/
+static void mmapOut(TraceStream *ts, const char *format, va_list args)
+{
+   int n;
+   if (ts->window == NULL || ts->pos + MAX_RECORD_LEN > ts->size)
    {
-      papiMode = getenv("PGOMP_PAPI"); // Get Environment variable PGOMP_PAPI's value.
-      if (strcmp(papiMode , "true") == 0)// Using PAPI
+      if (!nextExtent(ts))
       {
-         papiFlag = 1;
-         initPapi();
-         ioverhead=instOverhead();
+         __atomic_fetch_add(&mmapHeader->dropped, 1, __ATOMIC_RELAXED);
+         return;
       }
-      else if (strcmp(papiMode , "false") == 0)// Do not use PAPI
-         papiFlag = 0;
-         else //(papiFlag is not true or false )
-         {
-            fprintf(stderr,"LIBPGOMP ERROR: Environment variable PAPI_MODE "
-                           "set incorrectly it should be 'true',false or unset\n");
-            exit(0);
-         }
-     }
-#else
-   papiFlag = 0;
-#endif
-   //
-   // Function lookups (do all at initialization, so runtime is faster)
-   //
-   real_omp_init_lock = lookupFunction("omp_init_lock");
-   real_omp_destroy_lock = lookupFunction("omp_destroy_lock");
-   real_omp_set_lock = lookupFunction("omp_set_lock");
-   real_omp_test_lock = lookupFunction("omp_test_lock");
-   real_omp_unset_lock = lookupFunction("omp_unset_lock");
-   real_omp_set_nest_lock = lookupFunction("omp_set_nest_lock");
-   real_omp_test_nest_lock = lookupFunction("omp_test_nest_lock");
-   real_omp_unset_nest_lock = lookupFunction("omp_unset_nest_lock");
-   real_GOMP_barrier = lookupFunction("GOMP_barrier");
-   real_GOMP_critical_start = lookupFunction("GOMP_critical_start");
-   real_GOMP_critical_end = lookupFunction("GOMP_critical_end");
-   real_GOMP_critical_name_start = lookupFunction("GOMP_critical_name_start");
-   real_GOMP_critical_name_end = lookupFunction("GOMP_critical_name_end");
-   real_GOMP_parallel_start = lookupFunction("GOMP_parallel_start");
-   real_GOMP_parallel_end = lookupFunction("GOMP_parallel_end");
-   real_GOMP_single_start = lookupFunction("GOMP_single_start");
+   }
+   n = vsnprintf(ts->window + ts->pos, MAX_RECORD_LEN, format, args);
+   if (n > 0 && n < MAX_RECORD_LEN)
+      ts->pos += n;
 }
 
-/*-------------------------------------------------------------------*
-  Destructor attribute run at the end of the using of the library    *
- *-------------------------------------------------------------------*/
 /**
-   @brief It will execute automatically at the end of the using of the library.
-          It Prints the result and close the output file.
+   @brief Records how much of the last extent of every thread was used and
+          gives back the disk space of its unused rest. Called once from
+          pgomp_end().
 **/
-__attribute__((destructor)) void pgomp_end (void)
+static void closeMmap()
 {
-   if (modeFlag == 2)
-      printResult(hTable);
-   fclose(outFile);
+   TraceStream *ts;
+   uint64_t used;
+   for (ts = allStreams; ts != NULL; ts = ts->next)
+   {
+      if (ts->extent < 0)
+         continue;
+      mmapHeader->extents[ts->extent].used = ts->pos;
+      used = (ts->pos + pageSize - 1) / pageSize * pageSize;
+      if (used < ts->size)
+         fallocate(mmapFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                   mmapHeader->extents[ts->extent].offset + used,
+                   ts->size - used);
+   }
+   msync(mmapHeader, mmapHeader->headerSize, MS_SYNC);
+   if (mmapHeader->dropped > 0)
+      fprintf(stderr,"LIBPGOMP WARNING: %lu trace records were dropped%s\n",
+              (unsigned long) mmapHeader->dropped,
+              mmapHeader->numExtents >= MMAP_MAX_EXTENTS
+              ? " (raise MMAP_MAX_EXTENTS)" : " (out of disk space)");
 }
 
-/*-------------------------------------------------------------------*
- * omp_init_lock function                                            *
- *-------------------------------------------------------------------*/
+/*--------------------------------------------------------------------*
+ * fork handlers                                                      *
+ *--------------------------------------------------------------------*/
 
-void omp_init_lock(omp_lock_t *pLock)
+/**
+   @brief Before fork(): lets the writer finish what is queued so the
+          child does not inherit a half written file.
+**/
+static void forkPrepare()
 {
-   //int thId;
-   //thId = omp_get_thread_num(); // maybe will use someday
-   real_omp_init_lock(pLock);
+   if (TRACING && ioMode == IO_WRITER)
+      drainWriter();
 }
 
-/*-------------------------------------------------------------------*
- * omp_destroy_lock function                                         *
- *-------------------------------------------------------------------*/
-
-void omp_destroy_lock(omp_lock_t *pLock)
+/**
+   @brief After fork(), in the parent: lets the writer go on.
+**/
+static void forkParent()
 {
-   //int thId;
-   //thId = omp_get_thread_num();  // maybe will use someday
-   real_omp_destroy_lock(pLock);
+   if (TRACING && ioMode == IO_WRITER)
+      pthread_mutex_unlock(&writerLock);
 }
 
-/*-------------------------------------------------------------------*
- * omp_set_lock function                                             *
- *-------------------------------------------------------------------*/
 /**
-   @brief Gets the needed time values to calculate the thread locking
-          overhead. Also, gets call location.
-          Gets the start time which is the time when the current thread
-          reach this function.
-          Gets start execution time which is the time when the current
-          thread acquired the lock[thId].
-          Gets the return address of the function.
-   @param lock - A variable of type omp_lock_t that was initialized
-                 with omp_init_lock[thId].
-   @return void
+   @brief After fork(), in the child: the writer thread is gone and the
+          data inherited from the parent is the parent's to write. Drops
+          it, opens a file of the child's own and starts a new writer.
+          In aggregate mode aggregateForkChild() drops the counts.
 **/
-
-void omp_set_lock(omp_lock_t *pLock)
+static void forkChild()
 {
-   int thId;
-   thId = omp_get_thread_num();
-   lock[thId].beginAddr = getReturnAddress(0);
-   lock[thId].startName = __func__;
-   lock[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+   TraceStream *ts;
+   outputPid = getpid();
+   if (TRACING && ioMode == IO_MMAP)
    {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
+      // the mappings are shared with the parent's file
+      for (ts = allStreams; ts != NULL; ts = ts->next)
+      {
+         if (ts->window != NULL)
+            munmap(ts->window, ts->size);
+         ts->window = NULL;
+         ts->extent = -1;
+         ts->noSpace = false;
+      }
+      munmap(mmapHeader, mmapHeader->headerSize);
+      close(mmapFd);
+      openMmap();
+      return;
    }
-#endif
-   real_omp_set_lock(pLock);
-   if(papiFlag)
+   if (TRACING)
    {
-      STOP_COUNTER;
-      instCount[thId] =values[0]-ioverhead;
- //     noCycle[thId]+=values[1];
+      pthread_mutex_unlock(&writerLock);
+      for (ts = allStreams; ts != NULL; ts = ts->next)
+         if (ts->chunk != NULL)
+            ts->chunk->len = 0;
+      while (queuePop(&fullChunks) != NULL)
+         ; // leaked, the parent owns them
+      numChunks = 0;
+      droppedChunks = 0;
    }
-   lock[thId].startExTime = getTime();
-   if (modeFlag == 1)
+   // the parent's buffered output is the parent's to write: drop the
+   // inherited descriptor without flushing it
+   if (outFile != NULL)
+      close(fileno(outFile));
+   openFile();
+   if (TRACING)
+      startWriter();
+}
+
+/**
+   @brief Gets an empty chunk, recycled if possible.
+   @return The chunk, or NULL if out of memory.
+**/
+static TraceChunk* getChunk(unsigned int stream)
+{
+   TraceChunk *chunk = queuePop(&freeChunks);
+   if (chunk == NULL)
+      chunk = malloc(sizeof(TraceChunk));
+   if (chunk != NULL)
    {
-      if(papiFlag)
-      {
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", lock[thId].startName,
-              lock[thId].beginAddr, thId, lock[thId].startTime_1,
-              lock[thId].startExTime,values[0]-ioverhead);
-      }
-      else
-      {
-          fprintf(outFile,"  %s %p %d %lf %lf \n", lock[thId].startName,
-              lock[thId].beginAddr, thId, lock[thId].startTime_1,
-              lock[thId].startExTime);
-      }
+      chunk->stream = stream;
+      chunk->len = 0;
    }
+   return chunk;
 }
 
-/*-------------------------------------------------------------------*
- * omp_test_lock function                                            *
- *-------------------------------------------------------------------*/
 /**
-   @brief Gets the needed time values to calculate the thread locking
-          overhead. Also, gets call location.
-   @param lock - A variable of type omp_lock_t that was initialized
-          with omp_init_lock[thId].
-   @return If attempts to set the lock specified by the variable
-           succeed, the function returns TRUE; otherwise, the function
-           returns FALSE
+   @brief Creates the trace stream of the calling thread, with its first
+          chunk and a spare.
 **/
+static TraceStream* newStream()
+{
+   TraceStream *ts = malloc(sizeof(TraceStream));
+   if (ts == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for a trace stream\n");
+      exit(0);
+   }
+   ts->id = __atomic_fetch_add(&numStreams, 1, __ATOMIC_RELAXED);
+   ts->window = NULL;
+   ts->extent = -1;
+   ts->noSpace = false;
+   ts->size = ts->pos = 0;
+   if (ioMode == IO_MMAP)
+      ts->chunk = ts->spare = NULL;
+   else
+   {
+      ts->chunk = getChunk(ts->id);
+      ts->spare = getChunk(ts->id);
+   }
+   ts->next = __atomic_load_n(&allStreams, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&allStreams, &ts->next, ts, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+   myStream = ts;
+   return ts;
+}
 
-int omp_test_lock(omp_lock_t *pLock)
+/**
+   @brief Passes the calling thread's filled chunk to the writer and
+          swaps in the spare. Never waits: if the queue is full the chunk
+          is dropped (and counted) and reused.
+**/
+static void submitChunk(TraceStream *ts)
 {
-   int thId, result;
-   thId = omp_get_thread_num();
-   lock[thId].beginAddr = getReturnAddress(0);
-   lock[thId].startName = __func__;
-   lock[thId].startTime_1 =  getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+   if (ts->spare != NULL && queuePush(&fullChunks, ts->chunk))
    {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
+      ts->chunk = ts->spare;
+      ts->spare = getChunk(ts->id);
    }
-#endif
-   result = real_omp_test_lock(pLock);
-   if(papiFlag)
+   else
    {
-      STOP_COUNTER;
-      instCount[thId]=values[0]-ioverhead;
-   //   noCycle[thId]+=values[1];
-   }
-   lock[thId].startExTime = getTime();
-   if (modeFlag == 1)
-   { 
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld  \n", lock[thId].startName,
-                  lock[thId].beginAddr, thId, lock[thId].startTime_1,
-                  lock[thId].startExTime,instCount[thId]);
-      else
-         fprintf(outFile," %s %p %d %lf %lf  \n", lock[thId].startName,
-                  lock[thId].beginAddr, thId, lock[thId].startTime_1,
-                  lock[thId].startExTime);
+      __atomic_fetch_add(&droppedChunks, 1, __ATOMIC_RELAXED);
+      ts->chunk->len = 0;
    }
-   else if (modeFlag == 2)
-       lock[thId].startTime_1 = lock[thId].startExTime;
-   return result;
 }
 
 /*-------------------------------------------------------------------*
- * omp_unset_lock function                                           *
+ * hash function                                                     *
  *-------------------------------------------------------------------*/
 
 /**
-   @brief Calculates thread locking overhead which is the time thread
-          spent waiting to acquire a lock[thId].
-   @param lock - A variable of type omp_lock_t that was initialized
-          with omp_init_lock[thId].
-   @return void
+   @brief Calculates hash table index.
+   @param add - Function return address.
+   @param tId - Thread Id.
+   @return Hash table index.
+**/
+static unsigned int hash(void* add, int tId)
+{
+   uint64_t h = ((uint64_t) (uintptr_t) add ^ ((uint64_t) tId << 48))
+                * 0x9e3779b97f4a7c15ULL;
+   return (h >> 32) & (HTABLE_SIZE - 1);
+}
+
+/**
+   @brief Gets the key that makes the calling OS thread the owner of its
+          hash table buckets.
+**/
+static unsigned int getThreadKey()
+{
+   if (threadKey == 0)
+      threadKey = __atomic_add_fetch(&numThreadKeys, 1, __ATOMIC_RELAXED);
+   return threadKey;
+}
+
+/*-------------------------------------------------------------------*
+ * addBucket function                                                *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Adds new bucket to hash table.
+   @param index - hash table index.
+   @param thId - Thread Id.
+   @param name - Function name
+   @param beginAddr - Start function return address.
+   @param endAddr - End function return address.
+   @param wTime - Thread waiting time.
+   @param exTime - execution time.
+   @param sTime - Part of wTime the thread spent spinning.
+   @return Hash void.
+**/
+static void addBucket(int index, int thId,  const char *name, void* beginAddr,
+                void* endAddr, double wTime, double exTime, double sTime,
+                long long insCount)
+{
+   hTable[index].funName = name;
+   hTable[index].beginAddr = beginAddr;
+   hTable[index].endAddr = endAddr;
+   hTable[index].thId = thId;
+   hTable[index].wTime = wTime;
+   hTable[index].exTime = exTime;
+   hTable[index].spinTime = sTime;
+   hTable[index].count = 1;
+   hTable[index].iCount = insCount;
+}
+
+/*-------------------------------------------------------------------*
+ * updateBucket function                                             *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Updates an existing bucket in hash table.
+   @param index - hash table index.
+   @param wTime - thread waiting time.
+   @param exTime - execution time.
+   @param sTime - Part of wTime the thread spent spinning.
+   @return Hash void.
+**/
+static void updateBucket(int index, double wTime, double exTime, double sTime,
+                long long insCount)
+{
+   hTable[index].count++;
+   hTable[index].wTime += wTime;
+   hTable[index].exTime += exTime;
+   hTable[index].spinTime += sTime;
+   hTable[index].iCount +=insCount;
+}
+
+/*-------------------------------------------------------------------*
+ * editBucket function                                               *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief If the bucket does not exist in the hash table adds it as a new
+          bucket to hash table. If the bucket is already existed updates it.
+   @param index - hash table index.
+   @param thId - Thread Id.
+   @param name - Function name
+   @param beginAddr - Start function return address.
+   @param endAddr - End function return address.
+   @param wTime - Thread waiting time.
+   @param exTime - execution time.
+   @param sTime - Part of wTime the thread spent spinning.
+   @return The bucket's index, -1 if the table is full.
+**/
+static int editBucket(int index, int thId, const char *name, void* beginAddr,
+                 void* endAddr,double wTime, double exTime, double sTime,
+                 long long insCount)
+{
+   unsigned int key = getThreadKey(), owner, count;
+   // Every bucket is written by one thread only, the one whose key is in
+   // owner, so the counts need no atomics; a free bucket is claimed with
+   // a compare and swap. Threads that share a thread number (nested teams)
+   // get separate buckets, which printResult() adds up.
+   for (count = 0; count < HTABLE_SIZE; count++)
+   {
+      owner = __atomic_load_n(&hTable[index].owner, __ATOMIC_ACQUIRE);
+      if (owner == 0 && __atomic_compare_exchange_n(&hTable[index].owner, &owner,
+                           key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+         // Bucket not found.
+         usedBuckets[__atomic_fetch_add(&numUsedBuckets, 1, __ATOMIC_RELAXED)] = index;
+         addBucket(index, thId, name, beginAddr, endAddr, wTime, exTime, sTime,
+                   insCount);
+         return index;
+      }
+      if (owner == key && hTable[index].beginAddr == beginAddr
+          && hTable[index].thId == thId
+          && strcmp(hTable[index].funName , name) == 0)
+      {
+         // Bucket already existed.
+         updateBucket(index, wTime, exTime, sTime, insCount);
+         return index;
+      }
+      index = (index + 1) & (HTABLE_SIZE - 1);
+   }
+   __atomic_add_fetch(&droppedEvents, 1, __ATOMIC_RELAXED);
+   return -1;
+}
+
+/*--------------------------------------------------------------------*
+ * traceOut function                                                  *
+ *--------------------------------------------------------------------*/
+
+/**
+   @brief Writes one trace record into the calling thread's current chunk
+          (or, in mmap mode, its extent of the file). The thread never
+          makes a system call to write the output file itself.
+   @param format - printf style format of the record.
+   @param args - Its arguments.
+**/
+static void traceOutV(const char *format, va_list args)
+{
+   TraceStream *ts = myStream ? myStream : newStream();
+   va_list again;
+   size_t room;
+   int n;
+   if (ioMode == IO_MMAP)
+   {
+      mmapOut(ts, format, args);
+      return;
+   }
+   if (ts->chunk == NULL && (ts->chunk = getChunk(ts->id)) == NULL)
+      return;
+   va_copy(again, args);
+   room = TRACE_CHUNK_SIZE - ts->chunk->len;
+   n = vsnprintf(ts->chunk->data + ts->chunk->len, room, format, args);
+   if (n >= 0 && (size_t) n >= room)
+   {
+      // record does not fit, start a new chunk and write it again
+      submitChunk(ts);
+      room = TRACE_CHUNK_SIZE;
+      n = vsnprintf(ts->chunk->data, room, format, again);
+   }
+   va_end(again);
+   if (n > 0 && (size_t) n < room)
+      ts->chunk->len += n;
+}
+
+/**
+   @brief Writes a record of PGOMP itself, or one tail mode keeps, past
+          the trace governor.
+**/
+static void pgompOut(const char *format, ...)
+{
+   va_list args;
+   va_start(args, format);
+   traceOutV(format, args);
+   va_end(args);
+}
+
+/*--------------------------------------------------------------------*
+ * Trace governor (PGOMP_TRACE_BUDGET)                                *
+ *--------------------------------------------------------------------*/
+
+/**
+   @brief Finds the shared trace level of a site, claiming an entry for it
+          the first time it is seen.
+   @return The entry, or NULL if the table is full.
+**/
+static GovernorSite* findGovernorSite(void *addr)
+{
+   unsigned int index = (((uintptr_t) addr * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (GOVERNOR_SITES - 1);
+   unsigned int count;
+   void *found;
+   for (count = 0; count < GOVERNOR_SITES; count++)
+   {
+      found = __atomic_load_n(&governorSites[index].addr, __ATOMIC_ACQUIRE);
+      // claim a free entry; if another thread got it first, found is its site
+      if (found == NULL && __atomic_compare_exchange_n(&governorSites[index].addr,
+                              &found, addr, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         return &governorSites[index];
+      if (found == addr)
+         return &governorSites[index];
+      index = (index + 1) & (GOVERNOR_SITES - 1);
+   }
+   return NULL;
+}
+
+/**
+   @brief Creates the cost monitor of the calling thread.
+   @param now - Start of its first window.
+**/
+static GovernorThread* newGovernor(double now)
+{
+   GovernorThread *gt = calloc(1, sizeof(GovernorThread));
+   if (gt == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the trace governor\n");
+      exit(0);
+   }
+   gt->windowStart = now;
+   gt->dropped = __atomic_load_n(&droppedChunks, __ATOMIC_RELAXED);
+   gt->next = __atomic_load_n(&allGovernors, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&allGovernors, &gt->next, gt, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+   myGovernor = gt;
+   return gt;
+}
+
+/**
+   @brief Ends the calling thread's window. If the thread went over the
+          budget, or the trace output is falling behind, its busiest site
+          that is still traced drops one level, and a "PGOMP_sampled" or
+          "PGOMP_untraced" record notes from when.
+   @param gt - The thread's monitor.
+   @param thId - Thread number.
+   @param now - End of the window.
+**/
+static void endWindow(GovernorThread *gt, int thId, double now)
+{
+   GovernorSlot *busiest = NULL;
+   unsigned long dropped = __atomic_load_n(&droppedChunks, __ATOMIC_RELAXED);
+   bool pressure;
+   int i, level;
+   if (ioMode == IO_MMAP)
+      pressure = __atomic_load_n(&mmapHeader->numExtents, __ATOMIC_RELAXED)
+                 > MMAP_MAX_EXTENTS / 4 * 3;
+   else
+      pressure = dropped > gt->dropped
+                 || __atomic_load_n(&fullChunks.tail, __ATOMIC_RELAXED)
+                    - __atomic_load_n(&fullChunks.head, __ATOMIC_RELAXED)
+                    > WRITER_QUEUE_LEN / 4 * 3;
+   if (pressure || gt->traced * recordCost > traceBudget * (now - gt->windowStart))
+   {
+      for (i = 0; i < GOVERNOR_SLOTS; i++)
+      {
+         GovernorSlot *slot = &gt->slots[i];
+         if (slot->site != NULL && slot->events > 0
+             && __atomic_load_n(&slot->site->level, __ATOMIC_RELAXED) < LEVEL_UNTRACED
+             && (busiest == NULL || slot->events > busiest->events))
+            busiest = slot;
+      }
+      level = busiest ? __atomic_load_n(&busiest->site->level, __ATOMIC_RELAXED) : 0;
+      // only the thread that moves the site writes the record
+      if (busiest != NULL && __atomic_compare_exchange_n(&busiest->site->level,
+                                &level, level + 1, false, __ATOMIC_RELAXED,
+                                __ATOMIC_RELAXED))
+      {
+         __atomic_add_fetch(&levelChanges[level + 1], 1, __ATOMIC_RELAXED);
+         pgompOut("  %s %p %d %lf %lf  \n", level + 1 == LEVEL_SAMPLED ?
+                     "PGOMP_sampled" : "PGOMP_untraced", busiest->addr, thId,
+                     now, now);
+      }
+   }
+   for (i = 0; i < GOVERNOR_SLOTS; i++)
+      gt->slots[i].events = 0;
+   gt->traced = 0;
+   gt->dropped = dropped;
+   gt->windowStart = now;
+}
+
+/**
+   @brief Decides whether a record is written, from the level of its site.
+          Events that are not written are counted per site and thread.
+   @param args - Arguments of the record: name, site, thread number and
+          the two time columns, as in every trace record.
+   @return true if the record is to be written.
+**/
+static bool governTrace(va_list args)
+{
+   GovernorThread *gt;
+   GovernorSlot *slot = NULL;
+   const char *name;
+   void *addr;
+   unsigned int index, count;
+   double t1, t2;
+   int thId, level;
+   va_list fields;
+   va_copy(fields, args);
+   name = va_arg(fields, const char*);
+   addr = va_arg(fields, void*);
+   thId = va_arg(fields, int);
+   t1 = va_arg(fields, double);
+   t2 = va_arg(fields, double);
+   va_end(fields);
+   gt = myGovernor ? myGovernor : newGovernor(t1);
+   if (t1 - gt->windowStart >= GOVERNOR_WINDOW)
+      endWindow(gt, thId, t1);
+   if (strncmp(name, "PGOMP_", 6) == 0) // CPU records, always written
+   {
+      gt->traced++;
+      return true;
+   }
+   index = (((uintptr_t) addr * 0x9e3779b97f4a7c15ULL) >> 32) & (GOVERNOR_SLOTS - 1);
+   for (count = 0; count < GOVERNOR_SLOTS; count++)
+   {
+      slot = &gt->slots[index];
+      if (slot->addr == NULL)
+      {
+         slot->addr = addr;
+         slot->site = findGovernorSite(addr);
+      }
+      if (slot->addr == addr)
+         break;
+      index = (index + 1) & (GOVERNOR_SLOTS - 1);
+   }
+   if (count == GOVERNOR_SLOTS)
+   {
+      gt->traced++;
+      return true;
+   }
+   slot->events++;
+   slot->thId = thId;
+   level = slot->site ? __atomic_load_n(&slot->site->level, __ATOMIC_RELAXED)
+                      : LEVEL_FULL;
+   if (level == LEVEL_FULL
+       || (level == LEVEL_SAMPLED && ++slot->sample % GOVERNOR_SAMPLE == 0))
+   {
+      gt->traced++;
+      return true;
+   }
+   slot->omitted++;
+   slot->omittedTime += t2 - t1;
+   return false;
+}
+
+/**
+   @brief Writes a "PGOMP_omitted" record for every site and thread with
+          events that were not traced: the count in the first time column
+          and their total time in the second. Called once from pgomp_end().
+**/
+static void closeGovernor()
+{
+   GovernorThread *gt;
+   int i;
+   for (gt = allGovernors; gt != NULL; gt = gt->next)
+      for (i = 0; i < GOVERNOR_SLOTS; i++)
+         if (gt->slots[i].omitted > 0)
+            pgompOut("  %s %p %d %ld %lf  \n", "PGOMP_omitted",
+                        gt->slots[i].addr, gt->slots[i].thId,
+                        gt->slots[i].omitted, gt->slots[i].omittedTime);
+   if (levelChanges[LEVEL_SAMPLED] > 0)
+      fprintf(stderr,"LIBPGOMP WARNING: Over the trace budget, %lu sites were "
+                     "sampled and %lu of them untraced (see the PGOMP_sampled, "
+                     "PGOMP_untraced and PGOMP_omitted records)\n",
+              levelChanges[LEVEL_SAMPLED], levelChanges[LEVEL_UNTRACED]);
+}
+
+/*--------------------------------------------------------------------*
+ * Tail mode (PGOMP_MODE=tail)                                        *
+ *--------------------------------------------------------------------*/
+
+/**
+   @brief Keeps a record in the thread's history and writes it, with the
+          history since the last record written, if its time is an outlier
+          for its site. The moving average and variance of the site are in
+          the thread's aggregate table bucket for it.
+   @param format - Format of the record.
+   @param args - Its arguments.
+**/
+static void tailTrace(const char *format, va_list args)
+{
+   TailEvent *e = &tailHistory[tailSeen % TAIL_HISTORY];
+   AggregateInfo *bucket;
+   unsigned long i;
+   double x, d, threshold;
+   int index;
+   va_list fields;
+   va_copy(fields, args);
+   e->format = format;
+   e->name = va_arg(fields, const char*);
+   e->addr = va_arg(fields, void*);
+   e->thId = va_arg(fields, int);
+   e->t1 = va_arg(fields, double);
+   e->t2 = va_arg(fields, double);
+   e->iCount = COUNTING && strstr(format, "%lld") ? va_arg(fields, long long) : 0;
+   va_end(fields);
+   if (strncmp(e->name, "PGOMP_", 6) == 0) // CPU records, always written
+   {
+      traceOutV(format, args);
+      return;
+   }
+   tailSeen++;
+   x = e->t2 - e->t1;
+   index = editBucket(hash(e->addr, e->thId), e->thId, e->name, e->addr, e->addr,
+                      x, 0.0, 0.0, 0);
+   if (index < 0)
+      return;
+   bucket = &hTable[index];
+   if (bucket->count == 1)
+   {
+      bucket->mean = x;
+      return;
+   }
+   threshold = bucket->mean + tailSigma * sqrt(bucket->var);
+   if (bucket->count > TAIL_WARMUP && x > threshold
+       && x - bucket->mean >= TAIL_MIN_EXCESS)
+   {
+      pgompOut("  %s %p %d %lf %lf  \n", "PGOMP_tail", e->addr, e->thId,
+               bucket->mean, threshold);
+      i = tailWritten + TAIL_HISTORY < tailSeen ? tailSeen - TAIL_HISTORY : tailWritten;
+      for (; i < tailSeen; i++)
+      {
+         e = &tailHistory[i % TAIL_HISTORY];
+         pgompOut(e->format, e->name, e->addr, e->thId, e->t1, e->t2, e->iCount);
+      }
+      tailWritten = tailSeen;
+   }
+   d = x - bucket->mean;
+   bucket->mean += d / TAIL_EWMA;
+   bucket->var = (1.0 - 1.0 / TAIL_EWMA) * (bucket->var + d * d / TAIL_EWMA);
+}
+
+/**
+   @brief Writes one trace record, unless tail mode holds it back or the
+          trace governor leaves it out.
+   @param format - printf style format of the record. Every record starts
+          with its name, site, thread number and two time columns.
+**/
+static void traceOut(const char *format, ...)
+{
+   va_list args;
+   va_start(args, format);
+   if (tailFlag)
+      tailTrace(format, args);
+   else if (traceBudget == 0.0 || governTrace(args))
+      traceOutV(format, args);
+   va_end(args);
+}
+
+/*--------------------------------------------------------------------*
+ * getTime function to return the time.                               *
+ *--------------------------------------------------------------------*/
+#ifdef RELATIVE_TIME
+static double initialTime=0.0;
+#endif
+/**
+   @brief Gets the clock time.
+   @return The number of seconds and nanoseconds since 1/1/1970
+**/
+static double getTime()
+{
+   struct timespec tim;
+   if (clock_gettime(CLOCK_REALTIME, &tim) == -1)
+   {
+      perror("clock gettime");
+      exit(EXIT_FAILURE);
+   }
+#ifdef RELATIVE_TIME
+   return tim.tv_sec-initialTime+tim.tv_nsec/BILLION;
+#else
+   return tim.tv_sec+tim.tv_nsec/BILLION;
+#endif
+}
+
+/**
+   @brief Measures the time to format one typical trace record, the cost
+          the governor holds against the trace budget (PGOMP_TRACE_BUDGET).
+**/
+static void measureRecordCost()
+{
+   char buffer[MAX_RECORD_LEN];
+   double start = getTime(), now = start;
+   int i;
+   for (i = 0; i < 1000; i++)
+      snprintf(buffer, sizeof(buffer), "  %s %p %d %lf %lf  \n",
+               "GOMP_critical_start", (void*) buffer, i, start, now);
+   recordCost = (getTime() - start) / 1000;
+}
+
+/*--------------------------------------------------------------------*
+ * getThreadCpuTime function to return the thread CPU time.           *
+ *--------------------------------------------------------------------*/
+
+static int spinFlag = 0; /**< PGOMP_SPIN: split waits into spin and blocked time */
+
+/**
+   @brief Gets the CPU time consumed by the calling thread. Sampled
+          around every wait so that the wait can be split into the part
+          the thread spent spinning on a CPU and the part it was blocked
+          (sleeping in the kernel).
+   Only aggregate mode splits waits, traces do not need the time. The
+   thread CPU clock is a system call, not a vDSO read, so the split is
+   only made with PGOMP_SPIN=true.
+   @return The thread CPU time in seconds, or 0.0 if SPIN_TIME is off,
+           PGOMP_SPIN is not set or not aggregating.
+**/
+static double getThreadCpuTime()
+{
+#ifdef SPIN_TIME
+   struct timespec tim;
+   if (!AGGREGATING || !spinFlag)
+      return 0.0;
+   if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tim) == -1)
+   {
+      perror("clock gettime");
+      exit(EXIT_FAILURE);
+   }
+   return tim.tv_sec+tim.tv_nsec/BILLION;
+#else
+   return 0.0;
+#endif
+}
+
+/**
+   @brief Gets the spinning part of a wait.
+   @param wTime - Wall clock time of the wait.
+   @param cpuTime - Thread CPU time consumed during the wait.
+   @return The spin time, never more than the wait itself.
+**/
+static double spinTime(double wTime, double cpuTime)
+{
+   if (cpuTime < 0.0)
+      return 0.0;
+   return cpuTime < wTime ? cpuTime : wTime;
+}
+
+/**
+   @brief Adds an outermost parallel region to the program's parallel time.
+   @param time - Wall time of the region.
+   @param team - Number of threads in the team.
+**/
+static void countRegion(double time, unsigned team)
+{
+   pthread_mutex_lock(&regionLock);
+   totalParaTime += time;
+   teamParaTime += time * team;
+   numRegions++;
+   pthread_mutex_unlock(&regionLock);
+}
+
+/**
+   @brief Adds the allocations of one count to another.
+**/
+static void addAlloc(AllocCount *to, const AllocCount *from)
+{
+   int k;
+   for (k = 0; k < NUM_ALLOCS; k++)
+      to->calls[k] += from->calls[k];
+   to->bytes += from->bytes;
+   to->time += from->time;
+}
+
+/**
+   @brief Asked by the dispatcher once the build is loaded: whether it
+          should report the allocation functions (PGOMP_MALLOC, aggregate
+          mode).
+**/
+int pgomp_alloc_tracking(void)
+{
+   return allocFlag && AGGREGATING;
+}
+
+/**
+   @brief Called by the dispatcher's malloc(), free(), calloc(), realloc()
+          and posix_memalign() before they call the C library's. An
+          allocation is only counted while the thread runs a region body.
+          The dispatcher does not call the hooks again for allocations
+          made inside them.
+   @return The time, or -1 if the allocation is not counted.
+**/
+double pgomp_alloc_begin(void)
+{
+   return allocCount != NULL ? getTime() : -1.0;
+}
+
+/**
+   @brief Counts an allocation pgomp_alloc_begin() timed.
+   @param kind - ALLOC_MALLOC, ALLOC_FREE, ...
+   @param bytes - Bytes asked for, 0 for free().
+   @param start - What pgomp_alloc_begin() returned.
+**/
+void pgomp_alloc_end(int kind, size_t bytes, double start)
+{
+   AllocCount *ac = allocCount;
+   if (ac == NULL)
+      return;
+   ac->calls[kind]++;
+   ac->bytes += bytes;
+   ac->time += getTime() - start;
+}
+
+/**
+   @brief Adds a joined parallel region to the utilization of its site.
+   @param addr - Call site of the region.
+   @param team - Team members timed.
+   @param elapsed - Wall time of the region.
+   @param time - Thread time in each state, over all members.
+   @param alloc - Allocations in the bodies, over all members.
+**/
+static void countRegionSite(void *addr, unsigned team, double elapsed,
+                            const double time[NUM_STATES], const AllocCount *alloc)
+{
+   unsigned int index = (((uintptr_t) addr * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (REGION_SITES - 1);
+   unsigned int count;
+   int s;
+   pthread_mutex_lock(&regionLock);
+   for (count = 0; count < REGION_SITES; count++)
+   {
+      RegionStats *rs = &regionStats[index];
+      if (rs->addr == NULL)
+         rs->addr = addr;
+      if (rs->addr == addr)
+      {
+         rs->count++;
+         rs->threads += team;
+         rs->elapsed += elapsed;
+         for (s = 0; s < NUM_STATES; s++)
+            rs->time[s] += time[s];
+         addAlloc(&rs->alloc, alloc);
+         break;
+      }
+      index = (index + 1) & (REGION_SITES - 1);
+   }
+   if (count == REGION_SITES)
+      droppedEvents++;
+   pthread_mutex_unlock(&regionLock);
+}
+
+/**
+   @brief Reads an integer from a sysfs file of a CPU.
+   @return 0 on success, -1 if the file is missing or not a number.
+**/
+static int readCpuValue(const char *format, int cpu, int *value)
+{
+   char path[128];
+   FILE *f;
+   int ok;
+   snprintf(path, sizeof(path), format, cpu);
+   f = fopen(path, "r");
+   if (f == NULL)
+      return -1;
+   ok = fscanf(f, "%d", value) == 1;
+   fclose(f);
+   return ok ? 0 : -1;
+}
+
+/**
+   @brief Reads the core, socket and NUMA node of every CPU from sysfs.
+          Unknown values make each CPU its own core on socket and node 0.
+**/
+static void readTopology()
+{
+   char path[128];
+   DIR *dir;
+   struct dirent *entry;
+   int cpu;
+   numCpus = sysconf(_SC_NPROCESSORS_CONF);
+   if (numCpus < 0)
+      numCpus = 0;
+   if (numCpus > MAX_CPUS)
+      numCpus = MAX_CPUS;
+   for (cpu = 0; cpu < numCpus; cpu++)
+   {
+      cpuCore[cpu] = cpu;
+      cpuSocket[cpu] = cpuNode[cpu] = 0;
+      readCpuValue("/sys/devices/system/cpu/cpu%d/topology/core_id", cpu, &cpuCore[cpu]);
+      readCpuValue("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu,
+                   &cpuSocket[cpu]);
+      // the CPU's directory links to its NUMA node as "node<n>"
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+      dir = opendir(path);
+      if (dir == NULL)
+         continue;
+      while ((entry = readdir(dir)) != NULL)
+         if (sscanf(entry->d_name, "node%d", &cpuNode[cpu]) == 1)
+            break;
+      closedir(dir);
+   }
+}
+
+/**
+   @brief Notes the CPU the calling thread runs on. A change is a
+          migration: counted in aggregate mode, a PGOMP_cpu record (with
+          the CPU number in the location column) in trace mode.
+   @param now - Time of the event.
+**/
+static void noteCpu(double now)
+{
+   int cpu = sched_getcpu();
+   if (cpu == lastCpu)
+      return;
+   if (TRACING)
+      traceOut("  %s %p %d %lf %lf  \n", "PGOMP_cpu", (void*) (uintptr_t) cpu,
+               omp_get_thread_num(), now, now);
+   else if (myTimeline != NULL)
+   {
+      if (lastCpu >= 0)
+      {
+         myTimeline->migrations++;
+         if (cpu < numCpus && lastCpu < numCpus && cpuNode[cpu] != cpuNode[lastCpu])
+            myTimeline->nodeMigrations++;
+      }
+      myTimeline->cpu = cpu;
+   }
+   lastCpu = cpu;
+}
+
+/**
+   @brief Finds, or adds, the release record of a lock or critical section.
+   @param key - The lock, the critical section name or &criticalKey.
+   @return The record, NULL if the table is full.
+**/
+static ReleaseInfo* findRelease(void *key)
+{
+   unsigned int index = (((uintptr_t) key * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (HANDOFF_SITES - 1);
+   unsigned int count;
+   void *found;
+   for (count = 0; count < HANDOFF_SITES; count++)
+   {
+      found = __atomic_load_n(&releases[index].key, __ATOMIC_ACQUIRE);
+      // claim a free entry; if another thread got it first, found is its key
+      if (found == NULL && __atomic_compare_exchange_n(&releases[index].key, &found,
+                              key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         return &releases[index];
+      if (found == key)
+         return &releases[index];
+      index = (index + 1) & (HANDOFF_SITES - 1);
+   }
+   return NULL;
+}
+
+/**
+   @brief Notes where and when a lock or critical section is released.
+          Must be called before the release, while the caller holds it.
+**/
+static void noteRelease(void *key, double now)
+{
+   ReleaseInfo *r;
+   if (!cpuFlag || !AGGREGATING || (r = findRelease(key)) == NULL)
+      return;
+   r->cpu = lastCpu;
+   r->time = now;
+}
+
+/**
+   @brief Gets the histogram bucket of a time: below 1 us, 1-2 us, 2-4 us ...
+**/
+static int histBucket(double t)
+{
+   int bucket = 0;
+   for (t *= 1e6; t >= 1.0 && bucket < CRITICAL_HIST - 1; t /= 2)
+      bucket++;
+   return bucket;
+}
+
+/**
+   @brief Adds one pass through a critical section to the statistics of its
+          name. Must be called before the release, while the caller holds
+          the critical section, so no two threads update one entry at once.
+   @param key - The name cell, &criticalKey or &atomicKey.
+   @param wait - Time the caller waited to enter.
+   @param hold - Time the caller was inside.
+**/
+static void countCriticalName(void *key, double wait, double hold)
+{
+   unsigned int index = (((uintptr_t) key * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (CRITICAL_NAMES - 1);
+   unsigned int count;
+   CriticalStats *cs;
+   void *found;
+   if (!AGGREGATING)
+      return;
+   for (count = 0; count < CRITICAL_NAMES; count++)
+   {
+      cs = &criticalStats[index];
+      found = __atomic_load_n(&cs->key, __ATOMIC_ACQUIRE);
+      // claim a free entry; if another thread got it first, found is its key
+      if ((found == NULL && __atomic_compare_exchange_n(&cs->key, &found, key,
+                               false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+          || found == key)
+         break;
+      index = (index + 1) & (CRITICAL_NAMES - 1);
+   }
+   if (count == CRITICAL_NAMES)
+   {
+      __atomic_add_fetch(&droppedEvents, 1, __ATOMIC_RELAXED);
+      return;
+   }
+   if (wait < 0)
+      wait = 0;
+   if (hold < 0)
+      hold = 0;
+   cs->count++;
+   cs->wait += wait;
+   cs->hold += hold;
+   if (wait > cs->waitMax)
+      cs->waitMax = wait;
+   if (hold > cs->holdMax)
+      cs->holdMax = hold;
+   cs->waitHist[histBucket(wait)]++;
+   cs->holdHist[histBucket(hold)]++;
+   if (wait >= 1e-6)
+      cs->contended++;
+}
+
+/**
+   @brief Classifies the acquisition of a lock or critical section as a
+          handoff when the caller waited for another thread to release it.
+   @param key - The lock, the critical section name or &criticalKey.
+   @param started - Time the caller started to acquire it.
+   @param acquired - Time the caller got it.
+**/
+static void noteHandoff(void *key, double started, double acquired)
+{
+   ReleaseInfo *r;
+   Handoff *h;
+   int from;
+   if (!cpuFlag || !AGGREGATING || myTimeline == NULL
+       || (r = findRelease(key)) == NULL || r->time <= started)
+      return;
+   from = r->cpu;
+   if (from < 0 || from >= numCpus || lastCpu < 0 || lastCpu >= numCpus)
+      return;
+   if (cpuSocket[from] != cpuSocket[lastCpu])
+      h = &myTimeline->handoffs[HANDOFF_REMOTE];
+   else if (cpuCore[from] != cpuCore[lastCpu])
+      h = &myTimeline->handoffs[HANDOFF_SOCKET];
+   else
+      h = &myTimeline->handoffs[HANDOFF_CORE];
+   h->count++;
+   h->time += acquired - r->time;
+   if (acquired - r->time > h->max)
+      h->max = acquired - r->time;
+}
+
+/**
+   @brief Finds, or adds, the wait-for view of a lock or critical section.
+   @param key - The lock, the critical section name or &criticalKey.
+   @param named - A critical section.
+   @param site - Call site, kept if the lock is added.
+   @return The view, NULL if the table is full.
+**/
+static ConvoyLock* findConvoyLock(void *key, int named, void *site)
+{
+   unsigned int index = (((uintptr_t) key * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (CONVOY_LOCKS - 1);
+   unsigned int count;
+   void *found;
+   for (count = 0; count < CONVOY_LOCKS; count++)
+   {
+      found = __atomic_load_n(&convoyLocks[index].key, __ATOMIC_ACQUIRE);
+      // claim a free entry; if another thread got it first, found is its key
+      if (found == NULL && __atomic_compare_exchange_n(&convoyLocks[index].key, &found,
+                              key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+         convoyLocks[index].named = named;
+         convoyLocks[index].site = site;
+         return &convoyLocks[index];
+      }
+      if (found == key)
+         return &convoyLocks[index];
+      index = (index + 1) & (CONVOY_LOCKS - 1);
+   }
+   __atomic_add_fetch(&droppedEvents, 1, __ATOMIC_RELAXED);
+   return NULL;
+}
+
+/**
+   @brief Ends the wait of a thread for a lock, if it waits. libomp
+          reports a test as a wait, and a failed one does not get the
+          lock: that wait ends at the thread's next lock event.
+   @return The lock waited for, NULL if none.
+**/
+static ConvoyLock* convoyEndWait(Timeline *tl)
+{
+   ConvoyLock *cl = tl->waiting;
+   if (cl == NULL)
+      return NULL;
+   __atomic_store_n(&tl->waiting, NULL, __ATOMIC_RELEASE);
+   __atomic_sub_fetch(&cl->waiters, 1, __ATOMIC_RELAXED);
+   return cl;
+}
+
+/**
+   @brief Notes that the calling thread starts to wait for a lock or
+          critical section (PGOMP_CONVOY).
+   @param key - The lock, the critical section name or &criticalKey.
+   @param named - A critical section.
+   @param site - Call site.
+**/
+static void convoyWait(void *key, int named, void *site)
+{
+   ConvoyLock *cl;
+   if (!convoyFlag || !AGGREGATING || myTimeline == NULL
+       || (cl = findConvoyLock(key, named, site)) == NULL)
+      return;
+   convoyEndWait(myTimeline);
+   __atomic_add_fetch(&cl->waiters, 1, __ATOMIC_RELAXED);
+   __atomic_store_n(&myTimeline->waiting, cl, __ATOMIC_RELEASE);
+}
+
+/**
+   @brief Adds an acquisition of wanted while holding held to the lock
+          order pairs.
+**/
+static void noteLockOrder(ConvoyLock *held, ConvoyLock *wanted, double wait)
+{
+   unsigned int index = ((((uintptr_t) held ^ ((uintptr_t) wanted << 7))
+                          * 0x9e3779b97f4a7c15ULL) >> 32) & (CONVOY_ORDERS - 1);
+   unsigned int count;
+   LockOrder *lo;
+   ConvoyLock *found;
+   for (count = 0; count < CONVOY_ORDERS; count++)
+   {
+      lo = &lockOrders[index];
+      found = __atomic_load_n(&lo->held, __ATOMIC_ACQUIRE);
+      // only the holder of held adds its pairs, so wanted is set before
+      // the next thread holding held can look at the entry
+      if (found == NULL && __atomic_compare_exchange_n(&lo->held, &found, held,
+                              false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      {
+         lo->wanted = wanted;
+         break;
+      }
+      if (found == held && lo->wanted == wanted)
+         break;
+      index = (index + 1) & (CONVOY_ORDERS - 1);
+   }
+   if (count == CONVOY_ORDERS)
+   {
+      __atomic_add_fetch(&droppedEvents, 1, __ATOMIC_RELAXED);
+      return;
+   }
+   lo->count++;
+   lo->wait += wait;
+   if (wait >= 1e-6)
+      lo->contended++;
+}
+
+/**
+   @brief Notes that the calling thread got a lock or critical section
+          (PGOMP_CONVOY), after convoyWait() unless it was a test.
+   @param key - The lock, the critical section name or &criticalKey.
+   @param named - A critical section.
+   @param site - Call site.
+   @param wait - Time the caller waited to get it.
+   @param test - Got by a test, which does not wait and so adds no lock
+          order pairs: it can not deadlock.
+**/
+static void convoyAcquired(void *key, int named, void *site, double wait, bool test)
+{
+   Timeline *tl = myTimeline;
+   ConvoyLock *cl;
+   int i;
+   if (!convoyFlag || !AGGREGATING || tl == NULL)
+      return;
+   cl = convoyEndWait(tl);
+   if ((cl == NULL || cl->key != key) && (cl = findConvoyLock(key, named, site)) == NULL)
+      return;
+   __atomic_store_n(&cl->holder, tl, __ATOMIC_RELEASE);
+   cl->count++;
+   if (wait >= 1e-6)
+      cl->contended++;
+   for (i = 0; i < tl->numHeld && i < CONVOY_HELD && !test; i++)
+      noteLockOrder(tl->held[i], cl, wait);
+   if (tl->numHeld < CONVOY_HELD)
+      tl->held[tl->numHeld] = cl;
+   tl->numHeld++;
+}
+
+/**
+   @brief Notes that the calling thread releases a lock or critical
+          section (PGOMP_CONVOY). The next owner may already have it when
+          the release is noted after the fact (OMPT).
+**/
+static void convoyRelease(void *key, int named)
+{
+   Timeline *tl = myTimeline;
+   ConvoyLock *cl = NULL;
+   int i;
+   if (!convoyFlag || !AGGREGATING || tl == NULL)
+      return;
+   convoyEndWait(tl);
+   if (tl->numHeld == 0)
+      return;
+   for (i = (tl->numHeld < CONVOY_HELD ? tl->numHeld : CONVOY_HELD) - 1; i >= 0; i--)
+      if (tl->held[i]->key == key)
+      {
+         cl = tl->held[i];
+         for (; i + 1 < tl->numHeld && i + 1 < CONVOY_HELD; i++)
+            tl->held[i] = tl->held[i+1];
+         break;
+      }
+   if (cl == NULL && (tl->numHeld <= CONVOY_HELD
+                      || (cl = findConvoyLock(key, named, NULL)) == NULL))
+      return; // not held, or beyond the kept ones
+   tl->numHeld--;
+   // only clear the holder if it still is the caller
+   __atomic_compare_exchange_n(&cl->holder, &tl, NULL, false, __ATOMIC_RELEASE,
+                               __ATOMIC_RELAXED);
+}
+
+/**
+   @brief Takes one sample of the wait-for graph: the threads waiting for
+          every lock, and the chain of waits behind each lock, through
+          its holder to the lock that holder waits for, and so on.
+   @param now - Time of the sample.
+**/
+static void sampleConvoys(double now)
+{
+   ConvoySlot *slot;
+   ConvoyLock *cl, *next;
+   Timeline *holder;
+   int i, waiters, chain;
+   if (numConvoySlots == 0 || convoySlots[numConvoySlots-1].samples == convoyPerSlot)
+   {
+      if (numConvoySlots == CONVOY_SLOTS)
+      {
+         // merge neighbouring slots, each now covers twice the samples
+         for (i = 0; i < CONVOY_SLOTS / 2; i++)
+         {
+            ConvoySlot *a = &convoySlots[2*i], *b = &convoySlots[2*i+1];
+            convoySlots[i].time = a->time;
+            convoySlots[i].samples = a->samples + b->samples;
+            convoySlots[i].waiting = a->waiting + b->waiting;
+            convoySlots[i].maxDepth = a->maxDepth > b->maxDepth ? a->maxDepth : b->maxDepth;
+            convoySlots[i].maxChain = a->maxChain > b->maxChain ? a->maxChain : b->maxChain;
+            convoySlots[i].cycles = a->cycles + b->cycles;
+         }
+         numConvoySlots = CONVOY_SLOTS / 2;
+         convoyPerSlot *= 2;
+      }
+      slot = &convoySlots[numConvoySlots++];
+      memset(slot, 0, sizeof(ConvoySlot));
+      slot->time = now;
+   }
+   slot = &convoySlots[numConvoySlots-1];
+   slot->samples++;
+   for (i = 0; i < CONVOY_LOCKS; i++)
+   {
+      cl = &convoyLocks[i];
+      waiters = __atomic_load_n(&cl->waiters, __ATOMIC_RELAXED);
+      if (waiters <= 0)
+         continue;
+      cl->samples++;
+      cl->depth += waiters;
+      if (waiters > cl->maxDepth)
+         cl->maxDepth = waiters;
+      slot->waiting += waiters;
+      if (waiters > slot->maxDepth)
+         slot->maxDepth = waiters;
+      // follow the holders; a chain longer than the threads is a cycle
+      // that does not pass through cl
+      chain = 1;
+      next = cl;
+      while ((holder = __atomic_load_n(&next->holder, __ATOMIC_ACQUIRE)) != NULL
+             && (next = __atomic_load_n(&holder->waiting, __ATOMIC_ACQUIRE)) != NULL
+             && chain <= (int) numTimelines)
+      {
+         if (next == cl)
+         {
+            slot->cycles++;
+            break;
+         }
+         chain++;
+      }
+      if (chain > 1)
+         cl->chained++;
+      if (chain > slot->maxChain)
+         slot->maxChain = chain;
+   }
+}
+
+/**
+   @brief Body of the sampler thread: samples the wait-for graph every
+          CONVOY_INTERVAL_NS until stopSampler() sets samplerDone.
+**/
+static void* samplerThread(void *arg)
+{
+   struct timespec interval = { 0, CONVOY_INTERVAL_NS };
+   while (!__atomic_load_n(&samplerDone, __ATOMIC_ACQUIRE))
+   {
+      sampleConvoys(getTime());
+      nanosleep(&interval, NULL);
+   }
+   return NULL;
+}
+
+/**
+   @brief Starts the sampler thread (PGOMP_CONVOY).
+**/
+static void startSampler()
+{
+   samplerDone = 0;
+   if (pthread_create(&sampler, NULL, samplerThread, NULL) != 0)
+   {
+      convoyFlag = 0; // nothing for pgomp_end() to stop
+      fprintf(stderr,"LIBPGOMP ERROR: Cannot start the lock convoy sampler thread\n");
+      exit(0);
+   }
+}
+
+/**
+   @brief Stops the sampler thread. Called once from pgomp_end().
+**/
+static void stopSampler()
+{
+   __atomic_store_n(&samplerDone, 1, __ATOMIC_RELEASE);
+   pthread_join(sampler, NULL);
+}
+
+/**
+   @brief After fork(), in the child, after forkChild(): the sampler is
+          gone and the other threads with it. Drops the parent's wait-for
+          graph and lock order and starts a new sampler.
+**/
+static void samplerForkChild()
+{
+   Timeline *tl;
+   memset(convoyLocks, 0, sizeof(convoyLocks));
+   memset(lockOrders, 0, sizeof(lockOrders));
+   numConvoySlots = 0;
+   convoyPerSlot = 1;
+   for (tl = allTimelines; tl != NULL; tl = tl->next)
+   {
+      tl->waiting = NULL;
+      tl->numHeld = 0;
+   }
+   startSampler();
+}
+
+/**
+   @brief Starts the utilization timeline of the calling thread.
+   @param state - State the thread is in.
+   @param now - Time the thread is first seen.
+   @return The timeline.
+**/
+static Timeline* newTimeline(int state, double now)
+{
+   Timeline *tl = calloc(1, sizeof(Timeline));
+   if (tl == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for a thread timeline\n");
+      exit(0);
+   }
+   tl->id = __atomic_fetch_add(&numTimelines, 1, __ATOMIC_RELAXED);
+   tl->state = state;
+   tl->since = tl->start = now;
+   tl->cpu = lastCpu;
+   tl->next = __atomic_load_n(&allTimelines, __ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&allTimelines, &tl->next, tl, true,
+                                       __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      ;
+   myTimeline = tl;
+   return tl;
+}
+
+/**
+   @brief Moves the calling thread to another state of its timeline.
+          Only aggregate mode keeps timelines.
+   @param state - New state.
+   @param now - Time of the change.
+   @return The state the thread was in.
+**/
+static int enterState(int state, double now)
+{
+   Timeline *tl;
+   int old;
+   if (cpuFlag)
+      noteCpu(now);
+   if (!AGGREGATING)
+      return STATE_WORK;
+   tl = myTimeline;
+   if (tl == NULL)
+      tl = newTimeline(STATE_WORK, now);
+   old = tl->state;
+   tl->time[old] += now - tl->since;
+   tl->state = state;
+   tl->since = now;
+   return old;
+}
+
+/**
+   @brief After fork(), in the child, after forkChild(): what was counted
+          so far is the parent's to report. Drops the hash table buckets
+          in use, the region, critical section, handoff and loop
+          statistics and the allocation counts, and starts the program
+          time and the calling thread's timeline anew. The other threads
+          are gone, and their timelines with them. A lock held by one of
+          them at the fork is initialized again.
+**/
+static void aggregateForkChild()
+{
+   Timeline *tl = myTimeline;
+   double now = getTime();
+   unsigned int i;
+   int state;
+   for (i = 0; i < numUsedBuckets && i < HTABLE_SIZE; i++)
+      memset(&hTable[usedBuckets[i]], 0, sizeof(AggregateInfo));
+   numUsedBuckets = 0;
+   droppedEvents = 0;
+   pthread_mutex_init(&regionLock, NULL);
+   pthread_mutex_init(&loopLock, NULL);
+   progStartTime = now;
+   totalParaTime = teamParaTime = 0.0;
+   numRegions = 0;
+   for (i = 0; i < REGION_SITES; i++)
+      if (regionStats[i].addr != NULL)
+         memset(&regionStats[i], 0, sizeof(RegionStats));
+   for (i = 0; i < CRITICAL_NAMES; i++)
+      if (criticalStats[i].key != NULL)
+         memset(&criticalStats[i], 0, sizeof(CriticalStats));
+   for (i = 0; i < HANDOFF_SITES; i++)
+      if (releases[i].key != NULL)
+         memset(&releases[i], 0, sizeof(ReleaseInfo));
+   for (i = 0; i < LOOP_SITES; i++)
+      if (loopStats[i].addr != NULL)
+         memset(&loopStats[i], 0, sizeof(LoopStats));
+   allTimelines = NULL;
+   numTimelines = 0;
+   if (tl == NULL)
+      return;
+   state = tl->state;
+   memset(tl, 0, sizeof(Timeline));
+   tl->state = state;
+   tl->since = tl->start = now;
+   tl->cpu = lastCpu;
+   numTimelines = 1;
+   allTimelines = tl;
+}
+
+#ifdef BUILD_PAPI
+/*---------------------------------------------------------------*
+ *  Initialize the PAPI library                                  *
+ *---------------------------------------------------------------*/
+void initPapi()
+{
+   int retval;
+   long long values[NUM_EVENTS];
+   int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
+   if((retval = PAPI_library_init(PAPI_VER_CURRENT)) != PAPI_VER_CURRENT )
+   {
+      fprintf(stderr, "Error: %d %s\n",retval, errstring);
+      exit(1);
+   }
+   if ( PAPI_thread_init((unsigned long (*)(void))pthread_self) != PAPI_OK)
+      ERROR_RETURN(retval);
+   START_COUNTER;
+   STOP_COUNTER;
+}
+
+/*--------------------------------------------------------------------*
+ * Instruction counts overhead
+ *--------------------------------------------------------------------*/
+int instOverhead()
+{
+   int retval;
+   int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
+   long long values[NUM_EVENTS];
+   START_COUNTER;
+   STOP_COUNTER;
+   return values[0];
+}
+#endif
+
+/*--------------------------------------------------------------------*
+ * Instruction counts of a wrapped call
+ *--------------------------------------------------------------------*/
+
+/**
+   @brief Starts counting the instructions of a wrapped call (PGOMP_PAPI).
+**/
+static inline void counterStart()
+{
+#ifdef BUILD_PAPI
+   int retval;
+   int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
+   if (COUNTING)
+   {
+      START_COUNTER;
+   }
+#endif
+}
+
+/**
+   @brief Stops counting the instructions of a wrapped call.
+   @return The instructions of the call, 0 if PAPI does not count.
+**/
+static inline long long counterStop()
+{
+#ifdef BUILD_PAPI
+   int retval;
+   long long values[NUM_EVENTS];
+   if (COUNTING)
+   {
+      STOP_COUNTER;
+      return values[0] - ioverhead;
+   }
+#endif
+   return 0;
+}
+
+/**
+   @brief Writes the trace record of a wrapped call: name, call site,
+          thread, the times the call was reached and returned, and the
+          instructions counted if PAPI counts.
+**/
+static inline void traceRecord(const char *name, void *addr, int thId,
+                               double t1, double t2, long long count)
+{
+   if (COUNTING)
+      traceOut("  %s %p %d %lf %lf %lld \n", name, addr, thId, t1, t2, count);
+   else
+      traceOut("  %s %p %d %lf %lf  \n", name, addr, thId, t1, t2);
+}
+
+/*-------------------------------------------------------------------*
+ * printResult function                                               *
+ *-------------------------------------------------------------------*/
+
+/**
+   Per-site reduction of the per-thread aggregate rows
+**/
+typedef struct
+{
+/*@{*/
+   AggregateInfo **rows; /**< Per-thread rows of the site, by thread id */
+   int numRows; /**< Number of threads that reached the site */
+   long count; /**< Total executions over all threads */
+   double wTime; /**< Total waiting time */
+   double exTime; /**< Total execution time */
+   double spinTime; /**< Total spin time */
+   long long iCount; /**< Total instructions */
+   double wMin, wMax, wMean, wStddev; /**< Waiting time across threads */
+   double exMin, exMax, exMean, exStddev; /**< Execution time across threads */
+/*@}*/
+} SiteSummary;
+
+/**
+   @brief Orders rows by site (function name, call location), then thread.
+**/
+static int compareRows(const void *a, const void *b)
+{
+   const AggregateInfo *x = *(AggregateInfo* const*) a, *y = *(AggregateInfo* const*) b;
+   int c = strcmp(x->funName, y->funName);
+   if (c != 0)
+      return c;
+   if (x->beginAddr != y->beginAddr)
+      return x->beginAddr < y->beginAddr ? -1 : 1;
+   return x->thId - y->thId;
+}
+
+/**
+   @brief Orders sites by total cost (waiting plus execution time), highest
+          first.
+**/
+static int compareSites(const void *a, const void *b)
+{
+   const SiteSummary *x = a, *y = b;
+   double cx = x->wTime + x->exTime, cy = y->wTime + y->exTime;
+   return cx < cy ? 1 : (cx > cy ? -1 : 0);
+}
+
+/**
+   @brief Computes the totals and the min/max/mean/stddev across threads
+          of one site.
+**/
+static void summarizeSite(SiteSummary *site)
+{
+   int i;
+   double w2 = 0.0, ex2 = 0.0;
+   site->count = site->iCount = 0;
+   site->wTime = site->exTime = site->spinTime = 0.0;
+   site->wMin = site->wMax = site->rows[0]->wTime;
+   site->exMin = site->exMax = site->rows[0]->exTime;
+   for (i = 0; i < site->numRows; i++)
+   {
+      AggregateInfo *row = site->rows[i];
+      site->count += row->count;
+      site->iCount += row->iCount;
+      site->wTime += row->wTime;
+      site->exTime += row->exTime;
+      site->spinTime += row->spinTime;
+      w2 += row->wTime * row->wTime;
+      ex2 += row->exTime * row->exTime;
+      if (row->wTime < site->wMin) site->wMin = row->wTime;
+      if (row->wTime > site->wMax) site->wMax = row->wTime;
+      if (row->exTime < site->exMin) site->exMin = row->exTime;
+      if (row->exTime > site->exMax) site->exMax = row->exTime;
+   }
+   site->wMean = site->wTime / site->numRows;
+   site->exMean = site->exTime / site->numRows;
+   site->wStddev = sqrt(fmax(w2 / site->numRows - site->wMean * site->wMean, 0.0));
+   site->exStddev = sqrt(fmax(ex2 / site->numRows - site->exMean * site->exMean, 0.0));
+}
+
+/**
+   @brief Prints the rows of one site in the original space separated
+          format.
+**/
+static void printTextSite(const SiteSummary *site)
+{
+   int i;
+   for (i = 0; i < site->numRows; i++)
+   {
+      const AggregateInfo *row = site->rows[i];
+      if (COUNTING)
+         fprintf(outFile, " %s %p %p %d %lf %lf %ld %lf %lf %lld\n",
+                    row->funName, row->beginAddr, row->endAddr, row->thId,
+                    row->wTime, row->exTime, row->count, row->spinTime,
+                    row->wTime - row->spinTime, row->iCount);
+      else
+         fprintf(outFile, " %s %p %p %d %lf %lf %ld %lf %lf \n",
+                    row->funName, row->beginAddr, row->endAddr, row->thId,
+                    row->wTime, row->exTime, row->count, row->spinTime,
+                    row->wTime - row->spinTime);
+   }
+}
+
+/**
+   @brief Prints one site as CSV: a "site" summary row followed by one
+          "thread" row per thread.
+**/
+static void printCsvSite(const SiteSummary *site)
+{
+   int i;
+   fprintf(outFile, "site,%s,0x%lx,0x%lx,,%d,%ld,%.9f,%.9f,%.9f,%.9f,"
+                    "%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f",
+           site->rows[0]->funName, (unsigned long) site->rows[0]->beginAddr,
+           (unsigned long) site->rows[0]->endAddr, site->numRows, site->count,
+           site->wTime, site->exTime, site->spinTime, site->wTime - site->spinTime,
+           site->wMin, site->wMax, site->wMean, site->wStddev,
+           site->exMin, site->exMax, site->exMean, site->exStddev);
+   if (COUNTING)
+      fprintf(outFile, ",%lld", site->iCount);
+   fprintf(outFile, "\n");
+   for (i = 0; i < site->numRows; i++)
+   {
+      const AggregateInfo *row = site->rows[i];
+      fprintf(outFile, "thread,%s,0x%lx,0x%lx,%d,1,%ld,%.9f,%.9f,%.9f,%.9f,,,,,,,,",
+              row->funName, (unsigned long) row->beginAddr,
+              (unsigned long) row->endAddr, row->thId, row->count, row->wTime,
+              row->exTime, row->spinTime, row->wTime - row->spinTime);
+      if (COUNTING)
+         fprintf(outFile, ",%lld", row->iCount);
+      fprintf(outFile, "\n");
+   }
+}
+
+/**
+   @brief Prints one site as a JSON object.
+**/
+static void printJsonSite(const SiteSummary *site, bool last)
+{
+   int i;
+   fprintf(outFile, "  {\"function\": \"%s\", \"begin\": \"0x%lx\", \"end\": \"0x%lx\", "
+                    "\"threads\": %d, \"count\": %ld,\n",
+           site->rows[0]->funName, (unsigned long) site->rows[0]->beginAddr,
+           (unsigned long) site->rows[0]->endAddr, site->numRows, site->count);
+   fprintf(outFile, "   \"wait\": {\"total\": %.9f, \"min\": %.9f, \"max\": %.9f, "
+                    "\"mean\": %.9f, \"stddev\": %.9f},\n",
+           site->wTime, site->wMin, site->wMax, site->wMean, site->wStddev);
+   fprintf(outFile, "   \"exec\": {\"total\": %.9f, \"min\": %.9f, \"max\": %.9f, "
+                    "\"mean\": %.9f, \"stddev\": %.9f},\n",
+           site->exTime, site->exMin, site->exMax, site->exMean, site->exStddev);
+   fprintf(outFile, "   \"spin\": %.9f, \"blocked\": %.9f,", site->spinTime,
+           site->wTime - site->spinTime);
+   if (COUNTING)
+      fprintf(outFile, " \"instructions\": %lld,", site->iCount);
+   fprintf(outFile, "\n   \"perThread\": [\n");
+   for (i = 0; i < site->numRows; i++)
+   {
+      const AggregateInfo *row = site->rows[i];
+      fprintf(outFile, "    {\"thread\": %d, \"count\": %ld, \"wait\": %.9f, "
+                       "\"exec\": %.9f, \"spin\": %.9f, \"blocked\": %.9f",
+              row->thId, row->count, row->wTime, row->exTime, row->spinTime,
+              row->wTime - row->spinTime);
+      if (COUNTING)
+         fprintf(outFile, ", \"instructions\": %lld", row->iCount);
+      fprintf(outFile, "}%s\n", i + 1 < site->numRows ? "," : "");
+   }
+   fprintf(outFile, "   ]}%s\n", last ? "" : ",");
+}
+
+/**
+   @brief Prints the time the program spent outside and inside parallel
+          regions, and what Amdahl's law predicts for other thread counts
+          if the parallel time scales perfectly with the threads: the run
+          on one thread takes serial + threads * parallel time.
+**/
+static void printAmdahl()
+{
+   double total = getTime() - progStartTime, serial = total - totalParaTime;
+   double threads = totalParaTime > 0 ? teamParaTime / totalParaTime : 1.0;
+   double work, fraction, t;
+   int m, maxThreads = 8;
+   if (serial < 0)
+      serial = 0;
+   work = serial + teamParaTime;
+   fraction = work > 0 ? serial / work : 1.0;
+   while (maxThreads < 4 * threads)
+      maxThreads *= 2;
+   if (formatFlag == FORMAT_JSON)
+   {
+      fprintf(outFile, " \"program\": {\"time\": %.9f, \"serial\": %.9f, "
+                       "\"parallel\": %.9f, \"regions\": %ld, \"threads\": %.2f,\n"
+                       "  \"serial_fraction\": %.9f, ", total, serial,
+              totalParaTime, numRegions, threads, fraction);
+      if (fraction > 0)
+         fprintf(outFile, "\"speedup_ceiling\": %.3f,\n", 1 / fraction);
+      else
+         fprintf(outFile, "\"speedup_ceiling\": null,\n");
+      fprintf(outFile, "  \"predicted\": [");
+      for (m = 1; m <= maxThreads; m *= 2)
+      {
+         t = serial + teamParaTime / m;
+         fprintf(outFile, "%s\n   {\"threads\": %d, \"time\": %.9f, \"speedup\": %.3f}",
+                 m > 1 ? "," : "", m, t, t > 0 ? work / t : 0.0);
+      }
+      fprintf(outFile, "]},\n");
+      return;
+   }
+   fprintf(outFile, "# program %lf s: serial %lf s, parallel %lf s in %ld regions "
+                    "with %.2f threads\n", total, serial, totalParaTime, numRegions,
+           threads);
+   if (fraction > 0)
+      fprintf(outFile, "# serial fraction %lf, speedup ceiling %.3f\n", fraction,
+              1 / fraction);
+   else
+      fprintf(outFile, "# serial fraction 0, no speedup ceiling\n");
+   fprintf(outFile, "# predicted threads time speedup\n");
+   for (m = 1; m <= maxThreads; m *= 2)
+   {
+      t = serial + teamParaTime / m;
+      fprintf(outFile, "# predicted %d %lf %.3f\n", m, t, t > 0 ? work / t : 0.0);
+   }
+}
+
+/**
+   @brief Orders thread timelines by the order the threads were first seen.
+**/
+static int compareTimelines(const void *a, const void *b)
+{
+   const Timeline *x = *(Timeline* const*) a, *y = *(Timeline* const*) b;
+   return x->id < y->id ? -1 : (x->id > y->id ? 1 : 0);
+}
+
+/**
+   @brief Orders parallel region sites by wall time, largest first.
+**/
+static int compareRegionStats(const void *a, const void *b)
+{
+   const RegionStats *x = *(RegionStats* const*) a, *y = *(RegionStats* const*) b;
+   return x->elapsed < y->elapsed ? 1 : (x->elapsed > y->elapsed ? -1 : 0);
+}
+
+/**
+   @brief Prints the utilization of every thread, the share of its time
+          (from when it was first seen to now) in each state, and of the
+          team of every parallel region site, the share of the team's time
+          in the regions in each state. Threads are numbered in the order
+          they were first seen, the initial thread is 0.
+**/
+static void printUtilization()
+{
+   Timeline *tl, **threads;
+   RegionStats **regions;
+   double now = getTime(), time[NUM_STATES], total;
+   unsigned int numThreads = 0, numSites = 0, i;
+   int s;
+   for (tl = allTimelines; tl != NULL; tl = tl->next)
+      numThreads++;
+   threads = malloc((numThreads + 1) * sizeof(Timeline*));
+   regions = malloc(REGION_SITES * sizeof(RegionStats*));
+   if (threads == NULL || regions == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (tl = allTimelines, i = 0; tl != NULL; tl = tl->next)
+      threads[i++] = tl;
+   qsort(threads, numThreads, sizeof(Timeline*), compareTimelines);
+   for (i = 0; i < REGION_SITES; i++)
+      if (regionStats[i].count > 0)
+         regions[numSites++] = &regionStats[i];
+   qsort(regions, numSites, sizeof(RegionStats*), compareRegionStats);
+
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, " \"threads\": [");
+   else
+   {
+      fprintf(outFile, "# thread id time(s)");
+      for (s = 0; s < NUM_STATES; s++)
+         fprintf(outFile, " %s%%", stateNames[s]);
+      fprintf(outFile, "\n");
+   }
+   for (i = 0; i < numThreads; i++)
+   {
+      tl = threads[i];
+      total = now - tl->start;
+      for (s = 0; s < NUM_STATES; s++)
+         time[s] = tl->time[s] + tl->moved[s];
+      time[tl->state] += now - tl->since;
+      if (formatFlag == FORMAT_JSON)
+      {
+         fprintf(outFile, "%s\n  {\"thread\": %u, \"time\": %.9f", i > 0 ? "," : "",
+                 tl->id, total);
+         for (s = 0; s < NUM_STATES; s++)
+            fprintf(outFile, ", \"%s\": %.9f", stateNames[s],
+                    time[s] > 0 ? time[s] : 0.0);
+         fprintf(outFile, "}");
+         continue;
+      }
+      fprintf(outFile, "# thread %u %lf", tl->id, total);
+      for (s = 0; s < NUM_STATES; s++)
+         fprintf(outFile, " %.1f", total > 0 && time[s] > 0 ? 100 * time[s] / total : 0.0);
+      fprintf(outFile, "\n");
+   }
+
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "],\n \"regions\": [");
+   else
+   {
+      fprintf(outFile, "# region site count threads time(s)");
+      for (s = 0; s < STATE_IDLE; s++)
+         fprintf(outFile, " %s%%", stateNames[s]);
+      fprintf(outFile, "\n");
+   }
+   for (i = 0; i < numSites; i++)
+   {
+      RegionStats *rs = regions[i];
+      for (s = 0, total = 0.0; s < STATE_IDLE; s++)
+         total += rs->time[s];
+      if (formatFlag == FORMAT_JSON)
+      {
+         fprintf(outFile, "%s\n  {\"site\": \"%p\", \"count\": %ld, \"threads\": %.2f, "
+                          "\"time\": %.9f", i > 0 ? "," : "", rs->addr, rs->count,
+                 (double) rs->threads / rs->count, rs->elapsed);
+         for (s = 0; s < STATE_IDLE; s++)
+            fprintf(outFile, ", \"%s\": %.9f", stateNames[s], rs->time[s]);
+         fprintf(outFile, "}");
+         continue;
+      }
+      fprintf(outFile, "# region %p %ld %.2f %lf", rs->addr, rs->count,
+              (double) rs->threads / rs->count, rs->elapsed);
+      for (s = 0; s < STATE_IDLE; s++)
+         fprintf(outFile, " %.1f", total > 0 ? 100 * rs->time[s] / total : 0.0);
+      fprintf(outFile, "\n");
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]");
+   free(threads);
+   free(regions);
+}
+
+/**
+   @brief Prints the CPU migrations of every thread and the lock and
+          critical section handoffs of all threads by class (PGOMP_CPU).
+**/
+static void printCpus()
+{
+   Timeline *tl, **threads;
+   Handoff total[NUM_HANDOFFS];
+   unsigned int numThreads = 0, i;
+   int h;
+   memset(total, 0, sizeof(total));
+   for (tl = allTimelines; tl != NULL; tl = tl->next)
+      numThreads++;
+   threads = malloc((numThreads + 1) * sizeof(Timeline*));
+   if (threads == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (tl = allTimelines, i = 0; tl != NULL; tl = tl->next)
+      threads[i++] = tl;
+   qsort(threads, numThreads, sizeof(Timeline*), compareTimelines);
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"cpus\": [");
+   else
+      fprintf(outFile, "# cpu thread id cpu node migrations node-migrations\n");
+   for (i = 0; i < numThreads; i++)
+   {
+      tl = threads[i];
+      for (h = 0; h < NUM_HANDOFFS; h++)
+      {
+         total[h].count += tl->handoffs[h].count;
+         total[h].time += tl->handoffs[h].time;
+         if (tl->handoffs[h].max > total[h].max)
+            total[h].max = tl->handoffs[h].max;
+      }
+      if (formatFlag == FORMAT_JSON)
+         fprintf(outFile, "%s\n  {\"thread\": %u, \"cpu\": %d, \"node\": %d, "
+                          "\"migrations\": %ld, \"node_migrations\": %ld}",
+                 i > 0 ? "," : "", tl->id, tl->cpu,
+                 tl->cpu >= 0 && tl->cpu < numCpus ? cpuNode[tl->cpu] : -1,
+                 tl->migrations, tl->nodeMigrations);
+      else
+         fprintf(outFile, "# cpu %u %d %d %ld %ld\n", tl->id, tl->cpu,
+                 tl->cpu >= 0 && tl->cpu < numCpus ? cpuNode[tl->cpu] : -1,
+                 tl->migrations, tl->nodeMigrations);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "],\n \"handoffs\": {");
+   else
+      fprintf(outFile, "# handoff class count time(s) mean(us) max(us)\n");
+   for (h = 0; h < NUM_HANDOFFS; h++)
+   {
+      double mean = total[h].count ? total[h].time / total[h].count : 0.0;
+      if (formatFlag == FORMAT_JSON)
+         fprintf(outFile, "%s\n  \"%s\": {\"count\": %ld, \"time\": %.9f, "
+                          "\"mean\": %.9f, \"max\": %.9f}", h > 0 ? "," : "",
+                 handoffNames[h], total[h].count, total[h].time, mean, total[h].max);
+      else
+         fprintf(outFile, "# handoff %s %ld %lf %.3f %.3f\n", handoffNames[h],
+                 total[h].count, total[h].time, mean * 1e6, total[h].max * 1e6);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "}");
+   free(threads);
+}
+
+/**
+   @brief Calls of all allocation functions in a count.
+**/
+static long allocCalls(const AllocCount *ac)
+{
+   long calls = 0;
+   int k;
+   for (k = 0; k < NUM_ALLOCS; k++)
+      calls += ac->calls[k];
+   return calls;
+}
+
+/**
+   @brief Prints one count of allocations (PGOMP_MALLOC).
+   @param kind - "thread" or "region" ("site" in JSON).
+   @param id - Thread id or region site, as printed.
+**/
+static void printAllocCount(const char *kind, const char *id, const AllocCount *ac,
+                            bool first)
+{
+   long calls = allocCalls(ac);
+   int k;
+   if (formatFlag == FORMAT_JSON)
+   {
+      fprintf(outFile, "%s\n  {\"%s\": %s, \"calls\": %ld, \"bytes\": %ld, "
+                       "\"time\": %.9f", first ? "" : ",", kind, id, calls,
+              ac->bytes, ac->time);
+      for (k = 0; k < NUM_ALLOCS; k++)
+         fprintf(outFile, ", \"%s\": %ld", allocNames[k], ac->calls[k]);
+      fprintf(outFile, "}");
+      return;
+   }
+   fprintf(outFile, "# alloc %s %s %ld %ld %lf", kind, id, calls, ac->bytes, ac->time);
+   for (k = 0; k < NUM_ALLOCS; k++)
+      fprintf(outFile, " %ld", ac->calls[k]);
+   fprintf(outFile, "\n");
+}
+
+/**
+   @brief Prints the allocations in region bodies (PGOMP_MALLOC) of every
+          thread and of every parallel region site with any.
+**/
+static void printAllocs()
+{
+   Timeline *tl, **threads;
+   RegionStats **regions;
+   unsigned int numThreads = 0, numSites = 0, i;
+   char id[32];
+   int k;
+   for (tl = allTimelines; tl != NULL; tl = tl->next)
+      numThreads++;
+   threads = malloc((numThreads + 1) * sizeof(Timeline*));
+   regions = malloc(REGION_SITES * sizeof(RegionStats*));
+   if (threads == NULL || regions == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (tl = allTimelines, i = 0; tl != NULL; tl = tl->next)
+      threads[i++] = tl;
+   qsort(threads, numThreads, sizeof(Timeline*), compareTimelines);
+   for (i = 0; i < REGION_SITES; i++)
+      if (regionStats[i].count > 0)
+         regions[numSites++] = &regionStats[i];
+   qsort(regions, numSites, sizeof(RegionStats*), compareRegionStats);
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"alloc_threads\": [");
+   else
+   {
+      fprintf(outFile, "# alloc thread|region id calls bytes time(s)");
+      for (k = 0; k < NUM_ALLOCS; k++)
+         fprintf(outFile, " %s", allocNames[k]);
+      fprintf(outFile, "\n");
+   }
+   for (i = 0; i < numThreads; i++)
+   {
+      snprintf(id, sizeof(id), "%u", threads[i]->id);
+      printAllocCount("thread", id, &threads[i]->alloc, i == 0);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "],\n \"alloc_regions\": [");
+   for (i = 0, k = 0; i < numSites; i++)
+   {
+      if (allocCalls(&regions[i]->alloc) == 0)
+         continue;
+      if (formatFlag == FORMAT_JSON)
+      {
+         snprintf(id, sizeof(id), "\"%p\"", regions[i]->addr);
+         printAllocCount("site", id, &regions[i]->alloc, k++ == 0);
+      }
+      else
+      {
+         snprintf(id, sizeof(id), "%p", regions[i]->addr);
+         printAllocCount("region", id, &regions[i]->alloc, k++ == 0);
+      }
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]");
+   free(threads);
+   free(regions);
+}
+
+/**
+   @brief qsort() comparison of loop sites, longest span first.
+**/
+static int compareLoopStats(const void *a, const void *b)
+{
+   const LoopStats *x = *(LoopStats* const *) a, *y = *(LoopStats* const *) b;
+   return (x->span < y->span) - (x->span > y->span);
+}
+
+/**
+   @brief Prints every loop site with a dynamic, guided or runtime
+          schedule: how its iterations were handed out, and the time on
+          them by position in the loop, in LOOP_BINS bins. pgomp-advise
+          reads these lines.
+**/
+static void printLoops()
+{
+   LoopStats **loops;
+   unsigned int numLoops = 0, i;
+   int b;
+   loops = malloc(LOOP_SITES * sizeof(LoopStats*));
+   if (loops == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (i = 0; i < LOOP_SITES; i++)
+      if (loopStats[i].count > 0)
+         loops[numLoops++] = &loopStats[i];
+   qsort(loops, numLoops, sizeof(LoopStats*), compareLoopStats);
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"loops\": [");
+   else
+      fprintf(outFile, "# loop site schedule chunk count threads iterations chunks "
+                       "calls dispatch(s) busy(s) span(s)\n");
+   for (i = 0; i < numLoops; i++)
+   {
+      LoopStats *st = loops[i];
+      if (formatFlag == FORMAT_JSON)
+      {
+         fprintf(outFile, "%s\n  {\"site\": \"%p\", \"schedule\": \"%s\", "
+                          "\"chunk\": %ld, \"count\": %ld, \"threads\": %ld, "
+                          "\"iterations\": %.0f, \"chunks\": %ld, \"calls\": %ld, "
+                          "\"dispatch\": %.9f, \"busy\": %.9f, \"span\": %.9f, "
+                          "\"profile\": [", i > 0 ? "," : "", st->addr, st->schedule,
+                 st->chunkSize, st->count, st->threads, st->iterations, st->chunks,
+                 st->calls, st->dispatch, st->busy, st->span);
+         for (b = 0; b < LOOP_BINS; b++)
+            fprintf(outFile, "%s%.9f", b > 0 ? ", " : "", st->profile[b]);
+         fprintf(outFile, "]}");
+         continue;
+      }
+      fprintf(outFile, "# loop %p %s %ld %ld %ld %.0f %ld %ld %lf %lf %lf\n",
+              st->addr, st->schedule, st->chunkSize, st->count, st->threads,
+              st->iterations, st->chunks, st->calls, st->dispatch, st->busy,
+              st->span);
+      fprintf(outFile, "# loop-profile %p", st->addr);
+      for (b = 0; b < LOOP_BINS; b++)
+         fprintf(outFile, " %.9f", st->profile[b]);
+      fprintf(outFile, "\n");
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]");
+   free(loops);
+}
+
+/**
+   Finds the loaded object a critical section name cell is in
+**/
+typedef struct
+{
+/*@{*/
+   uintptr_t key; /**< Address of the name cell */
+   const char *file; /**< Set to the object's file, "" for the program */
+   uintptr_t base; /**< Set to the object's load bias */
+/*@}*/
+} ObjectLookup;
+
+/**
+   @brief dl_iterate_phdr() callback, stops at the object whose loadable
+          segments hold lookup->key.
+**/
+static int findObject(struct dl_phdr_info *info, size_t size, void *data)
+{
+   ObjectLookup *lookup = data;
+   int i;
+   for (i = 0; i < info->dlpi_phnum; i++)
+   {
+      const ElfW(Phdr) *ph = &info->dlpi_phdr[i];
+      uintptr_t start = info->dlpi_addr + ph->p_vaddr;
+      if (ph->p_type == PT_LOAD && lookup->key >= start
+          && lookup->key < start + ph->p_memsz)
+      {
+         lookup->file = info->dlpi_name;
+         lookup->base = info->dlpi_addr;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/**
+   A loaded object's file, mapped to read its static symbol table (.symtab),
+   which dladdr() does not see
+**/
+typedef struct
+{
+/*@{*/
+   const char *map; /**< Whole file */
+   size_t size; /**< File size */
+   const ElfW(Sym) *sym; /**< Symbol table, NULL if the object is stripped */
+   size_t numSym; /**< Entries in sym */
+   const char *strtab; /**< Names of the symbols */
+   size_t strSize; /**< Size of strtab */
+/*@}*/
+} ObjectFile;
+
+/**
+   @brief Maps the file of a loaded object and finds its symbol table.
+   @param file - dlpi_name of the object, "" for the program.
+   @return false if the file can not be read or is not an ELF file.
+**/
+static bool openObject(const char *file, ObjectFile *of)
+{
+   const ElfW(Ehdr) *eh;
+   const ElfW(Shdr) *sh;
+   struct stat st;
+   int fd, i;
+   memset(of, 0, sizeof(*of));
+   of->map = MAP_FAILED;
+   fd = open(file[0] ? file : "/proc/self/exe", O_RDONLY);
+   if (fd < 0)
+      return false;
+   if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(ElfW(Ehdr)))
+   {
+      of->size = st.st_size;
+      of->map = mmap(NULL, of->size, PROT_READ, MAP_PRIVATE, fd, 0);
+   }
+   close(fd);
+   if (of->map == MAP_FAILED)
+      return false;
+   eh = (const ElfW(Ehdr)*) of->map;
+   if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0)
+   {
+      munmap((void*) of->map, of->size);
+      of->map = MAP_FAILED;
+      return false;
+   }
+   if (eh->e_shoff == 0 || eh->e_shoff + eh->e_shnum * sizeof(ElfW(Shdr)) > of->size)
+      return true;
+   sh = (const ElfW(Shdr)*) (of->map + eh->e_shoff);
+   for (i = 0; i < eh->e_shnum; i++)
+      if (sh[i].sh_type == SHT_SYMTAB && sh[i].sh_link < eh->e_shnum
+          && sh[i].sh_offset + sh[i].sh_size <= of->size
+          && sh[sh[i].sh_link].sh_offset + sh[sh[i].sh_link].sh_size <= of->size)
+      {
+         of->sym = (const ElfW(Sym)*) (of->map + sh[i].sh_offset);
+         of->numSym = sh[i].sh_size / sizeof(ElfW(Sym));
+         of->strtab = of->map + sh[sh[i].sh_link].sh_offset;
+         of->strSize = sh[sh[i].sh_link].sh_size;
+         break;
+      }
+   return true;
+}
+
+/**
+   @brief Unmaps an object file opened with openObject().
+**/
+static void closeObject(ObjectFile *of)
+{
+   if (of->map != MAP_FAILED)
+      munmap((void*) of->map, of->size);
+   of->map = MAP_FAILED;
+}
+
+/**
+   @brief Gets the name of a critical section from the symbol of its name
+          cell, ".gomp_critical_user_<name>". The symbol is local to the
+          object's static symbol table, so a stripped object gives no name.
+   @param key - The name cell.
+   @param name - Set to the name, or to the address if it is not found.
+   @param len - Size of name.
+**/
+static void criticalName(void *key, char *name, size_t len)
+{
+   static const char prefix[] = ".gomp_critical_user_";
+   ObjectLookup lookup = { (uintptr_t) key, NULL, 0 };
+   ObjectFile of;
+   size_t j;
+   snprintf(name, len, "%p", key);
+   if (key == &criticalKey || key == &atomicKey)
+   {
+      snprintf(name, len, key == &criticalKey ? "(unnamed)" : "(atomic)");
+      return;
+   }
+   if (dl_iterate_phdr(findObject, &lookup) == 0 || !openObject(lookup.file, &of))
+      return;
+   for (j = 0; j < of.numSym; j++)
+   {
+      const char *symName = of.strtab + of.sym[j].st_name;
+      if (lookup.base + of.sym[j].st_value == lookup.key
+          && of.sym[j].st_name < of.strSize
+          && strncmp(symName, prefix, sizeof(prefix) - 1) == 0)
+      {
+         snprintf(name, len, "%s", symName + sizeof(prefix) - 1);
+         break;
+      }
+   }
+   closeObject(&of);
+}
+
+/**
+   @brief Compares critical section names, the most waited on first.
+**/
+static int compareCriticalStats(const void *a, const void *b)
+{
+   const CriticalStats *x = *(CriticalStats* const *) a, *y = *(CriticalStats* const *) b;
+   if (x->wait != y->wait)
+      return x->wait < y->wait ? 1 : -1;
+   return x->hold < y->hold ? 1 : x->hold > y->hold ? -1 : 0;
+}
+
+/**
+   @brief Prints the contention of every critical section name: entries,
+          contended entries, wait and hold times and their histograms.
+          All unnamed critical sections of the program are one lock in
+          libgomp and are reported as the name "(unnamed)", the atomics it
+          serializes as "(atomic)".
+**/
+static void printCriticalNames()
+{
+   CriticalStats **names;
+   char name[256];
+   unsigned int numNames = 0, i;
+   int b;
+   names = malloc(CRITICAL_NAMES * sizeof(CriticalStats*));
+   if (names == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (i = 0; i < CRITICAL_NAMES; i++)
+      if (criticalStats[i].count > 0)
+         names[numNames++] = &criticalStats[i];
+   qsort(names, numNames, sizeof(CriticalStats*), compareCriticalStats);
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"critical\": [");
+   else
+      fprintf(outFile, "# critical name count contended wait(s) wait-max(us) "
+                       "hold(s) hold-max(us)\n"
+                       "# critical-hist name wait|hold <1us 1-2us 2-4us ...\n");
+   for (i = 0; i < numNames; i++)
+   {
+      CriticalStats *cs = names[i];
+      criticalName(cs->key, name, sizeof(name));
+      if (formatFlag == FORMAT_JSON)
+      {
+         fprintf(outFile, "%s\n  {\"name\": \"%s\", \"count\": %ld, \"contended\": %ld, "
+                          "\"wait\": %.9f, \"wait_max\": %.9f, \"hold\": %.9f, "
+                          "\"hold_max\": %.9f, \"wait_hist\": [", i > 0 ? "," : "",
+                 name, cs->count, cs->contended, cs->wait, cs->waitMax, cs->hold,
+                 cs->holdMax);
+         for (b = 0; b < CRITICAL_HIST; b++)
+            fprintf(outFile, "%s%ld", b > 0 ? ", " : "", cs->waitHist[b]);
+         fprintf(outFile, "], \"hold_hist\": [");
+         for (b = 0; b < CRITICAL_HIST; b++)
+            fprintf(outFile, "%s%ld", b > 0 ? ", " : "", cs->holdHist[b]);
+         fprintf(outFile, "]}");
+         continue;
+      }
+      fprintf(outFile, "# critical %s %ld %ld %lf %.3f %lf %.3f\n", name, cs->count,
+              cs->contended, cs->wait, cs->waitMax * 1e6, cs->hold, cs->holdMax * 1e6);
+      fprintf(outFile, "# critical-hist %s wait", name);
+      for (b = 0; b < CRITICAL_HIST; b++)
+         fprintf(outFile, " %ld", cs->waitHist[b]);
+      fprintf(outFile, "\n# critical-hist %s hold", name);
+      for (b = 0; b < CRITICAL_HIST; b++)
+         fprintf(outFile, " %ld", cs->holdHist[b]);
+      fprintf(outFile, "\n");
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]");
+   free(names);
+}
+
+/**
+   @brief Compares the views of locks, the most waited for first.
+**/
+static int compareConvoyLocks(const void *a, const void *b)
+{
+   const ConvoyLock *x = *(ConvoyLock* const *) a, *y = *(ConvoyLock* const *) b;
+   if (x->depth != y->depth)
+      return x->depth < y->depth ? 1 : -1;
+   return x->contended < y->contended ? 1 : x->contended > y->contended ? -1 : 0;
+}
+
+/**
+   @brief Compares lock order pairs by the lock held.
+**/
+static int compareOrderHeld(const void *a, const void *b)
+{
+   const LockOrder *x = *(LockOrder* const *) a, *y = *(LockOrder* const *) b;
+   return x->held < y->held ? -1 : x->held > y->held;
+}
+
+/**
+   @brief Compares lock order pairs, the most waited for first.
+**/
+static int compareOrderWait(const void *a, const void *b)
+{
+   const LockOrder *x = *(LockOrder* const *) a, *y = *(LockOrder* const *) b;
+   if (x->wait != y->wait)
+      return x->wait < y->wait ? 1 : -1;
+   return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+/**
+   @brief Finds the lock order pairs that are inversions: the lock held is
+          also acquired, directly or through other locks, while holding
+          the lock wanted. Two threads that take such locks at once can
+          deadlock.
+   @param orders - The pairs, sorted by the lock held.
+**/
+static void findInversions(LockOrder **orders, unsigned int numOrders)
+{
+   unsigned int *first, *stack, i, j, numStack;
+   bool *seen;
+   ConvoyLock *node;
+   first = malloc((CONVOY_LOCKS + 1) * sizeof(unsigned int));
+   stack = malloc((numOrders + 1) * sizeof(unsigned int));
+   seen = malloc(CONVOY_LOCKS * sizeof(bool));
+   if (first == NULL || stack == NULL || seen == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   // first[l] is the first pair holding the lock at index l of convoyLocks
+   for (i = 0, j = 0; i <= CONVOY_LOCKS; i++)
+   {
+      while (j < numOrders && orders[j]->held < &convoyLocks[i])
+         j++;
+      first[i] = j;
+   }
+   for (i = 0; i < numOrders; i++)
+   {
+      // search from wanted for a way back to held
+      memset(seen, 0, CONVOY_LOCKS * sizeof(bool));
+      orders[i]->inversion = false;
+      numStack = 0;
+      stack[numStack++] = orders[i]->wanted - convoyLocks;
+      seen[orders[i]->wanted - convoyLocks] = true;
+      while (numStack > 0 && !orders[i]->inversion)
+      {
+         node = &convoyLocks[stack[--numStack]];
+         for (j = first[node - convoyLocks]; j < first[node - convoyLocks + 1]; j++)
+         {
+            if (orders[j]->wanted == orders[i]->held)
+            {
+               orders[i]->inversion = true;
+               break;
+            }
+            if (!seen[orders[j]->wanted - convoyLocks])
+            {
+               seen[orders[j]->wanted - convoyLocks] = true;
+               stack[numStack++] = orders[j]->wanted - convoyLocks;
+            }
+         }
+      }
+   }
+   free(first);
+   free(stack);
+   free(seen);
+}
+
+/**
+   @brief Prints the lock convoys (PGOMP_CONVOY): the samples of the
+          wait-for graph over time, the threads waiting for every lock,
+          and the pairs of locks acquired one while holding the other,
+          marking the inversions. Locks are named by their address,
+          critical sections as in printCriticalNames().
+**/
+static void printConvoys()
+{
+   ConvoyLock **locks;
+   LockOrder **orders;
+   char (*names)[128];
+   unsigned int numLocks = 0, numOrders = 0, i;
+   locks = malloc(CONVOY_LOCKS * sizeof(ConvoyLock*));
+   orders = malloc(CONVOY_ORDERS * sizeof(LockOrder*));
+   names = malloc(CONVOY_LOCKS * sizeof(*names));
+   if (locks == NULL || orders == NULL || names == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (i = 0; i < CONVOY_LOCKS; i++)
+   {
+      if (convoyLocks[i].key == NULL)
+         continue;
+      if (convoyLocks[i].named)
+         criticalName(convoyLocks[i].key, names[i], sizeof(names[i]));
+      else
+         snprintf(names[i], sizeof(names[i]), "%p", convoyLocks[i].key);
+      if (convoyLocks[i].count > 0)
+         locks[numLocks++] = &convoyLocks[i];
+   }
+   qsort(locks, numLocks, sizeof(ConvoyLock*), compareConvoyLocks);
+   for (i = 0; i < CONVOY_ORDERS; i++)
+      if (lockOrders[i].held != NULL && lockOrders[i].count > 0)
+         orders[numOrders++] = &lockOrders[i];
+   qsort(orders, numOrders, sizeof(LockOrder*), compareOrderHeld);
+   findInversions(orders, numOrders);
+   qsort(orders, numOrders, sizeof(LockOrder*), compareOrderWait);
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"convoy\": {\"interval\": %.9f, \"samples\": [",
+              CONVOY_INTERVAL_NS * 1e-9);
+   else
+      fprintf(outFile, "# convoy-sample time(s) samples waiting max-depth max-chain "
+                       "cycles\n");
+   for (i = 0; i < (unsigned int) numConvoySlots; i++)
+   {
+      ConvoySlot *cs = &convoySlots[i];
+      if (formatFlag == FORMAT_JSON)
+         fprintf(outFile, "%s\n  {\"time\": %.9f, \"samples\": %ld, \"waiting\": %.3f, "
+                          "\"max_depth\": %d, \"max_chain\": %d, \"cycles\": %ld}",
+                 i > 0 ? "," : "", cs->time - progStartTime, cs->samples,
+                 (double) cs->waiting / cs->samples, cs->maxDepth, cs->maxChain,
+                 cs->cycles);
+      else
+         fprintf(outFile, "# convoy-sample %lf %ld %.3f %d %d %ld\n",
+                 cs->time - progStartTime, cs->samples,
+                 (double) cs->waiting / cs->samples, cs->maxDepth, cs->maxChain,
+                 cs->cycles);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "],\n  \"locks\": [");
+   else
+      fprintf(outFile, "# convoy lock site count contended samples depth-mean "
+                       "depth-max chained\n");
+   for (i = 0; i < numLocks; i++)
+   {
+      ConvoyLock *cl = locks[i];
+      double mean = cl->samples ? (double) cl->depth / cl->samples : 0.0;
+      if (formatFlag == FORMAT_JSON)
+         fprintf(outFile, "%s\n  {\"lock\": \"%s\", \"critical\": %s, \"site\": \"%p\", "
+                          "\"count\": %ld, \"contended\": %ld, \"samples\": %ld, "
+                          "\"depth_mean\": %.3f, \"depth_max\": %d, \"chained\": %ld}",
+                 i > 0 ? "," : "", names[cl - convoyLocks], cl->named ? "true" : "false",
+                 cl->site, cl->count, cl->contended, cl->samples, mean, cl->maxDepth,
+                 cl->chained);
+      else
+         fprintf(outFile, "# convoy %s %p %ld %ld %ld %.3f %d %ld\n",
+                 names[cl - convoyLocks], cl->site, cl->count, cl->contended,
+                 cl->samples, mean, cl->maxDepth, cl->chained);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "],\n  \"orders\": [");
+   else
+      fprintf(outFile, "# lock-order held wanted count contended wait(s) inversion\n");
+   for (i = 0; i < numOrders; i++)
+   {
+      LockOrder *lo = orders[i];
+      if (formatFlag == FORMAT_JSON)
+         fprintf(outFile, "%s\n  {\"held\": \"%s\", \"wanted\": \"%s\", \"count\": %ld, "
+                          "\"contended\": %ld, \"wait\": %.9f, \"inversion\": %s}",
+                 i > 0 ? "," : "", names[lo->held - convoyLocks],
+                 names[lo->wanted - convoyLocks], lo->count, lo->contended, lo->wait,
+                 lo->inversion ? "true" : "false");
+      else
+         fprintf(outFile, "# lock-order %s %s %ld %ld %lf %s\n", names[lo->held - convoyLocks],
+                 names[lo->wanted - convoyLocks], lo->count, lo->contended, lo->wait,
+                 lo->inversion ? "yes" : "no");
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]}");
+   free(locks);
+   free(orders);
+   free(names);
+}
+
+/**
+   @brief Compares addresses, for qsort().
+**/
+static int compareAddrs(const void *a, const void *b)
+{
+   uintptr_t x = *(const uintptr_t*) a, y = *(const uintptr_t*) b;
+   return x < y ? -1 : x > y;
+}
+
+/**
+   @brief Prints the location of every site: its object (file name without
+          the directory), the function it is in and its offset from the
+          function, or from the object's load address if the object has no
+          symbol table. Site addresses change from run to run with address
+          space randomization and from build to build, locations let
+          pgomp-diff match the sites of two runs. The symbols are read here,
+          at exit, because the binaries may be rebuilt before the runs are
+          compared.
+   @param table[] - Hash table.
+**/
+static void printLocations(AggregateInfo table[])
+{
+   uintptr_t *addrs, *func;
+   const char **names;
+   ObjectLookup lookup;
+   ObjectFile of;
+   int numAddrs = 0, i, first, k;
+   size_t j;
+   addrs = malloc((HTABLE_SIZE + 1) * sizeof(uintptr_t));
+   func = malloc((HTABLE_SIZE + 1) * sizeof(uintptr_t));
+   names = malloc((HTABLE_SIZE + 1) * sizeof(char*));
+   if (addrs == NULL || func == NULL || names == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   for (i = 0; i < HTABLE_SIZE; i++)
+      if (table[i].count > 0 && table[i].beginAddr != NULL)
+         addrs[numAddrs++] = (uintptr_t) table[i].beginAddr;
+   qsort(addrs, numAddrs, sizeof(uintptr_t), compareAddrs);
+   for (i = 0, k = 0; i < numAddrs; i++)
+      if (k == 0 || addrs[i] != addrs[k-1])
+         addrs[k++] = addrs[i];
+   numAddrs = k;
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, ",\n \"locations\": [");
+   else
+      fprintf(outFile, "# location site object function offset\n");
+   // one object at a time: its addresses are consecutive, and every
+   // function symbol is looked up among them
+   for (first = 0; first < numAddrs; first = i)
+   {
+      const char *object = "?";
+      lookup.key = addrs[first];
+      lookup.file = NULL;
+      lookup.base = 0;
+      i = first + 1;
+      if (dl_iterate_phdr(findObject, &lookup) != 0)
+      {
+         uintptr_t low = addrs[first], high = addrs[first];
+         ObjectLookup next;
+         // extend over the following addresses of the same object
+         while (i < numAddrs)
+         {
+            next.key = addrs[i];
+            if (dl_iterate_phdr(findObject, &next) == 0 || next.file != lookup.file)
+               break;
+            high = addrs[i++];
+         }
+         object = strrchr(lookup.file, '/') ? strrchr(lookup.file, '/') + 1 : lookup.file;
+         for (k = first; k < i; k++)
+            names[k] = NULL;
+         if (openObject(lookup.file, &of))
+         {
+            for (j = 0; j < of.numSym; j++)
+            {
+               const ElfW(Sym) *sym = &of.sym[j];
+               uintptr_t start = lookup.base + sym->st_value;
+               if (ELF64_ST_TYPE(sym->st_info) != STT_FUNC || sym->st_size == 0
+                   || sym->st_name >= of.strSize || start > high
+                   || start + sym->st_size <= low)
+                  continue;
+               for (k = first; k < i; k++)
+                  if (addrs[k] >= start && addrs[k] < start + sym->st_size)
+                  {
+                     names[k] = of.strtab + sym->st_name;
+                     func[k] = start;
+                  }
+            }
+         }
+      }
+      else
+         names[first] = NULL;
+      if (object[0] == '\0')
+      {
+         static char exe[PATH_MAX];
+         ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+         exe[len > 0 ? len : 0] = '\0';
+         object = strrchr(exe, '/') ? strrchr(exe, '/') + 1 : exe;
+      }
+      for (k = first; k < i; k++)
+      {
+         const char *name = names[k] ? names[k] : "?";
+         unsigned long offset = addrs[k] - (names[k] ? func[k] : lookup.base);
+         if (formatFlag == FORMAT_JSON)
+            fprintf(outFile, "%s\n  {\"site\": \"0x%lx\", \"object\": \"%s\", "
+                             "\"function\": \"%s\", \"offset\": \"0x%lx\"}",
+                    k > 0 ? "," : "", (unsigned long) addrs[k], object, name, offset);
+         else
+            fprintf(outFile, "# location 0x%lx %s %s 0x%lx\n", (unsigned long) addrs[k],
+                    object, name, offset);
+      }
+      if (lookup.file != NULL)
+         closeObject(&of);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "]");
+   free(addrs);
+   free(func);
+   free(names);
+}
+
+/**
+   @brief Prints hash table data, grouped by site (function and call
+          location) with the most expensive sites first. In CSV and JSON
+          format each site also gets a reduction across its threads.
+   @param table[] - Hash table.
+   @return Hash void.
+**/
+static void printResult(AggregateInfo table[])
+{
+   AggregateInfo **rows;
+   SiteSummary *sites;
+   int index, numRows = 0, numSites = 0, i;
+   for (index = 0; index < HTABLE_SIZE ; index++)
+      if (table[index].count > 0)
+         numRows++;
+   rows = malloc((numRows + 1) * sizeof(AggregateInfo*));
+   sites = malloc((numRows + 1) * sizeof(SiteSummary));
+   if (rows == NULL || sites == NULL)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Out of memory for the results\n");
+      exit(0);
+   }
+   numRows = 0;
+   for (index = 0; index < HTABLE_SIZE ; index++)
+      if (table[index].count > 0)
+         rows[numRows++] = &table[index];
+   qsort(rows, numRows, sizeof(AggregateInfo*), compareRows);
+   // Threads of different (nested) teams with the same thread number have
+   // separate buckets, report them as one row
+   for (i = 0, index = 0; i < numRows; i++)
+   {
+      if (index > 0 && compareRows(&rows[i], &rows[index-1]) == 0)
+      {
+         rows[index-1]->count += rows[i]->count;
+         rows[index-1]->wTime += rows[i]->wTime;
+         rows[index-1]->exTime += rows[i]->exTime;
+         rows[index-1]->spinTime += rows[i]->spinTime;
+         rows[index-1]->iCount += rows[i]->iCount;
+      }
+      else
+         rows[index++] = rows[i];
+   }
+   numRows = index;
+   for (i = 0; i < numRows; i++)
+   {
+      if (numSites == 0 || strcmp(rows[i]->funName, sites[numSites-1].rows[0]->funName) != 0
+          || rows[i]->beginAddr != sites[numSites-1].rows[0]->beginAddr)
+      {
+         sites[numSites].rows = &rows[i];
+         sites[numSites++].numRows = 0;
+      }
+      sites[numSites-1].numRows++;
+   }
+   for (i = 0; i < numSites; i++)
+      summarizeSite(&sites[i]);
+   qsort(sites, numSites, sizeof(SiteSummary), compareSites);
+   if (formatFlag == FORMAT_CSV)
+      fprintf(outFile, "kind,function,begin,end,thread,threads,count,wait,exec,spin,"
+                       "blocked,wait_min,wait_max,wait_mean,wait_stddev,exec_min,"
+                       "exec_max,exec_mean,exec_stddev%s\n",
+              COUNTING ? ",instructions" : "");
+   else if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "{\"format\": \"pgomp-aggregate\", \"version\": 1,\n"
+                       " \"units\": {\"wait\": \"s\", \"exec\": \"s\", \"spin\": \"s\", "
+                       "\"blocked\": \"s\", \"count\": \"calls\"},\n"
+                       " \"sites\": [\n");
+   for (i = 0; i < numSites; i++)
+   {
+      if (formatFlag == FORMAT_CSV)
+         printCsvSite(&sites[i]);
+      else if (formatFlag == FORMAT_JSON)
+         printJsonSite(&sites[i], i + 1 == numSites);
+      else
+         printTextSite(&sites[i]);
+   }
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, " ],\n");
+   printAmdahl();
+   printUtilization();
+   printCriticalNames();
+   printLocations(table);
+   if (cpuFlag)
+      printCpus();
+   if (allocFlag)
+      printAllocs();
+   if (convoyFlag)
+      printConvoys();
+   printLoops();
+   if (formatFlag == FORMAT_JSON)
+      fprintf(outFile, "\n}\n");
+   free(rows);
+   free(sites);
+   if (droppedEvents > 0)
+      fprintf(stderr,"LIBPGOMP WARNING: Hash table full, %lu events were not "
+                     "counted (raise HTABLE_SIZE)\n", droppedEvents);
+}
+
+#ifndef PGOMP_STATIC
+/**
+   @brief Error checking wrapper around library dlsym() symbol lookup.
+          A specialized build loaded by the dispatcher is not in the
+          preload chain, so it asks the dispatcher for the real function.
+**/
+static void* lookupFunction(char* name)
+{
+   char* dlerr;
+   void* functionPtr;
+   void* (*realFunction)(const char *);
+   realFunction = (void* (*)(const char *)) dlsym(RTLD_DEFAULT, PGOMP_REAL_LOOKUP);
+   dlerror(); // clear dlerror flag
+   if (realFunction != NULL)
+      functionPtr = realFunction(name);
+   else
+      functionPtr = dlsym(RTLD_NEXT, name);
+   dlerr = dlerror();
+   if (dlerr || !functionPtr) {
+      fprintf(stderr,"LIBPGOMP ERROR: Unable to resolve real %s: (%s)\n",name,
+              (dlerr? dlerr : "no error message available"));
+      exit(0);
+   }
+   return functionPtr;
+}
+#endif
+
+/**
+   @brief Lookup function name that an address is inside of.
+**/
+//
+// This will not be reliable because dladdr() requires the symbol to be
+// accessible as an exported dynamic symbol. If you compile your program
+// with "-Wl,--export-dynamic" then it might work relatively well. For
+// now we do not have it integrated into the code.
+//
+static const char* lookupFunctionName(void* address)
+{
+   Dl_info info;
+   if (dladdr(address,&info))
+      return 0;
+   return info.dli_sname;
+}
+
+/*-------------------------------------------------------------------*
+ * Constructor attribute                                             *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief It will execute automatically when the tool runs.
+          It calls open file function and gets and checks Environment variable
+          PGOMP_MODE's value.
+**/
+
+__attribute__((constructor)) void pgomp_init()
+{
+   char* mode;
+#ifdef RELATIVE_TIME
+   initialTime = getTime();
+#endif
+   progStartTime = getTime();
+   if (getenv("PGOMP_MODE") == NULL)
+   {
+      mode = "aggregate";
+   }
+   else
+   {
+      mode = getenv("PGOMP_MODE"); // Get Environment variable PGOMP_MODE's value.
+   }
+   if (strcmp(mode , "trace") == 0)// Trace mode
+      modeFlag = 1;
+   else if (strcmp(mode , "tail") == 0)// Trace mode, outliers only
+   {
+      modeFlag = 1;
+      tailFlag = 1;
+   }
+   else if (strcmp(mode , "aggregate") == 0)// Aggregate mode
+      modeFlag = 2;
+   if (modeFlag < 1 || modeFlag> MAX_MODE_FLAG)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable "
+                     "PGOMP_MODE not 'trace', 'tail' or 'aggregate'\n");
+      exit(0);
+   }
+#if defined(PGOMP_VARIANT_TRACE) || defined(PGOMP_VARIANT_AGGREGATE)
+   if ((modeFlag == 1) != TRACING || (modeFlag == 2) != AGGREGATING)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: this build of the library is for PGOMP_MODE=%s, "
+                     "preload libpgomp.so instead\n", TRACING ? "trace" : "aggregate");
+      exit(0);
+   }
+#endif
+   if (modeFlag == 2)
+      newTimeline(STATE_WORK, progStartTime); // the initial thread is thread 0
+   //
+   // Aggregate output format
+   //
+   mode = getenv("PGOMP_FORMAT");
+   if (mode == NULL || strcmp(mode, "text") == 0)
+      formatFlag = FORMAT_TEXT;
+   else if (strcmp(mode, "csv") == 0)
+      formatFlag = FORMAT_CSV;
+   else if (strcmp(mode, "json") == 0)
+      formatFlag = FORMAT_JSON;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_FORMAT "
+                     "should be 'text', 'csv', 'json' or unset\n");
+      exit(0);
+   }
+   //
+   // CPU of every event, for migrations and lock handoffs
+   //
+   mode = getenv("PGOMP_CPU");
+   if (mode == NULL || strcmp(mode, "false") == 0)
+      cpuFlag = 0;
+   else if (strcmp(mode, "true") == 0)
+      cpuFlag = 1;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_CPU "
+                     "should be 'true', 'false' or unset\n");
+      exit(0);
+   }
+   if (cpuFlag)
+      readTopology();
+   //
+   // Allocations in parallel regions, timed by the dispatcher
+   //
+   mode = getenv("PGOMP_MALLOC");
+   if (mode == NULL || strcmp(mode, "false") == 0)
+      allocFlag = 0;
+   else if (strcmp(mode, "true") == 0)
+      allocFlag = 1;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_MALLOC "
+                     "should be 'true', 'false' or unset\n");
+      exit(0);
+   }
+   //
+   // Lock convoys and lock order, the wait-for graph sampled by a thread
+   //
+   mode = getenv("PGOMP_CONVOY");
+   if (mode == NULL || strcmp(mode, "false") == 0)
+      convoyFlag = 0;
+   else if (strcmp(mode, "true") == 0)
+      convoyFlag = 1;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_CONVOY "
+                     "should be 'true', 'false' or unset\n");
+      exit(0);
+   }
+   if (modeFlag != 2)
+      convoyFlag = 0; // only aggregate mode keeps the wait-for graph
+   //
+   // Spin and blocked time: two thread CPU clock reads per wait
+   //
+   mode = getenv("PGOMP_SPIN");
+   if (mode == NULL || strcmp(mode, "false") == 0)
+      spinFlag = 0;
+   else if (strcmp(mode, "true") == 0)
+      spinFlag = 1;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_SPIN "
+                     "should be 'true', 'false' or unset\n");
+      exit(0);
+   }
+#ifdef PGOMP_STATIC
+   if (allocFlag)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: PGOMP_MALLOC needs the preloaded "
+                     "libpgomp.so, not libpgomp.a\n");
+      exit(0);
+   }
+#endif
+   //
+   // Trace compression: "true" picks the best codec that was built in
+   //
+   mode = getenv("PGOMP_COMPRESS");
+   if (mode == NULL || strcmp(mode, "false") == 0)
+      compressFlag = CODEC_NONE;
+   else if (strcmp(mode, "lz") == 0)
+      compressFlag = CODEC_LZ;
+#ifdef BUILD_ZSTD
+   else if (strcmp(mode, "zstd") == 0 || strcmp(mode, "true") == 0)
+      compressFlag = CODEC_ZSTD;
+#else
+   else if (strcmp(mode, "true") == 0)
+      compressFlag = CODEC_LZ;
+#endif
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_COMPRESS "
+                     "should be 'true', 'false', 'lz'"
+#ifdef BUILD_ZSTD
+                     " or 'zstd'"
+#else
+                     " ('zstd' needs PGOMP built with BUILD_ZSTD)"
+#endif
+                     "\n");
+      exit(0);
+   }
+   if (modeFlag != 1)
+      compressFlag = CODEC_NONE; // only trace output is compressed
+   //
+   // Trace output path: writer thread (default) or memory-mapped extents
+   //
+   mode = getenv("PGOMP_TRACE_IO");
+   if (mode == NULL || strcmp(mode, "writer") == 0)
+      ioMode = IO_WRITER;
+   else if (strcmp(mode, "mmap") == 0)
+      ioMode = IO_MMAP;
+   else
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_TRACE_IO "
+                     "should be 'writer', 'mmap' or unset\n");
+      exit(0);
+   }
+   if (ioMode == IO_MMAP && compressFlag != CODEC_NONE)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: PGOMP_TRACE_IO=mmap cannot be "
+                     "combined with PGOMP_COMPRESS\n");
+      exit(0);
+   }
+   if (modeFlag != 1)
+      ioMode = IO_WRITER;
+   //
+   // Trace budget: percent of each thread's time trace records may cost
+   //
+   mode = getenv("PGOMP_TRACE_BUDGET");
+   if (mode != NULL)
+   {
+      char *end;
+      traceBudget = strtod(mode, &end) / 100;
+      if (end == mode || *end != '\0' || traceBudget <= 0.0 || traceBudget > 1.0)
+      {
+         fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_TRACE_BUDGET "
+                        "should be a percentage above 0 and at most 100\n");
+         exit(0);
+      }
+   }
+   if (modeFlag != 1 || tailFlag)
+      traceBudget = 0.0; // only full trace mode is governed
+   mode = getenv("PGOMP_TAIL_SIGMA");
+   if (mode != NULL)
+   {
+      char *end;
+      tailSigma = strtod(mode, &end);
+      if (end == mode || *end != '\0' || tailSigma <= 0.0)
+      {
+         fprintf(stderr,"LIBPGOMP ERROR: Environment variable PGOMP_TAIL_SIGMA "
+                        "should be a number above 0\n");
+         exit(0);
+      }
+   }
+   if (traceBudget > 0.0)
+      measureRecordCost();
+   if (ioMode == IO_MMAP)
+      openMmap();
+   else
+      openFile();
+   if (modeFlag == 1 && ioMode == IO_WRITER)
+      startWriter();
+   pthread_atfork(forkPrepare, forkParent, forkChild);
+   if (modeFlag == 2)
+      pthread_atfork(NULL, NULL, aggregateForkChild);
+   if (convoyFlag)
+   {
+      startSampler();
+      pthread_atfork(NULL, NULL, samplerForkChild);
+   }
+#ifdef BUILD_PAPI
+   char* papiMode;
+   if (getenv("PGOMP_PAPI") == NULL)
+   {
+      papiMode = "false";
+      papiFlag = 0;
+   }
+   else
+   {
+      papiMode = getenv("PGOMP_PAPI"); // Get Environment variable PGOMP_PAPI's value.
+      if (strcmp(papiMode , "true") == 0)// Using PAPI
+      {
+         papiFlag = 1;
+         initPapi();
+         ioverhead=instOverhead();
+      }
+      else if (strcmp(papiMode , "false") == 0)// Do not use PAPI
+         papiFlag = 0;
+         else //(papiFlag is not true or false )
+         {
+            fprintf(stderr,"LIBPGOMP ERROR: Environment variable PAPI_MODE "
+                           "set incorrectly it should be 'true',false or unset\n");
+            exit(0);
+         }
+     }
+#else
+   papiFlag = 0;
+#endif
+#if defined(PGOMP_VARIANT_TRACE) || defined(PGOMP_VARIANT_AGGREGATE)
+   if (papiFlag != COUNTING)
+   {
+      fprintf(stderr,"LIBPGOMP ERROR: this build of the library is for PGOMP_PAPI=%s, "
+                     "preload libpgomp.so instead\n", COUNTING ? "true" : "false");
+      exit(0);
+   }
+#endif
+#ifndef PGOMP_STATIC
+   //
+   // Function lookups (do all at initialization, so runtime is faster)
+   //
+#define REAL_LOOKUP(ret, name, params, args) real_##name = lookupFunction(#name);
+   PGOMP_WRAPPED_VOID(REAL_LOOKUP)
+   PGOMP_WRAPPED_VALUE(REAL_LOOKUP)
+#endif
+}
+
+/*-------------------------------------------------------------------*
+  Destructor attribute run at the end of the using of the library    *
+ *-------------------------------------------------------------------*/
+/**
+   @brief It will execute automatically at the end of the using of the library.
+          It Prints the result and close the output file.
+**/
+__attribute__((destructor)) void pgomp_end (void)
+{
+   // no output if pgomp_init() stopped on an error before opening it
+   if (convoyFlag && outFile != NULL)
+      stopSampler();
+   if (AGGREGATING && outFile != NULL)
+      printResult(hTable);
+   if (TRACING && traceBudget > 0.0)
+      closeGovernor();
+
+   if (TRACING && ioMode == IO_MMAP)
+      closeMmap();
+   else if (TRACING)
+      stopWriter();
+   if (outFile != NULL)
+      fclose(outFile);
+}
+
+/*-------------------------------------------------------------------*
+ * omp_init_lock function                                            *
+ *-------------------------------------------------------------------*/
+
+void omp_init_lock(omp_lock_t *pLock)
+{
+   //int thId;
+   //thId = omp_get_thread_num(); // maybe will use someday
+   real_omp_init_lock(pLock);
+}
+
+/*-------------------------------------------------------------------*
+ * omp_destroy_lock function                                         *
+ *-------------------------------------------------------------------*/
+
+void omp_destroy_lock(omp_lock_t *pLock)
+{
+   //int thId;
+   //thId = omp_get_thread_num();  // maybe will use someday
+   real_omp_destroy_lock(pLock);
+}
+
+/*-------------------------------------------------------------------*
+ * Lock-like constructs                                              *
+ *-------------------------------------------------------------------*/
+
+#define WRAP_HANDOFF 1 /**< Note the handoffs (PGOMP_CPU) and holder (PGOMP_CONVOY) */
+#define WRAP_NAMED 2 /**< Count the construct per critical section name */
+
+/**
+   A lock-like construct the thread is in, from its start function to its
+   end function. A thread that sets a lock while it holds another keeps
+   the call site and times of both.
+**/
+typedef struct
+{
+/*@{*/
+   const void *key; /**< The lock, or the construct's record if it has none */
+   PerThreadInfo start; /**< Start site, times and instruction count */
+/*@}*/
+} HeldConstruct;
+
+static __thread HeldConstruct heldConstructs[HELD_CONSTRUCTS]; // innermost last
+static __thread int numHeldConstructs = 0; /**< May exceed HELD_CONSTRUCTS */
+
+/**
+   @brief Keeps the start of the construct the thread got (aggregate mode)
+          until releaseConstruct().
+   @param key - The lock, or the construct's record if it has none.
+   @param info - The construct's record, with the start site and times.
+**/
+static void holdConstruct(const void *key, const PerThreadInfo *info)
+{
+   if (!AGGREGATING)
+      return;
+   if (numHeldConstructs < HELD_CONSTRUCTS)
+   {
+      heldConstructs[numHeldConstructs].key = key;
+      heldConstructs[numHeldConstructs].start = *info;
+   }
+   numHeldConstructs++;
+}
+
+/**
+   @brief Finds the start of the construct the thread leaves: the innermost
+          one it holds with the key.
+   @param key - As given to holdConstruct().
+   @param info - The construct's record, the last start of its kind.
+   @param start - Where to copy the start to.
+   @return start, or info if the start was not kept (nested deeper than
+           HELD_CONSTRUCTS, or started on another thread).
+**/
+static const PerThreadInfo* releaseConstruct(const void *key,
+                                             const PerThreadInfo *info,
+                                             PerThreadInfo *start)
+{
+   int i;
+   for (i = (numHeldConstructs < HELD_CONSTRUCTS ? numHeldConstructs
+                                                 : HELD_CONSTRUCTS) - 1; i >= 0; i--)
+      if (heldConstructs[i].key == key)
+      {
+         *start = heldConstructs[i].start;
+         for (; i + 1 < numHeldConstructs && i + 1 < HELD_CONSTRUCTS; i++)
+            heldConstructs[i] = heldConstructs[i+1];
+         numHeldConstructs--;
+         return start;
+      }
+   if (numHeldConstructs > HELD_CONSTRUCTS)
+      numHeldConstructs--; // beyond the kept ones
+   return info;
+}
+
+/**
+   Locks, nestable locks, critical sections, named critical sections, the
+   atomics libgomp serializes with its lock, and ordered regions wait in a
+   start function and are left in an end function. Their wrappers are
+   generated from one line per construct:
+
+      X(info, start, end, params, args, waitState, key, flags)
+
+   - info: the construct's per-thread record.
+   - start, end: the wrapped functions; params and args: their parameter
+     and argument lists.
+   - waitState: the thread's state while it waits in start.
+   - key: the lock, for handoffs, convoys and critical section names.
+   - flags: WRAP_HANDOFF and WRAP_NAMED.
+
+   The start wrapper gets the call site and the times the thread reached
+   start and got the construct, and in aggregate mode keeps them with the
+   key (holdConstruct()). The end wrapper finds them by the key, so a lock
+   set while another is held does not take the other's site and times.
+   It calculates the wait (the time to get the construct) and the
+   execution time (from getting the construct to reaching end). Nestable locks do not note handoffs or
+   holders: an unset does not always release the lock. Ordered regions
+   are not locks.
+**/
+#define LOCK_CONSTRUCTS(X) \
+   X(lock, omp_set_lock, omp_unset_lock, (omp_lock_t *pLock), (pLock), \
+     STATE_LOCK, pLock, WRAP_HANDOFF) \
+   X(nestedLock, omp_set_nest_lock, omp_unset_nest_lock, (omp_nest_lock_t *pLock), \
+     (pLock), STATE_LOCK, pLock, 0) \
+   X(critical, GOMP_critical_start, GOMP_critical_end, (void), (), \
+     STATE_CRITICAL, &criticalKey, WRAP_HANDOFF | WRAP_NAMED) \
+   X(namedCritical, GOMP_critical_name_start, GOMP_critical_name_end, (void **name), \
+     (name), STATE_CRITICAL, name, WRAP_HANDOFF | WRAP_NAMED) \
+   X(atomic, GOMP_atomic_start, GOMP_atomic_end, (void), (), \
+     STATE_CRITICAL, &atomicKey, WRAP_HANDOFF | WRAP_NAMED) \
+   X(ordered, GOMP_ordered_start, GOMP_ordered_end, (void), (), \
+     STATE_CRITICAL, NULL, 0)
+
+/** The key a construct is held under: the construct's record stands for
+    the lock of ordered regions */
+#define HELD_KEY(key, info) \
+   ((key) != NULL ? (const void *) (key) : (const void *) &(info))
+
+#define START_WRAPPER(info, start, end, params, args, waitState, key, flags) \
+void start params \
+{ \
+   int thId, state; \
+   thId = omp_get_thread_num(); \
+   info.beginAddr = getReturnAddress(0); \
+   info.startName = __func__; \
+   info.startTime_1 = getTime(); \
+   state = enterState(waitState, info.startTime_1); \
+   if ((flags) & WRAP_HANDOFF) \
+      convoyWait(key, (flags) & WRAP_NAMED, info.beginAddr); \
+   info.startCpu_1 = getThreadCpuTime(); \
+   counterStart(); \
+   real_##start args; \
+   if (COUNTING) \
+      instCount = counterStop(); \
+   info.startExCpu = getThreadCpuTime(); \
+   info.startExTime = getTime(); \
+   info.iCount = instCount; \
+   enterState(state, info.startExTime); \
+   if ((flags) & WRAP_HANDOFF) \
+   { \
+      noteHandoff(key, info.startTime_1, info.startExTime); \
+      convoyAcquired(key, (flags) & WRAP_NAMED, info.beginAddr, \
+                     info.startExTime - info.startTime_1, false); \
+   } \
+   if (TRACING) \
+      traceRecord(info.startName, info.beginAddr, thId, info.startTime_1, \
+                  info.startExTime, instCount); \
+   else \
+      holdConstruct(HELD_KEY(key, info), &info); \
+}
+
+#ifdef GOMP_DEBUG
+#define DEBUG_END(info) \
+   if (gompDebug) fprintf(stderr,"GOMP Debug: %s called from %s\n", __func__, \
+                          lookupFunctionName(info.endAddr));
+#else
+#define DEBUG_END(info)
+#endif
+
+#define END_WRAPPER(info, start, end, params, args, waitState, key, flags) \
+void end params \
+{ \
+   int thId, state; \
+   long long count; \
+   PerThreadInfo held; \
+   const PerThreadInfo *begin = &info; \
+   thId = omp_get_thread_num(); \
+   info.startTime_2 = getTime(); \
+   state = enterState(STATE_RUNTIME, info.startTime_2); \
+   if ((flags) & WRAP_HANDOFF) \
+   { \
+      noteRelease(key, info.startTime_2); \
+      convoyRelease(key, (flags) & WRAP_NAMED); \
+   } \
+   if (AGGREGATING) \
+      begin = releaseConstruct(HELD_KEY(key, info), &info, &held); \
+   if ((flags) & WRAP_NAMED) \
+      countCriticalName(key, begin->startExTime - begin->startTime_1, \
+                        info.startTime_2 - begin->startExTime); \
+   counterStart(); \
+   real_##end args; \
+   count = counterStop(); \
+   info.endAddr = getReturnAddress(0); \
+   DEBUG_END(info) \
+   if (TRACING) \
+   { \
+      info.endTime = getTime(); \
+      info.endName = __func__; \
+      traceRecord(info.endName, info.endAddr, thId, info.startTime_2, \
+                  info.endTime, count); \
+   } \
+   else if (AGGREGATING) \
+   { \
+      enterState(state, getTime()); \
+      editBucket(hash(begin->beginAddr,thId), thId, begin->startName, \
+                 begin->beginAddr, info.endAddr, \
+                 begin->startExTime - begin->startTime_1, \
+                 info.startTime_2 - begin->startExTime, \
+                 spinTime(begin->startExTime - begin->startTime_1, \
+                          begin->startExCpu - begin->startCpu_1), \
+                 begin->iCount + count); \
+   } \
+}
+
+/**
+   omp_test_lock() and omp_test_nest_lock(): like the start wrapper, but
+   the attempt does not wait. In aggregate mode the execution time of a
+   lock that was set counts from the attempt's return. flags as in
+   LOCK_CONSTRUCTS: a lock that was set is held.
+**/
+#define TEST_WRAPPER(info, test, lockType, flags) \
+int test(lockType *pLock) \
+{ \
+   int thId, result, state; \
+   thId = omp_get_thread_num(); \
+   info.beginAddr = getReturnAddress(0); \
+   info.startName = __func__; \
+   info.startTime_1 = getTime(); \
+   state = enterState(STATE_LOCK, info.startTime_1); \
+   info.startCpu_1 = getThreadCpuTime(); \
+   counterStart(); \
+   result = real_##test(pLock); \
+   if (COUNTING) \
+      instCount = counterStop(); \
+   info.startExCpu = getThreadCpuTime(); \
+   info.startExTime = getTime(); \
+   info.iCount = instCount; \
+   enterState(state, info.startExTime); \
+   if (((flags) & WRAP_HANDOFF) && result) \
+      convoyAcquired(pLock, 0, info.beginAddr, 0.0, true); \
+   if (TRACING) \
+      traceRecord(info.startName, info.beginAddr, thId, info.startTime_1, \
+                  info.startExTime, instCount); \
+   else if (AGGREGATING) \
+   { \
+      info.startTime_1 = info.startExTime; \
+      info.startCpu_1 = info.startExCpu; \
+      if (result) \
+         holdConstruct(pLock, &info); \
+   } \
+   return result; \
+}
+
+LOCK_CONSTRUCTS(START_WRAPPER)
+LOCK_CONSTRUCTS(END_WRAPPER)
+TEST_WRAPPER(lock, omp_test_lock, omp_lock_t, WRAP_HANDOFF)
+TEST_WRAPPER(nestedLock, omp_test_nest_lock, omp_nest_lock_t, 0)
+
+/*-------------------------------------------------------------------*
+ * Loops with dynamic, guided and runtime schedules                  *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief The loop state of the thread, see regionBody().
+**/
+static LoopState* currentLoop(void)
+{
+   return myLoop != NULL ? myLoop : &threadLoop;
+}
+
+/**
+   @brief Adds a thread's share of a loop to its site (aggregate mode).
+   @param ls - The thread's loop state, ls->addr set.
+   @param now - Time the thread reached the end of the loop.
+**/
+static void loopFinish(LoopState *ls, double now)
+{
+   unsigned int index = (((uintptr_t) ls->addr * 0x9e3779b97f4a7c15ULL) >> 32)
+                        & (LOOP_SITES - 1);
+   unsigned int count;
+   int b;
+   bool master = omp_get_thread_num() == 0;
+   pthread_mutex_lock(&loopLock);
+   for (count = 0; count < LOOP_SITES; count++)
+   {
+      LoopStats *st = &loopStats[index];
+      if (st->addr == NULL)
+      {
+         st->addr = ls->addr;
+         st->schedule = ls->schedule;
+         st->chunkSize = ls->chunkSize;
+      }
+      if (st->addr == ls->addr)
+      {
+         // every member runs the start function, the master counts the loop
+         if (master)
+         {
+            st->count++;
+            st->iterations += ls->iterations;
+         }
+         st->threads++;
+         st->chunks += ls->chunks;
+         st->calls += ls->calls;
+         st->dispatch += ls->dispatch;
+         st->busy += ls->busy;
+         st->span += now - ls->loopStart;
+         for (b = 0; b < LOOP_BINS; b++)
+            st->profile[b] += ls->profile[b];
+         break;
+      }
+      index = (index + 1) & (LOOP_SITES - 1);
+   }
+   if (count == LOOP_SITES)
+      droppedEvents++;
+   pthread_mutex_unlock(&loopLock);
+   ls->addr = NULL;
+}
+
+/**
+   @brief Starts a thread's share of a loop (aggregate mode).
+   @param schedule - "dynamic", "guided", or "runtime" for the schedule
+          omp_get_schedule() returns.
+   @param chunk - Chunk size, ignored for "runtime".
+   @param now - Time the start function was called.
+**/
+static void loopBegin(LoopState *ls, void *addr, const char *schedule, long start,
+                      long end, long incr, long chunk, double now)
+{
+   omp_sched_t kind;
+   int size;
+   long n;
+   if (!AGGREGATING)
+      return;
+   if (ls->addr != NULL)
+      loopFinish(ls, now); // the last loop ended without GOMP_loop_end*()
+   if (strcmp(schedule, "runtime") == 0)
+   {
+      omp_get_schedule(&kind, &size);
+      switch (kind & ~omp_sched_monotonic)
+      {
+         case omp_sched_static: schedule = "static"; break;
+         case omp_sched_guided: schedule = "guided"; break;
+         default: schedule = "dynamic"; break; // and auto, which libgomp runs as dynamic
+      }
+      chunk = size > 0 ? size : (kind & ~omp_sched_monotonic) == omp_sched_static ? 0 : 1;
+   }
+   n = incr > 0 ? (end - start + incr - 1) / incr : (end - start + incr + 1) / incr;
+   ls->addr = addr;
+   ls->schedule = schedule;
+   ls->chunkSize = chunk;
+   ls->start = start;
+   ls->incr = incr;
+   ls->iterations = n > 0 ? n : 0;
+   ls->loopStart = now;
+   ls->name = NULL;
+   ls->chunks = ls->calls = 0;
+   ls->dispatch = ls->busy = 0.0;
+   memset(ls->profile, 0, sizeof(ls->profile));
+}
+
+/**
+   @brief Ends the chunk the thread ran, if any: the time since it was
+          handed out is spread over the bins of its iterations.
+   @param endAddr - Call site of the function called after the chunk.
+**/
+static void loopChunkEnd(LoopState *ls, void *endAddr, double now)
+{
+   double from, to, time = now - ls->handedOut;
+   int thId, b;
+   if (ls->name == NULL)
+      return;
+   thId = omp_get_thread_num();
+   editBucket(hash(ls->dispatchAddr,thId), thId, ls->name, ls->dispatchAddr,
+              endAddr, ls->handedOut - ls->dispatchStart, time, 0.0, ls->iCount);
+   ls->name = NULL;
+   ls->chunks++;
+   ls->busy += time;
+   if (ls->iterations <= 0)
+      return;
+   from = (ls->first - ls->start) / (double) ls->incr / ls->iterations * LOOP_BINS;
+   to = (ls->last - ls->start) / (double) ls->incr / ls->iterations * LOOP_BINS;
+   if (to <= from || from < 0)
+      return;
+   for (b = (int) from; b < LOOP_BINS && b < to; b++)
+      ls->profile[b] += time / (to - from) * ((to < b + 1 ? to : b + 1)
+                                              - (from > b ? from : b));
+}
+
+/**
+   @brief Records a call of a loop's start or next function: the chunk it
+          handed out is timed until the thread's next call, like a
+          section.
+   @param result - What the function returned, false if no chunk is left.
+   @param t1, t2 - Times the function was called and returned.
+**/
+static void loopDispatch(LoopState *ls, const char *name, void *addr, _Bool result,
+                         const long *istart, const long *iend, double t1,
+                         double t2, long long iCount)
+{
+   int thId;
+   if (TRACING)
+   {
+      traceRecord(name, addr, omp_get_thread_num(), t1, t2, iCount);
+      return;
+   }
+   if (!AGGREGATING || ls->addr == NULL)
+      return;
+   ls->calls++;
+   ls->dispatch += t2 - t1;
+   if (result)
+   {
+      ls->name = name;
+      ls->dispatchAddr = addr;
+      ls->dispatchStart = t1;
+      ls->handedOut = t2;
+      ls->iCount = iCount;
+      ls->first = *istart;
+      ls->last = *iend;
+      return;
+   }
+   thId = omp_get_thread_num();
+   editBucket(hash(addr,thId), thId, name, addr, addr, t2 - t1, 0.0, 0.0, iCount);
+}
+
+/*-------------------------------------------------------------------*
+ * parallel region body trampoline                                   *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Prepares the frame of a region about to be started.
+   @param frame - Frame to fill in.
+   @param fn - Outlined region body.
+   @param data - Its argument.
+   @param addr - Call site of the region.
+   @param num_threads - Threads requested, 0 for the default.
+**/
+static void regionInit(RegionFrame *frame, void (*fn) (void *), void *data,
+                       void *addr, unsigned num_threads)
+{
+   unsigned maxMembers = num_threads ? num_threads : (unsigned) omp_get_max_threads();
+   frame->fn = fn;
+   frame->data = data;
+   frame->addr = addr;
+   frame->team = 0;
+   frame->schedule = NULL;
+   frame->members = frame->inlineMembers;
+   frame->maxMembers = REGION_MEMBERS;
+   if (maxMembers > REGION_MEMBERS)
+   {
+      frame->members = malloc(maxMembers * sizeof(RegionMember));
+      frame->maxMembers = frame->members ? maxMembers : 0;
+   }
+}
+
+/**
+   @brief Runs the outlined region body on a team member, timestamping its
+          entry and exit.
+   @param arg - The region's frame.
+**/
+static void regionBody(void *arg)
+{
+   RegionFrame *frame = arg;
+   RegionMember *m;
+   Timeline *tl = NULL;
+   AllocCount alloc, *outerAlloc = allocCount;
+   LoopState bodyLoop, *outerLoop = myLoop;
+   unsigned thId = omp_get_thread_num();
+   double startTime = getTime(), endTime, before[NUM_STATES];
+   int state = STATE_WORK, s;
+   if (thId == 0)
+      frame->team = omp_get_num_threads();
+   if (AGGREGATING)
+   {
+      // a thread first seen here was idle in the pool until the region started
+      tl = myTimeline ? myTimeline : newTimeline(STATE_IDLE, frame->forkTime);
+      state = enterState(STATE_WORK, startTime);
+      memcpy(before, tl->time, sizeof(before));
+   }
+   memset(&alloc, 0, sizeof(alloc));
+   if (tl != NULL && allocFlag)
+      allocCount = &alloc;
+   // loops in the body do not disturb a loop the thread is in outside it
+   bodyLoop.addr = NULL;
+   bodyLoop.name = NULL;
+   myLoop = &bodyLoop;
+   if (frame->schedule != NULL)
+      loopBegin(&bodyLoop, frame->addr, frame->schedule, frame->start, frame->end,
+                frame->incr, frame->chunk, startTime);
+   frame->fn(frame->data);
+   endTime = getTime();
+   if (bodyLoop.addr != NULL)
+   {
+      loopChunkEnd(&bodyLoop, frame->addr, endTime);
+      loopFinish(&bodyLoop, endTime);
+   }
+   myLoop = outerLoop;
+   allocCount = outerAlloc;
+   if (tl != NULL)
+   {
+      enterState(state, endTime);
+      addAlloc(&tl->alloc, &alloc);
+   }
+   if (thId < frame->maxMembers)
+   {
+      m = &frame->members[thId];
+      m->startTime = startTime;
+      m->endTime = endTime;
+      m->timeline = tl;
+      m->fromState = state;
+      m->alloc = alloc;
+      if (tl != NULL)
+         for (s = 0; s < NUM_STATES; s++)
+            m->body[s] = tl->time[s] - before[s];
+   }
+}
+
+/**
+   @brief Records every team member of a region that has just been joined:
+          its wake-up latency (region start to entering the body) with its
+          work (time in the body) as GOMP_parallel_wake, and its join wait
+          (leaving the body to the end of the region) as
+          GOMP_parallel_join, and adds the region to the utilization of its
+          site. Called by the thread that started the region.
+   @param frame - The region's frame, frame->team set.
+   @param joinTime - Time the region ended.
+**/
+static void regionJoin(RegionFrame *frame, double joinTime)
+{
+   unsigned thId, team = frame->team;
+   const RegionMember *m;
+   double wake, join, time[NUM_STATES] = { 0.0 };
+   AllocCount alloc;
+   int s;
+   memset(&alloc, 0, sizeof(alloc));
+   if (team > frame->maxMembers)
+      team = frame->maxMembers;
+   for (thId = 0; thId < team; thId++)
+   {
+      m = &frame->members[thId];
+      wake = m->startTime - frame->forkTime;
+      join = joinTime - m->endTime;
+      if (TRACING)
+      {
+         // the work is the time between the two records
+         traceOut("  %s %p %d %lf %lf  \n", "GOMP_parallel_wake", frame->addr,
+                  thId, frame->forkTime, m->startTime);
+         traceOut("  %s %p %d %lf %lf  \n", "GOMP_parallel_join", frame->addr,
+                  thId, m->endTime, joinTime);
+      }
+      else if (AGGREGATING)
+      {
+         editBucket(hash(frame->addr, thId), thId, "GOMP_parallel_wake",
+                    frame->addr, frame->addr, wake, m->endTime - m->startTime,
+                    0.0, 0);
+         editBucket(hash(frame->addr, thId), thId, "GOMP_parallel_join",
+                    frame->addr, frame->addr, join, 0.0, 0.0, 0);
+         time[STATE_RUNTIME] += wake;
+         time[STATE_BARRIER] += join;
+         if (m->timeline == NULL)
+            time[STATE_WORK] += m->endTime - m->startTime;
+         else
+         {
+            // the member spent the wake and join time in the state it was
+            // in outside the body (idle in the pool); it was starting up
+            // and waiting for the team
+            m->timeline->moved[m->fromState] -= wake + join;
+            m->timeline->moved[STATE_RUNTIME] += wake;
+            m->timeline->moved[STATE_BARRIER] += join;
+            for (s = 0; s < NUM_STATES; s++)
+               time[s] += m->body[s];
+         }
+         addAlloc(&alloc, &m->alloc);
+      }
+   }
+   if (AGGREGATING)
+      countRegionSite(frame->addr, team, joinTime - frame->forkTime, time, &alloc);
+   if (frame->members != frame->inlineMembers)
+      free(frame->members);
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_parallel_start function                                      *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Gets the time values that related to parallel section. The
+          other team members run the body through regionBody(), see
+          regionJoin().
+   @return void
 **/
 
-void omp_unset_lock(omp_lock_t *pLock)
+void GOMP_parallel_start (void (*fn) (void *),
+                           void *data, unsigned num_threads)
 {
-   int thId, index;
+   int thId, state, s;
+   RegionFrame *frame;
    thId = omp_get_thread_num();
-   lock[thId].startTime_2 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+#ifdef GOMP_DEBUG
+   if (gompDebug) fprintf(stderr,"GOMP Debug: GOMP_parallel_start, thid=%d\n",thId);
+#endif
+   parallel.beginAddr = getReturnAddress(0);
+#ifdef GOMP_DEBUG
+   if (gompDebug) fprintf(stderr,"GOMP Debug: GOMP_parallel_start called from %s\n",
+                          lookupFunctionName(parallel.beginAddr));
+#endif
+   parallel.startName = __func__;
+#ifdef GOMP_DEBUG
+   if (gompDebug) fprintf(stderr,"GOMP Debug: starting GOMP_parallel_start, thid=%d\n",thId);
+#endif
+   parallel.startTime_1 = getTime();
+   state = enterState(STATE_RUNTIME, parallel.startTime_1);
+   if (omp_get_level() == 0)
+      outerStartTime = parallel.startTime_1;
+   frame = malloc(sizeof(RegionFrame));
+   if (frame != NULL)
    {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
+      // the master runs its share by calling fn itself, only the other
+      // team members go through regionBody()
+      regionInit(frame, fn, data, parallel.beginAddr, num_threads);
+      frame->forkTime = parallel.startTime_1;
+      frame->outer = openRegion;
+      openRegion = frame;
+      fn = regionBody;
+      data = frame;
+   }
+   counterStart();
+   real_GOMP_parallel_start(fn, data,  num_threads);
+   if (COUNTING)
+      instCount = counterStop();
+   parallel.startExTime = getTime();
+   enterState(state, parallel.startExTime);
+   if (frame != NULL && frame->maxMembers > 0)
+   {
+      // the master's body runs until GOMP_parallel_end()
+      frame->members[0].timeline = myTimeline;
+      memset(&frame->members[0].alloc, 0, sizeof(AllocCount));
+      frame->outerAlloc = allocCount;
+      if (myTimeline != NULL && allocFlag)
+         allocCount = &frame->members[0].alloc;
+      if (myTimeline != NULL)
+         for (s = 0; s < NUM_STATES; s++)
+            frame->members[0].body[s] = -myTimeline->time[s];
    }
+#ifdef GOMP_DEBUG
+   if (gompDebug) fprintf(stderr,"GOMP Debug: finished GOMP_parallel_start, thid=%d\n",thId);
 #endif
-   real_omp_unset_lock(pLock);
-   if(papiFlag)
+   if (TRACING)
+      traceRecord(parallel.startName, parallel.beginAddr, thId,
+                  parallel.startTime_1, parallel.startExTime, instCount);
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_parallel_end function                                        *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Calculates the time that spend in parallel section. Also, gets
+          call location.
+   @return void
+**/
+
+void GOMP_parallel_end (void)
+{
+   int thId, index, state, s, team = 0;
+   double joinTime;
+   long long count;
+   RegionFrame *frame = openRegion;
+   thId = omp_get_thread_num();
+   if (omp_get_level() == 1)
+      team = omp_get_num_threads(); // ending an outermost region
+   parallel.startTime_2 = getTime();
+   state = enterState(STATE_RUNTIME, parallel.startTime_2);
+   if (frame != NULL)
    {
-      STOP_COUNTER;
-      instCount[thId]+=values[0]-ioverhead;
-     // noCycle[thId]+=values[1];
-   }
-   if (modeFlag == 1)
-   {
-      lock[thId].endAddr = getReturnAddress(0);
-      lock[thId].endTime = getTime();
-      lock[thId].endName = __func__;
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld  \n", lock[thId].endName,
-               lock[thId].endAddr, thId, lock[thId].startTime_2,
-               lock[thId].endTime,values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf \n", lock[thId].endName,
-               lock[thId].endAddr, thId, lock[thId].startTime_2,
-               lock[thId].endTime);
-   }
-   else if (modeFlag == 2)
-   {
-      index = hash(lock[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, lock[thId].startName,
-                     lock[thId].beginAddr,lock[thId].endAddr,
-                     lock[thId].startExTime - lock[thId].startTime_1 ,
-                     lock[thId].startTime_2 - lock[thId].startExTime,
-                     instCount[thId]);
-      else
-         editBucket(index, thId, lock[thId].startName,
-                     lock[thId].beginAddr,lock[thId].endAddr,
-                     lock[thId].startExTime - lock[thId].startTime_1 ,
-                     lock[thId].startTime_2 - lock[thId].startExTime,0);
+      openRegion = frame->outer;
+      frame->team = omp_get_num_threads();
+      if (frame->maxMembers > 0)
+      {
+         RegionMember *m = &frame->members[0];
+         m->startTime = parallel.startExTime;
+         m->endTime = parallel.startTime_2;
+         m->fromState = STATE_RUNTIME;
+         allocCount = frame->outerAlloc;
+         if (m->timeline != NULL)
+         {
+            for (s = 0; s < NUM_STATES; s++)
+               m->body[s] += m->timeline->time[s];
+            addAlloc(&m->timeline->alloc, &m->alloc);
+         }
+      }
+   }
+   counterStart();
+   real_GOMP_parallel_end();
+   count = counterStop();
+   joinTime = getTime();
+   enterState(state, joinTime);
+   if (team > 0)
+      countRegion(joinTime - outerStartTime, team);
+   if (frame != NULL)
+   {
+      regionJoin(frame, joinTime);
+      free(frame);
+   }
+   parallel.endAddr = getReturnAddress(0);
+   if (TRACING)
+   {
+      parallel.endTime = getTime();
+      parallel.endName = __func__;
+      traceRecord(parallel.endName, parallel.endAddr, thId,
+                  parallel.startTime_2, parallel.endTime, count);
+   }
+   else if (AGGREGATING)
+   {
+      index = hash(parallel.beginAddr,thId);
+      editBucket(index, thId, parallel.startName,
+                 parallel.beginAddr,parallel.endAddr,0.0,
+                 parallel.startTime_2 - parallel.startExTime,
+                 0.0, instCount + count);
+   }
+}
+
+
+
+/*-------------------------------------------------------------------*
+ * GOMP_parallel function                                            *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Times a whole parallel region started with a single call, see
+          GOMP_parallel().
+   @param name - The function called, for its record.
+   @param addr - Its call site.
+   @param frame - The region's frame, from regionInit().
+   @param run - Calls the real function with regionBody() and the frame.
+   @return void
+**/
+static void parallelRegion(const char *name, void *addr, RegionFrame *frame,
+                           unsigned num_threads, unsigned flags,
+                           void (*run)(RegionFrame *, unsigned, unsigned))
+{
+   int thId, index, outermost, state;
+   double startTime, endTime;
+   long long iCount = 0;
+   thId = omp_get_thread_num();
+   outermost = omp_get_level() == 0;
+   startTime = getTime();
+   state = enterState(STATE_RUNTIME, startTime);
+   frame->forkTime = startTime;
+   counterStart();
+   run(frame, num_threads, flags);
+   if (COUNTING)
+      iCount = counterStop();
+   endTime = getTime();
+   if (outermost)
+      countRegion(endTime - startTime, frame->team);
+   enterState(state, endTime);
+   regionJoin(frame, endTime);
+   if (TRACING)
+      traceRecord(name, addr, thId, startTime, endTime, iCount);
+   else if (AGGREGATING)
+   {
+      index = hash(addr,thId);
+      editBucket(index, thId, name, addr, addr, 0.0, endTime - startTime,
+                 0.0, iCount);
+   }
+}
+
+static void runParallel(RegionFrame *frame, unsigned num_threads, unsigned flags)
+{
+   real_GOMP_parallel(regionBody, frame, num_threads, flags);
+}
+
+/**
+   @brief Times a whole parallel region: GCC 4.9 and later start, run and
+          join a region with this single call instead of
+          GOMP_parallel_start()/GOMP_parallel_end(). The master runs its
+          share of the region inside the call, so nested regions of the
+          same thread are timed with locals, not the per-thread record.
+          The team runs the body through regionBody(), see regionJoin().
+   @return void
+**/
+
+void GOMP_parallel (void (*fn) (void *), void *data, unsigned num_threads,
+                    unsigned int flags)
+{
+   void *addr = getReturnAddress(0);
+   RegionFrame frame;
+   regionInit(&frame, fn, data, addr, num_threads);
+   parallelRegion(__func__, addr, &frame, num_threads, flags, runParallel);
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_parallel_loop_* functions                                    *
+ *-------------------------------------------------------------------*/
+
+/**
+   Combined parallel loops, from the lists in pgomp-wrap.h: timed like
+   GOMP_parallel(), and every team member starts its share of the loop in
+   regionBody(), since it only calls the next function.
+**/
+#define PARALLEL_LOOP_WRAPPER(X, name, sched) \
+static void run_##name(RegionFrame *frame, unsigned num_threads, unsigned flags) \
+{ \
+   real_##name(regionBody, frame, num_threads, frame->start, frame->end, \
+               frame->incr, frame->chunk, flags); \
+} \
+void name(void (*fn) (void *), void *data, unsigned num_threads, long start, \
+          long end, long incr, long chunk, unsigned flags) \
+{ \
+   void *addr = getReturnAddress(0); \
+   RegionFrame frame; \
+   regionInit(&frame, fn, data, addr, num_threads); \
+   frame.schedule = sched; \
+   frame.start = start; \
+   frame.end = end; \
+   frame.incr = incr; \
+   frame.chunk = chunk; \
+   parallelRegion(__func__, addr, &frame, num_threads, flags, run_##name); \
+}
+
+#define PARALLEL_LOOP_RUNTIME_WRAPPER(X, name, sched) \
+static void run_##name(RegionFrame *frame, unsigned num_threads, unsigned flags) \
+{ \
+   real_##name(regionBody, frame, num_threads, frame->start, frame->end, \
+               frame->incr, flags); \
+} \
+void name(void (*fn) (void *), void *data, unsigned num_threads, long start, \
+          long end, long incr, unsigned flags) \
+{ \
+   void *addr = getReturnAddress(0); \
+   RegionFrame frame; \
+   regionInit(&frame, fn, data, addr, num_threads); \
+   frame.schedule = sched; \
+   frame.start = start; \
+   frame.end = end; \
+   frame.incr = incr; \
+   frame.chunk = 0; \
+   parallelRegion(__func__, addr, &frame, num_threads, flags, run_##name); \
+}
+
+PGOMP_PARALLEL_LOOPS(, PARALLEL_LOOP_WRAPPER)
+PGOMP_PARALLEL_LOOP_RUNTIMES(, PARALLEL_LOOP_RUNTIME_WRAPPER)
+
+/*-------------------------------------------------------------------*
+ * GOMP_single_start                                                 *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief gets the time related to single section for each thread.
+**/
+
+bool GOMP_single_start(void)
+{
+   int thId, state; //,index;
+   bool result;
+   thId = omp_get_thread_num();
+   single.startTime_1 = getTime();
+   state = enterState(STATE_RUNTIME, single.startTime_1);
+   counterStart();
+   result = real_GOMP_single_start();
+   if (COUNTING)
+      instCount = counterStop();
+   single.endTime = getTime();
+   enterState(state, single.endTime);
+   single.beginAddr = single.endAddr = getReturnAddress(0);
+   single.startName = __func__;
+   if (TRACING)
+      traceRecord(single.startName, single.beginAddr, thId,
+                  single.startTime_1, single.endTime, instCount);
+   return result;
+}
+
+
+/*-------------------------------------------------------------------*
+ * sections dispatch                                                 *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Records the dispatch call that handed the thread the section it
+          has been running, now that the thread is back in the runtime.
+          The wait is the time the dispatch call took and the execution
+          time the time spent in the section.
+   @param endAddr - Return address of the call that ends the section.
+   @param now - Time that call was reached.
+**/
+static void closeSection(void *endAddr, double now)
+{
+   int thId, index;
+   if (sections.startName == NULL)
+      return;
+   if (AGGREGATING)
+   {
+      thId = omp_get_thread_num();
+      index = hash(sections.beginAddr,thId);
+      editBucket(index, thId, sections.startName,
+                 sections.beginAddr, endAddr,
+                 sections.startExTime - sections.startTime_1,
+                 now - sections.startExTime,
+                 spinTime(sections.startExTime - sections.startTime_1,
+                          sections.startExCpu - sections.startCpu_1),
+                 sections.iCount);
+   }
+   sections.startName = NULL;
+}
+
+/**
+   @brief Records a GOMP_sections_start() or GOMP_sections_next() call.
+          A call that handed out a section stays open until the thread
+          comes back for the next one; a call that returned 0 has no
+          section to run and is recorded at once.
+   @param name - Name of the dispatch function.
+   @param addr - Its return address.
+   @param section - Section it returned, 0 if none was left.
+   @param iCount - Instructions counted in the call.
+**/
+static void dispatchSection(const char *name, void *addr, unsigned section,
+                            long long iCount)
+{
+   int thId, index;
+   thId = omp_get_thread_num();
+   if (TRACING)
+      traceRecord(name, addr, thId, sections.startTime_1,
+                  sections.startExTime, iCount);
+   else if (AGGREGATING)
+   {
+      if (section != 0)
+      {
+         sections.startName = name;
+         sections.beginAddr = addr;
+         sections.iCount = iCount;
+         return;
+      }
+      index = hash(addr,thId);
+      editBucket(index, thId, name, addr, addr,
+                 sections.startExTime - sections.startTime_1, 0.0,
+                 spinTime(sections.startExTime - sections.startTime_1,
+                          sections.startExCpu - sections.startCpu_1),
+                 iCount);
+   }
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_sections_start function                                      *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Gets the time the thread waited for its first section and the
+          time it spent running it.
+   @param count - Number of sections in the construct.
+   @return The section to run, 0 if there is none.
+**/
+
+unsigned GOMP_sections_start(unsigned count)
+{
+   int state;
+   unsigned result;
+   void *addr = getReturnAddress(0);
+   sections.startTime_1 = getTime();
+   state = enterState(STATE_RUNTIME, sections.startTime_1);
+   sections.startCpu_1 = getThreadCpuTime();
+   counterStart();
+   result = real_GOMP_sections_start(count);
+   instCount = counterStop();
+   sections.startExCpu = getThreadCpuTime();
+   sections.startExTime = getTime();
+   enterState(state, sections.startExTime);
+   dispatchSection(__func__, addr, result, instCount);
+   return result;
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_sections_next function                                       *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Ends the section the thread ran and gets the time it waited for
+          the next one.
+   @return The section to run, 0 if there is none left.
+**/
+
+unsigned GOMP_sections_next(void)
+{
+   int state;
+   unsigned result;
+   void *addr = getReturnAddress(0);
+   double now = getTime();
+   state = enterState(STATE_RUNTIME, now);
+   closeSection(addr, now);
+   sections.startTime_1 = now;
+   sections.startCpu_1 = getThreadCpuTime();
+   counterStart();
+   result = real_GOMP_sections_next();
+   instCount = counterStop();
+   sections.startExCpu = getThreadCpuTime();
+   sections.startExTime = getTime();
+   enterState(state, sections.startExTime);
+   dispatchSection(__func__, addr, result, instCount);
+   return result;
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_single_copy_start function                                   *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Gets the times of a single construct with a copyprivate clause.
+          The thread that runs the single region gets NULL and is timed
+          until GOMP_single_copy_end(); the others wait here for its data,
+          which is recorded as wait time.
+   @return NULL in the thread that runs the region, the data it copies
+           out in the other threads.
+**/
+
+void* GOMP_single_copy_start(void)
+{
+   int thId, index, state;
+   void *result;
+   thId = omp_get_thread_num();
+   singleCopy.beginAddr = getReturnAddress(0);
+   singleCopy.startName = __func__;
+   singleCopy.startTime_1 = getTime();
+   state = enterState(STATE_BARRIER, singleCopy.startTime_1);
+   singleCopy.startCpu_1 = getThreadCpuTime();
+   counterStart();
+   result = real_GOMP_single_copy_start();
+   singleCopy.iCount = counterStop();
+   singleCopy.startExCpu = getThreadCpuTime();
+   singleCopy.startExTime = getTime();
+   enterState(state, singleCopy.startExTime);
+   if (TRACING)
+      traceRecord(singleCopy.startName, singleCopy.beginAddr, thId,
+                  singleCopy.startTime_1, singleCopy.startExTime,
+                  singleCopy.iCount);
+   else if (AGGREGATING && result != NULL)
+   {
+      index = hash(singleCopy.beginAddr,thId);
+      editBucket(index, thId, singleCopy.startName,
+                 singleCopy.beginAddr, singleCopy.beginAddr,
+                 singleCopy.startExTime - singleCopy.startTime_1, 0.0,
+                 spinTime(singleCopy.startExTime - singleCopy.startTime_1,
+                          singleCopy.startExCpu - singleCopy.startCpu_1),
+                 singleCopy.iCount);
+   }
+   return result;
+}
+
+/*-------------------------------------------------------------------*
+ * GOMP_single_copy_end function                                     *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Hands the data of a single region with a copyprivate clause to
+          the other threads and records the time the region ran.
+   @param data - Data to copy out.
+   @return void
+**/
+
+void GOMP_single_copy_end(void *data)
+{
+   int thId, index, state;
+   thId = omp_get_thread_num();
+   singleCopy.startTime_2 = getTime();
+   state = enterState(STATE_RUNTIME, singleCopy.startTime_2);
+   real_GOMP_single_copy_end(data);
+   singleCopy.endAddr = getReturnAddress(0);
+   singleCopy.endTime = getTime();
+   if (TRACING)
+      traceOut("  %s %p %d %lf %lf  \n", __func__, singleCopy.endAddr, thId,
+               singleCopy.startTime_2, singleCopy.endTime);
+   else if (AGGREGATING)
+   {
+      enterState(state, singleCopy.endTime);
+      index = hash(singleCopy.beginAddr,thId);
+      editBucket(index, thId, singleCopy.startName,
+                 singleCopy.beginAddr, singleCopy.endAddr,
+                 singleCopy.startExTime - singleCopy.startTime_1,
+                 singleCopy.startTime_2 - singleCopy.startExTime,
+                 spinTime(singleCopy.startExTime - singleCopy.startTime_1,
+                          singleCopy.startExCpu - singleCopy.startCpu_1),
+                 singleCopy.iCount);
+   }
+}
+
+/*-------------------------------------------------------------------*
+ * Loop start, next and end functions                                *
+ *-------------------------------------------------------------------*/
+
+/**
+   Loop start and next wrappers, from the lists in pgomp-wrap.h. The time
+   in them is spent in the runtime.
+**/
+#define LOOP_START_WRAPPER(X, name, schedule) \
+_Bool name(long start, long end, long incr, long chunk, long *istart, long *iend) \
+{ \
+   _Bool result; \
+   void *addr = getReturnAddress(0); \
+   LoopState *ls = currentLoop(); \
+   double t1 = getTime(), t2; \
+   int state = enterState(STATE_RUNTIME, t1); \
+   counterStart(); \
+   result = real_##name(start, end, incr, chunk, istart, iend); \
+   instCount = counterStop(); \
+   t2 = getTime(); \
+   enterState(state, t2); \
+   loopBegin(ls, addr, schedule, start, end, incr, chunk, t1); \
+   loopDispatch(ls, __func__, addr, result, istart, iend, t1, t2, instCount); \
+   return result; \
+}
+
+#define LOOP_RUNTIME_START_WRAPPER(X, name, schedule) \
+_Bool name(long start, long end, long incr, long *istart, long *iend) \
+{ \
+   _Bool result; \
+   void *addr = getReturnAddress(0); \
+   LoopState *ls = currentLoop(); \
+   double t1 = getTime(), t2; \
+   int state = enterState(STATE_RUNTIME, t1); \
+   counterStart(); \
+   result = real_##name(start, end, incr, istart, iend); \
+   instCount = counterStop(); \
+   t2 = getTime(); \
+   enterState(state, t2); \
+   loopBegin(ls, addr, schedule, start, end, incr, 0, t1); \
+   loopDispatch(ls, __func__, addr, result, istart, iend, t1, t2, instCount); \
+   return result; \
+}
+
+#define LOOP_NEXT_WRAPPER(X, name, schedule) \
+_Bool name(long *istart, long *iend) \
+{ \
+   _Bool result; \
+   void *addr = getReturnAddress(0); \
+   LoopState *ls = currentLoop(); \
+   double t1 = getTime(), t2; \
+   int state = enterState(STATE_RUNTIME, t1); \
+   loopChunkEnd(ls, addr, t1); \
+   counterStart(); \
+   result = real_##name(istart, iend); \
+   instCount = counterStop(); \
+   t2 = getTime(); \
+   enterState(state, t2); \
+   loopDispatch(ls, __func__, addr, result, istart, iend, t1, t2, instCount); \
+   return result; \
+}
+
+PGOMP_LOOP_STARTS(, LOOP_START_WRAPPER)
+PGOMP_LOOP_RUNTIME_STARTS(, LOOP_RUNTIME_START_WRAPPER)
+PGOMP_LOOP_NEXTS(, LOOP_NEXT_WRAPPER)
+
+/*-------------------------------------------------------------------*
+ * Barriers and the ends of loops and sections                       *
+ *-------------------------------------------------------------------*/
+
+/**
+   @brief Adds the thread's share of its loop to the loop's site.
+   @param endAddr - Return address of the call that ends the loop.
+   @param now - Time that call was reached.
+**/
+static void closeLoop(void *endAddr, double now)
+{
+   LoopState *ls = currentLoop();
+   if (!AGGREGATING)
+      return;
+   loopChunkEnd(ls, endAddr, now);
+   if (ls->addr != NULL)
+      loopFinish(ls, now);
+}
+
+/**
+   @brief A barrier has nothing the thread ran to close.
+**/
+static void closeNothing(void *endAddr, double now)
+{
+}
+
+/**
+   GOMP_barrier and the calls that end loops and sections are single
+   calls. Their wrappers are generated from one line per construct:
+
+      X(name, waitState, close)
+
+   - name: the wrapped function.
+   - waitState: STATE_BARRIER for the calls that wait at a barrier, whose
+     time is a wait (with its spin time and instruction count);
+     STATE_RUNTIME for the nowait ends, whose time is execution.
+   - close: called with the call site and the time it was reached, before
+     the real function, to record what the thread ran since the
+     construct's last call.
+
+   Parallel regions, single, copyprivate single and the sections dispatch
+   keep their own wrappers: they track region frames, split one construct
+   over two calls or hand out work.
+**/
+#define BARRIER_CONSTRUCTS(X) \
+   X(GOMP_barrier, STATE_BARRIER, closeNothing) \
+   X(GOMP_sections_end, STATE_BARRIER, closeSection) \
+   X(GOMP_sections_end_nowait, STATE_RUNTIME, closeSection) \
+   X(GOMP_loop_end, STATE_BARRIER, closeLoop) \
+   X(GOMP_loop_end_nowait, STATE_RUNTIME, closeLoop)
+
+#define BARRIER_WRAPPER(name, waitState, close) \
+void name(void) \
+{ \
+   int thId, index, state; \
+   void *addr = getReturnAddress(0); \
+   double startTime, startCpu = 0.0, endTime; \
+   thId = omp_get_thread_num(); \
+   startTime = getTime(); \
+   state = enterState(waitState, startTime); \
+   close(addr, startTime); \
+   if (waitState == STATE_BARRIER) \
+   { \
+      startCpu = getThreadCpuTime(); \
+      counterStart(); \
+   } \
+   real_##name(); \
+   if (waitState == STATE_BARRIER) \
+   { \
+      instCount = counterStop(); \
+      startCpu = getThreadCpuTime() - startCpu; \
+   } \
+   endTime = getTime(); \
+   enterState(state, endTime); \
+   if (TRACING && waitState == STATE_BARRIER) \
+      traceRecord(__func__, addr, thId, startTime, endTime, instCount); \
+   else if (TRACING) \
+      traceOut("  %s %p %d %lf %lf  \n", __func__, addr, thId, startTime, endTime); \
+   else if (AGGREGATING) \
+   { \
+      index = hash(addr,thId); \
+      if (waitState == STATE_BARRIER) \
+         editBucket(index, thId, __func__, addr, addr, endTime - startTime, 0.0, \
+                    spinTime(endTime - startTime, startCpu), instCount); \
+      else \
+         editBucket(index, thId, __func__, addr, addr, 0.0, endTime - startTime, \
+                    0.0, 0); \
+   } \
+}
+
+BARRIER_CONSTRUCTS(BARRIER_WRAPPER)
+
+#ifdef BUILD_OMPT
+/*-------------------------------------------------------------------*
+ * OMPT backend                                                      *
+ *-------------------------------------------------------------------*/
+
+//
+// LLVM's libomp reports its events through the OMPT tool interface: it
+// calls ompt_start_tool() when it starts, and PGOMP registers the
+// callbacks below. They feed the same tables, trace records and thread
+// timelines as the wrappers, under the name of the matching libgomp
+// function where there is one. While OMPT is on, the dispatcher passes
+// the wrapped functions (libomp has the GOMP_* ones too, for programs
+// built with GCC) straight to libomp, so nothing is counted twice.
+//
+// OMPT also shows what the wrappers can not see: the implicit barriers
+// (implicit_barrier), taskwait, taskgroup and reduction waits, the
+// worksharing constructs (loop, sections, single, single_other, ...) and
+// explicit tasks (task: the wait is from its creation to its first run,
+// the execution time the time it ran).
+//
+
+/**
+   A parallel region reported by OMPT, kept in its parallel_data
+**/
+typedef struct
+{
+/*@{*/
+   RegionFrame frame; /**< Times of the team, see regionJoin() */
+   int state; /**< State of the encountering thread before the region */
+   bool outermost; /**< Not nested in another region */
+/*@}*/
+} OmptRegion;
+
+/**
+   The implicit task of a thread in a region. Only the end of the task
+   tells whether its last implicit barrier was the one that ends the
+   region (recorded as the join, see regionJoin()), so that barrier is
+   held back until the thread's next event.
+**/
+typedef struct OmptTask
+{
+/*@{*/
+   RegionMember *member; /**< The thread's entry in the region's frame */
+   double before[NUM_STATES]; /**< Thread timeline when the task started */
+   int fromState; /**< State of the thread before the task */
+   int barrierState; /**< State of the thread before the implicit barrier */
+   bool pending; /**< An implicit barrier ended and is held back */
+   const void *barrierAddr; /**< Its call site */
+   double barrierStart; /**< Time it was reached */
+   double barrierEnd; /**< Time it was left */
+   double barrierCpu; /**< Thread CPU time spent in it */
+   AllocCount alloc; /**< Allocations in the task (PGOMP_MALLOC) */
+   AllocCount *outerAlloc; /**< allocCount of the thread before the task */
+   struct OmptTask *outer; /**< Task the thread ran before this one */
+/*@}*/
+} OmptTask;
+
+/**
+   An explicit task, kept in its task_data
+**/
+typedef struct
+{
+/*@{*/
+   const void *addr; /**< Where it was created */
+   double createTime; /**< Time it was created */
+   double firstRun; /**< Time it first ran, 0 until then */
+   double runStart; /**< Time it last started or resumed running */
+   double runTime; /**< Time it ran so far */
+/*@}*/
+} OmptExplicitTask;
+
+/**
+   A worksharing construct or synchronization region in progress
+**/
+typedef struct
+{
+/*@{*/
+   const char *name; /**< Record name */
+   const void *addr; /**< Call site */
+   double startTime; /**< Time it began */
+   double startCpu; /**< Thread CPU time when it began */
+   int state; /**< State of the thread before it */
+/*@}*/
+} OmptScope;
 
-   }
-}
+static __thread OmptTask *omptTask = NULL; /**< Innermost implicit task */
+static __thread OmptScope omptScopes[OMPT_SCOPES];
+static __thread int omptDepth = 0; /**< Open scopes, may exceed OMPT_SCOPES */
+static __thread int omptMutexState = -1; /**< State before the wait for a mutex */
+// the mutex callbacks come after the release, see omptMutexReleased()
+static pthread_mutex_t omptCriticalLock = PTHREAD_MUTEX_INITIALIZER;
 
-/*-------------------------------------------------------------------*
- * omp_set_nest_lock function                                        *
- *-------------------------------------------------------------------*/
+// Record names, indexed by ompt_mutex_t, ompt_sync_region_t and ompt_work_t
+static const char *omptAcquireNames[] = { NULL, "omp_set_lock", "omp_test_lock",
+   "omp_set_nest_lock", "omp_test_nest_lock", "GOMP_critical_start",
+   "GOMP_atomic_start", "GOMP_ordered_start" };
+static const char *omptReleaseNames[] = { NULL, "omp_unset_lock", "omp_unset_lock",
+   "omp_unset_nest_lock", "omp_unset_nest_lock", "GOMP_critical_end",
+   "GOMP_atomic_end", "GOMP_ordered_end" };
+static const char *omptSyncNames[] = { NULL, "GOMP_barrier", "implicit_barrier",
+   "GOMP_barrier", "GOMP_barrier", "taskwait", "taskgroup", "reduction",
+   "implicit_barrier", "implicit_barrier" };
+static const char *omptWorkNames[] = { NULL, "loop", "sections", "single",
+   "single_other", "workshare", "distribute", "taskloop", "scope" };
+
+#define OMPT_NAME(names, kind) \
+   ((unsigned) (kind) < sizeof(names) / sizeof(names[0]) ? names[kind] : NULL)
 
 /**
-   @brief Gets the needed time values to calculate the thread locking
-          overhead. Also, gets call location.
-          Gets the start time which is the time when the current thread
-          reach this function.
-          Gets start execution time which is the time when the current
-          thread acquired the lock[thId].
-          Gets the return address of the function.
-   @param lock - A variable of type omp_lock_t that was initialized
-                 with omp_init_lock[thId].
-   @return void
+   @brief Records a construct of the calling thread.
+   @param name - Record name.
+   @param beginAddr - Its call site.
+   @param endAddr - Call site of its end.
+   @param t1 - Time it began.
+   @param t2 - Time it ended.
+   @param wait - Wait time.
+   @param exec - Execution time.
+   @param spin - Spinning part of the wait.
 **/
-
-void omp_set_nest_lock(omp_nest_lock_t *pLock)
+static void omptRecord(const char *name, const void *beginAddr, const void *endAddr,
+                       double t1, double t2, double wait, double exec, double spin)
 {
-   int thId;
-   thId = omp_get_thread_num();
-   nestedLock[thId].beginAddr = getReturnAddress(0);
-   nestedLock[thId].startName = __func__;
-   nestedLock[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   real_omp_set_nest_lock(pLock);
-   if(papiFlag)
-   {
-      STOP_COUNTER;
-      instCount[thId] =values[0]-ioverhead;
-   //   noCycle[thId] =values[1];
-   }
-   nestedLock[thId].startExTime = getTime();
-   if (modeFlag == 1)
-   {
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", nestedLock[thId].startName,
-                  nestedLock[thId].beginAddr, thId, nestedLock[thId].startTime_1,
-                  nestedLock[thId].startExTime, instCount[thId]);
-     else
-        fprintf(outFile,"  %s %p %d %lf %lf  \n", nestedLock[thId].startName,
-                  nestedLock[thId].beginAddr, thId, nestedLock[thId].startTime_1,
-                  nestedLock[thId].startExTime);
-   }
+   int thId = omp_get_thread_num();
+   if (TRACING)
+      traceRecord(name, (void *) beginAddr, thId, t1, t2, 0);
+   else if (AGGREGATING)
+      editBucket(hash((void *) beginAddr, thId), thId, name, (void *) beginAddr,
+                 (void *) endAddr, wait, exec, spin, 0);
 }
 
-/*-------------------------------------------------------------------*
- * omp_test_nest_lock function                                       *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Gets the needed time values to calculate the thread locking
-          overhead. Also, gets call location.
-   @param lock - A variable of type omp_lock_t that was initialized
-          with omp_init_lock[thId].
-   @return If attempts to set the lock specified by the variable
-           succeed, the function returns TRUE; otherwise, the function
-           returns FALSE
+   @brief Records the implicit barrier held back by the thread's implicit
+          task: the thread has gone on, so it did not end the region.
 **/
-
-int omp_test_nest_lock(omp_nest_lock_t *pLock)
+static void omptFlush()
 {
-   int thId, result;
-   thId = omp_get_thread_num();
-   nestedLock[thId].beginAddr = getReturnAddress(0);
-   nestedLock[thId].startName = __func__;
-   nestedLock[thId].startTime_1 =  getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   result = real_omp_test_nest_lock(pLock);
-   if(papiFlag)
-   {
-      STOP_COUNTER;
-      instCount[thId]=values[0]-ioverhead;
- //   noCycle[thId]+=values[1];
-   }
-   nestedLock[thId].startExTime = getTime();
-   if (modeFlag == 1)
-   {
-      if(papiFlag)
-      
-         fprintf(outFile," %s %p %d %lf %lf %lld \n", nestedLock[thId].startName,
-                  nestedLock[thId].beginAddr, thId, nestedLock[thId].startTime_1,
-                  nestedLock[thId].startExTime,instCount[thId]);
-      else
-         fprintf(outFile," %s %p %d %lf %lf  \n", nestedLock[thId].startName,
-                  nestedLock[thId].beginAddr, thId, nestedLock[thId].startTime_1,
-                  nestedLock[thId].startExTime);
-   }
-   else if (modeFlag == 2)
-       nestedLock[thId].startTime_1 = nestedLock[thId].startExTime;
-   return result;
+   OmptTask *t = omptTask;
+   double wait;
+   if (t == NULL || !t->pending)
+      return;
+   t->pending = false;
+   wait = t->barrierEnd - t->barrierStart;
+   omptRecord("implicit_barrier", t->barrierAddr, t->barrierAddr,
+              t->barrierStart, t->barrierEnd, wait, 0.0,
+              spinTime(wait, t->barrierCpu));
 }
 
-/*-------------------------------------------------------------------*
- * omp_unset_nest_lock function                                      *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Calculates thread locking overhead which is the time thread
-          spent waiting to acquire a lock[thId].
-   @param lock - A variable of type omp_lock_t that was initialized
-          with omp_init_lock[thId].
-   @return void
+   @brief Notes that the thread may have left the body of its region, as
+          regionBody() does when the outlined body returns.
 **/
-
-void omp_unset_nest_lock(omp_nest_lock_t *pLock)
+static void omptLeave(OmptTask *t, double now)
 {
-   int thId, index;
-   thId = omp_get_thread_num();
-   nestedLock[thId].startTime_2 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   real_omp_unset_nest_lock(pLock);
-   if(papiFlag)
-   {
-      STOP_COUNTER;
-      instCount[thId]+=values[0]-ioverhead;
-    //  noCycle[thId]+=values[1];
-   }
-   nestedLock[thId].endAddr = getReturnAddress(0);
-   if (modeFlag == 1)
-   {
-      nestedLock[thId].endTime = getTime();
-      nestedLock[thId].endName = __func__;
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld  \n", nestedLock[thId].endName,
-                  nestedLock[thId].endAddr, thId, nestedLock[thId].startTime_2,
-                  nestedLock[thId].endTime, values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", nestedLock[thId].endName,
-                  nestedLock[thId].endAddr, thId, nestedLock[thId].startTime_2,
-                  nestedLock[thId].endTime);
+   RegionMember *m = t->member;
+   int s;
+   if (m == NULL)
+      return;
+   m->endTime = now;
+   m->alloc = t->alloc;
+   if (m->timeline != NULL)
+      for (s = 0; s < NUM_STATES; s++)
+         m->body[s] = m->timeline->time[s] - t->before[s];
+}
 
-   }
-   else if (modeFlag == 2)
+/**
+   @brief Opens a worksharing construct or synchronization region.
+**/
+static void omptBegin(const char *name, const void *addr, int state)
+{
+   OmptScope *sc;
+   omptFlush();
+   if (omptDepth < OMPT_SCOPES)
    {
-      index = hash(nestedLock[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, nestedLock[thId].startName,
-                     nestedLock[thId].beginAddr,nestedLock[thId].endAddr,
-                     nestedLock[thId].startExTime - nestedLock[thId].startTime_1 ,
-                     nestedLock[thId].startTime_2 - nestedLock[thId].startExTime,
-                     instCount[thId]);
-      else
-         editBucket(index, thId, nestedLock[thId].startName,
-                     nestedLock[thId].beginAddr,nestedLock[thId].endAddr,
-                     nestedLock[thId].startExTime - nestedLock[thId].startTime_1 ,
-                     nestedLock[thId].startTime_2 - nestedLock[thId].startExTime,0);
+      sc = &omptScopes[omptDepth];
+      sc->name = name;
+      sc->addr = addr;
+      sc->startTime = getTime();
+      sc->startCpu = getThreadCpuTime();
+      sc->state = enterState(state, sc->startTime);
    }
+   omptDepth++;
 }
 
-/*-------------------------------------------------------------------*
- * GOMP_barrier function                                             *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Calculates barrier Overhead which is the time earlier threads
-          wait for later threads.
-   @param void
-   @return void
+   @brief Closes the innermost scope and records it.
+   @param wait - The scope was a wait rather than execution.
 **/
-
-void GOMP_barrier(void)
+static void omptEnd(bool wait)
 {
-   int thId,index;
-   thId=omp_get_thread_num();
-   barrier[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];//To store our list of results
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   real_GOMP_barrier();
-   if(papiFlag)
-   {
-      STOP_COUNTER;  
-      instCount[thId]=values[0]-ioverhead;
-    //  noCycle[thId]+=values[1];
-   }
-   barrier[thId].endTime = getTime();
-   barrier[thId].beginAddr = barrier[thId].endAddr = getReturnAddress(0);
-   barrier[thId].startName = __func__;
-   if (modeFlag == 1)
-   {
-   if(papiFlag)
-      fprintf(outFile,"  %s %p %d %lf %lf  %lld \n", barrier[thId].startName,
-               barrier[thId].beginAddr, thId, barrier[thId].startTime_1,
-               barrier[thId].endTime,instCount[thId]);
+   OmptScope *sc;
+   double now, time;
+   if (omptDepth == 0 || --omptDepth >= OMPT_SCOPES)
+      return;
+   sc = &omptScopes[omptDepth];
+   now = getTime();
+   time = now - sc->startTime;
+   enterState(sc->state, now);
+   if (wait)
+      omptRecord(sc->name, sc->addr, sc->addr, sc->startTime, now, time, 0.0,
+                 spinTime(time, getThreadCpuTime() - sc->startCpu));
    else
-      fprintf(outFile,"  %s %p %d %lf %lf \n", barrier[thId].startName,
-               barrier[thId].beginAddr, thId, barrier[thId].startTime_1,
-               barrier[thId].endTime); 
-   }
-   else if (modeFlag == 2)
-   {
-      index = hash(barrier[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, barrier[thId].startName,
-                  barrier[thId].beginAddr,barrier[thId].endAddr,
-                  barrier[thId].endTime - barrier[thId].startTime_1 ,
-                  0.0,values[0]-ioverhead);
-      else
-         editBucket(index, thId, barrier[thId].startName,
-                  barrier[thId].beginAddr,barrier[thId].endAddr,
-                  barrier[thId].endTime - barrier[thId].startTime_1 ,
-                  0.0,0);
-   }
+      omptRecord(sc->name, sc->addr, sc->addr, sc->startTime, now, 0.0, time, 0.0);
 }
 
-/*-------------------------------------------------------------------*
- *  GOMP_critical_start function                                     *
- *-------------------------------------------------------------------*/
+static void omptParallelBegin(ompt_data_t *encounteringTask,
+                              const ompt_frame_t *encounteringFrame,
+                              ompt_data_t *parallel, unsigned int requested,
+                              int flags, const void *addr)
+{
+   double now = getTime();
+   OmptRegion *r;
+   omptFlush();
+   r = malloc(sizeof(OmptRegion));
+   parallel->ptr = r;
+   if (r == NULL)
+      return;
+   regionInit(&r->frame, NULL, NULL, (void *) addr, requested);
+   r->frame.forkTime = now;
+   r->outermost = omp_get_level() == 0;
+   r->state = enterState(STATE_RUNTIME, now);
+}
 
-/**
-   @brief Gets the needed time values to calculate the Critical Section
-          overhead. Also, gets call location.
-          Gets the start time which is the time when the current thread
-          reach this function.
-          Gets start execution time which is the time when the current
-          thread starts execution the corresponded critical section.
-          Gets the return address of the function.
-   @param void
-   @return void
-**/
+static void omptParallelEnd(ompt_data_t *parallel, ompt_data_t *encounteringTask,
+                            int flags, const void *addr)
+{
+   OmptRegion *r = parallel->ptr;
+   RegionFrame *frame;
+   double now = getTime();
+   if (r == NULL)
+      return;
+   frame = &r->frame;
+   parallel->ptr = NULL;
+   if (r->outermost)
+      countRegion(now - frame->forkTime, frame->team);
+   enterState(r->state, now);
+   regionJoin(frame, now);
+   omptRecord("GOMP_parallel", frame->addr, frame->addr, frame->forkTime, now,
+              0.0, now - frame->forkTime, 0.0);
+   free(r);
+}
 
-void GOMP_critical_start(void)
+static void omptImplicitTask(ompt_scope_endpoint_t endpoint, ompt_data_t *parallel,
+                             ompt_data_t *task, unsigned int team,
+                             unsigned int index, int flags)
 {
-   int thId;
-   thId=omp_get_thread_num();
-   critical[thId].beginAddr = getReturnAddress(0);
-   critical[thId].startName = __func__;
-   critical[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   real_GOMP_critical_start();
-   if(papiFlag)
+   double now = getTime();
+   OmptRegion *r;
+   OmptTask *t;
+   RegionMember *m;
+   Timeline *tl = NULL;
+   if (flags & ompt_task_initial)
+      return;
+   if (endpoint == ompt_scope_begin)
    {
-      STOP_COUNTER
-      instCount[thId]=values[0]-ioverhead;;
-     // noCycle[thId]+=values[1];
+      t = calloc(1, sizeof(OmptTask));
+      if (t == NULL)
+      {
+         fprintf(stderr,"LIBPGOMP ERROR: Out of memory for an OMPT task\n");
+         exit(0);
+      }
+      t->outer = omptTask;
+      omptTask = t;
+      t->outerAlloc = allocCount;
+      t->fromState = STATE_WORK;
+      r = parallel->ptr;
+      if (r == NULL)
+         return;
+      if (index == 0)
+         r->frame.team = team;
+      if (AGGREGATING)
+      {
+         // a thread first seen here was idle in the pool until the region started
+         tl = myTimeline ? myTimeline : newTimeline(STATE_IDLE, r->frame.forkTime);
+         t->fromState = enterState(STATE_WORK, now);
+         memcpy(t->before, tl->time, sizeof(t->before));
+         if (allocFlag)
+            allocCount = &t->alloc;
+      }
+      if (index < r->frame.maxMembers)
+      {
+         m = t->member = &r->frame.members[index];
+         memset(m, 0, sizeof(RegionMember));
+         m->startTime = m->endTime = now;
+         m->timeline = tl;
+         m->fromState = t->fromState;
+      }
+      return;
    }
-   critical[thId].startExTime = getTime();
-   if (modeFlag == 1)
+   t = omptTask;
+   if (t == NULL)
+      return;
+   allocCount = t->outerAlloc;
+   if (myTimeline != NULL)
+      addAlloc(&myTimeline->alloc, &t->alloc);
+   enterState(t->fromState, now);
+   if (!t->pending)
+      omptLeave(t, now);
+   else if (AGGREGATING && (tl = myTimeline) != NULL)
    {
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", critical[thId].startName,
-                  critical[thId].beginAddr, thId, critical[thId].startTime_1,
-                  critical[thId].startExTime,instCount[thId]);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", critical[thId].startName,
-                  critical[thId].beginAddr, thId, critical[thId].startTime_1,
-                  critical[thId].startExTime);
+      // the held back barrier ended the region: like a thread leaving
+      // regionBody(), the thread was back in its state from the start of
+      // that barrier, and regionJoin() counts the barrier as the join
+      tl->time[STATE_BARRIER] -= t->barrierEnd - t->barrierStart;
+      tl->time[t->barrierState] -= now - t->barrierEnd;
+      tl->time[t->fromState] += now - t->barrierStart;
    }
+   omptTask = t->outer;
+   free(t);
 }
 
-/*-------------------------------------------------------------------*
- * GOMP_critical_end function                                        *
- *-------------------------------------------------------------------*/
-
-/**
-   @brief Calculates Critical Section overhead which is the time thread
-          spent waiting to start executing the correspond critical
-          section.
-   @param lock - A variable of type omp_lock_t that was initialized
-          with omp_init_lock[thId].
-   @return void
-**/
-
-void GOMP_critical_end(void)
+static void omptSyncRegion(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint,
+                           ompt_data_t *parallel, ompt_data_t *task,
+                           const void *addr)
 {
-   int thId, index;
-   thId = omp_get_thread_num();
-   critical[thId].startTime_2 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+   const char *name = OMPT_NAME(omptSyncNames, kind);
+   OmptTask *t = omptTask;
+   double now;
+   if (name == NULL)
+      return;
+   if (t == NULL || (kind != ompt_sync_region_barrier_implicit
+                     && kind != ompt_sync_region_barrier_implicit_workshare
+                     && kind != ompt_sync_region_barrier_implicit_parallel))
    {
-       int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-       START_COUNTER;
+      if (endpoint == ompt_scope_begin)
+         omptBegin(name, addr, STATE_BARRIER);
+      else
+         omptEnd(true);
+      return;
    }
-#endif
-   real_GOMP_critical_end();
-   if(papiFlag)
+   now = getTime();
+   if (endpoint == ompt_scope_begin)
    {
-      STOP_COUNTER
-      instCount[thId]+=values[0]-ioverhead;
-     // noCycle[thId]+=values[1];
+      omptFlush();
+      t->barrierAddr = addr;
+      t->barrierStart = now;
+      t->barrierCpu = getThreadCpuTime();
+      t->barrierState = enterState(STATE_BARRIER, now);
+      // in case this barrier ends the region
+      omptLeave(t, now);
    }
-   critical[thId].endAddr = getReturnAddress(0);
-#ifdef GOMP_DEBUG
-   if (gompDebug) fprintf(stderr,"GOMP Debug: GOMP_critical_end called from %s\n",
-                          lookupFunctionName(critical[thId].endAddr));
-#endif
-   if (modeFlag == 1)
-   {
-      critical[thId].endTime = getTime();
-      critical[thId].endName = __func__;
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld  \n", critical[thId].endName,
-                  critical[thId].endAddr, thId, critical[thId].startTime_2,
-                  critical[thId].endTime, values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", critical[thId].endName,
-                  critical[thId].endAddr, thId, critical[thId].startTime_2,
-                  critical[thId].endTime);    
-   }
-   else if (modeFlag == 2)
-   {
-      index = hash(critical[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, critical[thId].startName,
-                     critical[thId].beginAddr,critical[thId].endAddr,
-                     critical[thId].startExTime - critical[thId].startTime_1 ,
-                     critical[thId].startTime_2 - critical[thId].startExTime,
-                     instCount[thId]);
-      else
-          editBucket(index, thId, critical[thId].startName,
-                     critical[thId].beginAddr,critical[thId].endAddr,
-                     critical[thId].startExTime - critical[thId].startTime_1 ,
-                     critical[thId].startTime_2 - critical[thId].startExTime,0);
+   else
+   {
+      t->barrierEnd = now;
+      t->barrierCpu = getThreadCpuTime() - t->barrierCpu;
+      enterState(t->barrierState, now);
+      t->pending = true;
    }
 }
 
-/*-------------------------------------------------------------------*
- * GGOMP_critical_name_start function                                *
- *-------------------------------------------------------------------*/
+static void omptWork(ompt_work_t kind, ompt_scope_endpoint_t endpoint,
+                     ompt_data_t *parallel, ompt_data_t *task, uint64_t count,
+                     const void *addr)
+{
+   const char *name = OMPT_NAME(omptWorkNames, kind);
+   if (name == NULL)
+      return;
+   if (endpoint == ompt_scope_begin)
+      omptBegin(name, addr, STATE_WORK);
+   else
+      omptEnd(false);
+}
 
 /**
-   @brief Gets the needed time values to calculate the Critical Section
-          overhead. Also, gets call location.
-          Gets the start time which is the time when the current thread
-          reach this function.
-          Gets start execution time which is the time when the current
-          thread starts execution the corresponded critical section.
-          Gets the return address of the function.
-   @param name - Critical Section name.
-   @return void
+   @brief The per-thread record of a mutex kind, as used by the wrappers.
 **/
-
-void GOMP_critical_name_start(void** name)
+static PerThreadInfo* omptMutexInfo(ompt_mutex_t kind)
 {
-   int thId;
-   thId = omp_get_thread_num();
-   namedCritical[thId].beginAddr = getReturnAddress(0);
-   namedCritical[thId].startName = __func__;
-   namedCritical[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif
-   real_GOMP_critical_name_start(name);
-   if(papiFlag)
-   {
-      STOP_COUNTER
-      instCount[thId]=values[0]-ioverhead;;
-     // noCycle[thId]+=values[1];
-   }
-   namedCritical[thId].startExTime = getTime();
-   if (modeFlag == 1)
+   switch (kind)
    {
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", namedCritical[thId].startName,
-               namedCritical[thId].beginAddr, thId, namedCritical[thId].startTime_1,
-               namedCritical[thId].startExTime, values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", namedCritical[thId].startName,
-               namedCritical[thId].beginAddr, thId, namedCritical[thId].startTime_1,
-               namedCritical[thId].startExTime);
+   case ompt_mutex_lock:
+   case ompt_mutex_test_lock:
+      return &lock;
+   case ompt_mutex_nest_lock:
+   case ompt_mutex_test_nest_lock:
+      return &nestedLock;
+   case ompt_mutex_critical:
+      return &critical;
+   case ompt_mutex_atomic:
+      return &atomic;
+   case ompt_mutex_ordered:
+      return &ordered;
+   default:
+      return NULL;
    }
 }
 
-/*-------------------------------------------------------------------*
- * GOMP_critical_name_end function                                   *
- *------------------------------------------------------------------ */
-
 /**
-   @brief Calculates Critical Section overhead which is the time thread
-          spent waiting to start executing the correspond critical
-          section.
-   @param name - Critical Section name.
-   @return void
+   @brief Whether the holder of a mutex kind is noted (PGOMP_CONVOY): the
+          mutexes the wrappers note, by their wait id.
 **/
+static bool omptConvoyKind(ompt_mutex_t kind)
+{
+   return kind == ompt_mutex_lock || kind == ompt_mutex_test_lock
+          || kind == ompt_mutex_critical || kind == ompt_mutex_atomic;
+}
 
-void GOMP_critical_name_end(void** name)
+static void omptMutexAcquire(ompt_mutex_t kind, unsigned int hint,
+                             unsigned int impl, ompt_wait_id_t waitId,
+                             const void *addr)
 {
-   int thId, index;
-   thId = omp_get_thread_num();
-   namedCritical[thId].startTime_2 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-      START_COUNTER;
-   }
-#endif   
-   real_GOMP_critical_name_end(name);
-   if(papiFlag)
+   PerThreadInfo *info = omptMutexInfo(kind);
+   if (info == NULL)
+      return;
+   omptFlush();
+   info->beginAddr = (void *) addr;
+   info->startName = omptAcquireNames[kind];
+   info->startTime_1 = getTime();
+   info->startCpu_1 = getThreadCpuTime();
+   // a test does not wait, and a failed one has no acquired callback
+   if (kind != ompt_mutex_test_lock && kind != ompt_mutex_test_nest_lock)
    {
-      STOP_COUNTER 
-      instCount[thId]+=values[0]-ioverhead;
-    //  noCycle[thId]+=values[1];
+      omptMutexState = enterState(kind <= ompt_mutex_test_nest_lock
+                                  ? STATE_LOCK : STATE_CRITICAL,
+                                  info->startTime_1);
+      if (omptConvoyKind(kind))
+         convoyWait((void *) waitId, kind > ompt_mutex_test_lock, (void *) addr);
    }
-   namedCritical[thId].endAddr = getReturnAddress(0);
-   if (modeFlag == 1)
+}
+
+static void omptMutexAcquired(ompt_mutex_t kind, ompt_wait_id_t waitId,
+                              const void *addr)
+{
+   PerThreadInfo *info = omptMutexInfo(kind);
+   if (info == NULL)
+      return;
+   info->startExCpu = getThreadCpuTime();
+   info->startExTime = getTime();
+   if (omptMutexState >= 0)
+      enterState(omptMutexState, info->startExTime);
+   omptMutexState = -1;
+   if (omptConvoyKind(kind))
+      convoyAcquired((void *) waitId, kind > ompt_mutex_test_lock, (void *) addr,
+                     info->startExTime - info->startTime_1,
+                     kind == ompt_mutex_test_lock);
+   if (TRACING)
+      traceRecord(info->startName, info->beginAddr, omp_get_thread_num(),
+                  info->startTime_1, info->startExTime, 0);
+   else
    {
-      namedCritical[thId].endTime = getTime();
-      namedCritical[thId].endName = __func__;
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", namedCritical[thId].endName,
-                  namedCritical[thId].endAddr, thId, namedCritical[thId].startTime_2,
-                  namedCritical[thId].endTime, values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", namedCritical[thId].endName,
-                  namedCritical[thId].endAddr, thId, namedCritical[thId].startTime_2,
-                  namedCritical[thId].endTime);
-   }
-   else if (modeFlag == 2)
-   {
-      index = hash(namedCritical[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, namedCritical[thId].startName,
-                     namedCritical[thId].beginAddr,namedCritical[thId].endAddr,
-                     namedCritical[thId].startExTime - namedCritical[thId].startTime_1 ,
-                     namedCritical[thId].startTime_2 - namedCritical[thId].startExTime,
-                     instCount[thId]);
-      else
-         editBucket(index, thId, namedCritical[thId].startName,
-                     namedCritical[thId].beginAddr,namedCritical[thId].endAddr,
-                     namedCritical[thId].startExTime - namedCritical[thId].startTime_1 ,
-                     namedCritical[thId].startTime_2 - namedCritical[thId].startExTime,0);
+      if (kind == ompt_mutex_test_lock || kind == ompt_mutex_test_nest_lock)
+      {
+         // as in TEST_WRAPPER: the lock is held from the test's return
+         info->startTime_1 = info->startExTime;
+         info->startCpu_1 = info->startExCpu;
+      }
+      info->iCount = 0;
+      holdConstruct((void *) waitId, info);
    }
 }
 
-/*-------------------------------------------------------------------*
- * GOMP_parallel_start function                                      *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief Gets the time values that related to parallel section.
-   @return void
+   @brief Records a mutex. libomp calls this after the release, so the
+          next owner may already be in: the critical section statistics
+          are kept under a lock of their own here.
 **/
-
-void GOMP_parallel_start (void (*fn) (void *),
-                           void *data, unsigned num_threads)
+static void omptMutexReleased(ompt_mutex_t kind, ompt_wait_id_t waitId,
+                              const void *addr)
 {
-   int thId;
-   thId = omp_get_thread_num();
-#ifdef GOMP_DEBUG
-   if (gompDebug) fprintf(stderr,"GOMP Debug: GOMP_parallel_start, thid=%d\n",thId);
-#endif
-   parallel[thId].beginAddr = getReturnAddress(0);
-#ifdef GOMP_DEBUG
-   if (gompDebug) fprintf(stderr,"GOMP Debug: GOMP_parallel_start called from %s\n",
-                          lookupFunctionName(parallel[thId].beginAddr));
-#endif
-   parallel[thId].startName = __func__;
-#ifdef GOMP_DEBUG
-   if (gompDebug) fprintf(stderr,"GOMP Debug: starting GOMP_parallel_start, thid=%d\n",thId);
-#endif
-   parallel[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+   PerThreadInfo held;
+   const PerThreadInfo *info = omptMutexInfo(kind);
+   double now = getTime(), wait, hold;
+   int thId = omp_get_thread_num();
+   if (info == NULL)
+      return;
+   if (AGGREGATING)
+      info = releaseConstruct((void *) waitId, info, &held);
+   if (addr == NULL)
+      addr = info->beginAddr;
+   wait = info->startExTime - info->startTime_1;
+   hold = now - info->startExTime;
+   if (omptConvoyKind(kind))
+      convoyRelease((void *) waitId, kind > ompt_mutex_test_lock);
+   if (TRACING)
+      traceRecord(omptReleaseNames[kind], (void *) addr, thId, now, now, 0);
+   else if (AGGREGATING)
+   {
+      if (kind == ompt_mutex_critical || kind == ompt_mutex_atomic)
       {
-          int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-          START_COUNTER;
+         pthread_mutex_lock(&omptCriticalLock);
+         countCriticalName((void *) waitId, wait, hold);
+         pthread_mutex_unlock(&omptCriticalLock);
       }
-#endif
-   real_GOMP_parallel_start(fn, data,  num_threads);
-   if(papiFlag)
-   {
-      STOP_COUNTER
-      instCount[thId]=values[0]-ioverhead;;
-    //  noCycle[thId]+=values[1];
+      editBucket(hash(info->beginAddr,thId), thId, info->startName,
+                 info->beginAddr, (void *) addr, wait, hold,
+                 spinTime(wait, info->startExCpu - info->startCpu_1), 0);
    }
-   parallel[thId].startExTime = getTime();
-#ifdef GOMP_DEBUG
-   if (gompDebug) fprintf(stderr,"GOMP Debug: finished GOMP_parallel_start, thid=%d\n",thId);
-#endif
-   if (modeFlag == 1)
+}
+
+static void omptNestLock(ompt_scope_endpoint_t endpoint, ompt_wait_id_t waitId,
+                         const void *addr)
+{
+   // set again by its owner: the acquire did not wait after all
+   if (endpoint == ompt_scope_begin && omptMutexState >= 0)
    {
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", parallel[thId].startName,
-                  parallel[thId].beginAddr, thId, parallel[thId].startTime_1,
-                  parallel[thId].startExTime, instCount[thId]);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", parallel[thId].startName,
-                  parallel[thId].beginAddr, thId, parallel[thId].startTime_1,
-                  parallel[thId].startExTime);
+      enterState(omptMutexState, getTime());
+      omptMutexState = -1;
    }
 }
 
-/*-------------------------------------------------------------------*
- * GOMP_parallel_end function                                        *
- *-------------------------------------------------------------------*/
-
-/**
-   @brief Calculates the time that spend in parallel section. Also, gets
-          call location.
-   @return void
-**/
+static void omptTaskCreate(ompt_data_t *encounteringTask,
+                           const ompt_frame_t *encounteringFrame,
+                           ompt_data_t *task, int flags, int hasDependences,
+                           const void *addr)
+{
+   OmptExplicitTask *et;
+   if (!(flags & ompt_task_explicit))
+      return;
+   omptFlush();
+   et = calloc(1, sizeof(OmptExplicitTask));
+   task->ptr = et;
+   if (et == NULL)
+      return;
+   et->addr = addr;
+   et->createTime = getTime();
+}
 
-void GOMP_parallel_end (void)
+static void omptTaskSchedule(ompt_data_t *prior, ompt_task_status_t status,
+                             ompt_data_t *next)
 {
-   int thId, index;
-   thId = omp_get_thread_num();
-   parallel[thId].startTime_2 = getTime(); // = seqStartTime
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
+   OmptExplicitTask *et = prior != NULL ? prior->ptr : NULL;
+   double now = getTime();
+   omptFlush();
+   if (et != NULL)
+   {
+      et->runTime += now - et->runStart;
+      if (status == ompt_task_complete || status == ompt_task_cancel)
       {
-          int Events[NUM_EVENTS] = {PAPI_TOT_INS, PAPI_TOT_CYC};
-          START_COUNTER;
+         omptRecord("task", et->addr, et->addr, et->firstRun, now,
+                    et->firstRun - et->createTime, et->runTime, 0.0);
+         prior->ptr = NULL;
+         free(et);
       }
-#endif
-   real_GOMP_parallel_end();
-   if(papiFlag)
-   {
-      STOP_COUNTER
-      instCount[thId]+=values[0]-ioverhead;;
-  //    noCycle[thId]+=values[1];
    }
-   parallel[thId].endAddr = getReturnAddress(0);
-    if (modeFlag == 1)
+   et = next != NULL ? next->ptr : NULL;
+   if (et != NULL)
    {
-      parallel[thId].endTime = getTime();
-      parallel[thId].endName = __func__;
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld \n", parallel[thId].endName,
-                  parallel[thId].endAddr, thId, parallel[thId].startTime_2,
-                  parallel[thId].endTime, values[0]-ioverhead);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", parallel[thId].endName,
-                  parallel[thId].endAddr, thId, parallel[thId].startTime_2,
-                  parallel[thId].endTime);
-   }
-   else if (modeFlag == 2)
-   {
-      index = hash(parallel[thId].beginAddr,thId);
-      if(papiFlag)
-         editBucket(index, thId, parallel[thId].startName,
-                     parallel[thId].beginAddr,parallel[thId].endAddr,0.0,
-                     parallel[thId].startTime_2 - parallel[thId].startExTime,
-                     instCount[thId]);
-      else
-         editBucket(index, thId, parallel[thId].startName,
-                     parallel[thId].beginAddr,parallel[thId].endAddr,0.0,
-                     parallel[thId].startTime_2 - parallel[thId].startExTime,0);
-
+      if (et->firstRun == 0.0)
+         et->firstRun = now;
+      et->runStart = now;
    }
 }
 
-
-
-/*-------------------------------------------------------------------*
- * GOMP_single_start                                                 *
- *-------------------------------------------------------------------*/
-
 /**
-   @brief gets the time related to single section for each thread.
+   @brief Registers the callbacks (OMPT initializer).
+   @return 1 to stay active, 0 if the runtime can not set callbacks.
 **/
+static int omptInitialize(ompt_function_lookup_t lookup, int initialDevice,
+                          ompt_data_t *toolData)
+{
+   ompt_set_callback_t setCallback;
+   setCallback = (ompt_set_callback_t) lookup("ompt_set_callback");
+   if (setCallback == NULL)
+      return 0;
+#define OMPT_CALLBACK(event, function) setCallback(event, (ompt_callback_t) function)
+   OMPT_CALLBACK(ompt_callback_parallel_begin, omptParallelBegin);
+   OMPT_CALLBACK(ompt_callback_parallel_end, omptParallelEnd);
+   OMPT_CALLBACK(ompt_callback_implicit_task, omptImplicitTask);
+   OMPT_CALLBACK(ompt_callback_sync_region, omptSyncRegion);
+   OMPT_CALLBACK(ompt_callback_work, omptWork);
+   OMPT_CALLBACK(ompt_callback_mutex_acquire, omptMutexAcquire);
+   OMPT_CALLBACK(ompt_callback_mutex_acquired, omptMutexAcquired);
+   OMPT_CALLBACK(ompt_callback_mutex_released, omptMutexReleased);
+   OMPT_CALLBACK(ompt_callback_nest_lock, omptNestLock);
+   OMPT_CALLBACK(ompt_callback_task_create, omptTaskCreate);
+   OMPT_CALLBACK(ompt_callback_task_schedule, omptTaskSchedule);
+   return 1;
+}
 
-bool GOMP_single_start(void)
+static void omptFinalize(ompt_data_t *toolData)
 {
-   int thId; //,index;
-   bool result;
-   thId = omp_get_thread_num();
-   single[thId].startTime_1 = getTime();
-#ifdef BUILD_PAPI
-   int retval;
-   long long values[NUM_EVENTS];
-   if(papiFlag)
-   {
-      STOP_COUNTER
-      instCount[thId]+=values[0]-ioverhead;;
-      noCycle[thId]+=values[1];
-   }
-#endif
-   result = real_GOMP_single_start();
-   if(papiFlag)
-   {
-      STOP_COUNTER
-      instCount[thId]=values[0]-ioverhead;;
-     // noCycle[thId]+=values[1];
-   }
-   single[thId].endTime = getTime();
-   single[thId].beginAddr = single[thId].endAddr = getReturnAddress(0);
-   single[thId].startName = __func__;
-   if (modeFlag == 1)
-   {
-      if(papiFlag)
-         fprintf(outFile,"  %s %p %d %lf %lf %lld  \n", single[thId].startName,
-                  single[thId].beginAddr, thId, single[thId].startTime_1,
-                  single[thId].endTime, instCount[thId]);
-      else
-         fprintf(outFile,"  %s %p %d %lf %lf  \n", single[thId].startName,
-                  single[thId].beginAddr, thId, single[thId].startTime_1,
-                  single[thId].endTime);
-   }
-   return result;
 }
 
+/**
+   @brief Called by an OMPT runtime (LLVM's libomp) when it starts.
+   @return The OMPT backend.
+**/
+ompt_start_tool_result_t* ompt_start_tool(unsigned int ompVersion,
+                                          const char *runtimeVersion)
+{
+   static ompt_start_tool_result_t result = { omptInitialize, omptFinalize, { 0 } };
+   return &result;
+}
+#endif
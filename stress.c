@@ -0,0 +1,194 @@
+/**
+   @file stress.c
+   @brief Concurrency stress program for PGOMP (make check).
+
+    Executes known numbers of barriers, critical sections, named critical
+    sections, lock and nest lock operations from many threads:
+
+    - a flat team of THREADS threads, ITERS times each
+    - a team of BIG_TEAM threads (more than PGOMP used to support)
+    - nested teams, OUTER x INNER threads
+    - SITES distinct critical call sites, once per thread each
+
+    and prints how many of each PGOMP should have recorded, as lines of
+    "expect <function> <count>" and "sites <function> <count>" on stdout.
+    check.sh compares them with the PGOMP output.
+
+       pgomp-stress [threads] [iterations]
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+#define BIG_TEAM 150
+#define BIG_ITERS 50
+#define OUTER 4
+#define INNER 4
+
+// SITES distinct critical sections, each its own call site
+#define SITE { _Pragma("omp critical") criticalCount++; }
+#define SITES4 SITE SITE SITE SITE
+#define SITES16 SITES4 SITES4 SITES4 SITES4
+#define SITES64 SITES16 SITES16 SITES16 SITES16
+#define SITES256 SITES64 SITES64 SITES64 SITES64
+#define SITES1024 SITES256 SITES256 SITES256 SITES256
+#define SITES2048 SITES1024 SITES1024
+#define SITES 2048
+
+static omp_lock_t lock;
+static omp_nest_lock_t nestLock;
+static long criticalCount = 0, namedCount = 0, lockCount = 0, nestCount = 0;
+
+/** Expected number of each construct, and of critical call sites */
+static long barriers = 0, criticals = 0, namedCriticals = 0, setLocks = 0,
+            testLocks = 0, nestLocks = 0, criticalSites = 0, namedSites = 0;
+
+static void flatTeam(int threads, long iters)
+{
+   int team = 0;
+   #pragma omp parallel num_threads(threads)
+   {
+      long i;
+      #pragma omp atomic
+      team++;
+      for (i = 0; i < iters; i++)
+      {
+         #pragma omp barrier
+         #pragma omp critical
+         criticalCount++;
+         #pragma omp critical(stressName)
+         namedCount++;
+         omp_set_lock(&lock);
+         lockCount++;
+         omp_unset_lock(&lock);
+         omp_set_nest_lock(&nestLock);
+         omp_set_nest_lock(&nestLock);
+         nestCount++;
+         omp_unset_nest_lock(&nestLock);
+         omp_unset_nest_lock(&nestLock);
+      }
+      // only one thread once the others are past the loop, so
+      // omp_test_lock() always succeeds
+      #pragma omp barrier
+      #pragma omp master
+      for (i = 0; i < iters; i++)
+      {
+         if (omp_test_lock(&lock))
+         {
+            lockCount++;
+            omp_unset_lock(&lock);
+         }
+      }
+   }
+   barriers += team * (iters + 1);
+   criticals += team * iters;
+   namedCriticals += team * iters;
+   setLocks += team * iters;
+   nestLocks += 2 * team * iters;
+   testLocks += iters;
+   criticalSites += 1;
+   namedSites += 1;
+}
+
+static void bigTeam()
+{
+   int team = 0;
+   #pragma omp parallel num_threads(BIG_TEAM)
+   {
+      long i;
+      #pragma omp atomic
+      team++;
+      for (i = 0; i < BIG_ITERS; i++)
+      {
+         #pragma omp critical
+         criticalCount++;
+         omp_set_lock(&lock);
+         lockCount++;
+         omp_unset_lock(&lock);
+         #pragma omp barrier
+      }
+   }
+   barriers += team * BIG_ITERS;
+   criticals += team * BIG_ITERS;
+   setLocks += team * BIG_ITERS;
+   criticalSites += 1;
+}
+
+static void nestedTeams(long iters)
+{
+   int team = 0;
+   omp_set_max_active_levels(2);
+   #pragma omp parallel num_threads(OUTER)
+   {
+      #pragma omp parallel num_threads(INNER)
+      {
+         long i;
+         #pragma omp atomic
+         team++;
+         for (i = 0; i < iters; i++)
+         {
+            #pragma omp critical
+            criticalCount++;
+            #pragma omp critical(stressName)
+            namedCount++;
+            omp_set_lock(&lock);
+            lockCount++;
+            omp_unset_lock(&lock);
+            #pragma omp barrier
+         }
+      }
+   }
+   omp_set_max_active_levels(1);
+   barriers += team * iters;
+   criticals += team * iters;
+   namedCriticals += team * iters;
+   setLocks += team * iters;
+   criticalSites += 1;
+   namedSites += 1;
+}
+
+static void manySites(int threads)
+{
+   int team = 0;
+   #pragma omp parallel num_threads(threads)
+   {
+      #pragma omp atomic
+      team++;
+      SITES2048
+   }
+   criticals += team * SITES;
+   criticalSites += SITES;
+}
+
+int main(int argc, char **argv)
+{
+   int threads = argc > 1 ? atoi(argv[1]) : 8;
+   long iters = argc > 2 ? atol(argv[2]) : 1000;
+   int status = 0;
+   omp_init_lock(&lock);
+   omp_init_nest_lock(&nestLock);
+   flatTeam(threads, iters);
+   bigTeam();
+   nestedTeams(iters / 10);
+   manySites(threads);
+   omp_destroy_lock(&lock);
+   omp_destroy_nest_lock(&nestLock);
+   // PGOMP must not have broken mutual exclusion either
+   if (criticalCount != criticals || namedCount != namedCriticals
+       || lockCount != setLocks + testLocks || nestCount != nestLocks / 2)
+   {
+      fprintf(stderr, "pgomp-stress: lost updates in critical sections or "
+                      "locks\n");
+      status = 1;
+   }
+   printf("expect GOMP_barrier %ld\n", barriers);
+   printf("expect GOMP_critical_start %ld\n", criticals);
+   printf("expect GOMP_critical_name_start %ld\n", namedCriticals);
+   printf("expect omp_set_lock %ld\n", setLocks);
+   printf("expect omp_test_lock %ld\n", testLocks);
+   printf("expect omp_set_nest_lock %ld\n", nestLocks);
+   printf("sites GOMP_critical_start %ld\n", criticalSites);
+   printf("sites GOMP_critical_name_start %ld\n", namedSites);
+   return status;
+}